@@ -8,9 +8,12 @@ set(SOURCE_FILES
         src/arcadia.cpp
         src/audio.cpp
         src/autoconf.cpp
+        src/benchmark.cpp
+        src/bitplane.cpp
         src/blitfunc.cpp
         src/blittable.cpp
         src/blitter.cpp
+        src/blitter_simd.cpp
         src/blkdev.cpp
         src/blkdev_cdimage.cpp
         src/bsdsocket.cpp
@@ -22,6 +25,7 @@ set(SOURCE_FILES
         src/cdtv.cpp
         src/cdtvcr.cpp
         src/cfgfile.cpp
+        src/chunkcompress.cpp
         src/cia.cpp
         src/consolehook.cpp
         src/cpuboard.cpp
@@ -68,6 +72,7 @@ set(SOURCE_FILES
         src/luascript.cpp
         src/main.cpp
         src/memory.cpp
+        src/mfmcache.cpp
         src/mos6502.cpp
         src/midiemu.cpp
         src/native2amiga.cpp
@@ -101,6 +106,7 @@ set(SOURCE_FILES
         src/x86.cpp
         src/zfile.cpp
         src/zfile_archive.cpp
+        src/zinflate.cpp
         src/archivers/7z/7zAlloc.c
         src/archivers/7z/7zArcIn.c
         src/archivers/7z/7zBuf.c
@@ -211,6 +217,7 @@ set(SOURCE_FILES
         src/osdep/charset.cpp
         src/osdep/dpi_handler.cpp
         src/osdep/fsdb_host.cpp
+        src/osdep/fsdb_dircache.cpp
         src/osdep/clipboard.cpp
         src/osdep/amiberry_hardfile.cpp
         src/osdep/keyboard.cpp
@@ -266,6 +273,7 @@ set(SOURCE_FILES
         src/slirp/tftp.cpp
         src/slirp/udp.cpp
         src/sounddep/sound.cpp
+        src/sounddep/sound_ring.cpp
         src/threaddep/threading.cpp
         src/osdep/gui/ControllerMap.cpp
         src/osdep/gui/CreateFolder.cpp
@@ -336,6 +344,7 @@ set(SOURCE_FILES
         src/jit/compstbl.cpp
         src/jit/compemu_fpp.cpp
         src/jit/compemu_support.cpp
+        src/jit/compemu_persist.cpp
 )
 
 set(PCEM_SOURCE_FILES
@@ -165,6 +165,7 @@
 #include "debug.h"
 #include "rommgr.h"
 #include "devices.h"
+#include "bitplane.h"
 
 #define AKIKO_DEBUG_IO 1
 #define AKIKO_DEBUG_IO_CMD 1
@@ -313,74 +314,20 @@ static uae_u32 akiko_buffer[8];
 static int akiko_read_offset, akiko_write_offset;
 static uae_u32 akiko_result[8];
 
-#if 0
-static void akiko_c2p_do (void)
-{
-	int i;
-
-	for (i = 0; i < 8; i++)
-		akiko_result[i] = 0;
-	/* FIXME: better c2p algoritm than this piece of crap.... */
-	for (i = 0; i < 8 * 32; i++) {
-		if (akiko_buffer[7 - (i >> 5)] & (1 << (i & 31)))
-			akiko_result[i & 7] |= 1 << (i >> 3);
-	}
-}
-#else
-/* Optimised Chunky-to-Planar algorithm by Mequa */
-static uae_u32 akiko_precalc_shift[32];
-static uae_u32 akiko_precalc_bytenum[32][8];
-static void akiko_c2p_precalculate(void)
-{
-	uae_u32 i, j;
-	for (i = 0; i < 32; i++) {
-		akiko_precalc_shift[i] = 1 << i;
-		for (j = 0; j < 8; j++) {
-			akiko_precalc_bytenum[i][j] = (i >> 3) + ((7 - j) << 2);
-		}
-	}
-}
-
 static void akiko_c2p_do(void)
 {
-	int i;
+	uae_u8 chunky[32], planes[8][4];
+	uae_u8 *pp[8];
 
-	for (i = 0; i < 8; i++) {
-		akiko_result[i]    =  (((akiko_buffer[0] & akiko_precalc_shift[i])    != 0) << (akiko_precalc_bytenum[i][0])   )
-						   |  (((akiko_buffer[1] & akiko_precalc_shift[i])    != 0) << (akiko_precalc_bytenum[i][1])   )
-						   |  (((akiko_buffer[2] & akiko_precalc_shift[i])    != 0) << (akiko_precalc_bytenum[i][2])   )
-						   |  (((akiko_buffer[3] & akiko_precalc_shift[i])    != 0) << (akiko_precalc_bytenum[i][3])   )
-						   |  (((akiko_buffer[4] & akiko_precalc_shift[i])    != 0) << (akiko_precalc_bytenum[i][4])   )
-						   |  (((akiko_buffer[5] & akiko_precalc_shift[i])    != 0) << (akiko_precalc_bytenum[i][5])   )
-						   |  (((akiko_buffer[6] & akiko_precalc_shift[i])    != 0) << (akiko_precalc_bytenum[i][6])   )
-						   |  (((akiko_buffer[7] & akiko_precalc_shift[i])    != 0) << (akiko_precalc_bytenum[i][7])   )
-						   |  (((akiko_buffer[0] & akiko_precalc_shift[i+8])  != 0) << (akiko_precalc_bytenum[i+8][0]) )
-						   |  (((akiko_buffer[1] & akiko_precalc_shift[i+8])  != 0) << (akiko_precalc_bytenum[i+8][1]) )
-						   |  (((akiko_buffer[2] & akiko_precalc_shift[i+8])  != 0) << (akiko_precalc_bytenum[i+8][2]) )
-						   |  (((akiko_buffer[3] & akiko_precalc_shift[i+8])  != 0) << (akiko_precalc_bytenum[i+8][3]) )
-						   |  (((akiko_buffer[4] & akiko_precalc_shift[i+8])  != 0) << (akiko_precalc_bytenum[i+8][4]) )
-						   |  (((akiko_buffer[5] & akiko_precalc_shift[i+8])  != 0) << (akiko_precalc_bytenum[i+8][5]) )
-						   |  (((akiko_buffer[6] & akiko_precalc_shift[i+8])  != 0) << (akiko_precalc_bytenum[i+8][6]) )
-						   |  (((akiko_buffer[7] & akiko_precalc_shift[i+8])  != 0) << (akiko_precalc_bytenum[i+8][7]) )
-						   |  (((akiko_buffer[0] & akiko_precalc_shift[i+16]) != 0) << (akiko_precalc_bytenum[i+16][0]))
-						   |  (((akiko_buffer[1] & akiko_precalc_shift[i+16]) != 0) << (akiko_precalc_bytenum[i+16][1]))
-						   |  (((akiko_buffer[2] & akiko_precalc_shift[i+16]) != 0) << (akiko_precalc_bytenum[i+16][2]))
-						   |  (((akiko_buffer[3] & akiko_precalc_shift[i+16]) != 0) << (akiko_precalc_bytenum[i+16][3]))
-						   |  (((akiko_buffer[4] & akiko_precalc_shift[i+16]) != 0) << (akiko_precalc_bytenum[i+16][4]))
-						   |  (((akiko_buffer[5] & akiko_precalc_shift[i+16]) != 0) << (akiko_precalc_bytenum[i+16][5]))
-						   |  (((akiko_buffer[6] & akiko_precalc_shift[i+16]) != 0) << (akiko_precalc_bytenum[i+16][6]))
-						   |  (((akiko_buffer[7] & akiko_precalc_shift[i+16]) != 0) << (akiko_precalc_bytenum[i+16][7]))
-						   |  (((akiko_buffer[0] & akiko_precalc_shift[i+24]) != 0) << (akiko_precalc_bytenum[i+24][0]))
-						   |  (((akiko_buffer[1] & akiko_precalc_shift[i+24]) != 0) << (akiko_precalc_bytenum[i+24][1]))
-						   |  (((akiko_buffer[2] & akiko_precalc_shift[i+24]) != 0) << (akiko_precalc_bytenum[i+24][2]))
-						   |  (((akiko_buffer[3] & akiko_precalc_shift[i+24]) != 0) << (akiko_precalc_bytenum[i+24][3]))
-						   |  (((akiko_buffer[4] & akiko_precalc_shift[i+24]) != 0) << (akiko_precalc_bytenum[i+24][4]))
-						   |  (((akiko_buffer[5] & akiko_precalc_shift[i+24]) != 0) << (akiko_precalc_bytenum[i+24][5]))
-						   |  (((akiko_buffer[6] & akiko_precalc_shift[i+24]) != 0) << (akiko_precalc_bytenum[i+24][6]))
-						   |  (((akiko_buffer[7] & akiko_precalc_shift[i+24]) != 0) << (akiko_precalc_bytenum[i+24][7]));
-	}
+	// 32 pixels, leftmost in the high byte of akiko_buffer[0]
+	for (int i = 0; i < 8; i++)
+		do_put_mem_long((uae_u32*)(chunky + i * 4), akiko_buffer[i]);
+	for (int i = 0; i < 8; i++)
+		pp[i] = planes[i];
+	bitplane_c2p(pp, chunky, 4);
+	for (int i = 0; i < 8; i++)
+		akiko_result[i] = do_get_mem_long((uae_u32*)planes[i]);
 }
-#endif
 
 static void akiko_c2p_write(int offset, uae_u32 v)
 {
@@ -2124,7 +2071,6 @@ static void akiko_reset(int hardreset)
 	cdaudiostop_do();
 	nvram_read();
 	eeprom_reset(cd32_eeprom);
-	akiko_c2p_precalculate();
 
 	cdrom_speed = 1;
 	cdrom_current_sector = -1;
@@ -1086,6 +1086,28 @@ extern z_off_t ZEXPORT unztell (unzFile file)
 	return (z_off_t)pfile_in_zip_read_info->stream.total_out;
 }
 
+/*
+  Give the position of the compressed data of the current file in the
+  zipfile, its compression method and compressed size
+*/
+extern int ZEXPORT unzGetCurrentFileDataPos (unzFile file, uLong *pos, uLong *method, uLong *csize)
+{
+	unz_s* s;
+	file_in_zip_read_info_s* pfile_in_zip_read_info;
+	if (file==NULL)
+		return UNZ_PARAMERROR;
+	s=(unz_s*)file;
+	pfile_in_zip_read_info=s->pfile_in_zip_read;
+
+	if (pfile_in_zip_read_info==NULL)
+		return UNZ_PARAMERROR;
+
+	*pos = pfile_in_zip_read_info->pos_in_zipfile + pfile_in_zip_read_info->byte_before_the_zipfile;
+	*method = pfile_in_zip_read_info->compression_method;
+	*csize = s->cur_file_info.compressed_size;
+	return UNZ_OK;
+}
+
 
 /*
   return 1 if the end of file was reached, 0 elsewhere
@@ -262,6 +262,13 @@ extern z_off_t ZEXPORT unztell OF((unzFile file));
   Give the current position in uncompressed data
 */
 
+extern int ZEXPORT unzGetCurrentFileDataPos OF((unzFile file, uLong *pos, uLong *method, uLong *csize));
+/*
+  Give the position of the compressed data of the current file in the
+  zipfile, its compression method and compressed size. The file must be
+  opened and not read yet.
+*/
+
 extern int ZEXPORT unzeof OF((unzFile file));
 /*
   return 1 if the end of file was reached, 0 elsewhere 
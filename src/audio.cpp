@@ -31,6 +31,7 @@
 #include "uae.h"
 #include "gui.h"
 #include "debug.h"
+#include "benchmark.h"
 #ifdef WITH_SNDBOARD
 #include "sndboard.h"
 #endif
@@ -46,6 +47,17 @@
 
 #include <math.h>
 
+#if !defined(WORDS_BIGENDIAN) && defined(__AVX2__)
+#include <immintrin.h>
+#define SINC_SIMD_AVX2
+#elif !defined(WORDS_BIGENDIAN) && defined(__SSE2__)
+#include <emmintrin.h>
+#define SINC_SIMD_SSE2
+#elif !defined(WORDS_BIGENDIAN) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+#include <arm_neon.h>
+#define SINC_SIMD_NEON
+#endif
+
 #define DEBUG_AUDIO 0
 #define DEBUG_AUDIO2 0
 #define DEBUG_AUDIO_HACK 0
@@ -88,17 +100,17 @@ STATIC_INLINE bool usehacks(void)
 
 #include "sinctable.cpp.in"
 
-typedef struct {
-	int time, output;
-} sinc_queue_t;
-
 struct audio_channel_data2
 {
 	int current_sample, last_sample;
 	uae_u8 new_sample;
 	int sample_accum, sample_accum_time;
 	int sinc_output_state;
-	sinc_queue_t sinc_queue[SINC_QUEUE_LENGTH];
+	/* BLEP queue as structure of arrays. Every entry is stored twice, at
+	 * head and head + SINC_QUEUE_LENGTH, so the newest to oldest walk
+	 * starting at the head never wraps and can be loaded as vectors. */
+	int sinc_queue_times[SINC_QUEUE_LENGTH * 2];
+	int sinc_queue_outputs[SINC_QUEUE_LENGTH * 2];
 	int sinc_queue_time;
 	int sinc_queue_head;
 	int audvol;
@@ -620,9 +632,10 @@ static void sinc_prehandler_paula (unsigned long best_evtime)
 		/* if output state changes, record the state change and also
 		 * write data into sinc queue for mixing in the BLEP */
 		if (acd->sinc_output_state != output) {
-			acd->sinc_queue_head = (acd->sinc_queue_head - 1) & (SINC_QUEUE_LENGTH - 1);
-			acd->sinc_queue[acd->sinc_queue_head].time = acd->sinc_queue_time;
-			acd->sinc_queue[acd->sinc_queue_head].output = output - acd->sinc_output_state;
+			int head = (acd->sinc_queue_head - 1) & (SINC_QUEUE_LENGTH - 1);
+			acd->sinc_queue_head = head;
+			acd->sinc_queue_times[head] = acd->sinc_queue_times[head + SINC_QUEUE_LENGTH] = acd->sinc_queue_time;
+			acd->sinc_queue_outputs[head] = acd->sinc_queue_outputs[head + SINC_QUEUE_LENGTH] = output - acd->sinc_output_state;
 			acd->sinc_output_state = output;
 		}
 
@@ -630,6 +643,112 @@ static void sinc_prehandler_paula (unsigned long best_evtime)
 	}
 }
 
+/* Sum of winsinc[age] * output over the queue entries from the head up to
+ * (not including) the first one that is too old. Integer products and sums
+ * wrap exactly like the plain scalar loop, summation order does not matter. */
+static uae_u32 sinc_blep_sum_scalar(const int *winsinc, const int *times, const int *outputs, int now, int j)
+{
+	uae_u32 sum = 0;
+	for (; j < SINC_QUEUE_LENGTH; j++) {
+		int age = now - times[j];
+		if (age >= SINC_QUEUE_MAX_AGE || age < 0)
+			break;
+		sum += (uae_u32)winsinc[age] * (uae_u32)outputs[j];
+	}
+	return sum;
+}
+
+#if defined(SINC_SIMD_AVX2)
+
+static uae_u32 sinc_blep_sum(const int *winsinc, const int *times, const int *outputs, int now)
+{
+	const __m256i vnow = _mm256_set1_epi32(now);
+	const __m256i agemask = _mm256_set1_epi32(~(SINC_QUEUE_MAX_AGE - 1));
+	const __m256i agelimit = _mm256_set1_epi32(SINC_QUEUE_MAX_AGE - 1);
+	__m256i acc = _mm256_setzero_si256();
+	int j;
+	for (j = 0; j < SINC_QUEUE_LENGTH; j += 8) {
+		__m256i age = _mm256_sub_epi32(vnow, _mm256_loadu_si256((const __m256i*)(times + j)));
+		__m256i ok = _mm256_cmpeq_epi32(_mm256_and_si256(age, agemask), _mm256_setzero_si256());
+		if (_mm256_movemask_ps(_mm256_castsi256_ps(ok)) != 0xff)
+			break;
+		__m256i w = _mm256_i32gather_epi32(winsinc, _mm256_and_si256(age, agelimit), 4);
+		acc = _mm256_add_epi32(acc, _mm256_mullo_epi32(w, _mm256_loadu_si256((const __m256i*)(outputs + j))));
+	}
+	uae_u32 lanes[8];
+	_mm256_storeu_si256((__m256i*)lanes, acc);
+	uae_u32 sum = 0;
+	for (int i = 0; i < 8; i++)
+		sum += lanes[i];
+	return sum + sinc_blep_sum_scalar(winsinc, times, outputs, now, j);
+}
+
+#elif defined(SINC_SIMD_SSE2)
+
+static inline __m128i sinc_mullo_epi32(__m128i a, __m128i b)
+{
+	// SSE2 has no 32-bit mullo, low halves of the two 32x32->64 products
+	__m128i even = _mm_mul_epu32(a, b);
+	__m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+	return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, 0x08), _mm_shuffle_epi32(odd, 0x08));
+}
+
+static uae_u32 sinc_blep_sum(const int *winsinc, const int *times, const int *outputs, int now)
+{
+	const __m128i vnow = _mm_set1_epi32(now);
+	const __m128i agemask = _mm_set1_epi32(~(SINC_QUEUE_MAX_AGE - 1));
+	__m128i acc = _mm_setzero_si128();
+	int j;
+	for (j = 0; j < SINC_QUEUE_LENGTH; j += 4) {
+		__m128i age = _mm_sub_epi32(vnow, _mm_loadu_si128((const __m128i*)(times + j)));
+		__m128i ok = _mm_cmpeq_epi32(_mm_and_si128(age, agemask), _mm_setzero_si128());
+		if (_mm_movemask_ps(_mm_castsi128_ps(ok)) != 0x0f)
+			break;
+		int ages[4];
+		_mm_storeu_si128((__m128i*)ages, age);
+		__m128i w = _mm_setr_epi32(winsinc[ages[0]], winsinc[ages[1]], winsinc[ages[2]], winsinc[ages[3]]);
+		acc = _mm_add_epi32(acc, sinc_mullo_epi32(w, _mm_loadu_si128((const __m128i*)(outputs + j))));
+	}
+	uae_u32 lanes[4];
+	_mm_storeu_si128((__m128i*)lanes, acc);
+	uae_u32 sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+	return sum + sinc_blep_sum_scalar(winsinc, times, outputs, now, j);
+}
+
+#elif defined(SINC_SIMD_NEON)
+
+static uae_u32 sinc_blep_sum(const int *winsinc, const int *times, const int *outputs, int now)
+{
+	const int32x4_t vnow = vdupq_n_s32(now);
+	const uint32x4_t agemask = vdupq_n_u32(~(uae_u32)(SINC_QUEUE_MAX_AGE - 1));
+	int32x4_t acc = vdupq_n_s32(0);
+	int j;
+	for (j = 0; j < SINC_QUEUE_LENGTH; j += 4) {
+		int32x4_t age = vsubq_s32(vnow, vld1q_s32(times + j));
+		uint32x4_t bad = vandq_u32(vreinterpretq_u32_s32(age), agemask);
+		uint64x2_t bad64 = vreinterpretq_u64_u32(bad);
+		if (vgetq_lane_u64(bad64, 0) | vgetq_lane_u64(bad64, 1))
+			break;
+		int32x4_t w = vdupq_n_s32(winsinc[vgetq_lane_s32(age, 0)]);
+		w = vsetq_lane_s32(winsinc[vgetq_lane_s32(age, 1)], w, 1);
+		w = vsetq_lane_s32(winsinc[vgetq_lane_s32(age, 2)], w, 2);
+		w = vsetq_lane_s32(winsinc[vgetq_lane_s32(age, 3)], w, 3);
+		acc = vmlaq_s32(acc, w, vld1q_s32(outputs + j));
+	}
+	uint32x4_t uacc = vreinterpretq_u32_s32(acc);
+	uae_u32 sum = vgetq_lane_u32(uacc, 0) + vgetq_lane_u32(uacc, 1) + vgetq_lane_u32(uacc, 2) + vgetq_lane_u32(uacc, 3);
+	return sum + sinc_blep_sum_scalar(winsinc, times, outputs, now, j);
+}
+
+#else
+
+static uae_u32 sinc_blep_sum(const int *winsinc, const int *times, const int *outputs, int now)
+{
+	return sinc_blep_sum_scalar(winsinc, times, outputs, now, 0);
+}
+
+#endif
+
 /* this interpolator performs BLEP mixing (bleps are shaped like integrated sinc
 * functions) with a type of BLEP that matches the filtering configuration. */
 static void samplexx_sinc_handler (int *datasp, int ch_start, int ch_num)
@@ -648,20 +767,14 @@ static void samplexx_sinc_handler (int *datasp, int ch_start, int ch_num)
 
 
 	for (i = ch_start, k = 0; k < ch_num; i++, k++) {
-		int j, v;
+		int v;
 		struct audio_channel_data2 *acd = audio_data[i];
 		/* The sum rings with harmonic components up to infinity... */
-		int sum = acd->sinc_output_state << 17;
+		uae_u32 sum = (uae_u32)acd->sinc_output_state << 17;
 		/* ...but we cancel them through mixing in BLEPs instead */
 		int offsetpos = acd->sinc_queue_head & (SINC_QUEUE_LENGTH - 1);
-		for (j = 0; j < SINC_QUEUE_LENGTH; j += 1) {
-			int age = acd->sinc_queue_time - acd->sinc_queue[offsetpos].time;
-			if (age >= SINC_QUEUE_MAX_AGE || age < 0)
-				break;
-			sum -= winsinc[age] * acd->sinc_queue[offsetpos].output;
-			offsetpos = (offsetpos + 1) & (SINC_QUEUE_LENGTH - 1);
-		}
-		v = sum >> 15;
+		sum -= sinc_blep_sum(winsinc, acd->sinc_queue_times + offsetpos, acd->sinc_queue_outputs + offsetpos, acd->sinc_queue_time);
+		v = (int)sum >> 15;
 		if (v > 32767)
 			v = 32767;
 		else if (v < -32768)
@@ -2388,6 +2501,7 @@ static void update_audio_volcnt(int cycles, float evtime, bool nextsmp)
 
 void update_audio (void)
 {
+	benchmark_scope bench(BENCH_AUDIO);
 	int n_cycles = 0;
 #if SOUNDSTUFF > 1
 	static int samplecounter;
@@ -0,0 +1,143 @@
+/*
+* UAE - The Un*x Amiga Emulator
+*
+* Headless benchmark runner
+*
+* Started with --benchmark <frames>. The run begins at the first vsync so
+* that setup and the initial reset are not part of the measurement, and
+* ends when the frame count is reached, the CPU halts or the emulation is
+* quit some other way. Display output is skipped and sound goes to a
+* null sink, the remaining work is the emulation itself.
+*/
+
+#include "sysconfig.h"
+#include "sysdeps.h"
+
+#include <atomic>
+
+#include "options.h"
+#include "custom.h"
+#include "uae.h"
+#include "benchmark.h"
+
+int benchmark_frames;
+bool benchmark_running;
+int benchmark_section_cur;
+uae_s64 benchmark_section_start;
+uae_s64 benchmark_time[BENCH_MAX];
+
+static std::atomic<uae_s64> benchmark_denise_time;
+static uae_s64 benchmark_start_time, benchmark_end_time;
+static double benchmark_emulated;
+static int benchmark_framecnt;
+static bool benchmark_done;
+static int benchmark_halted;
+
+static const TCHAR *benchmark_names[BENCH_MAX] = {
+	_T("CPU emulation"),
+	_T("hsync handler"),
+	_T("vsync handler"),
+	_T("Denise drawing"),
+	_T("Blitter"),
+	_T("Audio"),
+	_T("JIT compiler")
+};
+
+void benchmark_prefs(struct uae_prefs *p)
+{
+	p->headless = true;
+	p->start_gui = false;
+	p->turbo_emulation = 1;
+	p->turbo_emulation_limit = 0;
+}
+
+static void benchmark_stop(void)
+{
+	if (!benchmark_running)
+		return;
+	uae_s64 t = benchmark_clock();
+	benchmark_time[benchmark_section_cur] += t - benchmark_section_start;
+	benchmark_end_time = t;
+	benchmark_running = false;
+	benchmark_done = true;
+}
+
+void benchmark_vsync(void)
+{
+	if (!benchmark_active() || benchmark_done)
+		return;
+	if (!benchmark_running) {
+		memset(benchmark_time, 0, sizeof benchmark_time);
+		benchmark_denise_time = 0;
+		benchmark_framecnt = 0;
+		benchmark_emulated = 0;
+		benchmark_section_cur = BENCH_CPU;
+		benchmark_start_time = benchmark_section_start = benchmark_clock();
+		benchmark_running = true;
+		write_log(_T("Benchmark: started, %d frames\n"), benchmark_frames);
+		return;
+	}
+	benchmark_framecnt++;
+	benchmark_emulated += 1.0 / (vblank_hz > 0 ? vblank_hz : 50.0);
+	if (benchmark_framecnt >= benchmark_frames) {
+		benchmark_stop();
+		uae_quit();
+	}
+}
+
+void benchmark_trap(int id)
+{
+	if (!benchmark_running)
+		return;
+	benchmark_halted = id;
+	benchmark_stop();
+	uae_quit();
+}
+
+void benchmark_denise_add(uae_s64 ns)
+{
+	benchmark_denise_time += ns;
+}
+
+static void benchmark_out(const TCHAR *format, ...)
+{
+	TCHAR buffer[256];
+	va_list parms;
+
+	va_start(parms, format);
+	_vsntprintf(buffer, sizeof buffer / sizeof(TCHAR), format, parms);
+	va_end(parms);
+	write_log(_T("%s"), buffer);
+	fputs(buffer, stdout);
+}
+
+void benchmark_report(void)
+{
+	if (!benchmark_active())
+		return;
+	benchmark_stop();
+	if (!benchmark_done) {
+		benchmark_out(_T("Benchmark: emulation ended before the first frame\n"));
+		return;
+	}
+
+	double host = (benchmark_end_time - benchmark_start_time) / 1e9;
+	if (host <= 0)
+		host = 1e-9;
+	benchmark_out(_T("Benchmark: %d frames, %.2fs emulated in %.2fs host, %.2fx realtime (%.1f fps)\n"),
+		benchmark_framecnt, benchmark_emulated, host, benchmark_emulated / host, benchmark_framecnt / host);
+	if (benchmark_halted)
+		benchmark_out(_T("Benchmark: stopped early, CPU halted (reason %d)\n"), benchmark_halted);
+	else if (benchmark_framecnt < benchmark_frames)
+		benchmark_out(_T("Benchmark: stopped early by quit request\n"));
+	for (int i = 0; i < BENCH_MAX; i++) {
+		double t = benchmark_time[i] / 1e9;
+		benchmark_out(_T("  %-16s %8.3fs %5.1f%%\n"), benchmark_names[i], t, t * 100.0 / host);
+	}
+	double dt = benchmark_denise_time / 1e9;
+	if (dt > 0)
+		benchmark_out(_T("  %-16s %8.3fs %5.1f%% (Denise thread, runs in parallel)\n"), _T("Denise drawing"), dt, dt * 100.0 / host);
+	fflush(stdout);
+	benchmark_done = false;
+	benchmark_halted = 0;
+}
@@ -0,0 +1,207 @@
+/*
+* UAE - The Un*x Amiga Emulator
+*
+* Planar <-> chunky conversion
+*
+* Both directions are 8x8 bit matrix transposes. Eight plane bytes (or
+* eight chunky pixels) are packed into a 64-bit word, one byte per row,
+* and flipped with three delta swaps. The vector versions interleave the
+* plane bytes of 16 pixel groups with byte unpacks and run the same swaps
+* on 64-bit lanes.
+*/
+
+#include "sysconfig.h"
+#include "sysdeps.h"
+
+#include "bitplane.h"
+
+#if !defined(WORDS_BIGENDIAN) && defined(__SSE2__)
+#include <emmintrin.h>
+#define BITPLANE_SSE2
+#elif !defined(WORDS_BIGENDIAN) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+#include <arm_neon.h>
+#define BITPLANE_NEON
+#endif
+
+#define BP_K1 0xaa00aa00aa00aa00ULL
+#define BP_K2 0xcccc0000cccc0000ULL
+#define BP_K4 0xf0f0f0f00f0f0f0fULL
+
+/* flip about the anti-diagonal: bit c of row r moves to bit 7 - r of row 7 - c */
+static inline uae_u64 bp_flip_antidiag(uae_u64 x)
+{
+	uae_u64 t;
+	t = x ^ (x << 36);
+	x ^= BP_K4 & (t ^ (x >> 36));
+	t = BP_K2 & (x ^ (x << 18));
+	x ^= t ^ (t >> 18);
+	t = BP_K1 & (x ^ (x << 9));
+	x ^= t ^ (t >> 9);
+	return x;
+}
+
+/* transpose: bit c of row r moves to bit r of row c */
+static inline uae_u64 bp_transpose(uae_u64 x)
+{
+	uae_u64 t;
+	t = (x ^ (x >> 7)) & 0x00aa00aa00aa00aaULL;
+	x ^= t ^ (t << 7);
+	t = (x ^ (x >> 14)) & 0x0000cccc0000ccccULL;
+	x ^= t ^ (t << 14);
+	t = (x ^ (x >> 28)) & 0x00000000f0f0f0f0ULL;
+	x ^= t ^ (t << 28);
+	return x;
+}
+
+static inline void bp_store_le64(uae_u8 *p, uae_u64 v)
+{
+#ifdef WORDS_BIGENDIAN
+	for (int i = 0; i < 8; i++)
+		p[i] = (uae_u8)(v >> (i * 8));
+#else
+	memcpy(p, &v, 8);
+#endif
+}
+
+#if defined(BITPLANE_SSE2)
+
+static inline __m128i bp_flip_antidiag_v(__m128i x)
+{
+	const __m128i k1 = _mm_set1_epi64x((long long)BP_K1);
+	const __m128i k2 = _mm_set1_epi64x((long long)BP_K2);
+	const __m128i k4 = _mm_set1_epi64x((long long)BP_K4);
+	__m128i t;
+	t = _mm_xor_si128(x, _mm_slli_epi64(x, 36));
+	x = _mm_xor_si128(x, _mm_and_si128(k4, _mm_xor_si128(t, _mm_srli_epi64(x, 36))));
+	t = _mm_and_si128(k2, _mm_xor_si128(x, _mm_slli_epi64(x, 18)));
+	x = _mm_xor_si128(x, _mm_xor_si128(t, _mm_srli_epi64(t, 18)));
+	t = _mm_and_si128(k1, _mm_xor_si128(x, _mm_slli_epi64(x, 9)));
+	x = _mm_xor_si128(x, _mm_xor_si128(t, _mm_srli_epi64(t, 9)));
+	return x;
+}
+
+/* 16 plane bytes from each plane, 128 chunky pixels out */
+static void bp_p2c_16(uae_u8 *dst, const uae_u8 *const *p, int off)
+{
+	__m128i v[8];
+	for (int k = 0; k < 8; k++)
+		v[k] = p[k] ? _mm_loadu_si128((const __m128i*)(p[k] + off)) : _mm_setzero_si128();
+	// plane 7 ends up in the lowest byte of each group
+	__m128i a0 = _mm_unpacklo_epi8(v[7], v[6]), a1 = _mm_unpackhi_epi8(v[7], v[6]);
+	__m128i b0 = _mm_unpacklo_epi8(v[5], v[4]), b1 = _mm_unpackhi_epi8(v[5], v[4]);
+	__m128i c0 = _mm_unpacklo_epi8(v[3], v[2]), c1 = _mm_unpackhi_epi8(v[3], v[2]);
+	__m128i d0 = _mm_unpacklo_epi8(v[1], v[0]), d1 = _mm_unpackhi_epi8(v[1], v[0]);
+	__m128i e[4], f[4];
+	e[0] = _mm_unpacklo_epi16(a0, b0);
+	e[1] = _mm_unpackhi_epi16(a0, b0);
+	e[2] = _mm_unpacklo_epi16(a1, b1);
+	e[3] = _mm_unpackhi_epi16(a1, b1);
+	f[0] = _mm_unpacklo_epi16(c0, d0);
+	f[1] = _mm_unpackhi_epi16(c0, d0);
+	f[2] = _mm_unpacklo_epi16(c1, d1);
+	f[3] = _mm_unpackhi_epi16(c1, d1);
+	for (int i = 0; i < 4; i++) {
+		__m128i lo = _mm_unpacklo_epi32(e[i], f[i]);
+		__m128i hi = _mm_unpackhi_epi32(e[i], f[i]);
+		_mm_storeu_si128((__m128i*)(dst + i * 32), bp_flip_antidiag_v(lo));
+		_mm_storeu_si128((__m128i*)(dst + i * 32 + 16), bp_flip_antidiag_v(hi));
+	}
+}
+
+/* 16 chunky pixels to 2 bytes in each plane */
+static void bp_c2p_16(uae_u8 *const *planes, const uae_u8 *src, int off)
+{
+	__m128i x = _mm_loadu_si128((const __m128i*)src);
+	// reverse the bytes so that movemask returns the leftmost pixel in bit 15
+	x = _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+	x = _mm_shufflelo_epi16(x, 0x1b);
+	x = _mm_shufflehi_epi16(x, 0x1b);
+	x = _mm_shuffle_epi32(x, 0x4e);
+	for (int k = 7; k >= 0; k--) {
+		int m = _mm_movemask_epi8(x);
+		planes[k][off] = (uae_u8)(m >> 8);
+		planes[k][off + 1] = (uae_u8)m;
+		x = _mm_slli_epi16(x, 1);
+	}
+}
+
+#elif defined(BITPLANE_NEON)
+
+static inline uint64x2_t bp_flip_antidiag_v(uint64x2_t x)
+{
+	const uint64x2_t k1 = vdupq_n_u64(BP_K1);
+	const uint64x2_t k2 = vdupq_n_u64(BP_K2);
+	const uint64x2_t k4 = vdupq_n_u64(BP_K4);
+	uint64x2_t t;
+	t = veorq_u64(x, vshlq_n_u64(x, 36));
+	x = veorq_u64(x, vandq_u64(k4, veorq_u64(t, vshrq_n_u64(x, 36))));
+	t = vandq_u64(k2, veorq_u64(x, vshlq_n_u64(x, 18)));
+	x = veorq_u64(x, veorq_u64(t, vshrq_n_u64(t, 18)));
+	t = vandq_u64(k1, veorq_u64(x, vshlq_n_u64(x, 9)));
+	x = veorq_u64(x, veorq_u64(t, vshrq_n_u64(t, 9)));
+	return x;
+}
+
+static void bp_p2c_16(uae_u8 *dst, const uae_u8 *const *p, int off)
+{
+	uint8x16_t v[8];
+	for (int k = 0; k < 8; k++)
+		v[k] = p[k] ? vld1q_u8(p[k] + off) : vdupq_n_u8(0);
+	// plane 7 ends up in the lowest byte of each group
+	uint8x16x2_t a = vzipq_u8(v[7], v[6]);
+	uint8x16x2_t b = vzipq_u8(v[5], v[4]);
+	uint8x16x2_t c = vzipq_u8(v[3], v[2]);
+	uint8x16x2_t d = vzipq_u8(v[1], v[0]);
+	for (int h = 0; h < 2; h++) {
+		uint16x8x2_t e = vzipq_u16(vreinterpretq_u16_u8(a.val[h]), vreinterpretq_u16_u8(b.val[h]));
+		uint16x8x2_t f = vzipq_u16(vreinterpretq_u16_u8(c.val[h]), vreinterpretq_u16_u8(d.val[h]));
+		for (int q = 0; q < 2; q++) {
+			uint32x4x2_t g = vzipq_u32(vreinterpretq_u32_u16(e.val[q]), vreinterpretq_u32_u16(f.val[q]));
+			uae_u8 *o = dst + h * 64 + q * 32;
+			vst1q_u8(o, vreinterpretq_u8_u64(bp_flip_antidiag_v(vreinterpretq_u64_u32(g.val[0]))));
+			vst1q_u8(o + 16, vreinterpretq_u8_u64(bp_flip_antidiag_v(vreinterpretq_u64_u32(g.val[1]))));
+		}
+	}
+}
+
+#endif
+
+void bitplane_p2c(uae_u8 *chunky, const uae_u8 *const *planes, int depth, int nbytes)
+{
+	const uae_u8 *p[8];
+	int i = 0;
+
+	for (int k = 0; k < 8; k++)
+		p[k] = k < depth ? planes[k] : NULL;
+#if defined(BITPLANE_SSE2) || defined(BITPLANE_NEON)
+	for (; i + 16 <= nbytes; i += 16)
+		bp_p2c_16(chunky + i * 8, p, i);
+#endif
+	for (; i < nbytes; i++) {
+		uae_u64 x = 0;
+		for (int k = 0; k < 8; k++) {
+			if (p[k])
+				x |= (uae_u64)p[k][i] << (8 * (7 - k));
+		}
+		bp_store_le64(chunky + i * 8, bp_flip_antidiag(x));
+	}
+}
+
+void bitplane_c2p(uae_u8 *const *planes, const uae_u8 *chunky, int nbytes)
+{
+	int i = 0;
+
+#if defined(BITPLANE_SSE2)
+	for (; i + 2 <= nbytes; i += 2)
+		bp_c2p_16(planes, chunky + i * 8, i);
+#endif
+	for (; i < nbytes; i++) {
+		const uae_u8 *c = chunky + i * 8;
+		uae_u64 x = 0;
+		for (int j = 0; j < 8; j++)
+			x = (x << 8) | c[j];
+		x = bp_transpose(x);
+		for (int k = 0; k < 8; k++)
+			planes[k][i] = (uae_u8)(x >> (8 * k));
+	}
+}
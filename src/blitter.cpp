@@ -8,6 +8,7 @@
 */
 
 #define SPEEDUP 1
+#define BLITTER_SIMD 1
 #define BLITTER_DEBUG 0
 
 #include "sysconfig.h"
@@ -22,6 +23,7 @@
 #include "blit.h"
 #include "savestate.h"
 #include "debug.h"
+#include "benchmark.h"
 
 #define BLIT_TRACE 0
 #if BLIT_TRACE
@@ -477,6 +479,73 @@ static void blit_chipmem_agnus_wput(uaecptr addr, uae_u32 w, uae_u32 typemask)
 	}
 }
 
+#if BLITTER_SIMD
+// word address range touched by one channel over the whole blit
+static void blitter_simd_range(uaecptr pt, int stride, uae_s64 *lo, uae_s64 *hi)
+{
+	uae_s64 first = pt;
+	uae_s64 last = first + (uae_s64)stride * (blt_info.vblitsize - 1);
+	uae_s64 row = (blt_info.hblitsize - 1) * 2;
+	if (blitdesc) {
+		*lo = (first < last ? first : last) - row;
+		*hi = first > last ? first : last;
+	} else {
+		*lo = first < last ? first : last;
+		*hi = (first > last ? first : last) + row;
+	}
+}
+
+// Row based fast path, only if all enabled channels are plain chip RAM and
+// the result does not depend on the one word delay of the D write.
+static bool blitter_dofast_simd(uaecptr *pt, int *mod)
+{
+	struct blitter_simd_job job;
+	uae_s64 lo[4], hi[4];
+
+	if (blit_dof || (log_blitter & 4))
+		return false;
+#ifdef DEBUGGER
+	if (memwatch_enabled || debug_dma)
+		return false;
+#endif
+	if (blt_info.hblitsize <= 0 || blt_info.hblitsize > BLITTER_MAX_WORDS)
+		return false;
+	for (int i = 0; i < 4; i++) {
+		job.pt[i] = NULL;
+		job.stride[i] = blt_info.hblitsize * 2 + mod[i];
+		if (blitdesc)
+			job.stride[i] = -job.stride[i];
+		if (!pt[i])
+			continue;
+		if (pt[i] & 1)
+			return false;
+		blitter_simd_range(pt[i], job.stride[i], &lo[i], &hi[i]);
+		job.pt[i] = chipmem_agnus_xlate_range(lo[i], hi[i]);
+		if (!job.pt[i])
+			return false;
+		job.pt[i] += pt[i] - lo[i];
+	}
+	if (pt[3]) {
+		int stride = job.stride[3] < 0 ? -job.stride[3] : job.stride[3];
+		for (int i = 0; i < 3; i++) {
+			if (!pt[i] || hi[i] < lo[3] || lo[i] > hi[3])
+				continue;
+			// same pointer and modulo: every word is read before it is written
+			if (pt[i] == pt[3] && mod[i] == mod[3] && (stride >= blt_info.hblitsize * 2 || blt_info.vblitsize == 1))
+				continue;
+			return false;
+		}
+	}
+	job.desc = blitdesc != 0;
+	job.fill = blitfill != 0;
+	job.ife = blitife != 0;
+	job.fc = (blt_info.bltcon1 & BLTFC) != 0;
+	blitter_simd_blit(&job, &blt_info);
+	blitfc = job.fc;
+	return true;
+}
+#endif
+
 static void blitter_dofast(void)
 {
 	int i,j;
@@ -505,6 +574,13 @@ static void blitter_dofast(void)
 		blt_info.bltdpt += (blt_info.hblitsize * 2 + blt_info.bltdmod) * blt_info.vblitsize;
 	}
 
+#if BLITTER_SIMD
+	uaecptr simdpt[4] = { bltadatptr, bltbdatptr, bltcdatptr, bltddatptr };
+	int simdmod[4] = { blt_info.bltamod, blt_info.bltbmod, blt_info.bltcmod, blt_info.bltdmod };
+	if (blitter_dofast_simd(simdpt, simdmod)) {
+		;
+	} else
+#endif
 #if SPEEDUP
 	if (blitfunc_dofast[mt] && !blitfill) {
 		(*blitfunc_dofast[mt])(bltadatptr, bltbdatptr, bltcdatptr, bltddatptr, &blt_info);
@@ -606,6 +682,13 @@ static void blitter_dofast_desc(void)
 		bltddatptr = blt_info.bltdpt;
 		blt_info.bltdpt -= (blt_info.hblitsize * 2 + blt_info.bltdmod) * blt_info.vblitsize;
 	}
+#if BLITTER_SIMD
+	uaecptr simdpt[4] = { bltadatptr, bltbdatptr, bltcdatptr, bltddatptr };
+	int simdmod[4] = { blt_info.bltamod, blt_info.bltbmod, blt_info.bltcmod, blt_info.bltdmod };
+	if (blitter_dofast_simd(simdpt, simdmod)) {
+		;
+	} else
+#endif
 #if SPEEDUP
 	if (blitfunc_dofast_desc[mt] && !blitfill) {
 		(*blitfunc_dofast_desc[mt])(bltadatptr, bltbdatptr, bltcdatptr, bltddatptr, &blt_info);
@@ -999,6 +1082,7 @@ static int makebliteventtime(int delay)
 
 void blitter_handler(uae_u32 data)
 {
+	benchmark_scope bench(BENCH_BLITTER);
 	static int blitter_stuck;
 
 	if (!dmaen (DMA_BLITTER)) {
@@ -2028,6 +2112,7 @@ static void blitter_start_init(void)
 
 void do_blitter(int copper, uaecptr pc)
 {
+	benchmark_scope bench(BENCH_BLITTER);
 	int cycles;
 
 #if BLITTER_DEBUG
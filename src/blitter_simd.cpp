@@ -0,0 +1,334 @@
+/*
+* UAE - The Un*x Amiga Emulator
+*
+* Blitter emulation, row based SIMD engine for immediate blits
+*
+* Processes whole rows at once: channels are staged into native endian
+* row buffers, barrel shift, first/last word mask and minterm run on
+* vectors, area fill resolves per word carries with a short scalar scan.
+* Callers must only use this when all channels are plain chip RAM and
+* D does not alias a source in a way that depends on DMA ordering.
+*/
+
+#include "sysconfig.h"
+#include "sysdeps.h"
+
+#include "options.h"
+#include "memory.h"
+#include "blitter.h"
+
+#if !defined(WORDS_BIGENDIAN) && defined(__AVX2__)
+#include <immintrin.h>
+#define BLITTER_SIMD_AVX2
+#elif !defined(WORDS_BIGENDIAN) && defined(__SSE2__)
+#include <emmintrin.h>
+#define BLITTER_SIMD_SSE2
+#elif !defined(WORDS_BIGENDIAN) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+#include <arm_neon.h>
+#define BLITTER_SIMD_NEON
+#endif
+
+#if defined(BLITTER_SIMD_AVX2)
+
+struct blitvec
+{
+	typedef __m256i v;
+	static const int lanes = 16;
+	static inline v load(const uae_u16 *p) { return _mm256_loadu_si256((const __m256i*)p); }
+	static inline void store(uae_u16 *p, v x) { _mm256_storeu_si256((__m256i*)p, x); }
+	static inline v set1(uae_u16 x) { return _mm256_set1_epi16((short)x); }
+	static inline v vand(v a, v b) { return _mm256_and_si256(a, b); }
+	static inline v vor(v a, v b) { return _mm256_or_si256(a, b); }
+	static inline v vxor(v a, v b) { return _mm256_xor_si256(a, b); }
+	static inline v shl(v a, int n) { return _mm256_sll_epi16(a, _mm_cvtsi32_si128(n)); }
+	static inline v shr(v a, int n) { return _mm256_srl_epi16(a, _mm_cvtsi32_si128(n)); }
+	static inline v bswap(v a) { return _mm256_or_si256(_mm256_slli_epi16(a, 8), _mm256_srli_epi16(a, 8)); }
+	static inline v reverse(v a)
+	{
+		a = _mm256_shufflelo_epi16(a, 0x1b);
+		a = _mm256_shufflehi_epi16(a, 0x1b);
+		return _mm256_permute4x64_epi64(a, 0x1b);
+	}
+	static inline bool any(v a) { return !_mm256_testz_si256(a, a); }
+};
+
+#elif defined(BLITTER_SIMD_SSE2)
+
+struct blitvec
+{
+	typedef __m128i v;
+	static const int lanes = 8;
+	static inline v load(const uae_u16 *p) { return _mm_loadu_si128((const __m128i*)p); }
+	static inline void store(uae_u16 *p, v x) { _mm_storeu_si128((__m128i*)p, x); }
+	static inline v set1(uae_u16 x) { return _mm_set1_epi16((short)x); }
+	static inline v vand(v a, v b) { return _mm_and_si128(a, b); }
+	static inline v vor(v a, v b) { return _mm_or_si128(a, b); }
+	static inline v vxor(v a, v b) { return _mm_xor_si128(a, b); }
+	static inline v shl(v a, int n) { return _mm_sll_epi16(a, _mm_cvtsi32_si128(n)); }
+	static inline v shr(v a, int n) { return _mm_srl_epi16(a, _mm_cvtsi32_si128(n)); }
+	static inline v bswap(v a) { return _mm_or_si128(_mm_slli_epi16(a, 8), _mm_srli_epi16(a, 8)); }
+	static inline v reverse(v a)
+	{
+		a = _mm_shufflelo_epi16(a, 0x1b);
+		a = _mm_shufflehi_epi16(a, 0x1b);
+		return _mm_shuffle_epi32(a, 0x4e);
+	}
+	static inline bool any(v a) { return _mm_movemask_epi8(_mm_cmpeq_epi8(a, _mm_setzero_si128())) != 0xffff; }
+};
+
+#elif defined(BLITTER_SIMD_NEON)
+
+struct blitvec
+{
+	typedef uint16x8_t v;
+	static const int lanes = 8;
+	static inline v load(const uae_u16 *p) { return vld1q_u16(p); }
+	static inline void store(uae_u16 *p, v x) { vst1q_u16(p, x); }
+	static inline v set1(uae_u16 x) { return vdupq_n_u16(x); }
+	static inline v vand(v a, v b) { return vandq_u16(a, b); }
+	static inline v vor(v a, v b) { return vorrq_u16(a, b); }
+	static inline v vxor(v a, v b) { return veorq_u16(a, b); }
+	static inline v shl(v a, int n) { return vshlq_u16(a, vdupq_n_s16(n)); }
+	static inline v shr(v a, int n) { return vshlq_u16(a, vdupq_n_s16(-n)); }
+	static inline v bswap(v a) { return vreinterpretq_u16_u8(vrev16q_u8(vreinterpretq_u8_u16(a))); }
+	static inline v reverse(v a)
+	{
+		a = vrev64q_u16(a);
+		return vcombine_u16(vget_high_u16(a), vget_low_u16(a));
+	}
+	static inline bool any(v a)
+	{
+		uint64x2_t t = vreinterpretq_u64_u16(a);
+		return (vgetq_lane_u64(t, 0) | vgetq_lane_u64(t, 1)) != 0;
+	}
+};
+
+#else
+
+// portable fallback, one word per "vector"
+struct blitvec
+{
+	typedef uae_u32 v;
+	static const int lanes = 1;
+	static inline v load(const uae_u16 *p) { return *p; }
+	static inline void store(uae_u16 *p, v x) { *p = (uae_u16)x; }
+	static inline v set1(uae_u16 x) { return x; }
+	static inline v vand(v a, v b) { return a & b; }
+	static inline v vor(v a, v b) { return a | b; }
+	static inline v vxor(v a, v b) { return a ^ b; }
+	static inline v shl(v a, int n) { return (a << n) & 0xffff; }
+	static inline v shr(v a, int n) { return (a & 0xffff) >> n; }
+	static inline v bswap(v a) { uae_u16 w = (uae_u16)a; return do_get_mem_word(&w); }
+	static inline v reverse(v a) { return a; }
+	static inline bool any(v a) { return (a & 0xffff) != 0; }
+};
+
+#endif
+
+typedef blitvec::v bvec;
+
+// 32 words of headroom in front for the shift carry, and behind for
+// vector overrun past the end of the row.
+#define BLIT_SIMD_PAD 32
+#define BLIT_SIMD_ROW (BLIT_SIMD_PAD + BLITTER_MAX_WORDS + BLIT_SIMD_PAD)
+
+static uae_u16 blit_simd_rows[5][BLIT_SIMD_ROW] __attribute__((aligned(32)));
+
+/* Chip RAM row -> native endian words, in processing order. */
+static void blit_simd_stage(uae_u16 *dst, const uae_u8 *src, int h, bool desc)
+{
+	const int n = blitvec::lanes;
+	int i = 0;
+	if (!desc) {
+		for (; i + n <= h; i += n) {
+			blitvec::store(dst + i, blitvec::bswap(blitvec::load((const uae_u16*)(src + i * 2))));
+		}
+		for (; i < h; i++) {
+			dst[i] = do_get_mem_word((uae_u16*)(src + i * 2));
+		}
+	} else {
+		for (; i + n <= h; i += n) {
+			bvec x = blitvec::load((const uae_u16*)(src - (i + n - 1) * 2));
+			blitvec::store(dst + i, blitvec::reverse(blitvec::bswap(x)));
+		}
+		for (; i < h; i++) {
+			dst[i] = do_get_mem_word((uae_u16*)(src - i * 2));
+		}
+	}
+}
+
+/* Inverse of blit_simd_stage(). */
+static void blit_simd_unstage(uae_u8 *dst, const uae_u16 *src, int h, bool desc)
+{
+	const int n = blitvec::lanes;
+	int i = 0;
+	if (!desc) {
+		for (; i + n <= h; i += n) {
+			blitvec::store((uae_u16*)(dst + i * 2), blitvec::bswap(blitvec::load(src + i)));
+		}
+		for (; i < h; i++) {
+			do_put_mem_word((uae_u16*)(dst + i * 2), src[i]);
+		}
+	} else {
+		for (; i + n <= h; i += n) {
+			bvec x = blitvec::reverse(blitvec::bswap(blitvec::load(src + i)));
+			blitvec::store((uae_u16*)(dst - (i + n - 1) * 2), x);
+		}
+		for (; i < h; i++) {
+			do_put_mem_word((uae_u16*)(dst - i * 2), src[i]);
+		}
+	}
+}
+
+/* Barrel shifter: p[-1] is the previously processed word. */
+static inline bvec blit_simd_shift(const uae_u16 *p, int shift, bool desc)
+{
+	bvec cur = blitvec::load(p);
+	if (!shift)
+		return cur;
+	bvec prev = blitvec::load(p - 1);
+	if (desc)
+		return blitvec::vor(blitvec::shl(cur, shift), blitvec::shr(prev, 16 - shift));
+	return blitvec::vor(blitvec::shl(prev, 16 - shift), blitvec::shr(cur, shift));
+}
+
+static inline uae_u16 blit_simd_shift1(uae_u16 prev, uae_u16 cur, int shift, bool desc)
+{
+	if (desc)
+		return (((uae_u32)cur << 16) | prev) >> (16 - shift);
+	return (((uae_u32)prev << 16) | cur) >> shift;
+}
+
+void blitter_simd_blit(struct blitter_simd_job *job, struct bltinfo *b)
+{
+	const int n = blitvec::lanes;
+	const int h = b->hblitsize;
+	const bool desc = job->desc;
+	const int ashift = b->bltcon0 >> 12;
+	const int bshift = b->bltcon1 >> 12;
+	uae_u16 *a = blit_simd_rows[0] + BLIT_SIMD_PAD;
+	uae_u16 *bb = blit_simd_rows[1] + BLIT_SIMD_PAD;
+	uae_u16 *c = blit_simd_rows[2] + BLIT_SIMD_PAD;
+	uae_u16 *d = blit_simd_rows[3] + BLIT_SIMD_PAD;
+	uae_u16 *e = blit_simd_rows[4] + BLIT_SIMD_PAD;
+	uae_u8 *pta = job->pt[0], *ptb = job->pt[1], *ptc = job->pt[2], *ptd = job->pt[3];
+	uae_u16 bhold = b->bltbhold;
+	bool fc = job->fc;
+	bool nonzero = false;
+
+	// minterm as a mux tree: bit (a << 2) | (b << 1) | c of bltcon0 selects the output
+	bvec m[8], k[4];
+	for (int i = 0; i < 8; i++) {
+		m[i] = blitvec::set1((b->bltcon0 >> i) & 1 ? 0xffff : 0x0000);
+	}
+	for (int i = 0; i < 4; i++) {
+		k[i] = blitvec::vxor(m[i * 2], m[i * 2 + 1]);
+	}
+
+	if (!pta) {
+		for (int i = 0; i < h; i += n) {
+			blitvec::store(a + i, blitvec::set1(b->bltadat));
+		}
+	}
+	if (!ptc) {
+		for (int i = 0; i < h; i += n) {
+			blitvec::store(c + i, blitvec::set1(b->bltcdat));
+		}
+	}
+	a[-1] = b->bltaold;
+	bb[-1] = b->bltbold;
+
+	for (int j = 0; j < b->vblitsize; j++) {
+
+		if (pta) {
+			blit_simd_stage(a, pta, h, desc);
+			b->bltadat = a[h - 1];
+			pta += job->stride[0];
+		} else if (j > 0) {
+			a[0] = a[h - 1] = b->bltadat;
+		}
+		a[0] &= b->bltafwm;
+		a[h - 1] &= b->bltalwm;
+
+		if (ptb) {
+			blit_simd_stage(bb, ptb, h, desc);
+			bhold = blit_simd_shift1(h > 1 ? bb[h - 2] : bb[-1], bb[h - 1], bshift, desc);
+			ptb += job->stride[1];
+		}
+		if (ptc) {
+			blit_simd_stage(c, ptc, h, desc);
+			ptc += job->stride[2];
+		}
+
+		bvec vb = blitvec::set1(bhold);
+		for (int i = 0; i < h; i += n) {
+			bvec va = blit_simd_shift(a + i, ashift, desc);
+			if (ptb)
+				vb = blit_simd_shift(bb + i, bshift, desc);
+			bvec vc = blitvec::load(c + i);
+			bvec x0 = blitvec::vxor(m[0], blitvec::vand(vc, k[0]));
+			bvec x1 = blitvec::vxor(m[2], blitvec::vand(vc, k[1]));
+			bvec x2 = blitvec::vxor(m[4], blitvec::vand(vc, k[2]));
+			bvec x3 = blitvec::vxor(m[6], blitvec::vand(vc, k[3]));
+			bvec y0 = blitvec::vxor(x0, blitvec::vand(vb, blitvec::vxor(x0, x1)));
+			bvec y1 = blitvec::vxor(x2, blitvec::vand(vb, blitvec::vxor(x2, x3)));
+			blitvec::store(d + i, blitvec::vxor(y0, blitvec::vand(va, blitvec::vxor(y0, y1))));
+		}
+
+		if (job->fill) {
+			// e = parity of all lower bits of the same word (exclusive prefix xor)
+			for (int i = 0; i < h; i += n) {
+				bvec x = blitvec::shl(blitvec::load(d + i), 1);
+				x = blitvec::vxor(x, blitvec::shl(x, 1));
+				x = blitvec::vxor(x, blitvec::shl(x, 2));
+				x = blitvec::vxor(x, blitvec::shl(x, 4));
+				x = blitvec::vxor(x, blitvec::shl(x, 8));
+				blitvec::store(e + i, x);
+			}
+			// carry between words, then apply
+			fc = job->fc;
+			for (int i = 0; i < h; i++) {
+				uae_u16 w = d[i];
+				uae_u16 fm = e[i] ^ (fc ? 0xffff : 0x0000);
+				fc ^= ((e[i] ^ w) >> 15) & 1;
+				d[i] = job->ife ? (w | fm) : (w ^ fm);
+			}
+		}
+
+		if (!nonzero) {
+			for (int i = h; i < ((h + n - 1) / n) * n; i++) {
+				d[i] = 0;
+			}
+			for (int i = 0; i < h; i += n) {
+				if (blitvec::any(blitvec::load(d + i))) {
+					nonzero = true;
+					break;
+				}
+			}
+		}
+
+		if (ptd) {
+			blit_simd_unstage(ptd, d, h, desc);
+			ptd += job->stride[3];
+		}
+
+		a[-1] = a[h - 1];
+		bb[-1] = bb[h - 1];
+	}
+
+	b->bltaold = a[-1];
+	if (ptb) {
+		b->bltbold = b->bltbdat = bb[-1];
+		b->bltbhold = bhold;
+	}
+	if (ptc) {
+		b->bltcdat = c[h - 1];
+		// descending C read also lands in bltbdat, see blitter_dofast_desc()
+		if (desc)
+			b->bltbdat = b->bltcdat;
+	}
+	b->bltddat = d[h - 1];
+	if (nonzero)
+		b->blitzero = 0;
+	job->fc = fc;
+}
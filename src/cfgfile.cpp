@@ -2222,6 +2222,8 @@ void cfgfile_save_options (struct zfile *f, struct uae_prefs *p, int type)
 	cfgfile_write_strarr(f, _T("comp_trustnaddr"), compmode, p->comptrustnaddr);
 	cfgfile_write_bool (f, _T("comp_nf"), p->compnf);
 	cfgfile_write_bool (f, _T("comp_constjump"), p->comp_constjump);
+	cfgfile_dwrite_bool (f, _T("comp_persist"), p->comp_persist);
+	cfgfile_dwrite_bool (f, _T("comp_hotblocks"), p->comp_hotblocks);
 	cfgfile_write_strarr(f, _T("comp_flushmode"), flushmode, p->comp_hardflush);
 #ifdef USE_JIT_FPU
 	cfgfile_write_bool (f, _T("compfpu"), p->compfpu);
@@ -3024,6 +3026,10 @@ void cfgfile_save_options (struct zfile *f, struct uae_prefs *p, int type)
 
 	cfgfile_dwrite(f, _T("state_replay_rate"), _T("%d"), p->statecapturerate);
 	cfgfile_dwrite(f, _T("state_replay_buffers"), _T("%d"), p->statecapturebuffersize);
+	cfgfile_dwrite_bool(f, _T("state_replay_delta"), p->statecapturedelta);
+	cfgfile_dwrite(f, _T("state_replay_delta_size"), _T("%d"), p->statecapturedeltasize);
+	cfgfile_dwrite_bool(f, _T("state_replay_delta_compress"), p->statecapturecompress);
+	cfgfile_dwrite(f, _T("runahead"), _T("%d"), p->runahead);
 	cfgfile_dwrite_bool(f, _T("state_replay_autoplay"), p->inprec_autoplay);
 	cfgfile_dwrite_bool(f, _T("warp"), p->turbo_emulation);
 	cfgfile_dwrite(f, _T("warp_limit"), _T("%d"), p->turbo_emulation_limit);
@@ -3037,6 +3043,7 @@ void cfgfile_save_options (struct zfile *f, struct uae_prefs *p, int type)
 	cfgfile_dwrite (f, _T("filesys_max_size"), _T("%d"), p->filesys_limit);
 	cfgfile_dwrite (f, _T("filesys_max_name_length"), _T("%d"), p->filesys_max_name);
 	cfgfile_dwrite (f, _T("filesys_max_file_size"), _T("%d"), p->filesys_max_file_size);
+	cfgfile_dwrite (f, _T("hardfile_cache_size"), _T("%d"), p->hdf_cache_size);
 	cfgfile_dwrite_bool (f, _T("filesys_inject_icons"), p->filesys_inject_icons);
 	cfgfile_dwrite_str (f, _T("filesys_inject_icons_drawer"), p->filesys_inject_icons_drawer);
 	cfgfile_dwrite_str (f, _T("filesys_inject_icons_project"), p->filesys_inject_icons_project);
@@ -3692,6 +3699,10 @@ static int cfgfile_parse_host (struct uae_prefs *p, TCHAR *option, TCHAR *value)
 		|| cfgfile_intval (option, value, _T("sound_max_buff"), &p->sound_maxbsiz, 1)
 		|| cfgfile_intval (option, value, _T("state_replay_rate"), &p->statecapturerate, 1)
 		|| cfgfile_intval (option, value, _T("state_replay_buffers"), &p->statecapturebuffersize, 1)
+		|| cfgfile_yesno (option, value, _T("state_replay_delta"), &p->statecapturedelta)
+		|| cfgfile_intval (option, value, _T("state_replay_delta_size"), &p->statecapturedeltasize, 1)
+		|| cfgfile_yesno (option, value, _T("state_replay_delta_compress"), &p->statecapturecompress)
+		|| cfgfile_intval (option, value, _T("runahead"), &p->runahead, 1)
 		|| cfgfile_yesno (option, value, _T("state_replay_autoplay"), &p->inprec_autoplay)
 		|| cfgfile_intval (option, value, _T("sound_frequency"), &p->sound_freq, 1)
 		|| cfgfile_intval (option, value, _T("sound_volume"), &p->sound_volume_master, 1)
@@ -3731,6 +3742,7 @@ static int cfgfile_parse_host (struct uae_prefs *p, TCHAR *option, TCHAR *value)
 		|| cfgfile_intval (option, value, _T("filesys_max_size"), &p->filesys_limit, 1)
 		|| cfgfile_intval (option, value, _T("filesys_max_name_length"), &p->filesys_max_name, 1)
 		|| cfgfile_intval (option, value, _T("filesys_max_file_size"), &p->filesys_max_file_size, 1)
+		|| cfgfile_intval (option, value, _T("hardfile_cache_size"), &p->hdf_cache_size, 1)
 		|| cfgfile_yesno (option, value, _T("filesys_inject_icons"), &p->filesys_inject_icons)
 		|| cfgfile_string (option, value, _T("filesys_inject_icons_drawer"), p->filesys_inject_icons_drawer, sizeof p->filesys_inject_icons_drawer / sizeof (TCHAR))
 		|| cfgfile_string (option, value, _T("filesys_inject_icons_project"), p->filesys_inject_icons_project, sizeof p->filesys_inject_icons_project / sizeof (TCHAR))
@@ -6047,6 +6059,8 @@ static int cfgfile_parse_hardware (struct uae_prefs *p, const TCHAR *option, TCH
 		|| cfgfile_yesno(option, value, _T("fpu_strict"), &p->fpu_strict)
 		|| cfgfile_yesno(option, value, _T("comp_nf"), &p->compnf)
 		|| cfgfile_yesno(option, value, _T("comp_constjump"), &p->comp_constjump)
+		|| cfgfile_yesno(option, value, _T("comp_persist"), &p->comp_persist)
+		|| cfgfile_yesno(option, value, _T("comp_hotblocks"), &p->comp_hotblocks)
 		|| cfgfile_yesno(option, value, _T("comp_catchfault"), &p->comp_catchfault)
 #ifdef USE_JIT_FPU
 		|| cfgfile_yesno (option, value, _T("compfpu"), &p->compfpu)
@@ -8603,6 +8617,8 @@ void default_prefs (struct uae_prefs *p, bool reset, int type)
 	p->compnf = true;
 	p->comp_hardflush = false;
 	p->comp_constjump = true;
+	p->comp_persist = false;
+	p->comp_hotblocks = false;
 #ifdef USE_JIT_FPU
 	p->compfpu = 1;
 #else
@@ -8791,6 +8807,7 @@ void default_prefs (struct uae_prefs *p, bool reset, int type)
 	p->filesys_limit = 0;
 	p->filesys_max_name = 107;
 	p->filesys_max_file_size = 0x7fffffff;
+	p->hdf_cache_size = 1024;
 
 	p->z3autoconfig_start = 0x10000000;
 	p->chipmem.size = 0x00080000;
@@ -8831,6 +8848,10 @@ void default_prefs (struct uae_prefs *p, bool reset, int type)
 
 	p->statecapturebuffersize = 100;
 	p->statecapturerate = 5 * 50;
+	p->statecapturedelta = true;
+	p->statecapturedeltasize = 64;
+	p->statecapturecompress = true;
+	p->runahead = 0;
 	p->inprec_autoplay = true;
 	p->statefile_path[0] = 0;
 
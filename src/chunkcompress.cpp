@@ -0,0 +1,218 @@
+/*
+* UAE - The Un*x Amiga Emulator
+*
+* Parallel savestate chunk compression
+*/
+
+#include "sysconfig.h"
+#include "sysdeps.h"
+
+#include "threaddep/thread.h"
+#include "chunkcompress.h"
+
+#include <algorithm>
+#include <thread>
+#include <zlib.h>
+#ifdef USE_ZSTD
+#include <zstd.h>
+#endif
+
+/* Chunk compression is split into 1MB segments that are compressed in
+ * parallel. The chunk memory is read directly by the workers, it must not
+ * change until chunk_compress() returns.
+ *
+ * zlib: each segment is a raw deflate block sequence primed with the last
+ * 32k of the previous segment and ended with a sync flush, the last one
+ * is finished normally. Wrapped in a zlib header and the combined adler32
+ * this is one ordinary zlib stream, readable by older versions.
+ *
+ * zstd: each segment is a separate frame, frames are concatenated. Chunk
+ * flag bit 1 marks zstd data, such states need zstd support to load. */
+
+#define SAVE_SEGMENT_SIZE (1024 * 1024)
+#define SAVE_SEGMENT_DICT 32768
+#define SAVE_MAX_THREADS 8
+
+struct save_segment
+{
+	const uae_u8 *src;
+	size_t len;
+	bool first, last, zstd;
+	uae_u8 *out;
+	size_t outlen;
+	uLong adler;
+	int done;
+};
+
+static struct save_segment *save_segments;
+static int save_segments_alloc, save_segments_num, save_segments_next;
+static int save_threads;
+static bool save_threads_init;
+static uae_sem_t save_lock, save_work_sem, save_done_sem;
+
+static int save_segment_grab(void)
+{
+	int i = -1;
+	uae_sem_wait(&save_lock);
+	if (save_segments_next < save_segments_num)
+		i = save_segments_next++;
+	uae_sem_post(&save_lock);
+	return i;
+}
+
+static void save_segment_run(struct save_segment *s)
+{
+	s->out = NULL;
+	s->outlen = 0;
+	if (s->zstd) {
+#ifdef USE_ZSTD
+		size_t bound = ZSTD_compressBound(s->len);
+		s->out = xmalloc(uae_u8, bound);
+		if (s->out) {
+			size_t v = ZSTD_compress(s->out, bound, s->src, s->len, ZSTD_CLEVEL_DEFAULT);
+			if (ZSTD_isError(v)) {
+				xfree(s->out);
+				s->out = NULL;
+			} else {
+				s->outlen = v;
+			}
+		}
+#endif
+	} else {
+		z_stream zs;
+		memset(&zs, 0, sizeof zs);
+		if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) == Z_OK) {
+			if (!s->first)
+				deflateSetDictionary(&zs, s->src - SAVE_SEGMENT_DICT, SAVE_SEGMENT_DICT);
+			// room for the sync flush marker on top of the worst case
+			size_t bound = deflateBound(&zs, (uLong)s->len) + 16;
+			s->out = xmalloc(uae_u8, bound);
+			if (s->out) {
+				zs.next_in = (Bytef*)s->src;
+				zs.avail_in = (uInt)s->len;
+				zs.next_out = s->out;
+				zs.avail_out = (uInt)bound;
+				int v = deflate(&zs, s->last ? Z_FINISH : Z_SYNC_FLUSH);
+				if (zs.avail_in || (s->last ? v != Z_STREAM_END : v != Z_OK)) {
+					xfree(s->out);
+					s->out = NULL;
+				} else {
+					s->outlen = zs.total_out;
+				}
+			}
+			deflateEnd(&zs);
+		}
+		s->adler = adler32(adler32(0, NULL, 0), s->src, (uInt)s->len);
+	}
+	__atomic_store_n(&s->done, 1, __ATOMIC_RELEASE);
+}
+
+static int save_compress_thread(void *v)
+{
+	for (;;) {
+		uae_sem_wait(&save_work_sem);
+		int i;
+		while ((i = save_segment_grab()) >= 0) {
+			save_segment_run(&save_segments[i]);
+			uae_sem_post(&save_done_sem);
+		}
+	}
+	return 0;
+}
+
+static void save_compress_init(void)
+{
+	if (save_threads_init)
+		return;
+	save_threads_init = true;
+	uae_sem_init(&save_lock, 0, 1);
+	uae_sem_init(&save_work_sem, 0, 0);
+	uae_sem_init(&save_done_sem, 0, 0);
+	int n = (int)std::thread::hardware_concurrency() - 1;
+	n = std::max(0, std::min(n, SAVE_MAX_THREADS));
+	for (int i = 0; i < n; i++) {
+		if (!uae_start_thread(_T("savestate compress"), save_compress_thread, NULL, NULL))
+			break;
+		save_threads++;
+	}
+	write_log(_T("Savestate: %d compression threads\n"), save_threads);
+}
+
+/* returns compressed size, 0 if it failed. The output written until then has to be discarded. */
+size_t chunk_compress(const uae_u8 *chunk, size_t len, bool zstd, CHUNK_WRITE write, void *user)
+{
+	size_t total = 0;
+	uLong adler = adler32(0, NULL, 0);
+	bool ok = true;
+	int n;
+
+	if (!len)
+		return 0;
+	save_compress_init();
+	n = (int)((len + SAVE_SEGMENT_SIZE - 1) / SAVE_SEGMENT_SIZE);
+	if (n > save_segments_alloc) {
+		struct save_segment *s = xrealloc(struct save_segment, save_segments, n);
+		if (!s)
+			return 0;
+		save_segments = s;
+		save_segments_alloc = n;
+	}
+	for (int i = 0; i < n; i++) {
+		struct save_segment *s = &save_segments[i];
+		s->src = chunk + (size_t)i * SAVE_SEGMENT_SIZE;
+		s->len = std::min(len - (size_t)i * SAVE_SEGMENT_SIZE, (size_t)SAVE_SEGMENT_SIZE);
+		s->first = i == 0;
+		s->last = i == n - 1;
+		s->zstd = zstd;
+		s->out = NULL;
+		s->done = 0;
+	}
+	uae_sem_wait(&save_lock);
+	save_segments_num = n;
+	save_segments_next = 0;
+	uae_sem_post(&save_lock);
+	for (int i = 0; i < std::min(n - 1, save_threads); i++)
+		uae_sem_post(&save_work_sem);
+
+	if (!zstd) {
+		static const uae_u8 zhdr[2] = { 0x78, 0x9c };
+		write(user, zhdr, 2);
+		total += 2;
+	}
+	for (int i = 0; i < n; i++) {
+		struct save_segment *s = &save_segments[i];
+		// help out until the next segment in order is finished
+		while (!__atomic_load_n(&s->done, __ATOMIC_ACQUIRE)) {
+			int j = save_segment_grab();
+			if (j >= 0)
+				save_segment_run(&save_segments[j]);
+			else
+				uae_sem_wait(&save_done_sem);
+		}
+		if (!s->out)
+			ok = false;
+		if (ok) {
+			write(user, s->out, s->outlen);
+			total += s->outlen;
+			if (!zstd)
+				adler = adler32_combine(adler, s->adler, (z_off_t)s->len);
+		}
+		xfree(s->out);
+		s->out = NULL;
+	}
+	// workers post once per segment, drop the ones nobody waited for
+	while (uae_sem_trywait(&save_done_sem) == 0);
+
+	if (!ok)
+		return 0;
+	if (!zstd) {
+		uae_u8 ztrl[4];
+		ztrl[0] = (uae_u8)(adler >> 24);
+		ztrl[1] = (uae_u8)(adler >> 16);
+		ztrl[2] = (uae_u8)(adler >> 8);
+		ztrl[3] = (uae_u8)(adler >> 0);
+		write(user, ztrl, 4);
+		total += 4;
+	}
+	return total;
+}
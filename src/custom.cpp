@@ -54,6 +54,7 @@
 #ifdef WITH_SPECIALMONITORS
 #include "specialmonitors.h"
 #endif
+#include "benchmark.h"
 
 #define VPOSW_DISABLED 0
 #define VPOSW_DEBUG 0
@@ -411,6 +412,7 @@ static int linear_vpos_changes;
 static enum nln_how nextline_how;
 static bool prevlofs[3];
 static bool vsync_rendered, frame_rendered, frame_shown;
+static bool vsync_frame_hidden;
 static frame_time_t vsynctimeperline;
 static frame_time_t frameskiptime;
 static bool genlockhtoggle;
@@ -1724,17 +1726,20 @@ void compute_framesync(void)
 
 	hblank_hz = (currprefs.ntscmode ? CHIPSET_CLOCK_NTSC : CHIPSET_CLOCK_PAL) / (maxhpos + (linetoggle ? 0.5f : 0.0f));
 
-	write_log(_T("%s mode%s%s V=%.4fHz H=%0.4fHz (%dx%d+%d) IDX=%d (%s) D=%d RTG=%d/%d\n"),
-		isntsc ? _T("NTSC") : _T("PAL"),
-		islace ? _T(" lace") : _T(""),
-		doublescan > 0 ? _T(" dblscan") : _T(""),
-		vblank_hz,
-		hblank_hz,
-		maxhpos, maxvpos, lof_store ? 1 : 0,
-		cr ? cr->index : -1,
-		cr != NULL && cr->label != NULL ? cr->label : _T("<?>"),
-		currprefs.gfx_apmode[ad->picasso_on ? 1 : 0].gfx_display, ad->picasso_on, ad->picasso_requested_on
-	);
+	// run-ahead rollbacks come through here every frame
+	if (!isrunahead()) {
+		write_log(_T("%s mode%s%s V=%.4fHz H=%0.4fHz (%dx%d+%d) IDX=%d (%s) D=%d RTG=%d/%d\n"),
+			isntsc ? _T("NTSC") : _T("PAL"),
+			islace ? _T(" lace") : _T(""),
+			doublescan > 0 ? _T(" dblscan") : _T(""),
+			vblank_hz,
+			hblank_hz,
+			maxhpos, maxvpos, lof_store ? 1 : 0,
+			cr ? cr->index : -1,
+			cr != NULL && cr->label != NULL ? cr->label : _T("<?>"),
+			currprefs.gfx_apmode[ad->picasso_on ? 1 : 0].gfx_display, ad->picasso_on, ad->picasso_requested_on
+		);
+	}
 
 #ifdef PICASSO96
 	init_hz_p96(0);
@@ -5081,35 +5086,38 @@ static void vsync_handler_render(void)
 		frameskiptime += end - start;
 	}
 
-	bool frameok = framewait();
-	
-	if (!ad->picasso_on) {
-		if (!frame_rendered && vblank_hz_state) {
-			frame_rendered = crender_screen(0, 1, false);
-		}
-		if (frame_rendered && !frame_shown) {
-			frame_shown = show_screen_maybe(0, isvsync_chipset () >= 0);
+	// run-ahead frames that are not shown are not paced either
+	if (!vsync_frame_hidden) {
+		bool frameok = framewait();
+
+		if (!ad->picasso_on) {
+			if (!frame_rendered && vblank_hz_state) {
+				frame_rendered = crender_screen(0, 1, false);
+			}
+			if (frame_rendered && !frame_shown) {
+				frame_shown = show_screen_maybe(0, isvsync_chipset () >= 0);
+			}
 		}
-	}
 
-	fpscounter(frameok);
+		fpscounter(frameok);
 
-	bool waspaused = false;
-	while (handle_events()) {
-		if (!waspaused) {
-			if (crender_screen(0, 1, true)) {
-				show_screen(0, 0);
+		bool waspaused = false;
+		while (handle_events()) {
+			if (!waspaused) {
+				if (crender_screen(0, 1, true)) {
+					show_screen(0, 0);
+				}
+				waspaused = true;
 			}
-			waspaused = true;
-		}
-		// we are paused, do all config checks but don't do any emulation
-		if (vsync_handle_check()) {
-			redraw_frame();
-			if (crender_screen(0, 1, true)) {
-				show_screen(0, 0);
+			// we are paused, do all config checks but don't do any emulation
+			if (vsync_handle_check()) {
+				redraw_frame();
+				if (crender_screen(0, 1, true)) {
+					show_screen(0, 0);
+				}
 			}
+			config_check_vsync();
 		}
-		config_check_vsync();
 	}
 
 	vsync_rendered = false;
@@ -5365,6 +5373,8 @@ static void virtual_vsync_check(void)
 // emulated hardware vsync
 static void vsync_handler_post(void)
 {
+	benchmark_vsync();
+	benchmark_scope bench(BENCH_VSYNC);
 	int monid = 0;
 	static frame_time_t prevtime;
 
@@ -6614,20 +6624,57 @@ static bool uae_quit_check(void)
 	return false;
 }
 
+// The last speculative run-ahead frame is shown before the machine goes
+// back to the end of the real frame. The rollback restores a state like
+// rewind does, but it is not a reset: uae_reset() would drop the quit state.
+static void runahead_rollback(bool show)
+{
+	set_inhibit_frame(0, IHF_RUNAHEAD);
+	if (show) {
+		vsync_display_render();
+	}
+	quit_program = UAE_RESET;
+	set_special(SPCFLAG_BRK | SPCFLAG_MODE_CHANGE);
+}
+
+static bool custom_savestate_check(bool show)
+{
+	vsync_frame_hidden = savestate_runahead_hidden;
+	if (savestate_check()) {
+		if (savestate_runahead < 0) {
+			runahead_rollback(show);
+		} else {
+			uae_reset(0, 0);
+		}
+		return true;
+	}
+	if (savestate_runahead_hidden) {
+		set_inhibit_frame(0, IHF_RUNAHEAD);
+	} else {
+		clear_inhibit_frame(0, IHF_RUNAHEAD);
+	}
+	return false;
+}
+
 // executed at start of scanline
 static void hsync_handler(bool vs)
 {
+	benchmark_scope bench(BENCH_HSYNC);
+
 	display_last_hsync = get_cycles();
 
-	hsync_handler_pre(vs);
-	if (vs) {
-		devices_vsync_pre();
-		if (savestate_check()) {
-			uae_reset(0, 0);
-			return;
-		}
-		if (uae_quit_check()) {
-			return;
+	// after a run-ahead rollback this line has been handled already
+	// up to the state capture, the rest of it still has to be done
+	if (!vs || !savestate_runahead_resume()) {
+		hsync_handler_pre(vs);
+		if (vs) {
+			devices_vsync_pre();
+			if (custom_savestate_check(true)) {
+				return;
+			}
+			if (uae_quit_check()) {
+				return;
+			}
 		}
 	}
 	if (vpos == vsync_startline + 1 && !maxvpos_display_vsync_next) {
@@ -6722,9 +6769,17 @@ void custom_reset(bool hardreset, bool keyboardreset)
 		initial_frame = true;
 	}
 
-	target_reset();
+	if (!isrestore()) {
+		savestate_runahead_stop();
+	}
+
+	if (!isrunahead()) {
+		target_reset();
+	}
 	devices_reset(hardreset);
-	write_log(_T("Reset at %08X. Chipset mask = %08X\n"), M68K_GETPC, currprefs.chipset_mask);
+	if (!isrunahead()) {
+		write_log(_T("Reset at %08X. Chipset mask = %08X\n"), M68K_GETPC, currprefs.chipset_mask);
+	}
 #ifdef DEBUGGER
 	memory_map_dump();
 #endif
@@ -7056,14 +7111,16 @@ void custom_reset(bool hardreset, bool keyboardreset)
 			events_schedule();
 		}
 
-		write_log(_T("CPU=%d Chipset=%s %s\n"),
-			currprefs.cpu_model,
-			(aga_mode ? _T("AGA") :
-			(ecs_agnus && ecs_denise ? _T("Full ECS") :
-			(ecs_denise ? _T("ECS Denise") :
-			(ecs_agnus ? _T("ECS") : _T("OCS"))))),
-			currprefs.ntscmode ? _T("NTSC") : _T("PAL"));
-		write_log(_T("State restored\n"));
+		if (!isrunahead()) {
+			write_log(_T("CPU=%d Chipset=%s %s\n"),
+				currprefs.cpu_model,
+				(aga_mode ? _T("AGA") :
+				(ecs_agnus && ecs_denise ? _T("Full ECS") :
+				(ecs_denise ? _T("ECS Denise") :
+				(ecs_agnus ? _T("ECS") : _T("OCS"))))),
+				currprefs.ntscmode ? _T("NTSC") : _T("PAL"));
+			write_log(_T("State restored\n"));
+		}
 	}
 
 	sprite_width = GET_SPRITEWIDTH(fmode);
@@ -7802,12 +7859,18 @@ static void REGPARAM2 custom_lput(uaecptr addr, uae_u32 value)
 void custom_prepare_savestate(void)
 {
 	if (!currprefs.cpu_cycle_exact) {
-		for (int i = 0; i < ev2_max; i++) {
-			if (eventtab2[i].active) {
-				eventtab2[i].active = 0;
-				eventtab2[i].handler(eventtab2[i].data);
+		int cnt;
+		struct ev2 **list = event2_get_pending(&cnt);
+		for (int i = 0; i < cnt; i++) {
+			struct ev2 *e = list[i];
+			if (e->active) {
+				evfunc2 f = e->handler;
+				uae_u32 data = e->data;
+				event2_remevent_x(e);
+				f(data);
 			}
 		}
+		xfree(list);
 	}
 }
 
@@ -8723,29 +8786,40 @@ uae_u8 *restore_custom_event_delay(uae_u8 *src)
 }
 uae_u8 *save_custom_event_delay(size_t *len, uae_u8 *dstptr)
 {
-	uae_u8 *dstbak, *dst;
-	int cnt = 0, cnt2 = 0;
+	uae_u8 *dstbak, *dst, *dstcnt;
+	int cnt = 0, cnt2 = 0, pending;
+	struct ev2 **list = event2_get_pending(&pending);
 
-	for (int i = ev2_misc; i < ev2_max; i++) {
-		struct ev2 *e = &eventtab2[i];
-		if (e->active) {
+	for (int i = 0; i < pending; i++) {
+		if (list[i] != &eventtab2[ev2_blitter]) {
 			cnt++;
 		}
 	}
-	if (cnt == 0)
+	if (cnt == 0) {
+		xfree(list);
 		return NULL;
+	}
+	// count is saved as a byte
+	if (cnt > 255) {
+		write_log("%d pending events, only 255 saved\n", cnt);
+		cnt = 255;
+	}
 
 	if (dstptr)
 		dstbak = dst = dstptr;
 	else
-		dstbak = dst = xmalloc(uae_u8, 1000);
+		dstbak = dst = xmalloc(uae_u8, 5 + cnt * 13);
 
 	save_u32(1);
+	dstcnt = dst;
 	save_u8(cnt);
-	for (int i = ev2_misc; i < ev2_max; i++) {
-		struct ev2 *e = &eventtab2[i];
-		if (e->active) {
+	cnt = 0;
+	for (int i = 0; i < pending && cnt < 255; i++) {
+		struct ev2 *e = list[i];
+		if (e->active && e != &eventtab2[ev2_blitter]) {
 			evfunc2 f = e->handler;
+			evt_t evtime = e->evtime;
+			uae_u32 data = e->data;
 			uae_u8 type = 0;
 			if (f == event_send_interrupt_do_ext) {
 				type = 1;
@@ -8771,17 +8845,21 @@ uae_u8 *save_custom_event_delay(size_t *len, uae_u8 *dstptr)
 				type = 11;
 			} else {
 				write_log("unknown event2 handler %p\n", e->handler);
-				e->active = false;
-				f(e->data);
+				event2_remevent_x(e);
+				f(data);
 			}
 			if (type) {
 				cnt2++;
 			}
 			save_u8(type);
-			save_u64(e->evtime - get_cycles());
-			save_u32(e->data);
+			save_u64(evtime - get_cycles());
+			save_u32(data);
+			cnt++;
 		}
 	}
+	// unknown handlers may have removed later events
+	*dstcnt = cnt;
+	xfree(list);
 	write_log("%d pending events saved\n", cnt2);
 
 	*len = dst - dstbak;
@@ -8827,6 +8905,7 @@ void check_prefs_changed_custom(void)
 	if (!config_changed)
 		return;
 	currprefs.gfx_framerate = changed_prefs.gfx_framerate;
+	currprefs.runahead = changed_prefs.runahead;
 	if (currprefs.turbo_emulation_limit != changed_prefs.turbo_emulation_limit) {
 		currprefs.turbo_emulation_limit = changed_prefs.turbo_emulation_limit;
 		if (changed_prefs.turbo_emulation) {
@@ -11348,9 +11427,7 @@ static void vsync_nosync(void)
 	vsync_display_rendered = false;
 	virtual_vsync_check();
 	uae_quit_check();
-	if (savestate_check()) {
-		uae_reset(0, 0);
-	}
+	custom_savestate_check(false);
 }
 
 static void custom_trigger_start_nosync(void)
@@ -217,17 +217,23 @@ void devices_reset(int hardreset)
 #endif
 	memory_reset();
 #ifdef AUTOCONFIG
-	rtarea_reset();
+	if (!isrunahead())
+		rtarea_reset();
 #endif
 	DISK_reset();
 	CIA_reset(hardreset);
 	a1000_reset();
 #ifdef JIT
-	compemu_reset();
+	if (!isrunahead())
+		compemu_reset();
 #endif
 #ifdef WITH_PPC
 	uae_ppc_reset(is_hardreset());
 #endif
+	// run-ahead rollback only rewinds emulated chip state, host side
+	// devices, traps and keyboard MCUs must not notice it.
+	if (isrunahead())
+		return;
 	native2amiga_reset();
 #ifdef SCSIEMU
 	scsi_reset();
@@ -381,6 +387,7 @@ void virtualdevice_free(void)
 #ifdef GFXBOARD
 	gfxboard_free();
 #endif
+	drawing_free();
 	savestate_free();
 	memory_cleanup();
 	free_shm();
@@ -34,6 +34,8 @@ int disk_debug_track = -1;
 #include "zfile.h"
 #include "newcpu.h"
 #include "savestate.h"
+#include "threaddep/thread.h"
+#include "mfmcache.h"
 #include "cia.h"
 #include "debug.h"
 #ifdef FDI2RAW
@@ -772,8 +774,11 @@ static void drive_settype_id (drive *drv)
 #endif
 }
 
+static void drive_mfmcache_free(drive *drv);
+
 static void drive_image_free (drive *drv)
 {
+	drive_mfmcache_free(drv);
 	switch (drv->filetype)
 	{
 	case ADF_IPF:
@@ -942,6 +947,7 @@ static void update_drive_gui(int num, bool force)
 }
 
 static void drive_fill_bigbuf(drive *drv, int, int);
+static void drive_mfmcache_init(drive *drv);
 
 void DISK_get_path_text(struct uae_prefs *p, int n, TCHAR *text)
 {
@@ -1770,6 +1776,8 @@ static int drive_insert (drive *drv, struct uae_prefs *p, int dnum, const TCHAR
 	}
 	openwritefile(p, drv, 0);
 	drive_settype_id(drv); /* Set DD or HD drive */
+	if (!fake)
+		drive_mfmcache_init(drv);
 	drive_fill_bigbuf(drv, side, 1);
 	drv->mfmpos = uaerand();
 	drv->mfmpos |= uaerand() << 16;
@@ -2110,17 +2118,17 @@ static uae_u16 *mfmcoder (uae_u8 *src, uae_u16 *dest, int len)
 	return dest;
 }
 
-static void decode_pcdos (drive *drv, int tside)
+static int decode_pcdos (drive *drv, struct zfile *diskfile, int cyl, int tside, uae_u16 *bigmfmbuf, int *skipoffset)
 {
 	int i, len;
-	int tr = drv->cyl * 2 + tside;
+	int tr = cyl * 2 + tside;
 	uae_u16 *dstmfmbuf, *mfm2;
 	uae_u8 secbuf[1000];
 	uae_u16 crc16;
 	trackid *ti = drv->trackdata + tr;
 	int tracklen = 12500;
 
-	mfm2 = drv->bigmfmbuf;
+	mfm2 = bigmfmbuf;
 	*mfm2++ = 0x9254;
 	memset (secbuf, 0x4e, 40);
 	memset (secbuf + 40, 0x00, 12);
@@ -2140,8 +2148,8 @@ static void decode_pcdos (drive *drv, int tside)
 		secbuf[13] = 0xa1;
 		secbuf[14] = 0xa1;
 		secbuf[15] = 0xfe;
-		secbuf[16] = drv->cyl;
-		secbuf[17] = side;
+		secbuf[16] = cyl;
+		secbuf[17] = tside;
 		secbuf[18] = 1 + i;
 		secbuf[19] = 2; // 128 << 2 = 512
 		crc16 = get_crc16(secbuf + 12, 3 + 1 + 4);
@@ -2153,7 +2161,7 @@ static void decode_pcdos (drive *drv, int tside)
 		secbuf[57] = 0xa1;
 		secbuf[58] = 0xa1;
 		secbuf[59] = 0xfb;
-		read_floppy_data (drv->diskfile, drv->filetype, ti, i, &secbuf[60], NULL, 512);
+		read_floppy_data (diskfile, drv->filetype, ti, i, &secbuf[60], NULL, 512);
 		crc16 = get_crc16 (secbuf + 56, 3 + 1 + 512);
 		secbuf[60 + 512] = crc16 >> 8;
 		secbuf[61 + 512] = crc16 & 0xff;
@@ -2168,29 +2176,27 @@ static void decode_pcdos (drive *drv, int tside)
 		mfm2[57] = 0x4489;
 		mfm2[58] = 0x4489;
 	}
-	while (dstmfmbuf - drv->bigmfmbuf < tracklen / 2)
+	while (dstmfmbuf - bigmfmbuf < tracklen / 2)
 		*dstmfmbuf++ = 0x9254;
-	drv->skipoffset = 0;
-	drv->tracklen = addrdiff(dstmfmbuf, drv->bigmfmbuf) * 16;
+	*skipoffset = 0;
 	if (disk_debug_logging > 0)
 		write_log (_T("pcdos read track %d\n"), tr);
+	return addrdiff(dstmfmbuf, bigmfmbuf) * 16;
 }
 
-static void decode_amigados(drive *drv, int tside)
+static int decode_amigados(drive *drv, struct zfile *diskfile, int cyl, int tside, uae_u16 *dstmfmbuf, int *skipoffset)
 {
 	/* Normal AmigaDOS format track */
-	int tr = drv->cyl * 2 + tside;
+	int tr = cyl * 2 + tside;
 	int sec;
 	int dstmfmoffset = 0;
-	uae_u16 *dstmfmbuf = drv->bigmfmbuf;
 	int len = drv->num_secs * 544 + FLOPPY_GAP_LEN;
 	int prevbit;
 
 	trackid *ti = drv->trackdata + tr;
 	memset (dstmfmbuf, 0xaa, len * 2);
 	dstmfmoffset += FLOPPY_GAP_LEN;
-	drv->skipoffset = (FLOPPY_GAP_LEN * 8) / 3 * 2;
-	drv->tracklen = len * 2 * 8;
+	*skipoffset = (FLOPPY_GAP_LEN * 8) / 3 * 2;
 
 	prevbit = 0;
 	for (sec = 0; sec < drv->num_secs; sec++) {
@@ -2211,7 +2217,7 @@ static void decode_amigados(drive *drv, int tside)
 		for (i = 8; i < 24; i++)
 			secbuf[i] = 0;
 
-		read_floppy_data (drv->diskfile, drv->filetype, ti, sec, &secbuf[32], secheadbuf, 512);
+		read_floppy_data (diskfile, drv->filetype, ti, sec, &secbuf[32], secheadbuf, 512);
 
 		mfmbuf[0] = prevbit ? 0x2aaa : 0xaaaa;
 		mfmbuf[1] = 0xaaaa;
@@ -2285,6 +2291,7 @@ static void decode_amigados(drive *drv, int tside)
 
 	if (disk_debug_logging > 0)
 		write_log (_T("amigados read track %d\n"), tr);
+	return len * 2 * 8;
 }
 
 /*
@@ -2298,20 +2305,18 @@ static void decode_amigados(drive *drv, int tside)
 *
 */
 
-static void decode_diskspare(drive *drv, int tside)
+static int decode_diskspare(drive *drv, struct zfile *diskfile, int cyl, int tside, uae_u16 *dstmfmbuf, int *skipoffset)
 {
-	int tr = drv->cyl * 2 + tside;
+	int tr = cyl * 2 + tside;
 	int sec;
 	int dstmfmoffset = 0;
 	int size = 512 + 8;
-	uae_u16 *dstmfmbuf = drv->bigmfmbuf;
 	int len = drv->num_secs * size + FLOPPY_GAP_LEN;
 
 	trackid *ti = drv->trackdata + tr;
 	memset (dstmfmbuf, 0xaa, len * 2);
 	dstmfmoffset += FLOPPY_GAP_LEN;
-	drv->skipoffset = (FLOPPY_GAP_LEN * 8) / 3 * 2;
-	drv->tracklen = len * 2 * 8;
+	*skipoffset = (FLOPPY_GAP_LEN * 8) / 3 * 2;
 
 	for (sec = 0; sec < drv->num_secs; sec++) {
 		uae_u8 secbuf[512 + 8];
@@ -2325,7 +2330,7 @@ static void decode_diskspare(drive *drv, int tside)
 		secbuf[2] = 0;
 		secbuf[3] = 0;
 
-		read_floppy_data (drv->diskfile, drv->filetype, ti, sec, &secbuf[4], NULL, 512);
+		read_floppy_data (diskfile, drv->filetype, ti, sec, &secbuf[4], NULL, 512);
 
 		mfmbuf[0] = 0xaaaa;
 		mfmbuf[1] = 0x4489;
@@ -2372,6 +2377,169 @@ static void decode_diskspare(drive *drv, int tside)
 
 	if (disk_debug_logging > 0)
 		write_log (_T("diskspare read track %d\n"), tr);
+	return len * 2 * 8;
+}
+
+static int decode_sectortrack(drive *drv, struct zfile *diskfile, int cyl, int tside, uae_u16 *mfmbuf, int *skipoffset)
+{
+	trackid *ti = drv->trackdata + cyl * 2 + tside;
+
+	if (ti->type == TRACK_PCDOS)
+		return decode_pcdos(drv, diskfile, cyl, tside, mfmbuf, skipoffset);
+	if (ti->type == TRACK_AMIGADOS)
+		return decode_amigados(drv, diskfile, cyl, tside, mfmbuf, skipoffset);
+	return decode_diskspare(drv, diskfile, cyl, tside, mfmbuf, skipoffset);
+}
+
+/*
+* MFM track cache for sector based tracks (AmigaDOS, PC and DiskSpare).
+*
+* The cache worker encodes tracks from a private copy of the image and of
+* the drive geometry. drive_write_data() copies the written track back into
+* the private image and drops its encoded version.
+*/
+
+#define MFMCACHE_MAX_IMAGE (4 * 1024 * 1024)
+
+struct drive_mfmcache
+{
+	struct mfmcache *mc;
+	struct zfile *shadow; // private copy of the image, NULL if not used
+	struct zfile *diskfile; // image the copy was made from
+	drive *drv; // copy of the drive, worker only uses geometry and trackdata
+};
+
+static struct drive_mfmcache drive_mfmcaches[MAX_FLOPPY_DRIVES];
+
+// same image and geometry as the copy the tracks were encoded from
+static bool drive_mfmcache_usable(struct drive_mfmcache *dc, drive *drv)
+{
+	return dc->shadow && dc->diskfile == drv->diskfile && dc->drv->filetype == drv->filetype
+		&& dc->drv->num_secs == drv->num_secs && dc->drv->ddhd == drv->ddhd;
+}
+
+// called by the cache worker
+static int drive_mfmcache_encode(void *user, int cyl, int side, uae_u16 *mfm, int *skipoffset)
+{
+	struct drive_mfmcache *dc = (struct drive_mfmcache*)user;
+	drive *drv = dc->drv;
+	int type = drv->trackdata[cyl * 2 + side].type;
+
+	if (type != TRACK_PCDOS && type != TRACK_AMIGADOS && type != TRACK_DISKSPARE)
+		return -1;
+	return decode_sectortrack(drv, dc->shadow, cyl, side, mfm, skipoffset);
+}
+
+static void drive_mfmcache_free(drive *drv)
+{
+	struct drive_mfmcache *dc = &drive_mfmcaches[drv->drvnum];
+
+	if (!dc->mc)
+		return;
+	mfmcache_stop(dc->mc);
+	zfile_fclose(dc->shadow);
+	dc->shadow = NULL;
+	dc->diskfile = NULL;
+}
+
+static void drive_mfmcache_init(drive *drv)
+{
+	struct drive_mfmcache *dc = &drive_mfmcaches[drv->drvnum];
+	struct zfile *f;
+
+	drive_mfmcache_free(drv);
+	if (!amiberry_options.floppy_track_cache || !drv->diskfile)
+		return;
+	if (drv->filetype != ADF_NORMAL && drv->filetype != ADF_NORMAL_HEADER && drv->filetype != ADF_EXT1 &&
+		drv->filetype != ADF_EXT2 && drv->filetype != ADF_PCDOS)
+		return;
+	if (zfile_size(drv->diskfile) > MFMCACHE_MAX_IMAGE)
+		return;
+	if (!dc->mc)
+		dc->mc = mfmcache_alloc(MAX_TRACKS, MAXMFMBUF);
+	if (!dc->mc)
+		return;
+	f = zfile_fopen_load_zfile(drv->diskfile);
+	if (!f)
+		return;
+	if (!dc->drv)
+		dc->drv = xmalloc(drive, 1);
+	memcpy(dc->drv, drv, sizeof(drive));
+	dc->shadow = f;
+	dc->diskfile = drv->diskfile;
+	mfmcache_start(dc->mc, drive_mfmcache_encode, dc, drv->num_tracks, drv->cyl);
+}
+
+static bool drive_mfmcache_get(drive *drv, int tr)
+{
+	struct drive_mfmcache *dc = &drive_mfmcaches[drv->drvnum];
+
+	if (!drive_mfmcache_usable(dc, drv))
+		return false;
+	return mfmcache_get(dc->mc, tr, drv->bigmfmbuf, &drv->tracklen, &drv->skipoffset);
+}
+
+static void drive_mfmcache_put(drive *drv, int tr)
+{
+	struct drive_mfmcache *dc = &drive_mfmcaches[drv->drvnum];
+
+	if (drive_mfmcache_usable(dc, drv))
+		mfmcache_put(dc->mc, tr, drv->bigmfmbuf, drv->tracklen, drv->skipoffset);
+}
+
+static void drive_mfmcache_prefetch(drive *drv)
+{
+	struct drive_mfmcache *dc = &drive_mfmcaches[drv->drvnum];
+
+	if (dc->shadow)
+		mfmcache_prefetch(dc->mc, drv->cyl);
+}
+
+static void drive_mfmcache_write_begin(drive *drv)
+{
+	struct drive_mfmcache *dc = &drive_mfmcaches[drv->drvnum];
+
+	if (dc->mc)
+		mfmcache_write_begin(dc->mc);
+}
+
+static bool drive_mfmcache_copy(struct zfile *dst, struct zfile *src, uae_s64 offset, int len)
+{
+	if (offset < 0 || len <= 0)
+		return true;
+	if (offset + len > zfile_size(dst))
+		return false;
+	uae_u8 *buf = xmalloc(uae_u8, len);
+	zfile_fseek(src, offset, SEEK_SET);
+	zfile_fread(buf, 1, len, src);
+	zfile_fseek(dst, offset, SEEK_SET);
+	zfile_fwrite(buf, 1, len, dst);
+	xfree(buf);
+	return true;
+}
+
+// the worker is held off since write_begin, the private copy can be updated
+static void drive_mfmcache_write_end(drive *drv, int tr)
+{
+	struct drive_mfmcache *dc = &drive_mfmcaches[drv->drvnum];
+	bool reload = false;
+
+	if (!dc->mc)
+		return;
+	if (dc->shadow) {
+		trackid *ti = &drv->trackdata[tr];
+		if (dc->diskfile != drv->diskfile || dc->drv->filetype != drv->filetype) {
+			// converted to extended ADF
+			reload = true;
+		} else if (!drive_mfmcache_copy(dc->shadow, drv->diskfile, ti->offs, ti->len) ||
+			(drv->filetype == ADF_NORMAL_HEADER && !drive_mfmcache_copy(dc->shadow, drv->diskfile, ti->extraoffs, 16 * drv->num_secs))) {
+			reload = true;
+		}
+		dc->drv->trackdata[tr] = *ti;
+	}
+	mfmcache_write_end(dc->mc, tr);
+	if (reload)
+		drive_mfmcache_init(drv);
 }
 
 static void drive_fill_bigbuf(drive *drv, int tside, int force)
@@ -2463,17 +2631,13 @@ static void drive_fill_bigbuf(drive *drv, int tside, int force)
 		fdi2raw_loadtrack(drv->fdi, drv->bigmfmbuf, drv->tracktiming, tr, &drv->tracklen, &drv->indexoffset, &drv->multi_revolution, 1);
 #endif
 
-	} else if (ti->type == TRACK_PCDOS) {
-
-		decode_pcdos(drv, tside);
-
-	} else if (ti->type == TRACK_AMIGADOS) {
-
-		decode_amigados(drv, tside);
-
-	} else if (ti->type == TRACK_DISKSPARE) {
+	} else if (ti->type == TRACK_PCDOS || ti->type == TRACK_AMIGADOS || ti->type == TRACK_DISKSPARE) {
 
-		decode_diskspare(drv, tside);
+		if (!drive_mfmcache_get(drv, tr)) {
+			drv->tracklen = decode_sectortrack(drv, drv->diskfile, drv->cyl, tside, drv->bigmfmbuf, &drv->skipoffset);
+			drive_mfmcache_put(drv, tr);
+		}
+		drive_mfmcache_prefetch(drv);
 
 	} else if (ti->type == TRACK_NONE) {
 
@@ -2923,7 +3087,7 @@ static bool convert_adf_to_ext2 (drive *drv, int mode)
 	return true;
 }
 
-static void drive_write_data (drive * drv)
+static void drive_write_data_2 (drive * drv)
 {
 	int ret = -1;
 	int tr = drv->cyl * 2 + side;
@@ -2989,6 +3153,15 @@ static void drive_write_data (drive * drv)
 	drv->tracktiming[0] = 0;
 }
 
+static void drive_write_data (drive * drv)
+{
+	int tr = drv->cyl * 2 + side;
+
+	drive_mfmcache_write_begin(drv);
+	drive_write_data_2(drv);
+	drive_mfmcache_write_end(drv, tr);
+}
+
 static void drive_eject (drive * drv)
 {
 #ifdef DRIVESOUND
@@ -3482,6 +3655,19 @@ int disk_empty (int num)
 	return drive_empty (floppy + num);
 }
 
+// true if a track written now would go to a host image file
+bool disk_writable (void)
+{
+	for (int i = 0; i < MAX_FLOPPY_DRIVES; i++) {
+		drive *drv = floppy + i;
+		if (currprefs.floppyslots[i].dfxtype < 0 || drive_empty (drv))
+			continue;
+		if (!drive_writeprotected (drv))
+			return true;
+	}
+	return false;
+}
+
 static TCHAR *tobin (uae_u8 v)
 {
 	static TCHAR buf[9];
@@ -5936,7 +6122,7 @@ uae_u8 *restore_disk (int num,uae_u8 *src)
 		xfree(s);
 		s = restore_path_full();
 	}
-	if (s && s[0])
+	if (s && s[0] && !isrunahead())
 		write_log(_T("-> '%s'\n"), s);
 	_tcscpy(old, currprefs.floppyslots[num].df);
 	_tcsncpy(changed_prefs.floppyslots[num].df, s, MAX_DPATH);
@@ -5947,6 +6133,8 @@ uae_u8 *restore_disk (int num,uae_u8 *src)
 		if (!newis && old[0]) {
 			*currprefs.floppyslots[num].df = *changed_prefs.floppyslots[num].df = 0;
 			drv->dskchange = false;
+		} else if (newis && isrunahead() && !_tcscmp(old, changed_prefs.floppyslots[num].df) && !drive_empty(floppy + num)) {
+			// run-ahead rollback, the same image is still inserted
 		} else if (newis) {
 			drive_insert (floppy + num, &currprefs, num, changed_prefs.floppyslots[num].df, false, false);
 			if (drive_empty (floppy + num)) {
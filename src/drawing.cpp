@@ -39,6 +39,7 @@
 #endif
 #include "devices.h"
 #include "gfxboard.h"
+#include "benchmark.h"
 
 #define ENABLE_MULTITHREADED_DENISE 1
 
@@ -67,11 +68,12 @@ extern int multithread_enabled;
 #define GENLOCK_EXTRA_CLEAR 8
 #define MAX_RGA_OVERLAPPING_CYCLES 5
 
-uae_u8 *xlinebuffer, *xlinebuffer2;
-uae_u8 *xlinebuffer_genlock;
-static uae_u8 *xlinebuffer_start, *xlinebuffer_end;
-static uae_u8 *xlinebuffer2_start, *xlinebuffer2_end;
-static uae_u8 *xlinebuffer_genlock_start, *xlinebuffer_genlock_end;
+// line output state is per thread, fast path lines can be drawn by the line pool
+thread_local uae_u8 *xlinebuffer, *xlinebuffer2;
+thread_local uae_u8 *xlinebuffer_genlock;
+static thread_local uae_u8 *xlinebuffer_start, *xlinebuffer_end;
+static thread_local uae_u8 *xlinebuffer2_start, *xlinebuffer2_end;
+static thread_local uae_u8 *xlinebuffer_genlock_start, *xlinebuffer_genlock_end;
 
 static int *amiga2aspect_line_map, *native2amiga_line_map;
 static int native2amiga_line_map_height;
@@ -108,7 +110,27 @@ struct denise_rga_queue
 	uae_u16 reg, val;
 };
 
-static volatile uae_atomic rga_queue_read, rga_queue_write;
+/*
+ * Chipset -> Denise thread queue is a single producer/single consumer ring.
+ * Indices live on their own cache lines and are only touched with atomics,
+ * entries are published in batches (per line segment) and the semaphores
+ * are only posted when the other side has actually parked after spinning.
+ */
+#define DENISE_QUEUE_CACHE_LINE 64
+#define DENISE_QUEUE_SPIN 4000
+
+struct denise_queue_index
+{
+	volatile uae_atomic v;
+	uae_u8 pad[DENISE_QUEUE_CACHE_LINE - sizeof(uae_atomic)];
+};
+
+static struct denise_queue_index rga_queue_read __attribute__((aligned(DENISE_QUEUE_CACHE_LINE)));
+static struct denise_queue_index rga_queue_write __attribute__((aligned(DENISE_QUEUE_CACHE_LINE)));
+static struct denise_queue_index denise_reader_parked __attribute__((aligned(DENISE_QUEUE_CACHE_LINE)));
+static struct denise_queue_index denise_writer_parked __attribute__((aligned(DENISE_QUEUE_CACHE_LINE)));
+// producer private: next free slot, published to rga_queue_write in batches
+static uae_atomic rga_queue_write_next;
 static int denise_thread_state;
 static struct denise_rga_queue rga_queue[DENISE_RGA_SLOT_CHUNKS];
 static struct denise_rga_queue temp_line;
@@ -124,6 +146,14 @@ static void draw_denise_line(int gfx_ypos, nln_how how, uae_u32 linecnt, int sta
 static void sprwrite(int reg, uae_u32 v);
 static int spr_unalign_reg, spr_unalign_val;
 
+// set while the current thread draws a line for the line pool
+static thread_local bool line_pool_job;
+static bool denise_line_pool_add(struct denise_rga_queue *q);
+static void denise_line_pool_sync(void);
+static void denise_line_pool_help(void);
+static void denise_line_pool_update(void);
+static void denise_line_pool_reset(bool hard);
+
 static void quick_denise_rga(uae_u32 linecnt, int startpos, int endpos)
 {
 	int pos = startpos;
@@ -150,17 +180,85 @@ static void update_overlapped_cycles(int endpos)
 	}
 }
 
+static inline void denise_queue_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__) || (defined(__arm__) && defined(__ARM_ARCH) && __ARM_ARCH >= 7)
+	__asm__ __volatile__("yield");
+#endif
+}
+
+static inline uae_atomic denise_queue_get(struct denise_queue_index *idx)
+{
+	return __atomic_load_n(&idx->v, __ATOMIC_ACQUIRE);
+}
+
+static inline void denise_queue_set(struct denise_queue_index *idx, uae_atomic v)
+{
+	__atomic_store_n(&idx->v, v, __ATOMIC_SEQ_CST);
+}
+
+// wake up the other side only if it went to sleep
+static inline void denise_queue_wake(struct denise_queue_index *parked, uae_sem_t *sem)
+{
+	if (__atomic_load_n(&parked->v, __ATOMIC_SEQ_CST) && __atomic_exchange_n(&parked->v, 0, __ATOMIC_SEQ_CST)) {
+		uae_sem_post(sem);
+	}
+}
+
+static inline void denise_atomic_max(int *p, int v)
+{
+	int o = __atomic_load_n(p, __ATOMIC_RELAXED);
+	while (v > o && !__atomic_compare_exchange_n(p, &o, v, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+static inline void denise_atomic_min(int *p, int v)
+{
+	int o = __atomic_load_n(p, __ATOMIC_RELAXED);
+	while (v < o && !__atomic_compare_exchange_n(p, &o, v, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+// spin, then sleep until *idx no longer equals seen
+static void denise_queue_wait(struct denise_queue_index *idx, uae_atomic seen, struct denise_queue_index *parked, uae_sem_t *sem, int timeout)
+{
+	for (int i = 0; i < DENISE_QUEUE_SPIN; i++) {
+		if (denise_queue_get(idx) != seen) {
+			return;
+		}
+		denise_queue_relax();
+	}
+	for (;;) {
+		__atomic_store_n(&parked->v, 1, __ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&idx->v, __ATOMIC_SEQ_CST) != seen) {
+			__atomic_store_n(&parked->v, 0, __ATOMIC_SEQ_CST);
+			return;
+		}
+		if (timeout > 0) {
+			uae_sem_trywait_delay(sem, timeout);
+		} else {
+			uae_sem_wait(sem);
+		}
+		if (denise_queue_get(idx) != seen) {
+			return;
+		}
+	}
+}
+
 static void read_denise_line_queue(void)
 {
 	bool nolock = false;
+	uae_atomic rp = rga_queue_read.v;
 
-	while (rga_queue_read == rga_queue_write) {
-		uae_sem_wait(&write_sem);
+	if (denise_queue_get(&rga_queue_write) == rp) {
+		denise_line_pool_help();
+		denise_queue_wait(&rga_queue_write, rp, &denise_reader_parked, &write_sem, 0);
 	}
 
-	struct denise_rga_queue *q = &rga_queue[rga_queue_read & DENISE_RGA_SLOT_CHUNKS_MASK];
+	struct denise_rga_queue *q = &rga_queue[rp & DENISE_RGA_SLOT_CHUNKS_MASK];
 	this_line = q;
 	bool next = false;
+	uae_s64 bench_start = benchmark_running ? benchmark_clock() : 0;
 
 	//evt_t t1 = read_processor_time();
 
@@ -169,7 +267,9 @@ static void read_denise_line_queue(void)
 #endif
 
 
-	if (q->type == 0) {
+	if (denise_line_pool_add(q)) {
+		// drawn by the line pool
+	} else if (q->type == 0) {
 		draw_denise_line(q->gfx_ypos, q->how, q->linecnt, q->startpos, q->startcycle, q->endcycle, q->skip, q->skip2, q->dtotal, q->calib_start, q->calib_len, q->lol, q->hdelay, q->blanked, q->finalseg, q->ls);
 		next = q->finalseg;
 	} else if (q->type == 1) {
@@ -183,6 +283,7 @@ static void read_denise_line_queue(void)
 		next = true;
 		nolock = true;
 	} else if (q->type == 5) {
+		denise_line_pool_update();
 		draw_denise_vsync(q->erase);
 		nolock = true;
 	} else if (q->type == 6) {
@@ -210,15 +311,19 @@ static void read_denise_line_queue(void)
 		update_overlapped_cycles(q->endpos);
 	}
 
+	if (bench_start) {
+		benchmark_denise_add(benchmark_clock() - bench_start);
+	}
+
 	if (!nolock) {
 		if (!thread_debug_lock) {
 			write_log("read_denise_line_queue: queue lock was released during draw!\n");
 		}
 	}
 
-	atomic_inc(&rga_queue_read);
+	denise_queue_set(&rga_queue_read, rp + 1);
 
-	uae_sem_post(&read_sem);
+	denise_queue_wake(&denise_writer_parked, &read_sem);
 }
 
 static int denise_thread(void *v)
@@ -272,6 +377,8 @@ typedef enum
 static void select_lts(void);
 
 static uae_u32 ham_lastcolor;
+// fast path HAM decoder state, per thread
+static thread_local uae_u32 ham_lastcolor_fast;
 
 int debug_bpl_mask = 0xff, debug_bpl_mask_one;
 
@@ -321,8 +428,15 @@ static int sprite_offs[256];
 /* OCS/ECS color lookup table. */
 xcolnr xcolors[4096];
 
-static int chunky_out_prev_len;
-static uae_u32 chunky_out[4096], dpf_chunky_out[4096];
+struct denise_line_scratch
+{
+	int chunky_out_prev_len;
+	uae_u32 chunky_out[4096], dpf_chunky_out[4096];
+	uae_u8 row_tmp[MAX_PIXELS_PER_LINE * 32 / 8];
+	uae_u32 debug_bufx[256 * 2 * 4];
+};
+static struct denise_line_scratch denise_line_scratch_main;
+static thread_local struct denise_line_scratch *line_scratch = &denise_line_scratch_main;
 
 #ifdef AGA
 /* AGA mode color lookup tables */
@@ -511,13 +625,14 @@ static int denise_spr_nearestcnt;
 
 static int denise_y_start, denise_y_end;
 
-static int denise_pixtotal, denise_pixtotalv, denise_linecnt, denise_startpos, denise_cck, denise_endcycle;
+static thread_local int denise_pixtotal;
+static int denise_pixtotalv, denise_linecnt, denise_startpos, denise_cck, denise_endcycle;
 static int denise_pixtotalskip, denise_pixtotalskip2, denise_hdelay;
-static int denise_pixtotal_max;
-static uae_u32 *buf1, *buf2, *buf_d;
-static uae_u8 *gbuf;
+static thread_local int denise_pixtotal_max;
+static thread_local uae_u32 *buf1, *buf2, *buf_d;
+static thread_local uae_u8 *gbuf;
 static uae_u8 pixx0, pixx1, pixx2, pixx3;
-static uae_u32 debug_buf[256 * 2 * 4], debug_bufx[256 * 2 * 4];
+static uae_u32 debug_buf[256 * 2 * 4];
 static int hbstrt_offset, hbstop_offset;
 static int hstrt_offset, hstop_offset;
 static int bpl1dat_trigger_offset;
@@ -2455,7 +2570,10 @@ void drawing_init(void)
 	xlinebuffer2 = NULL;
 	xlinebuffer_genlock = NULL;
 
-	ad->inhibit_frame = 0;
+	// a run-ahead rollback keeps what the user and the host window asked for
+	if (!isrunahead()) {
+		ad->inhibit_frame = 0;
+	}
 
 	gfxbuffer_reset(0);
 	reset_drawing();
@@ -3487,15 +3605,17 @@ void denise_reset(bool hard)
 	custom_end_drawing();
 	dummyint = 0;
 	memset(&dummydrec, 0, sizeof(dummydrec));
-	memset(chunky_out, 0, sizeof(chunky_out));
-	memset(dpf_chunky_out, 0, sizeof(dpf_chunky_out));
+	// restored states keep the workers, they are idle at this point
+	denise_line_pool_reset(hard && !isrestore());
 	debug_dma_dhpos_odd = &dummyint;
 	debug_dma_ptr = &dummydrec;
 	denise_cycle_half = 0;
 	denise_strlong = false;
 	denise_strlong_fast = false;
 	rga_denise_fast_read = rga_denise_fast_write = 0;
-	rga_queue_write = rga_queue_read = 0;
+	rga_queue_write_next = 0;
+	denise_queue_set(&rga_queue_write, 0);
+	denise_queue_set(&rga_queue_read, 0);
 	denise_lol_shift_enable = false;
 	denise_lol_shift_prev = 0;
 	if (hard) {
@@ -4210,23 +4330,23 @@ static uae_u32 decode_ham_pixel_aga_fast(uint8_t pw, int planes, uae_u8 bxor, ua
 		int pc = pv >> 2;
 		switch (pv & 0x3)
 		{
-			case 0x0: ham_lastcolor = colors_aga[pc]; break;
-			case 0x1: ham_lastcolor &= 0xFFFF03; ham_lastcolor |= (pw & 0xFC); break;
-			case 0x2: ham_lastcolor &= 0x03FFFF; ham_lastcolor |= (pw & 0xFC) << 16; break;
-			case 0x3: ham_lastcolor &= 0xFF03FF; ham_lastcolor |= (pw & 0xFC) << 8; break;
+			case 0x0: ham_lastcolor_fast = colors_aga[pc]; break;
+			case 0x1: ham_lastcolor_fast &= 0xFFFF03; ham_lastcolor_fast |= (pw & 0xFC); break;
+			case 0x2: ham_lastcolor_fast &= 0x03FFFF; ham_lastcolor_fast |= (pw & 0xFC) << 16; break;
+			case 0x3: ham_lastcolor_fast &= 0xFF03FF; ham_lastcolor_fast |= (pw & 0xFC) << 8; break;
 		}
 	} else { /* AGA mode HAM6 */
 		int pv = pw ^ bxor;
 		uae_u32 pc = ((pw & 0xf) << 0) | ((pw & 0xf) << 4);
 		switch (pv & 0x30)
 		{
-			case 0x00: ham_lastcolor = colors_aga[pv & 0x0f]; break;
-			case 0x10: ham_lastcolor &= 0xFFFF00; ham_lastcolor |= pc << 0; break;
-			case 0x20: ham_lastcolor &= 0x00FFFF; ham_lastcolor |= pc << 16; break;
-			case 0x30: ham_lastcolor &= 0xFF00FF; ham_lastcolor |= pc << 8; break;
+			case 0x00: ham_lastcolor_fast = colors_aga[pv & 0x0f]; break;
+			case 0x10: ham_lastcolor_fast &= 0xFFFF00; ham_lastcolor_fast |= pc << 0; break;
+			case 0x20: ham_lastcolor_fast &= 0x00FFFF; ham_lastcolor_fast |= pc << 16; break;
+			case 0x30: ham_lastcolor_fast &= 0xFF00FF; ham_lastcolor_fast |= pc << 8; break;
 		}
 	}
-	return CONVERT_RGB(ham_lastcolor);
+	return CONVERT_RGB(ham_lastcolor_fast);
 }
 
 // OCS/ECS HAM
@@ -4235,12 +4355,12 @@ static uae_u32 decode_ham_pixel_fast(uint8_t pv, uae_u16 *colors_ocs)
 	/* OCS/ECS mode HAM6 */
 	switch (pv & 0x30)
 	{
-		case 0x00: ham_lastcolor = colors_ocs[pv]; break;
-		case 0x10: ham_lastcolor &= 0xFF0; ham_lastcolor |= (pv & 0xF); break;
-		case 0x20: ham_lastcolor &= 0x0FF; ham_lastcolor |= (pv & 0xF) << 8; break;
-		case 0x30: ham_lastcolor &= 0xF0F; ham_lastcolor |= (pv & 0xF) << 4; break;
+		case 0x00: ham_lastcolor_fast = colors_ocs[pv]; break;
+		case 0x10: ham_lastcolor_fast &= 0xFF0; ham_lastcolor_fast |= (pv & 0xF); break;
+		case 0x20: ham_lastcolor_fast &= 0x0FF; ham_lastcolor_fast |= (pv & 0xF) << 8; break;
+		case 0x30: ham_lastcolor_fast &= 0xF0F; ham_lastcolor_fast |= (pv & 0xF) << 4; break;
 	}
-	return xcolors[ham_lastcolor];
+	return xcolors[ham_lastcolor_fast];
 }
 
 // AGA HAM
@@ -5605,7 +5725,7 @@ static void get_line(int monid, int gfx_ypos, enum nln_how how, int lol_shift_pr
 	}
 
 	if (gfx_ypos >= 0 && gfx_ypos < vb->inheight) {
-		denise_y_end = gfx_ypos + 1;
+		int y_end = gfx_ypos + 1;
 		switch (how)
 		{
 			case nln_lower_black_always:
@@ -5626,17 +5746,22 @@ static void get_line(int monid, int gfx_ypos, enum nln_how how, int lol_shift_pr
 				xlinebuffer2 = xlinebuffer;
 				xlinebuffer2_start = xlinebuffer_start;
 				xlinebuffer2_end = xlinebuffer_end;
-				denise_y_end++;
+				y_end++;
 			}
 			break;
 			case nln_nblack:
 			if (gfx_ypos + 1 < vb->inheight) {
 				setxlinebuffer(0, gfx_ypos + 1);
 				memset(xlinebuffer, 0, vb->inwidth * vb->pixbytes);
-				denise_y_end++;
+				y_end++;
 			}
 			break;
 		}
+		if (line_pool_job) {
+			denise_atomic_max(&denise_y_end, y_end);
+		} else {
+			denise_y_end = y_end;
+		}
 		setxlinebuffer(0, gfx_ypos);
 		xshift = linetoscr_x_adjust >> hresolution;
 		denise_pixtotal -= xshift;
@@ -5649,7 +5774,7 @@ static void get_line(int monid, int gfx_ypos, enum nln_how how, int lol_shift_pr
 		xlinebuffer2_end = xlinebuffer_end;
 	}
 	buf2 = (uae_u32*)xlinebuffer2;
-	buf_d = debug_bufx;
+	buf_d = line_scratch->debug_bufx;
 	gbuf = xlinebuffer_genlock;
 
 	if (buf1) {
@@ -5727,10 +5852,10 @@ static void denise_draw_update(void)
 	denise_max_odd_even = denise_odd_even;
 }
 
-static uae_u32 *buf1t;
-static uae_u32 *buf2t;
-static uae_u32 *bufdt;
-static uae_u8 *bufg;
+static thread_local uae_u32 *buf1t;
+static thread_local uae_u32 *buf2t;
+static thread_local uae_u32 *bufdt;
+static thread_local uae_u8 *bufg;
 
 static void edgeblanking(int hbstrt_offset, int hbstop_offset, int internal_pixel_start_cnt, bool strlong_seen, bool lol, int lol_shift_prev)
 {
@@ -6129,10 +6254,14 @@ static void draw_denise_line(int gfx_ypos, enum nln_how how, uae_u32 linecnt, in
 #include "linetoscr_aga_fm1_genlock.cpp"
 #include "linetoscr_aga_fm2_genlock.cpp"
 #include "linetoscr_ecs_shres.cpp"
+// fast path lines collect collision bits per thread, merged when the line is done
+static thread_local uae_u16 line_clxdat;
+#define clxdat line_clxdat
 #include "linetoscr_ecs_fast.cpp"
 #include "linetoscr_aga_fast.cpp"
 #include "linetoscr_ecs_genlock_fast.cpp"
 #include "linetoscr_aga_genlock_fast.cpp"
+#undef clxdat
 
 // select linetoscr routine
 static void select_lts(void)
@@ -7027,9 +7156,9 @@ void draw_denise_border_line_fast(int gfx_ypos, bool blank, enum nln_how how, st
 	get_line(0, gfx_ypos, how, ls->lol_shift_prev);
 
 	if (!buf1 && !ls->blankedline && denise_planes > 0 && !blank) {
-		resolution_count[denise_res]++;
+		__atomic_fetch_add(&resolution_count[denise_res], 1, __ATOMIC_RELAXED);
 	}
-	lines_count++;
+	__atomic_fetch_add(&lines_count, 1, __ATOMIC_RELAXED);
 
 	if (!buf1) {
 		return;
@@ -7142,9 +7271,9 @@ void draw_denise_bitplane_line_fast(int gfx_ypos, enum nln_how how, struct lines
 	//write_log("* %d %d\n", gfx_ypos, vpos);
 
 	if (!buf1 && !ls->blankedline && denise_planes > 0) {
-		resolution_count[denise_res]++;
+		__atomic_fetch_add(&resolution_count[denise_res], 1, __ATOMIC_RELAXED);
 	}
-	lines_count++;
+	__atomic_fetch_add(&lines_count, 1, __ATOMIC_RELAXED);
 
 
 	if (!buf1) {
@@ -7170,8 +7299,7 @@ void draw_denise_bitplane_line_fast(int gfx_ypos, enum nln_how how, struct lines
 	int mode = CMODE_NORMAL;
 	if (ham) {
 		mode = CMODE_HAM;
-		last_bpl_pix = 0;
-		setlasthamcolor();
+		ham_lastcolor_fast = aga_mode ? denise_colors.color_regs_aga[0] : denise_colors.color_regs_ecs[0];
 	} else if (dpf) {
 		mode = CMODE_DUALPF;
 	} else if (ehb) {
@@ -7209,15 +7337,16 @@ void draw_denise_bitplane_line_fast(int gfx_ypos, enum nln_how how, struct lines
 		}
 	}
 
-	uae_u32 *cstart = chunky_out + 1024;
+	struct denise_line_scratch *ds = line_scratch;
+	uae_u32 *cstart = ds->chunky_out + 1024;
 	int len = (ls->bpllen + 3) / 4;
 	int byteoutlen = len * 8 * 4;
 	pfield_doline_8(planecnt, len, (uae_u8*)cstart, ls);
 	// if previous line was longer: clear the unused part
-	if (chunky_out_prev_len > byteoutlen) {
-		memset((uae_u8*)cstart + byteoutlen, 0, chunky_out_prev_len - byteoutlen);
+	if (ds->chunky_out_prev_len > byteoutlen) {
+		memset((uae_u8*)cstart + byteoutlen, 0, ds->chunky_out_prev_len - byteoutlen);
 	}
-	chunky_out_prev_len = byteoutlen;
+	ds->chunky_out_prev_len = byteoutlen;
 
 	bool ecsena = ecs_denise && (ls->bplcon0 & 1) != 0;
 	bool brdblank = (ls->bplcon3 & 0x20) && ecsena;
@@ -7284,7 +7413,7 @@ void draw_denise_bitplane_line_fast(int gfx_ypos, enum nln_how how, struct lines
 		cp2 -= byteshift2;
 		// different bitplane delay in DPF? Merge them.
 		if (cp != cp2) {
-			uae_u8 *dpout = (uae_u8*)(dpf_chunky_out + 1024);
+			uae_u8 *dpout = (uae_u8*)(ds->dpf_chunky_out + 1024);
 			for (int i = 0; i < len * 8 + 7; i++) {
 				uae_u32 pix0 = ((uae_u32*)cp)[i];
 				uae_u32 pix1 = ((uae_u32*)cp2)[i];
@@ -7370,10 +7499,10 @@ void draw_denise_bitplane_line_fast(int gfx_ypos, enum nln_how how, struct lines
 
 	// if horizontal shift is large enough to skip part of hdiw or bitplane, draw them to temp buffer.
 	if (draw_startoffset > bpl1dat_trigger_offset || draw_startoffset > hbstop_offset || draw_startoffset > hstrt_offset) {
-		buf1 = (uae_u32*)row_tmp8;
-		buf2 = (uae_u32*)row_tmp8;
+		buf1 = (uae_u32*)ds->row_tmp;
+		buf2 = (uae_u32*)ds->row_tmp;
 		int end = draw_startoffset;
-		int cnt = ltsf_init(draw_start, draw_startoffset, &end, hbstrt_offset, hbstop_offset, bpl1dat_trigger_offset, row_tmp8 + sizeof(row_tmp8), buf1);
+		int cnt = ltsf_init(draw_start, draw_startoffset, &end, hbstrt_offset, hbstop_offset, bpl1dat_trigger_offset, ds->row_tmp + sizeof(ds->row_tmp), buf1);
 		ltsf(cnt, end, hbstrt_offset, hbstop_offset, hstrt_offset, hstop_offset, bpl1dat_trigger_offset,
 			planecnt, bgcol, &cp, &cp2, 1 << cpadd, cpadds, 1 << bufadd, ls);
 		draw_start = draw_startoffset;
@@ -7424,11 +7553,19 @@ void draw_denise_bitplane_line_fast(int gfx_ypos, enum nln_how how, struct lines
 		memset(gbuf, 0, total);
 	}
 
-	if (ls->hstop_offset > diwlastword_total && ls->bpl1dat_trigger_offset >= 0) {
-		diwlastword_total = ls->hstop_offset;
+	if (ls->bpl1dat_trigger_offset >= 0) {
+		denise_atomic_max(&diwlastword_total, ls->hstop_offset);
+		denise_atomic_min(&diwfirstword_total, ls->hstrt_offset);
+	}
+
+	if (line_clxdat) {
+		__atomic_fetch_or(&clxdat, line_clxdat, __ATOMIC_RELAXED);
+		line_clxdat = 0;
 	}
-	if (ls->hstrt_offset < diwfirstword_total && ls->bpl1dat_trigger_offset >= 0) {
-		diwfirstword_total = ls->hstrt_offset;
+	// pool jobs leave the shared HAM state alone, the accurate path reloads it at the next DIW start
+	if (ham && !line_pool_job) {
+		last_bpl_pix = 0;
+		ham_lastcolor = ham_lastcolor_fast;
 	}
 
 #else
@@ -7602,10 +7739,295 @@ static void updatelinedata(void)
 	this_line->linear_vpos = linear_vpos;
 }
 
+/*
+ * Line pool. Fast path lines (queue types 1 and 2) only depend on their
+ * linestate snapshot, the color table it points to and Denise state that is
+ * only changed by other queue entries. The Denise thread hands them to the
+ * pool and keeps going, any other entry first waits until every handed out
+ * line has been drawn. Workers and the Denise thread claim lines from one
+ * shared index, whichever thread is free takes the next line.
+ * draw_denise_line_queue_flush() also waits for the pool, color table reuse
+ * and end of frame handling don't need to know about it.
+ */
+#define DENISE_LINE_POOL_MAX_THREADS 7
+#define DENISE_LINE_POOL_SIZE 32
+#define DENISE_LINE_POOL_MASK (DENISE_LINE_POOL_SIZE - 1)
+
+struct denise_line_pool_job
+{
+	int type;
+	int gfx_ypos;
+	nln_how how;
+	bool blanked;
+	struct linestate *ls;
+	volatile uae_atomic busy;
+};
+
+struct denise_line_pool_worker
+{
+	struct denise_queue_index parked __attribute__((aligned(DENISE_QUEUE_CACHE_LINE)));
+	uae_sem_t sem;
+	int num;
+	volatile int quit;
+	volatile int state;
+	struct denise_line_scratch *scratch;
+};
+
+static struct denise_queue_index line_pool_submitted __attribute__((aligned(DENISE_QUEUE_CACHE_LINE)));
+static struct denise_queue_index line_pool_claimed __attribute__((aligned(DENISE_QUEUE_CACHE_LINE)));
+static struct denise_queue_index line_pool_done __attribute__((aligned(DENISE_QUEUE_CACHE_LINE)));
+static struct denise_queue_index line_pool_owner_parked __attribute__((aligned(DENISE_QUEUE_CACHE_LINE)));
+static struct denise_queue_index line_pool_flush_parked __attribute__((aligned(DENISE_QUEUE_CACHE_LINE)));
+static uae_sem_t line_pool_owner_sem, line_pool_flush_sem;
+static struct denise_line_pool_job line_pool[DENISE_LINE_POOL_SIZE];
+static struct denise_line_pool_worker *line_pool_workers[DENISE_LINE_POOL_MAX_THREADS];
+static int line_pool_started;
+static volatile int line_pool_active;
+// Denise thread only: lines handed out since last sync and the last output row they touch
+static bool line_pool_used;
+static int line_pool_row_end;
+
+// claim and draw one line, false if nothing is left to claim
+static bool denise_line_pool_run(void)
+{
+	uae_atomic c = denise_queue_get(&line_pool_claimed);
+	for (;;) {
+		if (c == denise_queue_get(&line_pool_submitted)) {
+			return false;
+		}
+		if (__atomic_compare_exchange_n(&line_pool_claimed.v, &c, c + 1, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+			break;
+		}
+	}
+
+	struct denise_line_pool_job *j = &line_pool[c & DENISE_LINE_POOL_MASK];
+	uae_s64 bench_start = benchmark_running ? benchmark_clock() : 0;
+	line_pool_job = true;
+	if (j->type == 1) {
+		draw_denise_bitplane_line_fast(j->gfx_ypos, j->how, j->ls);
+	} else {
+		draw_denise_border_line_fast(j->gfx_ypos, j->blanked, j->how, j->ls);
+	}
+	line_pool_job = false;
+	if (bench_start) {
+		benchmark_denise_add(benchmark_clock() - bench_start);
+	}
+
+	__atomic_store_n(&j->busy, 0, __ATOMIC_RELEASE);
+	__atomic_add_fetch(&line_pool_done.v, 1, __ATOMIC_SEQ_CST);
+	denise_queue_wake(&line_pool_owner_parked, &line_pool_owner_sem);
+	denise_queue_wake(&line_pool_flush_parked, &line_pool_flush_sem);
+	return true;
+}
+
+// Denise thread: draw a line or sleep until one completes
+static void denise_line_pool_step(void)
+{
+	uae_atomic d = denise_queue_get(&line_pool_done);
+	if (d == line_pool_submitted.v) {
+		return;
+	}
+	if (!denise_line_pool_run()) {
+		denise_queue_wait(&line_pool_done, d, &line_pool_owner_parked, &line_pool_owner_sem, 500);
+	}
+}
+
+static void denise_line_pool_sync(void)
+{
+	if (!line_pool_used) {
+		return;
+	}
+	while (denise_queue_get(&line_pool_done) != line_pool_submitted.v) {
+		denise_line_pool_step();
+	}
+	line_pool_used = false;
+}
+
+// queue is empty, help the workers instead of sleeping
+static void denise_line_pool_help(void)
+{
+	if (line_pool_used) {
+		while (denise_line_pool_run());
+	}
+}
+
+// hand a fast path line to the pool, otherwise wait until the pool is idle and return false
+static bool denise_line_pool_add(struct denise_rga_queue *q)
+{
+	if (!line_pool_active || (q->type != 1 && q->type != 2) || !q->ls || q->ls->strlong_seen || erase_next_draw ||
+		(q->type == 1 && currprefs.gfx_lores_mode)) {
+		denise_line_pool_sync();
+		return false;
+	}
+
+	int row_start = q->gfx_ypos;
+	int row_end = q->gfx_ypos;
+	if (q->how == nln_upper_black_always) {
+		row_start--;
+	} else if (q->how == nln_lower_black_always || q->how == nln_doubled || q->how == nln_nblack) {
+		row_end++;
+	}
+	// lines in flight must never share an output row
+	if (line_pool_used && row_start <= line_pool_row_end) {
+		denise_line_pool_sync();
+	}
+
+	// keep the drawing lag small, lines read chip RAM when they are drawn
+	uae_atomic sub = line_pool_submitted.v;
+	uae_atomic limit = (line_pool_active + 1) * 2;
+	struct denise_line_pool_job *j = &line_pool[sub & DENISE_LINE_POOL_MASK];
+	while (sub - denise_queue_get(&line_pool_done) >= limit || __atomic_load_n(&j->busy, __ATOMIC_ACQUIRE)) {
+		denise_line_pool_step();
+	}
+
+	j->type = q->type;
+	j->gfx_ypos = q->gfx_ypos;
+	j->how = q->how;
+	j->blanked = q->blanked;
+	j->ls = q->ls;
+	j->busy = 1;
+	line_pool_used = true;
+	line_pool_row_end = row_end;
+	denise_queue_set(&line_pool_submitted, sub + 1);
+
+	for (int i = 0; i < line_pool_active; i++) {
+		denise_queue_wake(&line_pool_workers[i]->parked, &line_pool_workers[i]->sem);
+	}
+	return true;
+}
+
+// like denise_queue_wait() on line_pool_submitted, also returns when the worker is stopped
+static void denise_line_pool_idle(struct denise_line_pool_worker *w, uae_atomic seen)
+{
+	for (int i = 0; i < DENISE_QUEUE_SPIN; i++) {
+		if (denise_queue_get(&line_pool_submitted) != seen || w->quit) {
+			return;
+		}
+		denise_queue_relax();
+	}
+	__atomic_store_n(&w->parked.v, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&line_pool_submitted.v, __ATOMIC_SEQ_CST) == seen && !__atomic_load_n(&w->quit, __ATOMIC_SEQ_CST)) {
+		uae_sem_wait(&w->sem);
+	}
+	__atomic_store_n(&w->parked.v, 0, __ATOMIC_SEQ_CST);
+}
+
+static int denise_line_pool_thread(void *v)
+{
+	struct denise_line_pool_worker *w = (struct denise_line_pool_worker*)v;
+
+	line_scratch = w->scratch;
+	w->state = 1;
+	while (!w->quit) {
+		uae_atomic seen = denise_queue_get(&line_pool_submitted);
+		if (w->num < line_pool_active && denise_line_pool_run()) {
+			continue;
+		}
+		denise_line_pool_idle(w, seen);
+	}
+	w->state = -1;
+	return 0;
+}
+
+// Denise thread, pool is idle
+static void denise_line_pool_update(void)
+{
+	int n = std::max(0, std::min(amiberry_options.denise_render_threads, DENISE_LINE_POOL_MAX_THREADS));
+	if (n == line_pool_active) {
+		return;
+	}
+	if (!line_pool_started) {
+		uae_sem_init(&line_pool_owner_sem, 0, 0);
+		uae_sem_init(&line_pool_flush_sem, 0, 0);
+	}
+	while (line_pool_started < n) {
+		struct denise_line_pool_worker *w = xcalloc(struct denise_line_pool_worker, 1);
+		w->num = line_pool_started;
+		w->scratch = xcalloc(struct denise_line_scratch, 1);
+		uae_sem_init(&w->sem, 0, 0);
+		line_pool_workers[line_pool_started++] = w;
+		uae_start_thread(_T("denise line"), denise_line_pool_thread, w, NULL);
+	}
+	write_log(_T("Denise line pool: %d worker threads\n"), n);
+	line_pool_active = n;
+}
+
+// emulation thread, after the Denise thread has caught up
+static void denise_line_pool_flush(void)
+{
+	for (;;) {
+		uae_atomic d = denise_queue_get(&line_pool_done);
+		if (d == denise_queue_get(&line_pool_submitted)) {
+			return;
+		}
+		denise_queue_wait(&line_pool_done, d, &line_pool_flush_parked, &line_pool_flush_sem, 500);
+	}
+}
+
+// pool is idle: stop the workers and free them, the next vsync starts them again if still configured
+static void denise_line_pool_free(void)
+{
+	if (!line_pool_started) {
+		return;
+	}
+	line_pool_active = 0;
+	for (int i = 0; i < line_pool_started; i++) {
+		struct denise_line_pool_worker *w = line_pool_workers[i];
+		__atomic_store_n(&w->quit, 1, __ATOMIC_SEQ_CST);
+		uae_sem_post(&w->sem);
+	}
+	for (int i = 0; i < line_pool_started; i++) {
+		struct denise_line_pool_worker *w = line_pool_workers[i];
+		while (w->state >= 0) {
+			sleep_millis(1);
+		}
+		uae_sem_destroy(&w->sem);
+		xfree(w->scratch);
+		xfree(w);
+		line_pool_workers[i] = NULL;
+	}
+	uae_sem_destroy(&line_pool_owner_sem);
+	uae_sem_destroy(&line_pool_flush_sem);
+	line_pool_started = 0;
+	write_log(_T("Denise line pool: stopped\n"));
+}
+
+static void denise_line_pool_reset(bool hard)
+{
+	if (hard) {
+		denise_line_pool_free();
+	}
+	memset(&denise_line_scratch_main, 0, sizeof(denise_line_scratch_main));
+	for (int i = 0; i < line_pool_started; i++) {
+		memset(line_pool_workers[i]->scratch, 0, sizeof(struct denise_line_scratch));
+	}
+}
+
+void drawing_free(void)
+{
+	draw_denise_line_queue_flush();
+	denise_line_pool_free();
+}
+
+static void denise_queue_publish(void)
+{
+	if (rga_queue_write.v == rga_queue_write_next) {
+		return;
+	}
+	denise_queue_set(&rga_queue_write, rga_queue_write_next);
+	denise_queue_wake(&denise_reader_parked, &write_sem);
+}
+
 static bool waitqueue_nolock(void)
 {
-	while (((rga_queue_write + 1) & DENISE_RGA_SLOT_CHUNKS_MASK) == (rga_queue_read & DENISE_RGA_SLOT_CHUNKS_MASK)) {
-		uae_sem_trywait_delay(&read_sem, 500);
+	for (;;) {
+		uae_atomic rp = denise_queue_get(&rga_queue_read);
+		if (((rga_queue_write_next + 1) & DENISE_RGA_SLOT_CHUNKS_MASK) != (rp & DENISE_RGA_SLOT_CHUNKS_MASK)) {
+			break;
+		}
+		// full: everything pending must be visible before waiting for the reader
+		denise_queue_publish();
+		denise_queue_wait(&rga_queue_read, rp, &denise_writer_parked, &read_sem, 500);
 	}
 	return true;
 }
@@ -7621,11 +8043,14 @@ static bool waitqueue(int id)
 	waitqueue_nolock();
 	return true;
 }
-static void addtowritequeue(void)
+// register updates and other small entries are batched until the next line segment
+static void addtowritequeue(bool publish)
 {
-	atomic_inc(&rga_queue_write);
+	rga_queue_write_next++;
 
-	uae_sem_post(&write_sem);
+	if (publish) {
+		denise_queue_publish();
+	}
 }
 
 void draw_denise_border_line_fast_queue(int gfx_ypos, bool blank, enum nln_how how, struct linestate *ls)
@@ -7636,7 +8061,7 @@ void draw_denise_border_line_fast_queue(int gfx_ypos, bool blank, enum nln_how h
 			return;
 		}
 
-		struct denise_rga_queue *q = &rga_queue[rga_queue_write & DENISE_RGA_SLOT_CHUNKS_MASK];
+		struct denise_rga_queue *q = &rga_queue[rga_queue_write_next & DENISE_RGA_SLOT_CHUNKS_MASK];
 		q->gfx_ypos = gfx_ypos;
 		q->blanked = blank;
 		q->how = how;
@@ -7645,10 +8070,11 @@ void draw_denise_border_line_fast_queue(int gfx_ypos, bool blank, enum nln_how h
 		q->vpos = vpos;
 		q->linear_vpos = linear_vpos;
 
-		addtowritequeue();
+		addtowritequeue(true);
 
 	} else {
 	
+		benchmark_scope bench(BENCH_DRAWING);
 		updatelinedata();
 		draw_denise_border_line_fast(gfx_ypos, blank, how, ls);
 	
@@ -7663,7 +8089,7 @@ void draw_denise_bitplane_line_fast_queue(int gfx_ypos, enum nln_how how, struct
 			return;
 		}
 
-		struct denise_rga_queue *q = &rga_queue[rga_queue_write & DENISE_RGA_SLOT_CHUNKS_MASK];
+		struct denise_rga_queue *q = &rga_queue[rga_queue_write_next & DENISE_RGA_SLOT_CHUNKS_MASK];
 		q->gfx_ypos = gfx_ypos;
 		q->how = how;
 		q->ls = ls;
@@ -7671,10 +8097,11 @@ void draw_denise_bitplane_line_fast_queue(int gfx_ypos, enum nln_how how, struct
 		q->vpos = vpos;
 		q->linear_vpos = linear_vpos;
 
-		addtowritequeue();
+		addtowritequeue(true);
 
 	} else {
 	
+		benchmark_scope bench(BENCH_DRAWING);
 		updatelinedata();
 		draw_denise_bitplane_line_fast(gfx_ypos, how, ls);
 	
@@ -7689,7 +8116,7 @@ void quick_denise_rga_queue(uae_u32 linecnt, int startpos, int endpos)
 			return;
 		}
 
-		struct denise_rga_queue *q = &rga_queue[rga_queue_write & DENISE_RGA_SLOT_CHUNKS_MASK];
+		struct denise_rga_queue *q = &rga_queue[rga_queue_write_next & DENISE_RGA_SLOT_CHUNKS_MASK];
 		q->linecnt = linecnt;
 		q->startpos = startpos;
 		q->endpos = endpos;
@@ -7697,7 +8124,7 @@ void quick_denise_rga_queue(uae_u32 linecnt, int startpos, int endpos)
 		q->vpos = vpos;
 		q->linear_vpos = linear_vpos;
 
-		addtowritequeue();
+		addtowritequeue(false);
 	
 	} else {
 
@@ -7715,7 +8142,7 @@ void denise_handle_quick_strobe_queue(uae_u16 strobe, int strobe_pos, int endpos
 			return;
 		}
 
-		struct denise_rga_queue *q = &rga_queue[rga_queue_write & DENISE_RGA_SLOT_CHUNKS_MASK];
+		struct denise_rga_queue *q = &rga_queue[rga_queue_write_next & DENISE_RGA_SLOT_CHUNKS_MASK];
 		q->strobe = strobe;
 		q->strobe_pos = strobe_pos;
 		q->endpos = endpos;
@@ -7723,7 +8150,7 @@ void denise_handle_quick_strobe_queue(uae_u16 strobe, int strobe_pos, int endpos
 		q->vpos = vpos;
 		q->linear_vpos = linear_vpos;
 
-		addtowritequeue();
+		addtowritequeue(true);
 
 	} else {
 
@@ -7742,7 +8169,7 @@ void draw_denise_line_queue(int gfx_ypos, nln_how how, uae_u32 linecnt, int star
 			return;
 		}
 
-		struct denise_rga_queue *q = &rga_queue[rga_queue_write & DENISE_RGA_SLOT_CHUNKS_MASK];
+		struct denise_rga_queue *q = &rga_queue[rga_queue_write_next & DENISE_RGA_SLOT_CHUNKS_MASK];
 		q->type = 0;
 		q->gfx_ypos = gfx_ypos;
 		q->how = how;
@@ -7765,10 +8192,11 @@ void draw_denise_line_queue(int gfx_ypos, nln_how how, uae_u32 linecnt, int star
 		q->finalseg = finalseg;
 		q->linear_vpos = linear_vpos;
 
-		addtowritequeue();
+		addtowritequeue(true);
 
 	} else {
 
+		benchmark_scope bench(BENCH_DRAWING);
 		updatelinedata();
 		draw_denise_line(gfx_ypos, how, linecnt, startpos, startcycle, endcycle, skip, skip2, dtotal, calib_start, calib_len, lol, hdelay, blanked, finalseg, ls);
 		if (finalseg) {
@@ -7785,16 +8213,17 @@ void draw_denise_vsync_queue(int erase)
 		if (!waitqueue_nolock()) {
 			return;
 		}
-		struct denise_rga_queue *q = &rga_queue[rga_queue_write & DENISE_RGA_SLOT_CHUNKS_MASK];
+		struct denise_rga_queue *q = &rga_queue[rga_queue_write_next & DENISE_RGA_SLOT_CHUNKS_MASK];
 		q->type = 5;
 		q->erase = erase;
 		q->vpos = vpos;
 		q->linear_vpos = linear_vpos;
 
-		addtowritequeue();
+		addtowritequeue(true);
 
 	} else {
 	
+		benchmark_scope bench(BENCH_DRAWING);
 		updatelinedata();
 		draw_denise_vsync(erase);
 
@@ -7808,7 +8237,7 @@ void denise_update_reg_queue(uae_u16 reg, uae_u16 v, uae_u32 linecnt)
 		if (!waitqueue_nolock()) {
 			return;
 		}
-		struct denise_rga_queue *q = &rga_queue[rga_queue_write & DENISE_RGA_SLOT_CHUNKS_MASK];
+		struct denise_rga_queue *q = &rga_queue[rga_queue_write_next & DENISE_RGA_SLOT_CHUNKS_MASK];
 		q->type = 6;
 		q->vpos = vpos;
 		q->linear_vpos = linear_vpos;
@@ -7816,7 +8245,7 @@ void denise_update_reg_queue(uae_u16 reg, uae_u16 v, uae_u32 linecnt)
 		q->val = v;
 		q->linecnt = linecnt;
 
-		addtowritequeue();
+		addtowritequeue(false);
 
 	} else {
 
@@ -7833,14 +8262,14 @@ void denise_store_restore_registers_queue(bool store, uae_u32 linecnt)
 		if (!waitqueue(7)) {
 			return;
 		}
-		struct denise_rga_queue *q = &rga_queue[rga_queue_write & DENISE_RGA_SLOT_CHUNKS_MASK];
+		struct denise_rga_queue *q = &rga_queue[rga_queue_write_next & DENISE_RGA_SLOT_CHUNKS_MASK];
 		q->type = 7;
 		q->vpos = vpos;
 		q->linear_vpos = linear_vpos;
 		q->val = store ? 1 : 0;
 		q->linecnt = linecnt;
 
-		addtowritequeue();
+		addtowritequeue(false);
 
 	} else {
 
@@ -7857,12 +8286,15 @@ void draw_denise_line_queue_flush(void)
 {
 	if (MULTITHREADED_DENISE) {
 
+		denise_queue_publish();
 		for (;;) {
-			if (rga_queue_read == rga_queue_write) {
-				return;
+			uae_atomic rp = denise_queue_get(&rga_queue_read);
+			if (rp == rga_queue_write_next) {
+				break;
 			}
-			uae_sem_trywait_delay(&read_sem, 500);
+			denise_queue_wait(&rga_queue_read, rp, &denise_writer_parked, &read_sem, 500);
 		}
+		denise_line_pool_flush();
 
 	}
 }
@@ -11,6 +11,8 @@
 #include "sysconfig.h"
 #include "sysdeps.h"
 
+#include <algorithm>
+
 #include "options.h"
 #include "events.h"
 #ifdef WITH_PPC
@@ -336,48 +338,163 @@ void do_cycles_slow(int cycles_to_add)
 	cycles_to_add_remain += remain;
 }
 
-static int event2idx;
+/*
+ * eventtab2 events are kept in a binary min-heap ordered by evtime, events
+ * due at the same cycle run in the order they were added. The fixed slots
+ * (eventtab2[], ev2_blitter) are heap nodes like any other, everything else
+ * gets a node from a free list that grows on demand.
+ */
+
+#define EV2_POOL_CHUNK 64
+
+static struct ev2 **event2heap;
+static int event2heapcnt, event2heapsize;
+static struct ev2 *event2free;
+static uae_u64 event2seq;
 static int event2cnt;
-static int event2restart;
+
+static bool event2_isfixed(const struct ev2 *e)
+{
+	return e >= eventtab2 && e < eventtab2 + ev2_max;
+}
+
+static bool event2_before(const struct ev2 *a, const struct ev2 *b)
+{
+	if (a->evtime != b->evtime)
+		return a->evtime < b->evtime;
+	return a->seq < b->seq;
+}
+
+static void event2_heap_set(int idx, struct ev2 *e)
+{
+	event2heap[idx] = e;
+	e->heapidx = idx;
+}
+
+static void event2_sift_up(int idx)
+{
+	struct ev2 *e = event2heap[idx];
+	while (idx > 0) {
+		int parent = (idx - 1) / 2;
+		if (!event2_before(e, event2heap[parent]))
+			break;
+		event2_heap_set(idx, event2heap[parent]);
+		idx = parent;
+	}
+	event2_heap_set(idx, e);
+}
+
+static void event2_sift_down(int idx)
+{
+	struct ev2 *e = event2heap[idx];
+	for (;;) {
+		int child = idx * 2 + 1;
+		if (child >= event2heapcnt)
+			break;
+		if (child + 1 < event2heapcnt && event2_before(event2heap[child + 1], event2heap[child]))
+			child++;
+		if (!event2_before(event2heap[child], e))
+			break;
+		event2_heap_set(idx, event2heap[child]);
+		idx = child;
+	}
+	event2_heap_set(idx, e);
+}
+
+static void event2_insert(struct ev2 *e)
+{
+	if (event2heapcnt >= event2heapsize) {
+		event2heapsize = event2heapsize ? event2heapsize * 2 : EV2_POOL_CHUNK;
+		event2heap = xrealloc(struct ev2*, event2heap, event2heapsize);
+	}
+	e->active = true;
+	e->seq = event2seq++;
+	event2_heap_set(event2heapcnt++, e);
+	event2_sift_up(e->heapidx);
+}
+
+// take an active event out of the heap, pooled nodes go back to the free list
+static void event2_cancel(struct ev2 *e)
+{
+	int idx = e->heapidx;
+	struct ev2 *last = event2heap[--event2heapcnt];
+	e->active = false;
+	e->heapidx = -1;
+	if (!event2_isfixed(e)) {
+		e->next = event2free;
+		event2free = e;
+	}
+	if (last == e)
+		return;
+	event2_heap_set(idx, last);
+	if (idx > 0 && event2_before(last, event2heap[(idx - 1) / 2]))
+		event2_sift_up(idx);
+	else
+		event2_sift_down(idx);
+}
+
+static struct ev2 *event2_alloc(void)
+{
+	if (!event2free) {
+		// never freed, the nodes are reused until the emulator exits
+		struct ev2 *chunk = xcalloc(struct ev2, EV2_POOL_CHUNK);
+		for (int i = 0; i < EV2_POOL_CHUNK; i++) {
+			chunk[i].heapidx = -1;
+			chunk[i].next = event2free;
+			event2free = &chunk[i];
+		}
+	}
+	struct ev2 *e = event2free;
+	event2free = e->next;
+	e->next = NULL;
+	return e;
+}
+
+// identical event already queued for the same cycle? Only subtrees that can hold et are visited.
+static struct ev2 *event2_find_same(int idx, evt_t et, uae_u32 data, evfunc2 func)
+{
+	if (idx >= event2heapcnt)
+		return NULL;
+	struct ev2 *e = event2heap[idx];
+	if (e->evtime > et)
+		return NULL;
+	if (e->evtime == et && e->handler == func && e->data == data)
+		return e;
+	struct ev2 *f = event2_find_same(idx * 2 + 1, et, data, func);
+	if (f)
+		return f;
+	return event2_find_same(idx * 2 + 2, et, data, func);
+}
+
+static struct ev2 *event2_find_handler(evfunc2 func)
+{
+	for (int i = 0; i < event2heapcnt; i++) {
+		if (event2heap[i]->handler == func)
+			return event2heap[i];
+	}
+	return NULL;
+}
 
 void MISC_handler(void)
 {
-	evt_t mintime;
 	evt_t ct = get_cycles();
 
-	if (event2cnt) {
-		event2restart++;
-	}
 	eventtab[ev_misc].active = 0;
-	mintime = EVT_MAX;
-	int idx2 = event2idx;
-	for (int i = 0; i < ev2_max; i++) {
-		int idx = (idx2 + i) & (ev2_max - 1);
-		ev2 *e = &eventtab2[idx];
-		if (e->active) {
-			if (e->evtime == ct) {
-				e->active = false;
-				event2cnt++;
-				e->handler(e->data);
-				event2cnt--;
-				if (event2restart > 0) {
-					event2restart--;
-					mintime = EVT_MAX;
-					i = 0;
-				}
-			} else {
-				evt_t eventtime = e->evtime - ct;
-				if (eventtime < mintime) {
-					mintime = eventtime;
-				}
-			}
-		}
+	// handlers can add events, they are picked up by this loop if they are due now
+	event2cnt++;
+	while (event2heapcnt > 0 && event2heap[0]->evtime <= ct) {
+		struct ev2 *e = event2heap[0];
+		evfunc2 func = e->handler;
+		uae_u32 data = e->data;
+		event2_cancel(e);
+		func(data);
 	}
-	if (mintime < EVT_MAX) {
+	event2cnt--;
+	if (event2heapcnt > 0) {
 		ev *e = &eventtab[ev_misc];
 		e->active = true;
 		e->oldcycles = ct;
-		e->evtime = ct + mintime;
+		e->evtime = event2heap[0]->evtime;
 		events_schedule();
 	}
 }
@@ -393,95 +510,86 @@ void event2_newevent_xx_ce(evt_t t, uae_u32 data, evfunc2 func)
 
 void event2_newevent_xx(int no, evt_t t, uae_u32 data, evfunc2 func)
 {
-	evt_t et;
-	static int next = ev2_misc;
+	evt_t ct = get_cycles();
+	evt_t et = t + ct;
+	struct ev2 *e;
 
-	et = t + get_cycles();
 	if (no < 0) {
-		no = next;
-		for (;;) {
-			if (!eventtab2[no].active) {
-				break;
-			}
-			if (eventtab2[no].evtime == et && eventtab2[no].handler == func && eventtab2[no].data == data)
-				break;
-			no++;
-			if (no == ev2_max) {
-				no = ev2_misc;
-			}
-			if (no == next) {
-				// we may have multiple interrupts queued, merge if possible
-				for (int i = 0; i < ev2_max; i++) {
-					auto ev2 = &eventtab2[i];
-					if (ev2->active && ev2->handler == func && ev2->evtime == et && func == event_doint_delay_do_ext) {
-						ev2->data |= data;
-						return;
-					}
-				}
-				write_log(_T("out of event2's!\n"));
-				// execute most recent event immediately
-				evt_t mintime = EVT_MAX;
-				int minevent = -1;
-				evt_t ct = get_cycles();
-				for (int i = 0; i < ev2_max; i++) {
-					if (eventtab2[i].active) {
-						evt_t eventtime = eventtab2[i].evtime - ct;
-						if (eventtime < mintime) {
-							mintime = eventtime;
-							minevent = i;
-						}
-					}
-				}
-				if (minevent >= 0) {
-					eventtab2[minevent].active = false;
-					eventtab2[minevent].handler(eventtab2[minevent].data);
-				}
-				continue;
-			}
-		}
-		next = no;
+		if (event2_find_same(0, et, data, func))
+			return;
+		e = event2_alloc();
+	} else {
+		e = &eventtab2[no];
+		if (e->active)
+			event2_cancel(e);
 	}
-	ev2 *e = &eventtab2[no];
-	e->active = true;
 	e->evtime = et;
 	e->handler = func;
 	e->data = data;
-	event2idx = addrdiff(e, eventtab2) + 1;
-	MISC_handler();
+	event2_insert(e);
+
+	if (event2cnt) {
+		// called from an event handler, MISC_handler reschedules when it is done
+		return;
+	}
+	if (et <= ct) {
+		MISC_handler();
+		return;
+	}
+	ev *m = &eventtab[ev_misc];
+	if (!m->active || et < m->evtime) {
+		m->active = true;
+		m->oldcycles = ct;
+		m->evtime = et;
+		events_schedule();
+	}
+}
+
+void event2_remevent(int no)
+{
+	if (eventtab2[no].active)
+		event2_cancel(&eventtab2[no]);
+}
+
+void event2_remevent_x(struct ev2 *e)
+{
+	if (e->active)
+		event2_cancel(e);
+}
+
+struct ev2 **event2_get_pending(int *cnt)
+{
+	struct ev2 **list = xmalloc(struct ev2*, event2heapcnt + 1);
+	for (int i = 0; i < event2heapcnt; i++)
+		list[i] = event2heap[i];
+	std::sort(list, list + event2heapcnt, event2_before);
+	*cnt = event2heapcnt;
+	return list;
 }
 
 void event2_newevent_x_replace_exists(evt_t t, uae_u32 data, evfunc2 func)
 {
-	for (int i = 0; i < ev2_max; i++) {
-		if (eventtab2[i].active && eventtab2[i].handler == func) {
-			eventtab2[i].active = false;
-			if (t <= 0) {
-				func(data);
-				return;
-			}
-			event2_newevent_xx(-1, t * CYCLE_UNIT, data, func);
-			return;
-		}
+	struct ev2 *e = event2_find_handler(func);
+	if (!e)
+		return;
+	event2_cancel(e);
+	if (t <= 0) {
+		func(data);
+		return;
 	}
+	event2_newevent_xx(-1, t * CYCLE_UNIT, data, func);
 }
 
 void event2_newevent_x_remove(evfunc2 func)
 {
-	for (int i = 0; i < ev2_max; i++) {
-		if (eventtab2[i].active && eventtab2[i].handler == func) {
-			eventtab2[i].active = false;
-		}
-	}
+	struct ev2 *e;
+	while ((e = event2_find_handler(func)))
+		event2_cancel(e);
 }
 
 bool event2_newevent_x_exists(evfunc2 func)
 {
-	for (int i = 0; i < ev2_max; i++) {
-		if (eventtab2[i].active && eventtab2[i].handler == func) {
-			return true;
-		}
-	}
-	return false;
+	return event2_find_handler(func) != NULL;
 }
 
 void event2_newevent_x_replace(evt_t t, uae_u32 data, evfunc2 func)
@@ -517,7 +625,6 @@ void clear_events(void)
 		eventtab[i].active = 0;
 		eventtab[i].oldcycles = get_cycles();
 	}
-	for (int i = 0; i < ev2_max; i++) {
-		eventtab2[i].active = 0;
-	}
+	while (event2heapcnt > 0)
+		event2_cancel(event2heap[event2heapcnt - 1]);
 }
@@ -31,6 +31,7 @@
 #include "a2065.h"
 #endif
 #include "gfxboard.h"
+#include "picasso96.h"
 #ifdef CD32
 #include "cd32_fmv.h"
 #endif
@@ -2380,6 +2381,8 @@ static void allocate_expamem (void)
 		}
 #ifdef PICASSO96
 		if (gfxmem_banks[0]->allocated_size > 0 && gfxmem_banks[0]->start > 0) {
+			// read() fails with EFAULT on write protected VRAM pages
+			picasso_resetwritewatch(0);
 			restore_ram (p96_filepos, gfxmem_banks[0]->baseaddr);
 			map_banks(gfxmem_banks[0], gfxmem_banks[0]->start >> 16, currprefs.rtgboards[0].rtgmem_size >> 16,
 				gfxmem_banks[0]->allocated_size);
@@ -440,7 +440,6 @@ typedef struct exallkey {
 
 #define EXKEYS 128
 #define EXALLKEYS 100
-#define MAX_AINO_HASH 128
 #define NOTIFY_HASH_SIZE 127
 
 /* handler state info */
@@ -482,7 +481,9 @@ typedef struct _unit {
 
 	a_inode rootnode;
 	unsigned int aino_cache_size;
-	a_inode *aino_hash[MAX_AINO_HASH];
+	a_inode **aino_index;
+	unsigned int aino_index_size;
+	unsigned int aino_index_count;
 	unsigned int nr_cache_hits;
 	unsigned int nr_cache_lookups;
 
@@ -1697,8 +1698,8 @@ static struct fs_dirhandle *fs_opendir (Unit *u, a_inode *aino)
 		if (fsd->zd)
 			return fsd;
 	} else if (fsd->fstype == FS_DIRECTORY) {
-		fsd->od = my_opendir (aino->nname);
-		if (fsd->od)
+		fsd->dcd = fsdb_dircache_opendir (aino->nname);
+		if (fsd->dcd)
 			return fsd;
 	} else if (fsd->fstype == FS_CDFS) {
 		fsd->isod = isofs_opendir (u->ui.cdfs_superblock, aino->uniq_external);
@@ -1715,7 +1716,7 @@ static void fs_closedir (struct fs_dirhandle *fsd)
 	if (fsd->fstype  == FS_ARCHIVE)
 		zfile_closedir_archive (fsd->zd);
 	else if (fsd->fstype == FS_DIRECTORY)
-		my_closedir (fsd->od);
+		fsdb_dircache_closedir (fsd->dcd);
 	else if (fsd->fstype == FS_CDFS)
 		isofs_closedir (fsd->isod);
 	xfree (fsd);
@@ -2441,6 +2442,186 @@ static void prepare_for_open (TCHAR *name)
 {
 }
 
+/* a_inode index
+ *
+ * Locks refer to their a_inode by uniq, the unit hashes every a_inode in
+ * the tree by it. Each directory also hashes its children by the last
+ * component of the Amiga name (folded like same_aname) and of the native
+ * name, so that resolving a path or an ExNext entry in a directory with
+ * thousands of files does not walk the sibling chain. Both double in size
+ * when the load goes above one.
+ */
+
+#define AINO_INDEX_MIN 256
+#define AINO_DIRHASH_MIN 16
+
+struct aino_dirhash {
+	a_inode **aname;
+	a_inode **nname;
+	unsigned int mask;
+	unsigned int count;
+};
+
+static uae_u32 aino_name_hash (const TCHAR *s, TCHAR sep)
+{
+	const TCHAR *p = _tcsrchr (s, sep);
+	uae_u32 h = 2166136261u;
+
+	if (p)
+		s = p + 1;
+	for (; *s; s++) {
+		uae_u8 c = (uae_u8)*s;
+		if ((c >= 'A' && c <= 'Z') || (c >= 192 && c <= 214) || (c >= 216 && c <= 222))
+			c += 32;
+		h ^= c;
+		h *= 16777619;
+	}
+	return h;
+}
+
+static void aino_index_grow (Unit *unit)
+{
+	unsigned int size = unit->aino_index_size ? unit->aino_index_size * 2 : AINO_INDEX_MIN;
+	a_inode **index = xcalloc (a_inode*, size);
+
+	if (!index)
+		return;
+	for (unsigned int i = 0; i < unit->aino_index_size; i++) {
+		a_inode *a = unit->aino_index[i];
+		while (a) {
+			a_inode *next = a->uniq_next;
+			a_inode **bucket = &index[a->uniq & (size - 1)];
+			a->uniq_next = *bucket;
+			*bucket = a;
+			a = next;
+		}
+	}
+	xfree (unit->aino_index);
+	unit->aino_index = index;
+	unit->aino_index_size = size;
+}
+
+static void aino_index_add (Unit *unit, a_inode *aino)
+{
+	a_inode **bucket;
+
+	if (unit->aino_index_count >= unit->aino_index_size)
+		aino_index_grow (unit);
+	if (!unit->aino_index)
+		return;
+	bucket = &unit->aino_index[aino->uniq & (unit->aino_index_size - 1)];
+	aino->uniq_next = *bucket;
+	*bucket = aino;
+	unit->aino_index_count++;
+}
+
+static void aino_index_remove (Unit *unit, a_inode *aino)
+{
+	a_inode **ap;
+
+	if (!unit->aino_index)
+		return;
+	ap = &unit->aino_index[aino->uniq & (unit->aino_index_size - 1)];
+	while (*ap && *ap != aino)
+		ap = &(*ap)->uniq_next;
+	if (*ap) {
+		*ap = aino->uniq_next;
+		unit->aino_index_count--;
+	}
+	aino->uniq_next = 0;
+}
+
+/* A renamed file keeps the uniq of the old a_inode */
+static void aino_set_uniq (Unit *unit, a_inode *aino, uae_u32 uniq)
+{
+	aino_index_remove (unit, aino);
+	aino->uniq = uniq;
+	aino_index_add (unit, aino);
+}
+
+static void aino_dirhash_insert (struct aino_dirhash *dh, a_inode *aino)
+{
+	a_inode **bucket;
+
+	bucket = &dh->aname[aino_name_hash (aino->aname, '/') & dh->mask];
+	aino->aname_next = *bucket;
+	*bucket = aino;
+	bucket = &dh->nname[aino_name_hash (aino->nname, FSDB_DIR_SEPARATOR) & dh->mask];
+	aino->nname_next = *bucket;
+	*bucket = aino;
+	dh->count++;
+}
+
+static void aino_dirhash_free (a_inode *dir)
+{
+	if (!dir->dirhash)
+		return;
+	xfree (dir->dirhash->aname);
+	xfree (dir->dirhash);
+	dir->dirhash = 0;
+}
+
+/* Hash the child list of dir from scratch, with at least size buckets.
+ * Without a hash (no children or out of memory) lookups scan the list.  */
+static void aino_dirhash_rebuild (a_inode *dir, unsigned int size)
+{
+	struct aino_dirhash *dh;
+	unsigned int count = 0;
+
+	aino_dirhash_free (dir);
+	for (a_inode *a = dir->child; a; a = a->sibling)
+		count++;
+	if (!count)
+		return;
+	while (size < count)
+		size *= 2;
+	dh = xcalloc (struct aino_dirhash, 1);
+	if (!dh)
+		return;
+	dh->aname = xcalloc (a_inode*, size * 2);
+	if (!dh->aname) {
+		xfree (dh);
+		return;
+	}
+	dh->nname = dh->aname + size;
+	dh->mask = size - 1;
+	for (a_inode *a = dir->child; a; a = a->sibling)
+		aino_dirhash_insert (dh, a);
+	dir->dirhash = dh;
+}
+
+/* aino has just been linked into the child list of dir */
+static void aino_dirhash_add (a_inode *dir, a_inode *aino)
+{
+	struct aino_dirhash *dh = dir->dirhash;
+
+	if (dh && dh->count <= dh->mask)
+		aino_dirhash_insert (dh, aino);
+	else
+		aino_dirhash_rebuild (dir, dh ? (dh->mask + 1) * 2 : AINO_DIRHASH_MIN);
+}
+
+static void aino_dirhash_remove (a_inode *dir, a_inode *aino)
+{
+	struct aino_dirhash *dh = dir->dirhash;
+	a_inode **ap;
+
+	if (!dh)
+		return;
+	ap = &dh->aname[aino_name_hash (aino->aname, '/') & dh->mask];
+	while (*ap && *ap != aino)
+		ap = &(*ap)->aname_next;
+	if (!*ap)
+		return;
+	*ap = aino->aname_next;
+	ap = &dh->nname[aino_name_hash (aino->nname, FSDB_DIR_SEPARATOR) & dh->mask];
+	while (*ap && *ap != aino)
+		ap = &(*ap)->nname_next;
+	if (*ap)
+		*ap = aino->nname_next;
+	dh->count--;
+}
+
 static void de_recycle_aino (Unit *unit, a_inode *aino)
 {
 	aino_test (aino);
@@ -2454,6 +2635,7 @@ static void de_recycle_aino (Unit *unit, a_inode *aino)
 
 static void free_aino(a_inode *aino)
 {
+	aino_dirhash_free(aino);
 	xfree(aino->aname);
 	xfree(aino->comment);
 	xfree(aino->nname);
@@ -2462,9 +2644,9 @@ static void free_aino(a_inode *aino)
 
 static void dispose_aino (Unit *unit, a_inode **aip, a_inode *aino)
 {
-	int hash = aino->uniq % MAX_AINO_HASH;
-	if (unit->aino_hash[hash] == aino)
-		unit->aino_hash[hash] = 0;
+	aino_index_remove (unit, aino);
+	if (aino->parent)
+		aino_dirhash_remove (aino->parent, aino);
 
 	if (aino->dirty && aino->parent)
 		fsdb_dir_writeback (aino->parent);
@@ -2618,7 +2800,9 @@ static void move_aino_children (Unit *unit, a_inode *from, a_inode *to)
 	aino_test (to);
 	to->child = from->child;
 	from->child = 0;
+	aino_dirhash_free (from);
 	update_child_names (unit, to->child, to);
+	aino_dirhash_rebuild (to, AINO_DIRHASH_MIN);
 }
 
 static void delete_aino (Unit *unit, a_inode *aino)
@@ -2660,54 +2844,20 @@ static void delete_aino (Unit *unit, a_inode *aino)
 	dispose_aino (unit, aip, aino);
 }
 
-static a_inode *lookup_sub (a_inode *dir, uae_u32 uniq)
-{
-	a_inode **cp = &dir->child;
-	a_inode *c, *retval;
-
-	for (;;) {
-		c = *cp;
-		if (c == 0)
-			return 0;
-
-		if (c->uniq == uniq) {
-			retval = c;
-			break;
-		}
-		if (c->dir) {
-			a_inode *a = lookup_sub (c, uniq);
-			if (a != 0) {
-				retval = a;
-				break;
-			}
-		}
-		cp = &c->sibling;
-	}
-	if (! dir->locked_children) {
-		/* Move to the front to speed up repeated lookups.  Don't do this if
-		an ExNext is going on in this directory, or we'll terminally
-		confuse it.  */
-		*cp = c->sibling;
-		c->sibling = dir->child;
-		dir->child = c;
-	}
-	return retval;
-}
-
 static a_inode *lookup_aino (Unit *unit, uae_u32 uniq)
 {
-	a_inode *a;
-	int hash = uniq % MAX_AINO_HASH;
+	a_inode *a = 0;
 
 	if (uniq == 0)
 		return &unit->rootnode;
-	a = unit->aino_hash[hash];
-	if (a == 0 || a->uniq != uniq)
-		a = lookup_sub (&unit->rootnode, uniq);
-	else
+	if (unit->aino_index) {
+		a = unit->aino_index[uniq & (unit->aino_index_size - 1)];
+		while (a && a->uniq != uniq)
+			a = a->uniq_next;
+	}
+	if (a)
 		unit->nr_cache_hits++;
 	unit->nr_cache_lookups++;
-	unit->aino_hash[hash] = a;
 	aino_test (a);
 	return a;
 }
@@ -2902,6 +3052,8 @@ static void init_child_aino_tree (Unit *unit, a_inode *base, a_inode *aino)
 	base->child = aino;
 	aino->next = aino->prev = 0;
 	aino->volflags = unit->volflags;
+	aino_dirhash_add (base, aino);
+	aino_index_add (unit, aino);
 }
 
 static void init_child_aino (Unit *unit, a_inode *base, a_inode *aino)
@@ -3008,7 +3160,8 @@ static a_inode *create_child_aino (Unit *unit, a_inode *base, TCHAR *rel, int is
 
 static a_inode *lookup_child_aino (Unit *unit, a_inode *base, TCHAR *rel, int *err)
 {
-	a_inode *c = base->child;
+	struct aino_dirhash *dh = base->dirhash;
+	a_inode *c = dh ? dh->aname[aino_name_hash (rel, '/') & dh->mask] : base->child;
 	int l0 = uaetcslen (rel);
 
 	aino_test (base);
@@ -3024,7 +3177,7 @@ static a_inode *lookup_child_aino (Unit *unit, a_inode *base, TCHAR *rel, int *e
 		if (l0 <= l1 && same_aname (rel, c->aname + l1 - l0)
 			&& (l0 == l1 || c->aname[l1-l0-1] == '/') && c->mountcount == unit->mountcount)
 			break;
-		c = c->sibling;
+		c = dh ? c->aname_next : c->sibling;
 	}
 	if (c != 0)
 		return c;
@@ -3037,7 +3190,8 @@ static a_inode *lookup_child_aino (Unit *unit, a_inode *base, TCHAR *rel, int *e
 /* Different version because for this one, REL is an nname.  */
 static a_inode *lookup_child_aino_for_exnext (Unit *unit, a_inode *base, TCHAR *rel, uae_u32 *err, uae_u64 uniq_external, struct virtualfilesysobject *vfso)
 {
-	a_inode *c = base->child;
+	struct aino_dirhash *dh = base->dirhash;
+	a_inode *c = dh ? dh->nname[aino_name_hash (rel, FSDB_DIR_SEPARATOR) & dh->mask] : base->child;
 	int l0 = uaetcslen (rel);
 	int isvirtual = unit->volflags & (MYVOLUMEINFO_ARCHIVE | MYVOLUMEINFO_CDFS);
 
@@ -3051,7 +3205,7 @@ static a_inode *lookup_child_aino_for_exnext (Unit *unit, a_inode *base, TCHAR *
 		if (l0 <= l1 && _tcscmp (rel, c->nname + l1 - l0) == 0
 			&& (l0 == l1 || c->nname[l1-l0-1] == FSDB_DIR_SEPARATOR) && c->mountcount == unit->mountcount)
 			break;
-		c = c->sibling;
+		c = dh ? c->nname_next : c->sibling;
 	}
 	if (c != 0)
 		return c;
@@ -3270,8 +3424,6 @@ static Unit *startup_create_unit(TrapContext *ctx, UnitInfo *uinfo, int num)
 	unit->rootnode.volflags = uinfo->volflags;
 	aino_test_init (&unit->rootnode);
 	unit->aino_cache_size = 0;
-	for (i = 0; i < MAX_AINO_HASH; i++)
-		unit->aino_hash[i] = 0;
 	return unit;
 }
 
@@ -4686,7 +4838,7 @@ static int filesys_readdir(struct fs_dirhandle *d, TCHAR *fn, uae_u64 *uniq)
 	if (d->fstype == FS_ARCHIVE)
 		ok = zfile_readdir_archive(d->zd, fn);
 	else if (d->fstype == FS_DIRECTORY)
-		ok = my_readdir(d->od, fn);
+		ok = fsdb_dircache_readdir(d->dcd, fn);
 	else if (d->fstype == FS_CDFS)
 		ok = isofs_readdir(d->isod, fn, uniq);
 	return ok;
@@ -5532,7 +5684,9 @@ static void	action_read(TrapContext *ctx, Unit *unit, dpacket *packet)
 
 			/* normal fast read */
 			uae_u8 *realpt = get_real_address (addr);
+			writewatch_host_write_begin (realpt, size);
 			actual = fs_read (k->fd, realpt, size);
+			writewatch_host_write_end (realpt, size);
 
 		}
 
@@ -6308,7 +6462,7 @@ static void	action_rename_object(TrapContext *ctx, Unit *unit, dpacket *packet)
 	a2->comment = a1->comment;
 	a1->comment = 0;
 	a2->amigaos_mode = a1->amigaos_mode;
-	a2->uniq = a1->uniq;
+	aino_set_uniq (unit, a2, a1->uniq);
 	a2->elock = a1->elock;
 	a2->shlock = a1->shlock;
 	a2->has_dbentry = a1->has_dbentry;
@@ -7400,6 +7554,8 @@ static void filesys_reset2 (void)
 	filesys_free_handles ();
 	for (u = units; u; u = u1) {
 		u1 = u->next;
+		aino_dirhash_free (&u->rootnode);
+		xfree (u->aino_index);
 		xfree (u);
 	}
 	units = 0;
@@ -22,6 +22,7 @@
 * Offset 263, 257 bytes, nname
 * Offset 519, 81 bytes, comment
 */
+#define FSDB_ENTRY_SIZE (1 + 4 + 257 + 257 + 81)
 
 #define TRACING_ENABLED 0
 #if TRACING_ENABLED
@@ -51,6 +52,8 @@ TCHAR *fsdb_search_dir (const TCHAR *dirname, TCHAR *rel)
 	my_opendir_s *dir;
 	TCHAR fn[MAX_DPATH];
 
+	if (fsdb_dircache_search (dirname, rel, &p))
+		return p;
 	dir = my_opendir (dirname);
 	/* This really shouldn't happen...  */
 	if (! dir)
@@ -87,6 +90,7 @@ static void kill_fsdb (a_inode *dir)
 	TCHAR *n = build_nname (dir->nname, FSDB_FILE);
 	_wunlink (n);
 	xfree (n);
+	fsdb_dircache_metadata_changed (dir->nname);
 }
 
 static void fsdb_fixup (FILE *f, uae_u8 *buf, int size, a_inode *base)
@@ -145,6 +149,7 @@ void fsdb_clean_dir (a_inode *dir)
 		kill_fsdb (dir);
 	} else {
 		my_truncate (n, pos1);
+		fsdb_dircache_metadata_changed (dir->nname);
 	}
 	xfree (n);
 }
@@ -172,43 +177,80 @@ static a_inode *aino_from_buf (a_inode *base, uae_u8 *buf, long off)
 	return aino;
 }
 
-a_inode *fsdb_lookup_aino_aname (a_inode *base, const TCHAR *aname)
+/* The whole db file of a directory, NULL if it has none.  */
+static uae_u8 *fsdb_load (a_inode *dir, int *sizep)
 {
+	uae_u8 *data;
 	FILE *f;
+	int size;
 
-	f = get_fsdb (base, _T("r+b"));
-	if (f == 0) {
+	*sizep = 0;
+	if (!dir->nname)
+		return NULL;
+	data = fsdb_dircache_metadata (dir->nname, &size);
+	if (size >= 0) {
+		*sizep = size;
+		return data;
+	}
+	f = get_fsdb (dir, _T("rb"));
+	if (f == 0)
+		return NULL;
+	fseek (f, 0, SEEK_END);
+	size = ftell (f);
+	fseek (f, 0, SEEK_SET);
+	data = NULL;
+	if (size > 0) {
+		data = xmalloc (uae_u8, size);
+		size = fread (data, 1, size, f);
+	}
+	fclose (f);
+	if (size <= 0) {
+		xfree (data);
+		return NULL;
+	}
+	*sizep = size;
+	return data;
+}
+
+a_inode *fsdb_lookup_aino_aname (a_inode *base, const TCHAR *aname)
+{
+	uae_u8 *data;
+	int size;
+
+	data = fsdb_load (base, &size);
+	if (data == 0) {
 #ifndef AMIBERRY
 		if (currprefs.filesys_custom_uaefsdb && (base->volflags & MYVOLUMEINFO_STREAMS))
 			return custom_fsdb_lookup_aino_aname (base, aname);
 #endif
 		return 0;
 	}
-	for (;;) {
-		uae_u8 buf[1 + 4 + 257 + 257 + 81];
+	for (int off = 0; off + FSDB_ENTRY_SIZE <= size; off += FSDB_ENTRY_SIZE) {
+		uae_u8 *buf = data + off;
 		TCHAR *s;
-		if (fread (buf, 1, sizeof buf, f) < sizeof buf)
-			break;
+		if (buf[0] == 0)
+			continue;
 		s = au ((char*)buf + 5);
-		if (buf[0] != 0 && same_aname (s, aname)) {
-			long pos = ftell (f) - sizeof buf;
-			fclose (f);
+		if (same_aname (s, aname)) {
+			a_inode *a = aino_from_buf (base, buf, off);
 			xfree (s);
-			return aino_from_buf (base, buf, pos);
+			xfree (data);
+			return a;
 		}
 		xfree (s);
 	}
-	fclose (f);
+	xfree (data);
 	return 0;
 }
 
 a_inode *fsdb_lookup_aino_nname (a_inode *base, const TCHAR *nname)
 {
-	FILE *f;
+	uae_u8 *data;
+	int size;
 	char *s;
 
-	f = get_fsdb (base, _T("r+b"));
-	if (f == 0) {
+	data = fsdb_load (base, &size);
+	if (data == 0) {
 #ifndef AMIBERRY
 		if (currprefs.filesys_custom_uaefsdb && (base->volflags & MYVOLUMEINFO_STREAMS))
 			return custom_fsdb_lookup_aino_nname (base, nname);
@@ -216,51 +258,44 @@ a_inode *fsdb_lookup_aino_nname (a_inode *base, const TCHAR *nname)
 		return 0;
 	}
 	s = ua (nname);
-	for (;;) {
-		uae_u8 buf[1 + 4 + 257 + 257 + 81];
-		if (fread (buf, 1, sizeof buf, f) < sizeof buf)
-			break;
+	for (int off = 0; off + FSDB_ENTRY_SIZE <= size; off += FSDB_ENTRY_SIZE) {
+		uae_u8 *buf = data + off;
 		if (buf[0] != 0 && strcmp ((char*)buf + 5 + 257, s) == 0) {
-			long pos = ftell (f) - sizeof buf;
-			fclose (f);
+			a_inode *a = aino_from_buf (base, buf, off);
 			xfree (s);
-			return aino_from_buf (base, buf, pos);
+			xfree (data);
+			return a;
 		}
 	}
 	xfree (s);
-	fclose (f);
+	xfree (data);
 	return 0;
 }
 
 int fsdb_used_as_nname (a_inode *base, const TCHAR *nname)
 {
-	FILE *f;
-	uae_u8 buf[1 + 4 + 257 + 257 + 81];
+	uae_u8 *data;
+	int size, found = 0;
 
-	f = get_fsdb (base, _T("r+b"));
-	if (f == 0) {
+	data = fsdb_load (base, &size);
+	if (data == 0) {
 #ifndef AMIBERRY
 		if (currprefs.filesys_custom_uaefsdb && (base->volflags & MYVOLUMEINFO_STREAMS))
 			return custom_fsdb_used_as_nname (base, nname);
 #endif
 		return 0;
 	}
-	for (;;) {
+	for (int off = 0; !found && off + FSDB_ENTRY_SIZE <= size; off += FSDB_ENTRY_SIZE) {
+		uae_u8 *buf = data + off;
 		TCHAR *s;
-		if (fread (buf, 1, sizeof buf, f) < sizeof buf)
-			break;
 		if (buf[0] == 0)
 			continue;
 		s = au ((char*)buf + 5 + 257);
-		if (_tcscmp (s, nname) == 0) {
-			xfree (s);
-			fclose (f);
-			return 1;
-		}
+		found = _tcscmp (s, nname) == 0;
 		xfree (s);
 	}
-	fclose (f);
-	return 0;
+	xfree (data);
+	return found;
 }
 
 static int needs_dbentry (a_inode *aino)
@@ -393,4 +428,5 @@ void fsdb_dir_writeback (a_inode *dir)
 	TRACE ((_T("end\n")));
 	fclose (f);
 	xfree (tmpbuf);
+	fsdb_dircache_metadata_changed (dir->nname);
 }
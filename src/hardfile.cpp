@@ -609,21 +609,270 @@ static uae_u32 vhd_checksum (uae_u8 *p, int offset)
 static int hdf_write2(struct hardfiledata *hfd, void *buffer, uae_u64 offset, int len);
 static int hdf_read2(struct hardfiledata *hfd, void *buffer, uae_u64 offset, int len);
 
+/*
+ * Write-behind queue
+ *
+ * Writes are copied to a per hardfile queue and written by a worker thread,
+ * so the emulated controller does not wait for the host device. Writes that
+ * continue the newest queued write are merged into it. Reads are done under
+ * the same file lock as the worker and are patched with still queued data,
+ * block zero writes are done synchronously after the queue has drained.
+ * A queued write that fails is reported by the next CMD_UPDATE or SCSI
+ * SYNCHRONIZE CACHE, the point where its writer asks for its data to be
+ * on the disk.
+ */
+
+#define HDF_IO_MERGE_MAX (256 * 1024)
+#define HDF_IO_PENDING_MAX (4 * 1024 * 1024)
+
+struct hdf_iowrite
+{
+	struct hdf_iowrite *next;
+	uae_u64 offset;
+	int len, size;
+	uae_u8 *data;
+};
+
+struct hdf_ioqueue
+{
+	struct hardfiledata *hfd;
+	uae_sem_t lock;
+	uae_sem_t filelock;
+	uae_sem_t wake;
+	struct hdf_iowrite *first, *last;
+	uae_sem_t drained;
+	bool busy;
+	// queued bytes, waiters and errors are protected by lock
+	int pending;
+	int waiters;
+	int errors;
+	uae_u64 error_offset;
+	volatile int state;
+};
+
+static int hdf_io_thread(void *v)
+{
+	struct hdf_ioqueue *q = (struct hdf_ioqueue*)v;
+
+	uae_set_thread_priority(NULL, 1);
+	q->state = 1;
+	for (;;) {
+		uae_sem_wait(&q->wake);
+		for (;;) {
+			uae_sem_wait(&q->lock);
+			struct hdf_iowrite *w = q->first;
+			if (!w) {
+				uae_sem_post(&q->lock);
+				break;
+			}
+			// head entry is being written, no more merging into it
+			q->busy = true;
+			uae_sem_post(&q->lock);
+
+			uae_sem_wait(&q->filelock);
+			int ret = hdf_write2(q->hfd, w->data, w->offset, w->len);
+			uae_sem_wait(&q->lock);
+			q->first = w->next;
+			if (!q->first)
+				q->last = NULL;
+			q->pending -= w->len;
+			q->busy = false;
+			if (ret != w->len && !q->errors++)
+				q->error_offset = w->offset;
+			while (q->waiters > 0) {
+				q->waiters--;
+				uae_sem_post(&q->drained);
+			}
+			uae_sem_post(&q->lock);
+			uae_sem_post(&q->filelock);
+
+			if (ret != w->len)
+				write_log(_T("HDF: queued write %llx (%d) failed (%d)\n"), w->offset, w->len, ret);
+			xfree(w->data);
+			xfree(w);
+		}
+		if (q->state == 0)
+			break;
+	}
+	q->state = -1;
+	return 0;
+}
+
 static void hdf_init_cache(struct hardfiledata *hfd)
 {
+	struct hdf_ioqueue *q;
+
+	if (hfd->ioq)
+		return;
+	q = xcalloc(struct hdf_ioqueue, 1);
+	if (!q)
+		return;
+	q->hfd = hfd;
+	uae_sem_init(&q->lock, 0, 1);
+	uae_sem_init(&q->filelock, 0, 1);
+	uae_sem_init(&q->wake, 0, 0);
+	uae_sem_init(&q->drained, 0, 0);
+	if (!uae_start_thread(_T("hardfile_io"), hdf_io_thread, q, NULL)) {
+		uae_sem_destroy(&q->lock);
+		uae_sem_destroy(&q->filelock);
+		uae_sem_destroy(&q->wake);
+		uae_sem_destroy(&q->drained);
+		xfree(q);
+		return;
+	}
+	while (q->state == 0)
+		sleep_millis(1);
+	hfd->ioq = q;
+}
+
+// waits until no more than limit bytes are queued, the worker posts
+// drained once per waiter after each finished write
+static void hdf_drain_cache(struct hdf_ioqueue *q, int limit)
+{
+	uae_sem_wait(&q->lock);
+	while (q->pending > limit) {
+		q->waiters++;
+		uae_sem_post(&q->lock);
+		uae_sem_wait(&q->drained);
+		uae_sem_wait(&q->lock);
+	}
+	uae_sem_post(&q->lock);
 }
-static void hdf_flush_cache(struct hardfiledata *hdf)
+
+// writes out the queue, returns false if a queued write failed since the
+// previous sync
+static bool hdf_sync_cache(struct hdf_ioqueue *q)
 {
+	int errors;
+
+	hdf_drain_cache(q, 0);
+	uae_sem_wait(&q->lock);
+	errors = q->errors;
+	q->errors = 0;
+	uae_sem_post(&q->lock);
+	if (errors)
+		write_log(_T("HDF: %d queued write(s) failed, first at %llx\n"), errors, q->error_offset);
+	return errors == 0;
+}
+
+static void hdf_flush_cache(struct hardfiledata *hfd)
+{
+	struct hdf_ioqueue *q = hfd->ioq;
+
+	if (!q)
+		return;
+	hdf_drain_cache(q, 0);
+	q->state = 0;
+	uae_sem_post(&q->wake);
+	while (q->state == 0)
+		sleep_millis(1);
+	uae_sem_destroy(&q->lock);
+	uae_sem_destroy(&q->filelock);
+	uae_sem_destroy(&q->wake);
+	uae_sem_destroy(&q->drained);
+	xfree(q);
+	hfd->ioq = NULL;
 }
 
 static int hdf_cache_read(struct hardfiledata *hfd, void *buffer, uae_u64 offset, int len)
 {
-	return hdf_read2(hfd, buffer, offset, len);
+	struct hdf_ioqueue *q = hfd->ioq;
+	int ret;
+
+	if (!q)
+		return hdf_read2(hfd, buffer, offset, len);
+	uae_sem_wait(&q->filelock);
+	ret = hdf_read2(hfd, buffer, offset, len);
+	if (ret > 0) {
+		// apply writes that have not reached the file yet, oldest first
+		uae_sem_wait(&q->lock);
+		for (struct hdf_iowrite *w = q->first; w; w = w->next) {
+			uae_u64 start = offset > w->offset ? offset : w->offset;
+			uae_u64 end = offset + ret < w->offset + w->len ? offset + ret : w->offset + w->len;
+			if (start < end)
+				memcpy((uae_u8*)buffer + (start - offset), w->data + (start - w->offset), (size_t)(end - start));
+		}
+		uae_sem_post(&q->lock);
+	}
+	uae_sem_post(&q->filelock);
+	return ret;
 }
 
 static int hdf_cache_write(struct hardfiledata *hfd, void *buffer, uae_u64 offset, int len)
 {
-	return hdf_write2(hfd, buffer, offset, len);
+	struct hdf_ioqueue *q;
+	struct hdf_iowrite *w;
+
+	if (len <= 0 || hfd->ci.readonly || hfd->drive_empty || hfd->dangerous)
+		return hdf_write2(hfd, buffer, offset, len);
+	hdf_init_cache(hfd);
+	q = hfd->ioq;
+	if (!q)
+		return hdf_write2(hfd, buffer, offset, len);
+	if (offset < hfd->virtual_size + 512) {
+		// block zero write is verified by the host layer
+		hdf_drain_cache(q, 0);
+		uae_sem_wait(&q->filelock);
+		int ret = hdf_write2(hfd, buffer, offset, len);
+		uae_sem_post(&q->filelock);
+		return ret;
+	}
+	hdf_drain_cache(q, HDF_IO_PENDING_MAX - len);
+
+	uae_sem_wait(&q->lock);
+	w = q->last;
+	if (w && !(w == q->first && q->busy)) {
+		if (offset >= w->offset && offset + len <= w->offset + w->len) {
+			// rewrite of data still in the newest entry
+			memcpy(w->data + (offset - w->offset), buffer, len);
+			uae_sem_post(&q->lock);
+			return len;
+		}
+		if (offset == w->offset + w->len && w->len + len <= HDF_IO_MERGE_MAX) {
+			if (w->len + len > w->size) {
+				int size = w->size * 2 < w->len + len ? w->len + len : w->size * 2;
+				uae_u8 *p = xrealloc(uae_u8, w->data, size);
+				if (p) {
+					w->data = p;
+					w->size = size;
+				}
+			}
+			if (w->len + len <= w->size) {
+				memcpy(w->data + w->len, buffer, len);
+				w->len += len;
+				q->pending += len;
+				uae_sem_post(&q->lock);
+				uae_sem_post(&q->wake);
+				return len;
+			}
+		}
+	}
+	uae_sem_post(&q->lock);
+
+	w = xcalloc(struct hdf_iowrite, 1);
+	if (w)
+		w->data = xmalloc(uae_u8, len);
+	if (!w || !w->data) {
+		xfree(w);
+		hdf_drain_cache(q, 0);
+		uae_sem_wait(&q->filelock);
+		int ret = hdf_write2(hfd, buffer, offset, len);
+		uae_sem_post(&q->filelock);
+		return ret;
+	}
+	memcpy(w->data, buffer, len);
+	w->offset = offset;
+	w->len = w->size = len;
+	uae_sem_wait(&q->lock);
+	if (q->last)
+		q->last->next = w;
+	else
+		q->first = w;
+	q->last = w;
+	q->pending += len;
+	uae_sem_post(&q->lock);
+	uae_sem_post(&q->wake);
+	return len;
 }
 
 int hdf_open (struct hardfiledata *hfd, const TCHAR *pname)
@@ -742,7 +991,6 @@ int hdf_open (struct hardfiledata *hfd, const TCHAR *pname)
 	write_log (_T("HDF is VHD %s image, virtual size=%lldK (%llx %lld)\n"),
 		hfd->hfd_type == HFD_VHD_FIXED ? _T("fixed") : _T("dynamic"),
 		hfd->virtsize / 1024, hfd->virtsize, hfd->virtsize);
-	hdf_init_cache (hfd);
 	return 1;
 nonvhd:
 	hfd->hfd_type = 0;
@@ -1314,7 +1562,10 @@ static uae_u64 cmd_read(TrapContext *ctx, struct hardfiledata *hfd, uaecptr data
 			return 0;
 		if (bank_data->check(dataptr, (uae_u32)len)) {
 			uae_u8 *buffer = bank_data->xlateaddr(dataptr);
-			return cmd_readx(hfd, buffer, offset, (uae_u32)len);
+			writewatch_host_write_begin(buffer, (size_t)len);
+			uae_u64 ret = cmd_readx(hfd, buffer, offset, (uae_u32)len);
+			writewatch_host_write_end(buffer, (size_t)len);
+			return ret;
 		}
 	}
 	int total = 0;
@@ -2097,6 +2348,10 @@ int scsi_hd_emulate (struct hardfiledata *hfd, struct hd_hardfiledata *hdhfd, ua
 		if (nodisk (hfd))
 			goto nodisk;
 		scsi_len = 0;
+		if (hfd->ioq && !hdf_sync_cache(hfd->ioq)) {
+			chkerr = 2;
+			goto checkfail;
+		}
 		break;
 	case 0xa8: /* READ (12) */
 		if (nodisk (hfd))
@@ -2807,8 +3062,12 @@ static uae_u32 hardfile_do_io (TrapContext *ctx, struct hardfiledata *hfd, struc
 		actual = hfd->drive_empty ? 1 :0;
 		break;
 
-		/* Some commands that just do nothing and return zero */
 	case CMD_UPDATE:
+		if (hfd->ioq && !hdf_sync_cache(hfd->ioq))
+			error = 45; // HFERR_BadStatus
+		break;
+
+		/* Some commands that just do nothing and return zero */
 	case CMD_CLEAR:
 	case CMD_MOTOR:
 	case CMD_SEEK:
@@ -0,0 +1,91 @@
+/*
+* UAE - The Un*x Amiga Emulator
+*
+* Headless benchmark runner
+*
+* Runs a configuration for a fixed number of emulated frames as fast as
+* possible and reports where the host time went. Time is accounted
+* exclusively: entering a section pauses the one it was entered from, so
+* the per-section totals add up to the run time of the emulation thread.
+*/
+
+#ifndef UAE_BENCHMARK_H
+#define UAE_BENCHMARK_H
+
+#include "uae/types.h"
+#include <time.h>
+
+enum benchmark_section
+{
+	BENCH_CPU,		/* CPU emulation and everything not listed below */
+	BENCH_HSYNC,	/* custom.cpp hsync handler */
+	BENCH_VSYNC,	/* custom.cpp vsync handler */
+	BENCH_DRAWING,	/* Denise line drawing done on the emulation thread */
+	BENCH_BLITTER,	/* blitter handler and immediate blits */
+	BENCH_AUDIO,	/* Paula sample generation and the sound sink */
+	BENCH_JIT,		/* JIT block translation */
+	BENCH_MAX
+};
+
+extern int benchmark_frames;
+extern bool benchmark_running;
+extern int benchmark_section_cur;
+extern uae_s64 benchmark_section_start;
+extern uae_s64 benchmark_time[BENCH_MAX];
+
+extern void benchmark_prefs(struct uae_prefs *p);
+extern void benchmark_vsync(void);
+extern void benchmark_trap(int id);
+extern void benchmark_report(void);
+extern void benchmark_denise_add(uae_s64 ns);
+
+/* benchmark mode was requested, the run may not have started yet */
+static inline bool benchmark_active(void)
+{
+	return benchmark_frames > 0;
+}
+
+static inline uae_s64 benchmark_clock(void)
+{
+	struct timespec ts;
+#ifdef CLOCK_MONOTONIC_RAW
+	clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+#else
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static inline int benchmark_enter(int section)
+{
+	if (!benchmark_running)
+		return -1;
+	uae_s64 t = benchmark_clock();
+	int prev = benchmark_section_cur;
+	benchmark_time[prev] += t - benchmark_section_start;
+	benchmark_section_start = t;
+	benchmark_section_cur = section;
+	return prev;
+}
+
+static inline void benchmark_leave(int prev)
+{
+	if (prev < 0 || !benchmark_running)
+		return;
+	uae_s64 t = benchmark_clock();
+	benchmark_time[benchmark_section_cur] += t - benchmark_section_start;
+	benchmark_section_start = t;
+	benchmark_section_cur = prev;
+}
+
+/* Emulation thread only. Restores the previous section on every return path. */
+struct benchmark_scope
+{
+	int prev;
+	explicit benchmark_scope(int section) : prev(benchmark_enter(section)) { }
+	~benchmark_scope() { benchmark_leave(prev); }
+	benchmark_scope(const benchmark_scope&) = delete;
+	benchmark_scope& operator=(const benchmark_scope&) = delete;
+};
+
+#endif /* UAE_BENCHMARK_H */
@@ -0,0 +1,22 @@
+/*
+* UAE - The Un*x Amiga Emulator
+*
+* Planar <-> chunky conversion (bitplane.cpp)
+*
+* Plane bytes hold 8 pixels, leftmost pixel in bit 7. Chunky bytes hold one
+* pixel each, bit n comes from plane n.
+*/
+
+#ifndef UAE_BITPLANE_H
+#define UAE_BITPLANE_H
+
+#include "uae/types.h"
+
+/* nbytes bytes of each of the first depth planes to nbytes * 8 chunky
+ * pixels. Missing (NULL) planes and planes from depth up read as zero. */
+extern void bitplane_p2c(uae_u8 *chunky, const uae_u8 *const *planes, int depth, int nbytes);
+
+/* nbytes * 8 chunky pixels to nbytes bytes in each of the 8 planes */
+extern void bitplane_c2p(uae_u8 *const *planes, const uae_u8 *chunky, int nbytes);
+
+#endif /* UAE_BITPLANE_H */
@@ -67,4 +67,16 @@ extern blitter_func *const blitfunc_dofast[256];
 extern blitter_func *const blitfunc_dofast_desc[256];
 extern uae_u32 blit_masktable[BLITTER_MAX_WORDS];
 
+/* Immediate blit over host memory (blitter_simd.cpp). pt[] point to the
+ * first word of each channel (NULL if disabled), stride[] is the signed
+ * byte distance between row starts, including modulo and direction. */
+struct blitter_simd_job {
+	uae_u8 *pt[4];
+	int stride[4];
+	bool desc;
+	bool fill, ife, fc;
+};
+
+extern void blitter_simd_blit(struct blitter_simd_job *job, struct bltinfo *b);
+
 #endif /* UAE_BLITTER_H */
@@ -97,6 +97,7 @@ struct socketbase {
 	uae_u32 sets [3];
 	uae_u32 timeout;
 	uae_u32 sigmp;
+	struct waitselect_set *wsset;	/* descriptors watched by WaitSelect() */
 #endif
 #ifdef AMIBERRY
 	TrapContext *context;
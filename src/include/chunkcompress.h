@@ -0,0 +1,10 @@
+#ifndef UAE_CHUNKCOMPRESS_H
+#define UAE_CHUNKCOMPRESS_H
+
+#include "uae/types.h"
+
+typedef void (*CHUNK_WRITE)(void *user, const void *data, size_t len);
+
+extern size_t chunk_compress(const uae_u8 *chunk, size_t len, bool zstd, CHUNK_WRITE write, void *user);
+
+#endif /* UAE_CHUNKCOMPRESS_H */
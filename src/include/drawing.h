@@ -115,6 +115,7 @@ extern void vsync_handle_redraw(int long_field, uae_u16, uae_u16, bool drawlines
 extern bool vsync_handle_check(void);
 extern void reset_drawing(void);
 extern void drawing_init(void);
+extern void drawing_free(void);
 extern bool frame_drawn(int monid);
 extern void redraw_frame(void);
 extern void full_redraw_all(void);
@@ -138,6 +139,7 @@ extern void notice_resolution_seen(int res, bool lace);
 #define IHF_SCROLLLOCK 0
 #define IHF_QUIT_PROGRAM 1
 #define IHF_PICASSO 2
+#define IHF_RUNAHEAD 3
 
 void set_inhibit_frame(int monid, int bit);
 void clear_inhibit_frame(int monid, int bit);
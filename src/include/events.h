@@ -63,6 +63,8 @@ struct ev2
 	uae_u32 data;
 	evfunc2 handler;
 	ev2 *next;
+	int heapidx;
+	uae_u64 seq;
 };
 
 // hsync handlers must have priority over misc
@@ -74,9 +76,10 @@ enum {
 	ev_max
 };
 
+// fixed eventtab2 slots, other events are allocated as needed
 enum {
-	ev2_blitter, ev2_misc,
-	ev2_max = 16
+	ev2_blitter,
+	ev2_max
 };
 
 extern int pissoff_value;
@@ -157,6 +160,10 @@ extern void event2_newevent_x_add_not_exists(evt_t t, uae_u32 data, evfunc2 func
 extern void event2_newevent_x_remove(evfunc2 func);
 extern void event2_newevent_xx_ce(evt_t t, uae_u32 data, evfunc2 func);
 bool event2_newevent_x_exists(evfunc2 func);
+extern void event2_remevent(int no);
+extern void event2_remevent_x(struct ev2 *e);
+// active events in the order they will run, free the list with xfree()
+extern struct ev2 **event2_get_pending(int *cnt);
 
 STATIC_INLINE void event2_newevent_x(int no, evt_t t, uae_u32 data, evfunc2 func)
 {
@@ -176,11 +183,6 @@ STATIC_INLINE void event2_newevent2(evt_t t, uae_u32 data, evfunc2 func)
 	event2_newevent_x(-1, t, data, func);
 }
 
-STATIC_INLINE void event2_remevent(int no)
-{
-	eventtab2[no].active = 0;
-}
-
 void event_audxdat_func(uae_u32);
 void event_setdsr(uae_u32);
 void event_CIA_synced_interrupt(uae_u32);
@@ -13,6 +13,7 @@
 #include "traps.h"
 
 struct hardfilehandle;
+struct hdf_ioqueue;
 
 #define MAX_HDF_CACHE_BLOCKS 128
 #define MAX_SCSI_SENSE 36
@@ -79,6 +80,7 @@ struct hardfiledata {
 
 	struct ini_data *geometry;
 	int specialaccessmode;
+	struct hdf_ioqueue *ioq;
 };
 
 #define HFD_FLAGS_REALDRIVE 1
@@ -114,6 +114,10 @@ typedef struct a_inode_struct {
     unsigned int mountcount;
 	uae_u64 uniq_external;
 	struct virtualfilesysobject *vfso;
+	/* Chains of the unit's uniq index and of the parent's name hashes.  */
+	struct a_inode_struct *uniq_next, *aname_next, *nname_next;
+	/* Name hashes of a directory's children, NULL while it has none.  */
+	struct aino_dirhash *dirhash;
 #ifdef AINO_DEBUG
     uae_u32 checksum2;
 #endif
@@ -143,6 +147,19 @@ extern int fsdb_mode_representable_p (const a_inode *, int);
 extern int fsdb_mode_supported (const a_inode *);
 extern TCHAR *fsdb_create_unique_nname (const a_inode *base, const TCHAR *);
 
+/* Host directory listing cache (osdep/fsdb_dircache.cpp). Each returns
+ * false/NULL when it can't help and the caller should go to the host.  */
+struct stat;
+struct fsdb_dircache_handle;
+extern bool fsdb_dircache_search (const TCHAR *dirname, TCHAR *rel, TCHAR **found);
+extern struct fsdb_dircache_handle *fsdb_dircache_opendir (const TCHAR *dirname);
+extern int fsdb_dircache_readdir (struct fsdb_dircache_handle *, TCHAR *fn);
+extern void fsdb_dircache_closedir (struct fsdb_dircache_handle *);
+extern bool fsdb_dircache_stat (const TCHAR *nname, struct stat *st);
+/* Contents of the db file of dirname, size 0 if there is none, -1 if not cached.  */
+extern uae_u8 *fsdb_dircache_metadata (const TCHAR *dirname, int *size);
+extern void fsdb_dircache_metadata_changed (const TCHAR *dirname);
+
 struct my_opendir_s;
 struct my_openfile_s;
 
@@ -20,4 +20,6 @@ extern void setcapslockstate(int);
 extern void keybuf_inject(const uae_char*);
 extern void keybuf_ignore_next_release(void);
 extern void keybuf_vsync(void);
+extern void keybuf_runahead_mark(void);
+extern void keybuf_runahead_rollback(void);
 #endif /* UAE_KEYBUF_H */
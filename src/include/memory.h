@@ -500,6 +500,15 @@ extern addrbank *mem_banks[MEMORY_BANKS];
 extern uae_u8 *baseaddr[MEMORY_BANKS];
 #endif
 
+/* Host address of the start of each 64k bank if the mapped bank's
+ * baseaddr_direct_r/w can be used for it, NULL if accesses must go through
+ * the bank functions. Lets get_long() and friends skip the bank pointer
+ * and the indirect call for plain RAM and ROM. */
+extern uae_u8 *mem_direct_r[MEMORY_BANKS], *mem_direct_w[MEMORY_BANKS];
+extern void memory_direct_set(int bnr);
+/* call when direct pointers of an already mapped bank change */
+extern void memory_direct_update(addrbank *ab);
+
 #define get_mem_bank(addr) (*mem_banks[bankindex(addr)])
 extern addrbank *get_mem_bank_real(uaecptr);
 
@@ -510,10 +519,13 @@ extern addrbank *get_mem_bank_real(uaecptr);
 		baseaddr[bankindex(addr)] = (b)->baseaddr - (realstart); \
 	else \
 		baseaddr[bankindex(addr)] = (uae_u8*)(((uae_u8*)b)+1); \
+	memory_direct_set(bankindex(addr)); \
 } while (0)
 #else
-#define put_mem_bank(addr, b, realstart) \
-	(mem_banks[bankindex(addr)] = (b));
+#define put_mem_bank(addr, b, realstart) do { \
+	(mem_banks[bankindex(addr)] = (b)); \
+	memory_direct_set(bankindex(addr)); \
+} while (0)
 #endif
 
 extern void memory_init (void);
@@ -540,6 +552,22 @@ extern void initramboard(addrbank *ab, struct ramboard *rb);
 extern void loadboardfile(addrbank *ab, struct boardloadfile *lf);
 extern void mman_set_barriers(bool);
 
+/* page protection write tracking, see amiberry_mem.cpp */
+struct writewatch;
+typedef void (*WRITEWATCH_FUNC)(void *user, int page);
+extern int writewatch_pagesize(void);
+extern struct writewatch *writewatch_add(uae_u8 *base, size_t size, WRITEWATCH_FUNC func, void *user);
+extern void writewatch_remove(struct writewatch *ww);
+extern void writewatch_forget(uae_u8 *base, size_t size);
+extern bool writewatch_valid(struct writewatch *ww);
+extern void writewatch_lock(void);
+extern void writewatch_unlock(void);
+extern bool writewatch_armed(struct writewatch *ww, int page);
+extern int writewatch_arm(struct writewatch *ww, int page, int count);
+extern void writewatch_disarm(struct writewatch *ww);
+extern void writewatch_host_write_begin(const void *p, size_t size);
+extern void writewatch_host_write_end(const void *p, size_t size);
+
 uae_u32 memory_get_long(uaecptr);
 uae_u32 memory_get_word(uaecptr);
 uae_u32 memory_get_byte(uaecptr);
@@ -548,22 +576,37 @@ uae_u32 memory_get_wordi(uaecptr);
 
 STATIC_INLINE uae_u32 get_long(uaecptr addr)
 {
+	uae_u8 *m = mem_direct_r[bankindex(addr)];
+	if (m)
+		return do_get_mem_long((uae_u32*)(m + (addr & 0xffff)));
 	return memory_get_long(addr);
 }
 STATIC_INLINE uae_u32 get_word (uaecptr addr)
 {
+	uae_u8 *m = mem_direct_r[bankindex(addr)];
+	if (m)
+		return do_get_mem_word((uae_u16*)(m + (addr & 0xffff)));
 	return memory_get_word(addr);
 }
 STATIC_INLINE uae_u32 get_byte (uaecptr addr)
 {
+	uae_u8 *m = mem_direct_r[bankindex(addr)];
+	if (m)
+		return do_get_mem_byte(m + (addr & 0xffff));
 	return memory_get_byte(addr);
 }
 STATIC_INLINE uae_u32 get_longi(uaecptr addr)
 {
+	uae_u8 *m = mem_direct_r[bankindex(addr)];
+	if (m)
+		return do_get_mem_long((uae_u32*)(m + (addr & 0xffff)));
 	return memory_get_longi(addr);
 }
 STATIC_INLINE uae_u32 get_wordi(uaecptr addr)
 {
+	uae_u8 *m = mem_direct_r[bankindex(addr)];
+	if (m)
+		return do_get_mem_word((uae_u16*)(m + (addr & 0xffff)));
 	return memory_get_wordi(addr);
 }
 
@@ -695,15 +738,27 @@ void memory_put_byte(uaecptr, uae_u32);
 
 STATIC_INLINE void put_long (uaecptr addr, uae_u32 l)
 {
-	memory_put_long(addr, l);
+	uae_u8 *m = mem_direct_w[bankindex(addr)];
+	if (m)
+		do_put_mem_long((uae_u32*)(m + (addr & 0xffff)), l);
+	else
+		memory_put_long(addr, l);
 }
 STATIC_INLINE void put_word (uaecptr addr, uae_u32 w)
 {
-	memory_put_word(addr, w);
+	uae_u8 *m = mem_direct_w[bankindex(addr)];
+	if (m)
+		do_put_mem_word((uae_u16*)(m + (addr & 0xffff)), w);
+	else
+		memory_put_word(addr, w);
 }
 STATIC_INLINE void put_byte (uaecptr addr, uae_u32 b)
 {
-	memory_put_byte(addr, b);
+	uae_u8 *m = mem_direct_w[bankindex(addr)];
+	if (m)
+		do_put_mem_byte(m + (addr & 0xffff), b);
+	else
+		memory_put_byte(addr, b);
 }
 
 // do split memory access if it can cross memory banks
@@ -848,6 +903,7 @@ extern void REGPARAM3 chipmem_bput (uaecptr, uae_u32) REGPARAM;
 
 extern uae_u32 REGPARAM3 chipmem_agnus_wget (uaecptr) REGPARAM;
 extern void REGPARAM3 chipmem_agnus_wput (uaecptr, uae_u32) REGPARAM;
+extern uae_u8 *chipmem_agnus_xlate_range(uae_s64 start, uae_s64 end);
 
 extern addrbank dummy_bank;
 
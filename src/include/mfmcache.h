@@ -0,0 +1,21 @@
+#ifndef UAE_MFMCACHE_H
+#define UAE_MFMCACHE_H
+
+#include "uae/types.h"
+
+/* encodes a track into mfm, returns its length in bits or -1 if the track isn't cached */
+typedef int (*MFMCACHE_ENCODE)(void *user, int cyl, int side, uae_u16 *mfm, int *skipoffset);
+
+struct mfmcache;
+
+extern struct mfmcache *mfmcache_alloc(int maxtracks, int maxwords);
+extern void mfmcache_start(struct mfmcache *mc, MFMCACHE_ENCODE encode, void *user, int numtracks, int cyl);
+extern void mfmcache_stop(struct mfmcache *mc);
+extern bool mfmcache_active(struct mfmcache *mc);
+extern bool mfmcache_get(struct mfmcache *mc, int tr, uae_u16 *mfm, int *tracklen, int *skipoffset);
+extern void mfmcache_put(struct mfmcache *mc, int tr, const uae_u16 *mfm, int tracklen, int skipoffset);
+extern void mfmcache_prefetch(struct mfmcache *mc, int cyl);
+extern void mfmcache_write_begin(struct mfmcache *mc);
+extern void mfmcache_write_end(struct mfmcache *mc, int tr);
+
+#endif /* UAE_MFMCACHE_H */
@@ -884,6 +884,11 @@ extern cpuop_func *cpufunctbl[65536] ASM_SYM_FOR_FUNC("cpufunctbl");
 #ifdef JIT
 extern void (*flush_icache)(int);
 extern void compemu_reset(void);
+extern void compemu_persist_save(void);
+extern void compemu_persist_reset(void);
+extern void compemu_hot_stats(void);
+extern bool compemu_persist_hot(uaecptr pc, const uae_u8 *pcp);
+extern void compemu_persist_record(uaecptr pc, const uae_u8 *pcp, int len);
 #else
 #define flush_icache(int) do {} while (0)
 #define flush_icache_hard(int) do {} while (0)
@@ -676,6 +676,8 @@ struct uae_prefs {
 	bool comp_hardflush;
 	bool comp_constjump;
 	bool comp_catchfault;
+	bool comp_persist;
+	bool comp_hotblocks;
 	int cachesize;
 	bool cachesize_inhibit;
 	TCHAR jitblacklist[MAX_DPATH];
@@ -788,6 +790,7 @@ struct uae_prefs {
 	int filesys_limit;
 	int filesys_max_name;
 	int filesys_max_file_size;
+	int hdf_cache_size;
 	bool filesys_inject_icons;
 	TCHAR filesys_inject_icons_tool[MAX_DPATH];
 	TCHAR filesys_inject_icons_project[MAX_DPATH];
@@ -1029,6 +1032,9 @@ struct uae_prefs {
 	struct slirp_redir slirp_redirs[MAX_SLIRP_REDIRS];
 #endif
 	int statecapturerate, statecapturebuffersize;
+	bool statecapturedelta, statecapturecompress;
+	int statecapturedeltasize;
+	int runahead;
 
 	TCHAR open_gui[256];
 	TCHAR quit_amiberry[256];
@@ -1307,6 +1313,10 @@ struct amiberry_options
 	bool rctrl_as_ramiga = false;
 	bool gui_joystick_control = true;
 	bool default_multithreaded_drawing = true;
+	int denise_render_threads = 0;
+	bool rtg_vram_write_protect = false;
+	bool floppy_track_cache = false;
+	bool savestate_zstd = false;
 	int default_line_mode = 1;
 	int input_default_mouse_speed = 100;
 	bool input_keyboard_as_joystick_stop_keypresses = false;
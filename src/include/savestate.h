@@ -289,6 +289,20 @@ STATIC_INLINE bool isrestore(void)
 	return savestate_state == STATE_RESTORE || savestate_state == STATE_REWIND;
 }
 
+/* run-ahead: speculative frames left in this cycle, -1 while rolling back */
+extern int savestate_runahead;
+/* the frame being emulated is not going to be shown */
+extern bool savestate_runahead_hidden;
+
+/* emulating frames that will be rolled back, host input and sound must wait */
+STATIC_INLINE bool isrunahead(void)
+{
+	return savestate_runahead != 0;
+}
+
+extern bool savestate_runahead_resume(void);
+extern void savestate_runahead_stop(void);
+
 extern void savestate_quick(int slot, int save);
 
 extern void savestate_capture(int);
@@ -6,6 +6,7 @@
 typedef uae_s64 (*ZFILEREAD)(void*, uae_u64, uae_u64, struct zfile*);
 typedef uae_s64 (*ZFILEWRITE)(const void*, uae_u64, uae_u64, struct zfile*);
 typedef uae_s64 (*ZFILESEEK)(struct zfile*, uae_s64, int);
+typedef void (*ZFILECLOSE)(struct zfile*);
 
 struct zfile {
     TCHAR *name;
@@ -31,6 +32,7 @@ struct zfile {
     ZFILEREAD zfileread;
     ZFILEWRITE zfilewrite;
     ZFILESEEK zfileseek;
+    ZFILECLOSE zfileclose; // frees what userdata points to
     void *userdata;
     int useparent;
 };
@@ -147,6 +149,11 @@ extern void archive_access_close (void *handle, unsigned int id);
 extern struct zfile *archive_getzfile (struct znode *zn, unsigned int id, int flags);
 extern struct zfile *archive_unpackzfile (struct zfile *zf);
 
+/* compressed members at least this large are inflated on demand */
+#define ZFILE_STREAM_MIN_SIZE (8 * 1024 * 1024)
+extern struct zfile *zfile_fopen_deflate (struct zfile *z, const TCHAR *name, uae_u64 offset, uae_u64 csize, uae_u64 size);
+extern bool zfile_isdeflate (struct zfile *z);
+
 //extern struct zfile *decompress_zfd (struct zfile*);
 
 #endif /* UAE_ZARCHIVE_H */
@@ -24,7 +24,7 @@ struct fs_dirhandle
 	int fstype;
 	union {
 		struct zdirectory *zd;
-		struct my_opendir_s *od;
+		struct fsdb_dircache_handle *dcd;
 		struct cd_opendir_s *isod;
 	};
 };
@@ -73,6 +73,7 @@ extern uae_u8 *zfile_getdata(struct zfile *z, uae_s64 offset, int len, int *outl
 extern void zfile_exit(void);
 extern int execute_command(TCHAR *);
 extern int zfile_iscompressed(struct zfile *z);
+extern int zfile_isondemand(struct zfile *z);
 extern int zfile_zcompress(struct zfile *dst, void *src, size_t size);
 extern int zfile_zuncompress(void *dst, int dstsize, struct zfile *src, int srcsize);
 extern int zfile_gettype(struct zfile *z);
@@ -0,0 +1,20 @@
+#ifndef UAE_ZINFLATE_H
+#define UAE_ZINFLATE_H
+
+#include "uae/types.h"
+
+// deflate can't expand data more than this
+#define ZINFLATE_MAXRATIO 1032
+
+/* reads len bytes of the compressed stream at offset, returns bytes read */
+typedef uae_s64 (*ZINFLATE_READ)(void *user, uae_s64 offset, void *buf, uae_s64 len);
+
+struct zinflate;
+
+extern struct zinflate *zinflate_open(uae_s64 csize, ZINFLATE_READ read, void *user, const TCHAR *name);
+extern void zinflate_close(struct zinflate *zi);
+extern uae_s64 zinflate_read(struct zinflate *zi, uae_s64 pos, void *data, uae_s64 size);
+extern uae_s64 zinflate_scan(struct zinflate *zi);
+extern uae_s64 zinflate_csize(struct zinflate *zi);
+
+#endif /* UAE_ZINFLATE_H */
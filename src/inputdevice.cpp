@@ -3622,6 +3622,9 @@ static int inputread;
 void inputdevice_read_msg(bool vblank)
 {
 	int got2 = 0;
+	// host input is only fed to real frames, not to speculative run-ahead frames
+	if (isrunahead())
+		return;
 	for (;;) {
 		int got = handle_msgpump(vblank);
 		if (!got)
@@ -4332,6 +4335,10 @@ void inputdevice_hsync(bool forceread)
 	catweasel_hsync ();
 #endif
 
+	// queued host events wait for the real frame
+	if (isrunahead())
+		return;
+
 	int cnt = 0;
 	struct delayed_event *de = delayed_events, *prev = NULL;
 	while (de) {
@@ -5906,7 +5913,7 @@ void inputdevice_vsync (void)
 	if (inputdevice_logging & 32)
 		write_log (_T("*\n"));
 
-	if (autopause > 0 && pause_emulation == 0) {
+	if (autopause > 0 && pause_emulation == 0 && !isrunahead()) {
 		autopause--;
 		if (!autopause) {
 			pausemode(1);
@@ -5920,7 +5927,8 @@ void inputdevice_vsync (void)
 	mouseupdate (0, true);
 	inputread = -1;
 
-	inputdevice_handle_inputcode ();
+	if (!isrunahead())
+		inputdevice_handle_inputcode ();
 	if (mouseedge_alive > 0)
 		mouseedge_alive--;
 	if (mouseedge(monid))
@@ -5936,7 +5944,8 @@ void inputdevice_vsync (void)
 			setmouseactive(0, -1);
 		}
 	}
-	inputdevice_checkconfig ();
+	if (!isrunahead())
+		inputdevice_checkconfig ();
 
 	if (currprefs.turbo_emulation > 2) {
 		currprefs.turbo_emulation--;
@@ -5949,6 +5958,9 @@ void inputdevice_vsync (void)
 
 void inputdevice_reset (void)
 {
+	// a run-ahead rollback is not a reset, keep the host side state
+	if (isrunahead())
+		return;
 	magicmouse_ibase = 0;
 	magicmouse_gfxbase = 0;
 	mousehack_reset ();
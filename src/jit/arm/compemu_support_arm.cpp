@@ -41,6 +41,7 @@
 #include "events.h"
 #include "include/memory.h"
 #include "newcpu.h"
+#include "benchmark.h"
 #include "comptbl_arm.h"
 #include "compemu_arm.h"
 #include <SDL.h>
@@ -2738,6 +2739,7 @@ static inline unsigned int get_opcode_cft_map(unsigned int f)
 void compile_block(cpu_history* pc_hist, int blocklen, int totcycles)
 {
     if (cache_enabled && compiled_code && currprefs.cpu_model >= 68020) {
+        benchmark_scope bench(BENCH_JIT);
 #ifdef PROFILE_COMPILE_TIME
         compile_count++;
         clock_t start_time = clock();
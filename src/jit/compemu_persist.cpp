@@ -0,0 +1,200 @@
+/*
+* UAE - The Un*x Amiga Emulator
+*
+* JIT warm start profile
+*
+* Translated code can't be reused across sessions as it embeds host
+* addresses of the emulator state, handlers and other blocks. What can be
+* kept is the knowledge which 68k blocks got hot enough to be translated.
+* The profile is keyed by the Kickstart ROM, the RAM layout and the JIT
+* settings, and each entry carries a checksum of the 68k code it was
+* recorded for. A block whose code still matches is translated on its
+* first execution instead of going through the countdown stub first.
+*/
+
+#include "sysconfig.h"
+#include "sysdeps.h"
+
+#ifdef JIT
+
+#include <unordered_map>
+
+#include "options.h"
+#include "memory.h"
+#include "newcpu.h"
+#include "zfile.h"
+#include "crc32.h"
+#include "uae.h"
+
+#define PERSIST_MAGIC 0x4a495431 /* JIT1 */
+#define PERSIST_MAX_ENTRIES 65536
+#define PERSIST_MAX_LEN 1024
+
+struct persist_entry
+{
+	uae_u32 pc;
+	uae_u32 len;
+	uae_u32 c1, c2;
+};
+
+static std::unordered_map<uae_u32, persist_entry> persist_hints;
+static bool persist_loaded, persist_dirty;
+static uae_u32 persist_key;
+static int persist_hits;
+
+static void persist_checksum(const uae_u8 *p, int len, uae_u32 *c1, uae_u32 *c2)
+{
+	uae_u32 k1 = 0, k2 = 0;
+	for (int i = 0; i + 4 <= len; i += 4) {
+		uae_u32 v;
+		memcpy(&v, p + i, 4);
+		k1 += v;
+		k2 ^= v;
+	}
+	*c1 = k1;
+	*c2 = k2;
+}
+
+static uae_u32 persist_hash(uae_u32 h, uae_u32 v)
+{
+	for (int i = 0; i < 4; i++) {
+		h ^= (v >> (i * 8)) & 0xff;
+		h *= 16777619;
+	}
+	return h;
+}
+
+static uae_u32 persist_calc_key(void)
+{
+	uae_u32 h = 2166136261u;
+
+	if (kickmem_bank.baseaddr && kickmem_bank.allocated_size)
+		h = persist_hash(h, get_crc32(kickmem_bank.baseaddr, kickmem_bank.allocated_size));
+	h = persist_hash(h, currprefs.cpu_model);
+	h = persist_hash(h, currprefs.fpu_model);
+	h = persist_hash(h, currprefs.address_space_24);
+	h = persist_hash(h, currprefs.cachesize);
+	h = persist_hash(h, currprefs.comptrustbyte | (currprefs.comptrustword << 4) | (currprefs.comptrustlong << 8) | (currprefs.comptrustnaddr << 12));
+	h = persist_hash(h, currprefs.compnf | (currprefs.compfpu << 1) | (currprefs.comp_constjump << 2) | (currprefs.comp_hardflush << 3));
+	h = persist_hash(h, currprefs.chipmem.size);
+	h = persist_hash(h, currprefs.bogomem.size);
+	h = persist_hash(h, currprefs.mbresmem_low.size);
+	h = persist_hash(h, currprefs.mbresmem_high.size);
+	for (int i = 0; i < MAX_RAM_BOARDS; i++) {
+		h = persist_hash(h, currprefs.fastmem[i].size);
+		h = persist_hash(h, currprefs.z3fastmem[i].size);
+	}
+	return h;
+}
+
+static void persist_path(TCHAR *path, uae_u32 key)
+{
+	TCHAR tmp[MAX_DPATH];
+	get_nvram_path(tmp, sizeof tmp / sizeof(TCHAR));
+	_sntprintf(path, MAX_DPATH, _T("%sjit_%08x.jitp"), tmp, key);
+}
+
+static void persist_load(void)
+{
+	TCHAR path[MAX_DPATH];
+	uae_u32 hdr[3];
+
+	persist_loaded = true;
+	persist_dirty = false;
+	persist_hits = 0;
+	persist_hints.clear();
+	persist_key = persist_calc_key();
+	persist_path(path, persist_key);
+	struct zfile *f = zfile_fopen(path, _T("rb"), ZFD_NORMAL);
+	if (!f)
+		return;
+	if (zfile_fread(hdr, sizeof hdr, 1, f) == 1 && hdr[0] == PERSIST_MAGIC && hdr[1] == persist_key && hdr[2] <= PERSIST_MAX_ENTRIES) {
+		for (uae_u32 i = 0; i < hdr[2]; i++) {
+			persist_entry e;
+			if (zfile_fread(&e, sizeof e, 1, f) != 1)
+				break;
+			if (e.len <= PERSIST_MAX_LEN)
+				persist_hints[e.pc] = e;
+		}
+		write_log(_T("JIT: loaded %d hot blocks from '%s'\n"), (int)persist_hints.size(), path);
+	}
+	zfile_fclose(f);
+}
+
+void compemu_persist_save(void)
+{
+	TCHAR path[MAX_DPATH];
+	uae_u32 hdr[3];
+
+	if (!persist_loaded || !persist_dirty)
+		return;
+	persist_dirty = false;
+	persist_path(path, persist_key);
+	struct zfile *f = zfile_fopen(path, _T("wb"), 0);
+	if (!f) {
+		write_log(_T("JIT: can't write '%s'\n"), path);
+		return;
+	}
+	hdr[0] = PERSIST_MAGIC;
+	hdr[1] = persist_key;
+	hdr[2] = (uae_u32)persist_hints.size();
+	zfile_fwrite(hdr, sizeof hdr, 1, f);
+	for (const auto &it : persist_hints)
+		zfile_fwrite(&it.second, sizeof it.second, 1, f);
+	zfile_fclose(f);
+	write_log(_T("JIT: saved %d hot blocks to '%s', %d reused this session\n"), (int)hdr[2], path, persist_hits);
+}
+
+void compemu_persist_reset(void)
+{
+	compemu_persist_save();
+	// ROM and settings may have changed, key is recalculated on next use
+	persist_loaded = false;
+	persist_hints.clear();
+}
+
+bool compemu_persist_hot(uaecptr pc, const uae_u8 *pcp)
+{
+	uae_u32 c1, c2;
+
+	if (!persist_loaded)
+		persist_load();
+	auto it = persist_hints.find(pc);
+	if (it == persist_hints.end())
+		return false;
+	// the recorded block may not fit in the bank it is in now
+	if (!valid_address(pc, it->second.len))
+		return false;
+	persist_checksum(pcp, it->second.len, &c1, &c2);
+	if (c1 != it->second.c1 || c2 != it->second.c2)
+		return false;
+	persist_hits++;
+	return true;
+}
+
+void compemu_persist_record(uaecptr pc, const uae_u8 *pcp, int len)
+{
+	persist_entry e;
+
+	if (!persist_loaded)
+		persist_load();
+	if (len > PERSIST_MAX_LEN)
+		len = PERSIST_MAX_LEN;
+	len &= ~3;
+	if (len <= 0)
+		return;
+	e.pc = pc;
+	e.len = len;
+	persist_checksum(pcp, len, &e.c1, &e.c2);
+	auto it = persist_hints.find(pc);
+	if (it != persist_hints.end()) {
+		if (!memcmp(&it->second, &e, sizeof e))
+			return;
+	} else if (persist_hints.size() >= PERSIST_MAX_ENTRIES) {
+		return;
+	}
+	persist_hints[pc] = e;
+	persist_dirty = true;
+}
+
+#endif /* JIT */
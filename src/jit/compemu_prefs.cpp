@@ -18,6 +18,7 @@ bool check_prefs_changed_comp (bool checkonly)
 		currprefs.compnf != changed_prefs.compnf ||
 		currprefs.comp_hardflush != changed_prefs.comp_hardflush ||
 		currprefs.comp_constjump != changed_prefs.comp_constjump ||
+		currprefs.comp_hotblocks != changed_prefs.comp_hotblocks ||
 		currprefs.compfpu != changed_prefs.compfpu ||
 		currprefs.fpu_strict != changed_prefs.fpu_strict ||
 		currprefs.cachesize != changed_prefs.cachesize)
@@ -33,6 +34,7 @@ bool check_prefs_changed_comp (bool checkonly)
 	currprefs.compnf = changed_prefs.compnf;
 	currprefs.comp_hardflush = changed_prefs.comp_hardflush;
 	currprefs.comp_constjump = changed_prefs.comp_constjump;
+	currprefs.comp_hotblocks = changed_prefs.comp_hotblocks;
 	currprefs.compfpu = changed_prefs.compfpu;
 	currprefs.fpu_strict = changed_prefs.fpu_strict;
 
@@ -126,6 +126,7 @@ static inline void *vm_acquire(uae_u32 size, int options = VM_MAP_DEFAULT)
 #define UNUSED(x)
 #include "uae.h"
 #include "uae/log.h"
+#include "benchmark.h"
 #define jit_log(format, ...) \
 	write_log("JIT: " format "\n", ##__VA_ARGS__);
 #define jit_log2(format, ...)
@@ -325,6 +326,15 @@ static int		optcount[10]		= {
 	-1, -1, -1, -1
 };
 
+#ifdef UAE
+/* With comp_hotblocks, blocks of the first translated level keep counting
+   down and are translated once more at OPTLEV_HOT when they expire */
+#define OPTLEV_HOT 7
+#define HOT_BLOCK_COUNT 500
+/* counted at translation time only, the translated code doesn't keep stats */
+static uae_u32 hot_promoted, hot_flag_exits, hot_recompiles;
+#endif
+
 #ifdef UAE
 op_properties prop[65536];
 #else
@@ -698,10 +708,19 @@ static inline void set_dhtu(blockinfo* bi, cpuop_func *dh)
 	}
 }
 
+#ifdef UAE
+static void hot_callers_recompile(blockinfo *bi);
+#endif
+
 static inline void invalidate_block(blockinfo* bi)
 {
 	int i;
 
+#ifdef UAE
+	/* Code changed, hot callers can't trust the old needed_flags */
+	if (bi->relied_flags != 0xff)
+		hot_callers_recompile(bi);
+#endif
 	bi->optlevel=0;
 	bi->count=optcount[0]-1;
 	bi->handler=NULL;
@@ -781,6 +800,51 @@ static inline void mark_callers_recompile(blockinfo * bi)
 	x = next;
   }
 }
+
+#endif
+
+#ifdef UAE
+/* Only the direct callers: hot blocks promise nothing about their own
+   flags, so there is nothing to propagate further */
+static void hot_callers_recompile(blockinfo *bi)
+{
+	dependency *x = bi->deplist;
+
+	bi->relied_flags = 0xff;
+	while (x) {
+		dependency *next = x->next;
+		blockinfo *cbi = x->source;
+		if (x->jmp_off && cbi->optlevel == OPTLEV_HOT) {
+			if (cbi->status == BI_ACTIVE || cbi->status == BI_NEED_CHECK) {
+				block_need_recompile(cbi);
+				hot_recompiles++;
+			} else if (cbi->status == BI_COMPILING) {
+				redo_current_block = 1;
+			}
+		}
+		x = next;
+	}
+}
+
+/* A hot block that ends in a conditional branch doesn't store flags that
+   neither successor reads. The successors' needed_flags become a promise
+   that hot_callers_recompile() takes back when they grow. */
+static bool hot_exit_flags(uintptr next, uintptr taken)
+{
+	blockinfo *bi1 = get_blockinfo_addr((void*)next);
+	blockinfo *bi2 = get_blockinfo_addr((void*)taken);
+
+	if (!bi1 || !bi2 || bi1->status == BI_INVALID || bi2->status == BI_INVALID)
+		return false;
+	if (bi1->needed_flags == 0xff || bi2->needed_flags == 0xff)
+		return false;
+	if ((bi1->needed_flags | bi2->needed_flags) & FLAG_CZNV)
+		return false;
+	bi1->relied_flags &= bi1->needed_flags;
+	bi2->relied_flags &= bi2->needed_flags;
+	hot_flag_exits++;
+	return true;
+}
 #endif
 
 static inline blockinfo* get_blockinfo_addr_new(void* addr, int /* setstate */)
@@ -4070,14 +4134,38 @@ static void prepare_block(blockinfo* bi)
 	bi->env=default_ss;
 	bi->status=BI_INVALID;
 	bi->havestate=0;
+#ifdef UAE
+	bi->relied_flags=0xff;
+#endif
 	//bi->env=empty_ss;
 }
 
 #ifdef UAE
 void compemu_reset(void)
 {
+	compemu_hot_stats();
 	flush_icache = lazy_flush ? flush_icache_lazy : flush_icache_hard;
 	set_cache_state(0);
+	compemu_persist_reset();
+}
+
+void compemu_hot_stats(void)
+{
+	int hot = 0;
+
+	if (!currprefs.comp_hotblocks || !hot_promoted)
+		return;
+	for (int l = 0; l < 2; l++) {
+		for (blockinfo *bi = l ? dormant : active; bi; bi = bi->next) {
+			if (bi->optlevel == OPTLEV_HOT)
+				hot++;
+		}
+	}
+	write_log(_T("JIT: %u blocks promoted to hot, %d alive, %u exits without flag store, %u recompiled for flags\n"),
+		hot_promoted, hot, hot_flag_exits, hot_recompiles);
+	hot_promoted = 0;
+	hot_flag_exits = 0;
+	hot_recompiles = 0;
 }
 #endif
 
@@ -4747,6 +4835,7 @@ static void compile_block(cpu_history* pc_hist, int blocklen)
 {
 	if (cache_enabled && compiled_code) {
 #endif
+		benchmark_scope bench(BENCH_JIT);
 #ifdef PROFILE_COMPILE_TIME
 		compile_count++;
 		clock_t start_time = clock();
@@ -4796,12 +4885,25 @@ static void compile_block(cpu_history* pc_hist, int blocklen)
 				/* What the heck? We are not supposed to be here! */
 			}
 		}
+#ifdef UAE
+		/* Block was hot in an earlier session and its code is unchanged,
+		   skip the countdown and translate it right away */
+		if (currprefs.comp_persist && optlev == 0 && bi->count == optcount[0] - 1 &&
+			compemu_persist_hot(start_pc + (uae_u32)((uae_u8*)pc_hist[0].location - start_pc_p), (uae_u8*)pc_hist[0].location))
+			bi->count = -1;
+#endif
 		if (bi->count==-1) {
 			optlev++;
 			while (!optcount[optlev])
 				optlev++;
 			bi->count=optcount[optlev]-1;
 		}
+#ifdef UAE
+		if (currprefs.comp_hotblocks && optlev == OPTLEV_HOT - 1 && bi->count < 0)
+			bi->count = HOT_BLOCK_COUNT - 1;
+		if (optlev == OPTLEV_HOT && bi->optlevel != OPTLEV_HOT)
+			hot_promoted++;
+#endif
 		current_block_pc_p= JITPTR pc_hist[0].location;
 
 		remove_deps(bi); /* We are about to create new code */
@@ -4857,6 +4959,10 @@ static void compile_block(cpu_history* pc_hist, int blocklen)
 		bi->csi = csi;
 #endif
 
+#ifdef UAE
+		if (liveflags[0] & ~bi->relied_flags)
+			hot_callers_recompile(bi);
+#endif
 		bi->needed_flags=liveflags[0];
 
 		align_target(align_loops);
@@ -5101,6 +5207,14 @@ static void compile_block(cpu_history* pc_hist, int blocklen)
 					extra_len+=2; /* The next instruction now is part of this block */
 				}
 			}
+#ifdef UAE
+			else if (next_pc_p && taken_pc_p && was_comp &&
+				optlev == OPTLEV_HOT && currprefs.compnf &&
+				hot_exit_flags(next_pc_p, taken_pc_p))
+			{
+				dont_care_flags();
+			}
+#endif
 #endif
 			log_flush();
 
@@ -5273,6 +5387,19 @@ static void compile_block(cpu_history* pc_hist, int blocklen)
 		}
 #endif
 
+#ifdef UAE
+		if (currprefs.comp_persist && optlev > 0) {
+			uae_u8 *p0 = (uae_u8*)pc_hist[0].location;
+			intptr span = 0;
+			for (i = 0; i < blocklen; i++) {
+				intptr d = (uae_u8*)pc_hist[i].location - p0;
+				if (d > span && d < 1024)
+					span = d;
+			}
+			compemu_persist_record(start_pc + (uae_u32)(p0 - start_pc_p), p0, (int)span + LONGEST_68K_INST);
+		}
+#endif
+
 		current_cache_size += JITPTR get_target() - JITPTR current_compile_p;
 
 #ifdef JIT_DEBUG
@@ -479,6 +479,11 @@ typedef struct blockinfo_t {
     dependency* deplist; /* List of things that depend on this */
     smallstate  env;
 
+#ifdef UAE
+    /* hot block tier (comp_hotblocks) */
+    uae_u8 relied_flags;    /* needed_flags hot callers rely on, 0xff if none */
+#endif
+
 #ifdef JIT_DEBUG
     /* (gb) size of the compiled block (direct handler) */
     uae_u32 direct_handler_size;
@@ -20,10 +20,12 @@
 #include "keybuf.h"
 #include "inputdevice.h"
 #include "custom.h"
+#include "savestate.h"
 
 int key_swap_hack2 = false;
 
 static int kpb_first, kpb_last;
+static int kpb_runahead;
 
 #define KEYBUF_SIZE 256
 static int keybuf[KEYBUF_SIZE];
@@ -194,6 +196,8 @@ static bool can_inject(void)
 {
 	static int ovpos, cnt;
 
+	if (isrunahead())
+		return false;
 	if (ovpos == vpos)
 		return false;
 	ovpos = vpos;
@@ -332,6 +336,17 @@ int record_key_direct(int kc, bool direct)
 	return 1;
 }
 
+/* Keys read by speculative run-ahead frames are read again after the rollback */
+void keybuf_runahead_mark(void)
+{
+	kpb_runahead = kpb_last;
+}
+
+void keybuf_runahead_rollback(void)
+{
+	kpb_last = kpb_runahead;
+}
+
 void keybuf_init (void)
 {
 	kpb_first = kpb_last = 0;
@@ -71,6 +71,7 @@
 #include "fsdb.h"
 #include "fsdb_host.h"
 #include "keyboard.h"
+#include "benchmark.h"
 
 // Special version string so that AmigaOS can detect it
 static constexpr char __ver[40] = "$VER: Amiberry v8.0.0 (2025-12-21)";
@@ -851,6 +852,8 @@ void usage()
 	std::cout << " --autoload <file>          Load an .lha WHDLoad game or a CD32 CD image, using the WHDBooter." << '\n';
 	std::cout << " --cdimage <file>           Load the CD image provided when starting emulation." << '\n';
 	std::cout << " --statefile <file>         Load a save state file." << '\n';
+	std::cout << " --benchmark <frames>       Run headless at maximum speed for the given number of frames and" << '\n';
+	std::cout << "                            print a timing report on exit." << '\n';
 	std::cout << " -s <option>=<value>        Set one or more configuration options directly, without loading a file." <<
 		'\n';
 	std::cout << "                            Edit a configuration file in order to know valid parameters and settings." <<
@@ -1143,6 +1146,13 @@ static void parse_cmdline (int argc, TCHAR **argv)
 			console_emulation = true;
 		else if (_tcscmp(argv[i], _T("--log")) == 0)
 			console_logging = 1;
+		else if (_tcscmp(argv[i], _T("--benchmark")) == 0)
+		{
+			if (i + 1 == argc)
+				write_log(_T("Missing argument for '--benchmark' option.\n"));
+			else
+				benchmark_frames = _tstol(argv[++i]);
+		}
 		else if (_tcscmp(argv[i], _T("-s")) == 0)
 		{
 			if (i + 1 == argc)
@@ -1285,6 +1295,9 @@ static void parse_cmdline (int argc, TCHAR **argv)
 			usage();
 		}
 	}
+	// applied last so that a config loaded later on the command line can't undo it
+	if (benchmark_active())
+		benchmark_prefs(&currprefs);
 }
 
 static void parse_cmdline_and_init_file(int argc, TCHAR **argv)
@@ -1347,6 +1360,7 @@ static void do_start_program ()
 	{
 		write_log("An exception was thrown while running m68k_go!\n");
 	}
+	benchmark_report ();
 }
 
 static void start_program ()
@@ -106,6 +106,7 @@ static int bogomem_aliasing;
 static bool last_address_space_24;
 
 addrbank *mem_banks[MEMORY_BANKS];
+uae_u8 *mem_direct_r[MEMORY_BANKS], *mem_direct_w[MEMORY_BANKS];
 
 /* This has two functions. It either holds a host address that, when added
 to the 68k address, gives the host address corresponding to that 68k
@@ -869,6 +870,17 @@ static uae_u8 *REGPARAM2 chipmem_xlate (uaecptr addr)
 	return chipmem_bank.baseaddr + addr;
 }
 
+/* Host pointer to Agnus-visible chip RAM if every word in [start, end]
+ * is accessed by chipmem_agnus_wget/wput as plain RAM, NULL otherwise. */
+uae_u8 *chipmem_agnus_xlate_range(uae_s64 start, uae_s64 end)
+{
+	if (chipmem_wget_indirect != chipmem_agnus_wget || chipmem_wput_indirect != chipmem_agnus_wput)
+		return NULL;
+	if (start < 0 || start > end || end + 2 > chipmem_full_size)
+		return NULL;
+	return chipmem_bank.baseaddr + start;
+}
+
 STATIC_INLINE void REGPARAM2 chipmem_lput_bigmem (uaecptr addr, uae_u32 v)
 {
 	put_long (addr, v);
@@ -1070,6 +1082,7 @@ static void a1000_handle_kickstart (int mode)
 		kickstart_version = 0;
 		kickmem_bank.baseaddr_direct_r = NULL;
 	}
+	memory_direct_update(&kickmem_bank);
 	if (kickstart_version == 0xffff)
 		kickstart_version = 0;
 }
@@ -2211,6 +2224,33 @@ err:
 	return 0;
 }
 
+static uae_u8 *memory_direct_ptr(addrbank *ab, uae_u8 *base, int bnr)
+{
+	// the whole 64k bank must be contiguous in host memory
+	if (!base || ab->mask < 0xffff || ((ab->mask + 1) & ab->mask) || (ab->startaccessmask & 0xffff))
+		return NULL;
+	return base + ((((uae_u32)bnr << 16) - ab->startaccessmask) & ab->mask);
+}
+
+void memory_direct_set(int bnr)
+{
+	addrbank *ab = mem_banks[bnr];
+	if (!ab) {
+		mem_direct_r[bnr] = mem_direct_w[bnr] = NULL;
+		return;
+	}
+	mem_direct_r[bnr] = memory_direct_ptr(ab, ab->baseaddr_direct_r, bnr);
+	mem_direct_w[bnr] = memory_direct_ptr(ab, ab->baseaddr_direct_w, bnr);
+}
+
+void memory_direct_update(addrbank *ab)
+{
+	for (int i = 0; i < MEMORY_BANKS; i++) {
+		if (mem_banks[i] == ab)
+			memory_direct_set(i);
+	}
+}
+
 static void set_direct_memory(addrbank *ab)
 {
 	if (!(ab->flags & ABFLAG_DIRECTACCESS))
@@ -2221,6 +2261,7 @@ static void set_direct_memory(addrbank *ab)
 	ab->baseaddr_direct_r = ab->baseaddr;
 	if (!(ab->flags & ABFLAG_ROM))
 		ab->baseaddr_direct_w = ab->baseaddr;
+	memory_direct_update(ab);
 }
 
 #ifndef NATMEM_OFFSET
@@ -2234,12 +2275,16 @@ bool mapped_malloc (addrbank *ab)
 	ab->baseaddr_direct_r = NULL;
 	ab->baseaddr_direct_w = NULL;
 	ab->flags &= ~ABFLAG_MAPPED;
+	memory_direct_update(ab);
 	set_direct_memory(ab);
 	return ab->baseaddr != NULL;
 }
 
 void mapped_free (addrbank *ab)
 {
+	ab->baseaddr_direct_r = NULL;
+	ab->baseaddr_direct_w = NULL;
+	memory_direct_update(ab);
 	xfree(ab->baseaddr);
 	ab->flags &= ~ABFLAG_MAPPED;
 	ab->allocated_size = 0;
@@ -2371,6 +2416,7 @@ bool mapped_malloc (addrbank *ab)
 	ab->baseaddr_direct_r = NULL;
 	ab->baseaddr_direct_w = NULL;
 	ab->flags &= ~ABFLAG_MAPPED;
+	memory_direct_update(ab);
 
 	if (ab->label && ab->label[0] == '*') {
 		if (ab->start == 0 || ab->start == 0xffffffff) {
@@ -2777,6 +2823,7 @@ static void setmemorywidth(struct ramboard *mb, addrbank *ab)
 	if (mb->fault) {
 		ab->baseaddr_direct_w = NULL;
 		ab->baseaddr_direct_r = NULL;
+		memory_direct_update(ab);
 		ab->lput = &dummy_lput;
 		ab->wput = &dummy_wput;
 		ab->bput = &dummy_bput;
@@ -0,0 +1,206 @@
+/*
+* UAE - The Un*x Amiga Emulator
+*
+* MFM track cache
+*
+* A worker thread encodes the tracks around the head with the owner's
+* encode callback, so stepping normally finds the next track already
+* encoded. Lookups never wait for the worker, a track that is being
+* encoded right now is simply a miss.
+*/
+
+#include "sysconfig.h"
+#include "sysdeps.h"
+
+#include "threaddep/thread.h"
+#include "mfmcache.h"
+
+#define MFMCACHE_AHEAD 2 /* cylinders encoded in each direction */
+#define MFMCACHE_MAX 8
+
+struct mfmcache_track
+{
+	uae_u16 *mfm;
+	int tracklen;
+	int skipoffset;
+	bool valid;
+};
+
+struct mfmcache
+{
+	uae_sem_t lock;
+	MFMCACHE_ENCODE encode; // NULL when stopped
+	void *user;
+	int numtracks, maxtracks;
+	int busy; // owner is changing what encode() reads
+	volatile int want_cyl;
+	uae_u16 *buf;
+	struct mfmcache_track *track;
+};
+
+static struct mfmcache *mfmcaches[MFMCACHE_MAX];
+static int mfmcache_count;
+static uae_sem_t mfmcache_sem;
+
+static void mfmcache_store(struct mfmcache_track *t, const uae_u16 *mfm, int tracklen, int skipoffset)
+{
+	int words = (tracklen + 15) / 16;
+
+	t->mfm = xrealloc(uae_u16, t->mfm, words);
+	memcpy(t->mfm, mfm, words * sizeof(uae_u16));
+	t->tracklen = tracklen;
+	t->skipoffset = skipoffset;
+	t->valid = true;
+}
+
+static void mfmcache_invalidate(struct mfmcache *mc)
+{
+	for (int i = 0; i < mc->maxtracks; i++) {
+		xfree(mc->track[i].mfm);
+		mc->track[i].mfm = NULL;
+		mc->track[i].valid = false;
+	}
+}
+
+static void mfmcache_fill(struct mfmcache *mc)
+{
+	int center = mc->want_cyl;
+	int d = 0;
+
+	while (d <= MFMCACHE_AHEAD * 2) {
+		// head cylinder first, then alternating outwards
+		int cyl = center + ((d & 1) ? (d + 1) / 2 : -(d / 2));
+		d++;
+		for (int s = 0; s < 2 && cyl >= 0; s++) {
+			int tr = cyl * 2 + s;
+			uae_sem_wait(&mc->lock);
+			if (!mc->encode || mc->busy) {
+				uae_sem_post(&mc->lock);
+				return;
+			}
+			if (tr < mc->numtracks && !mc->track[tr].valid) {
+				int skipoffset;
+				int tracklen = mc->encode(mc->user, cyl, s, mc->buf, &skipoffset);
+				if (tracklen >= 0)
+					mfmcache_store(&mc->track[tr], mc->buf, tracklen, skipoffset);
+			}
+			uae_sem_post(&mc->lock);
+		}
+		if (mc->want_cyl != center) {
+			center = mc->want_cyl;
+			d = 0;
+		}
+	}
+}
+
+static int mfmcache_thread(void *v)
+{
+	for (;;) {
+		uae_sem_wait(&mfmcache_sem);
+		for (int i = 0; i < mfmcache_count; i++) {
+			if (mfmcaches[i]->encode)
+				mfmcache_fill(mfmcaches[i]);
+		}
+	}
+	return 0;
+}
+
+/* caches are never freed, stop them and start them again with a new image */
+struct mfmcache *mfmcache_alloc(int maxtracks, int maxwords)
+{
+	struct mfmcache *mc;
+
+	if (mfmcache_count >= MFMCACHE_MAX)
+		return NULL;
+	if (!mfmcache_count) {
+		uae_sem_init(&mfmcache_sem, 0, 0);
+		uae_start_thread(_T("floppy mfm"), mfmcache_thread, NULL, NULL);
+	}
+	mc = xcalloc(struct mfmcache, 1);
+	mc->track = xcalloc(struct mfmcache_track, maxtracks);
+	mc->buf = xmalloc(uae_u16, maxwords);
+	mc->maxtracks = maxtracks;
+	uae_sem_init(&mc->lock, 0, 1);
+	// the worker only looks at it after the next mfmcache_sem post
+	mfmcaches[mfmcache_count++] = mc;
+	return mc;
+}
+
+void mfmcache_start(struct mfmcache *mc, MFMCACHE_ENCODE encode, void *user, int numtracks, int cyl)
+{
+	uae_sem_wait(&mc->lock);
+	mfmcache_invalidate(mc);
+	mc->encode = encode;
+	mc->user = user;
+	mc->numtracks = numtracks < mc->maxtracks ? numtracks : mc->maxtracks;
+	mc->want_cyl = cyl;
+	uae_sem_post(&mc->lock);
+	uae_sem_post(&mfmcache_sem);
+}
+
+/* when this returns the worker is not using the owner's data anymore */
+void mfmcache_stop(struct mfmcache *mc)
+{
+	uae_sem_wait(&mc->lock);
+	mc->encode = NULL;
+	mc->user = NULL;
+	mfmcache_invalidate(mc);
+	uae_sem_post(&mc->lock);
+}
+
+bool mfmcache_active(struct mfmcache *mc)
+{
+	return mc && mc->encode;
+}
+
+bool mfmcache_get(struct mfmcache *mc, int tr, uae_u16 *mfm, int *tracklen, int *skipoffset)
+{
+	bool hit = false;
+
+	// never wait for the worker, encoding the track here is just as fast
+	if (!mfmcache_active(mc) || tr < 0 || tr >= mc->maxtracks || uae_sem_trywait(&mc->lock))
+		return false;
+	if (mc->encode && !mc->busy && mc->track[tr].valid) {
+		struct mfmcache_track *t = &mc->track[tr];
+		memcpy(mfm, t->mfm, ((t->tracklen + 15) / 16) * sizeof(uae_u16));
+		*tracklen = t->tracklen;
+		*skipoffset = t->skipoffset;
+		hit = true;
+	}
+	uae_sem_post(&mc->lock);
+	return hit;
+}
+
+void mfmcache_put(struct mfmcache *mc, int tr, const uae_u16 *mfm, int tracklen, int skipoffset)
+{
+	if (!mfmcache_active(mc) || tr < 0 || tr >= mc->maxtracks || uae_sem_trywait(&mc->lock))
+		return;
+	if (mc->encode && !mc->busy)
+		mfmcache_store(&mc->track[tr], mfm, tracklen, skipoffset);
+	uae_sem_post(&mc->lock);
+}
+
+void mfmcache_prefetch(struct mfmcache *mc, int cyl)
+{
+	if (!mfmcache_active(mc))
+		return;
+	mc->want_cyl = cyl;
+	uae_sem_post(&mfmcache_sem);
+}
+
+/* the worker leaves the cache alone until write_end, the owner can update what encode() reads */
+void mfmcache_write_begin(struct mfmcache *mc)
+{
+	uae_sem_wait(&mc->lock);
+	mc->busy++;
+	uae_sem_post(&mc->lock);
+}
+
+void mfmcache_write_end(struct mfmcache *mc, int tr)
+{
+	uae_sem_wait(&mc->lock);
+	mc->busy--;
+	if (tr >= 0 && tr < mc->maxtracks)
+		mc->track[tr].valid = false;
+	uae_sem_post(&mc->lock);
+}
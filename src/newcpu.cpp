@@ -52,6 +52,7 @@
 #include "x86.h"
 #endif
 #include "devices.h"
+#include "benchmark.h"
 #ifdef WITH_DRACO
 #include "draco.h"
 #endif
@@ -5740,6 +5741,7 @@ void cpu_halt(int id)
 		}
 		regs.halted = id;
 		gui_data.cpu_halted = id;
+		benchmark_trap(id);
 		gui_led(LED_CPU, 0, -1);
 		if (id >= 0) {
 			regs.intmask = 7;
@@ -6656,8 +6658,11 @@ void m68k_go (int may_quit)
 			if (cpu_hardreset) {
 				m68k_reset_restore();
 			}
-			prefs_changed_cpu();
-			build_cpufunctbl();
+			// run-ahead rollback restores the same CPU config every frame
+			if (!isrunahead()) {
+				prefs_changed_cpu();
+				build_cpufunctbl();
+			}
 			set_x_funcs();
 			set_cycles (start_cycles);
 			custom_reset (cpu_hardreset != 0, cpu_keyboardreset);
@@ -6696,7 +6701,8 @@ void m68k_go (int may_quit)
 				savestate_check ();
 			if (input_record == INPREC_RECORD_START)
 				input_record = INPREC_RECORD_NORMAL;
-			statusline_clear();
+			if (!isrunahead())
+				statusline_clear();
 		} else {
 			if (input_record == INPREC_RECORD_START) {
 				input_record = INPREC_RECORD_NORMAL;
@@ -6829,6 +6835,12 @@ void m68k_go (int may_quit)
 		if (quit_program == UAE_QUIT)
 			break;
 	}
+#ifdef JIT
+	compemu_persist_save();
+#if defined(CPU_i386) || defined(CPU_x86_64)
+	compemu_hot_stats();
+#endif
+#endif
 	protect_roms(false);
 	mman_set_barriers(true);
 	in_m68k_go--;
@@ -7262,7 +7274,9 @@ void restore_cpu_finish (void)
 {
 	if (!currprefs.fpu_model)
 		fpu_reset();
-	init_m68k ();
+	// run-ahead rolls back every frame, the CPU model and its tables stay the same
+	if (!isrunahead())
+		init_m68k ();
 	m68k_setpc_normal (regs.pc);
 	doint ();
 	fill_prefetch_quick ();
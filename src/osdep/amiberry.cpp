@@ -3563,6 +3563,22 @@ void save_amiberry_settings()
 	// This helps with performance, but may cause glitches in some cases
 	write_bool_option("default_multithreaded_drawing", amiberry_options.default_multithreaded_drawing);
 
+	// Extra threads that draw simple chipset lines in parallel with the drawing thread (0-7)
+	// Only used with multithreaded drawing, 0 disables it
+	write_int_option("denise_render_threads", amiberry_options.denise_render_threads);
+
+	// Track RTG VRAM writes with page protection (Linux), RTG screen updates copy only written pages
+	// Off by default, the first write to each page after a frame costs a fault
+	write_bool_option("rtg_vram_write_protect", amiberry_options.rtg_vram_write_protect);
+
+	// Encode the MFM data of floppy image tracks around the drive head in a background thread
+	// Used with ADF and PC disk images of up to 4MB
+	write_bool_option("floppy_track_cache", amiberry_options.floppy_track_cache);
+
+	// Compress savestate chunks with zstd instead of zlib (needs a build with USE_ZSTD)
+	// Faster to save and load, but such states can't be loaded by versions without zstd support
+	write_bool_option("savestate_zstd", amiberry_options.savestate_zstd);
+
 	// Default mouse input speed
 	write_int_option("input_default_mouse_speed", amiberry_options.input_default_mouse_speed);
 
@@ -3864,6 +3880,10 @@ static int parse_amiberry_settings_line(const char *path, char *linea)
 		ret |= cfgfile_yesno(option, value, "rctrl_as_ramiga", &amiberry_options.rctrl_as_ramiga);
 		ret |= cfgfile_yesno(option, value, "gui_joystick_control", &amiberry_options.gui_joystick_control);
 		ret |= cfgfile_yesno(option, value, "default_multithreaded_drawing", &amiberry_options.default_multithreaded_drawing);
+		ret |= cfgfile_intval(option, value, "denise_render_threads", &amiberry_options.denise_render_threads, 1);
+		ret |= cfgfile_yesno(option, value, "rtg_vram_write_protect", &amiberry_options.rtg_vram_write_protect);
+		ret |= cfgfile_yesno(option, value, "floppy_track_cache", &amiberry_options.floppy_track_cache);
+		ret |= cfgfile_yesno(option, value, "savestate_zstd", &amiberry_options.savestate_zstd);
 		ret |= cfgfile_intval(option, value, "input_default_mouse_speed", &amiberry_options.input_default_mouse_speed, 1);
 		ret |= cfgfile_yesno(option, value, "input_keyboard_as_joystick_stop_keypresses", &amiberry_options.input_keyboard_as_joystick_stop_keypresses);
 		ret |= cfgfile_string(option, value, "default_open_gui_key", amiberry_options.default_open_gui_key, sizeof amiberry_options.default_open_gui_key);
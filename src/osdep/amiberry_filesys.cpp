@@ -445,31 +445,21 @@ std::string prefix_with_data_path(const std::string& filename)
 			return false;
 		}
 
-		// Use filesystem for better path handling
-		const auto output = iso_8859_1_to_utf8(std::string_view(name));
-		fs::path filepath(output);
-
-		// Get file status using std::filesystem
-		std::error_code ec;
-		auto file_status = fs::status(filepath, ec);
-		if (ec) {
-			write_log("my_stat: status check failed for %s: %s\n",
-				output.c_str(), ec.message().c_str());
-			return false;
-		}
-
-		// Get detailed file information
+		// Entries of mounted directories usually come from the listing cache
 		struct stat st {};
-		if (stat(output.c_str(), &st) == -1) {
-			write_log("my_stat: stat failed for %s: %s\n",
-				output.c_str(), strerror(errno));
-			return false;
+		if (!fsdb_dircache_stat(name, &st)) {
+			const auto output = iso_8859_1_to_utf8(std::string_view(name));
+			if (stat(output.c_str(), &st) == -1) {
+				write_log("my_stat: stat failed for %s: %s\n",
+					output.c_str(), strerror(errno));
+				return false;
+			}
 		}
 
 		// Fill in the stat buffer
 		statbuf->size = st.st_size;
-		statbuf->mode = ((file_status.permissions() & fs::perms::owner_read) != fs::perms::none ? FILEFLAG_READ : 0) |
-			((file_status.permissions() & fs::perms::owner_write) != fs::perms::none ? FILEFLAG_WRITE : 0);
+		statbuf->mode = ((st.st_mode & S_IRUSR) ? FILEFLAG_READ : 0) |
+			((st.st_mode & S_IWUSR) ? FILEFLAG_WRITE : 0);
 		statbuf->mtime.tv_sec = st.st_mtime + get_local_time_offset(st.st_mtime);
 		statbuf->mtime.tv_usec = 0;
 
@@ -45,6 +45,7 @@
 #include "vkbd/vkbd.h"
 #include "fsdb_host.h"
 #include "savestate.h"
+#include "benchmark.h"
 #include "uae/types.h"
 
 #include <png.h>
@@ -281,10 +282,84 @@ static bool SDL2_alloctexture(int monid, int w, int h)
 
 	AmigaMonitor* mon = &AMonitors[monid];
 	amiga_texture = SDL_CreateTexture(mon->amiga_renderer, pixel_format, SDL_TEXTUREACCESS_STREAMING, amiga_surface->w, amiga_surface->h);
+	mon->full_render_needed = true;
 	return amiga_texture != nullptr;
 #endif
 }
 
+#ifndef USE_OPENGL
+// Clean rows between two changed ones up to this count are uploaded with them
+#define ROW_UPLOAD_GAP 4
+
+static void upload_amiga_rows(int first, int end)
+{
+	const SDL_Rect rect = { 0, first, amiga_surface->w, end - first };
+	SDL_UpdateTexture(amiga_texture, &rect, static_cast<const uae_u8*>(amiga_surface->pixels) + first * amiga_surface->pitch, amiga_surface->pitch);
+}
+
+// Upload only what changed since the previous frame.
+// RTG reports the changed areas as rectangles. Chipset reports the rows it has drawn,
+// those are compared against a copy of what the texture already holds.
+// If every change was reported and there were none, nothing is uploaded.
+static void update_amiga_texture(AmigaMonitor* mon)
+{
+	const auto* pixels = static_cast<const uae_u8*>(amiga_surface->pixels);
+	const int pitch = amiga_surface->pitch;
+	const int rowbytes = amiga_surface->w * amiga_surface->format->BytesPerPixel;
+	const size_t shadow_size = static_cast<size_t>(rowbytes) * amiga_surface->h;
+	const bool rows = mon->dirty_row_end > mon->dirty_row_first;
+
+	if (mon->full_render_needed || (!mon->dirty_complete && mon->dirty_rects.empty() && !rows) ||
+		(rows && mon->row_shadow.size() != shadow_size)) {
+		SDL_UpdateTexture(amiga_texture, nullptr, pixels, pitch);
+		if (rows) {
+			mon->row_shadow.resize(shadow_size);
+			for (int y = 0; y < amiga_surface->h; y++) {
+				memcpy(&mon->row_shadow[y * rowbytes], pixels + y * pitch, rowbytes);
+			}
+		} else {
+			mon->row_shadow.clear();
+		}
+	} else {
+		if (rows) {
+			const int end = std::min(mon->dirty_row_end, amiga_surface->h);
+			int span_first = -1, span_end = -1;
+			for (int y = std::max(mon->dirty_row_first, 0); y < end; y++) {
+				const uae_u8* src = pixels + y * pitch;
+				uae_u8* shadow = &mon->row_shadow[y * rowbytes];
+				if (!memcmp(src, shadow, rowbytes)) {
+					continue;
+				}
+				memcpy(shadow, src, rowbytes);
+				if (span_first >= 0 && y - span_end > ROW_UPLOAD_GAP) {
+					upload_amiga_rows(span_first, span_end);
+					span_first = -1;
+				}
+				if (span_first < 0) {
+					span_first = y;
+				}
+				span_end = y + 1;
+			}
+			if (span_first >= 0) {
+				upload_amiga_rows(span_first, span_end);
+			}
+		}
+		for (const auto& rect : mon->dirty_rects) {
+			SDL_UpdateTexture(amiga_texture, &rect, pixels + rect.y * pitch + rect.x * amiga_surface->format->BytesPerPixel, pitch);
+		}
+		// the shadow no longer matches the texture
+		if (!mon->dirty_rects.empty()) {
+			mon->row_shadow.clear();
+		}
+	}
+
+	mon->dirty_rects.clear();
+	mon->full_render_needed = false;
+	mon->dirty_complete = false;
+	mon->dirty_row_first = mon->dirty_row_end = 0;
+}
+#endif
+
 static void update_leds(const int monid)
 {
 	AmigaMonitor* mon = &AMonitors[monid];
@@ -377,19 +452,7 @@ static bool SDL2_renderframe(const int monid, int mode, int immediate)
 			SDL_RenderClear(mon->amiga_renderer);
 		}
 
-		// If a full render is needed or there are no specific dirty rects, update the whole texture.
-		if (mutable_mon->full_render_needed || mutable_mon->dirty_rects.empty()) {
-			SDL_UpdateTexture(amiga_texture, nullptr, amiga_surface->pixels, amiga_surface->pitch);
-		} else {
-			// Otherwise, update only the collected dirty rectangles.
-			for (const auto& rect : mutable_mon->dirty_rects) {
-				SDL_UpdateTexture(amiga_texture, &rect, static_cast<const uae_u8*>(amiga_surface->pixels) + rect.y * amiga_surface->pitch + rect.x * amiga_surface->format->BytesPerPixel, amiga_surface->pitch);
-			}
-		}
-
-		// Clear the dirty rects list for the next frame.
-		mutable_mon->dirty_rects.clear();
-		mutable_mon->full_render_needed = false;
+		update_amiga_texture(mutable_mon);
 
 		const SDL_Rect* p_crop = &crop_rect;
 		const SDL_Rect* p_quad = &render_quad;
@@ -437,6 +500,9 @@ static bool SDL2_renderframe(const int monid, int mode, int immediate)
 static void SDL2_showframe(const int monid)
 {
 	const AmigaMonitor* mon = &AMonitors[monid];
+	// nothing is shown and frames are not paced when benchmarking
+	if (benchmark_active())
+		return;
 	SDL_RenderPresent(mon->amiga_renderer);
 
 	static Uint64 freq = 0;
@@ -1339,7 +1405,7 @@ bool render_screen(const int monid, const int mode, const bool immediate)
 	int cnt;
 
 	mon->render_ok = false;
-	if (ad->picasso_on || monitor_off) {
+	if (ad->picasso_on || monitor_off || benchmark_active()) {
 		return mon->render_ok;
 	}
 	cnt = 0;
@@ -1514,16 +1580,20 @@ void unlockscr(struct vidbuffer* vb, int y_start, int y_end)
 		// Not using SDL2_UnlockTexture due to performance reasons, see lockscr for details
 		//SDL_UnlockTexture(amiga_texture);
 
-		// Record the dirty rectangle if y_start and y_end are valid.
-		if (y_start >= 0 && y_end >= y_start) {
-			AmigaMonitor* mon = &AMonitors[vb->monitor_id];
-			SDL_Rect dirty_rect;
-			dirty_rect.x = 0;
-			dirty_rect.y = y_start;
-			dirty_rect.w = vb->width_allocated;
-			dirty_rect.h = y_end - y_start + 1;
-
-			add_dirty_rect(mon, dirty_rect);
+		// Record the drawn rows if y_start and y_end are valid, -2 requests a full update.
+		// Rows that are identical to the previous frame are skipped when uploading.
+		AmigaMonitor* mon = &AMonitors[vb->monitor_id];
+		if (y_start == -2) {
+			mon->full_render_needed = true;
+		} else if (y_start >= 0 && y_end >= y_start) {
+			if (mon->dirty_row_end > mon->dirty_row_first) {
+				mon->dirty_row_first = std::min(mon->dirty_row_first, y_start);
+				mon->dirty_row_end = std::max(mon->dirty_row_end, y_end + 1);
+			} else {
+				mon->dirty_row_first = y_start;
+				mon->dirty_row_end = y_end + 1;
+			}
+			mon->dirty_complete = true;
 		}
 	}
 }
@@ -1550,7 +1620,7 @@ void flush_clear_screen(struct vidbuffer* vb)
 			for (int y = 0; y < vb->height_allocated; y++)
 				memset(static_cast<uae_u8*>(vb->bufmem) + y * vb->rowbytes, 0, bytes_per_row);
 		}
-		unlockscr(vb, -1, -1);
+		unlockscr(vb, -2, -1);
 	}
 }
 
@@ -2648,6 +2718,12 @@ void DX_Invalidate(struct AmigaMonitor* mon, int x, int y, int width, int height
 	mon->p96_double_buffer_needs_flushing = 1;
 }
 
+// The caller reported every change since the last frame through DX_Invalidate()
+void DX_InvalidateComplete(AmigaMonitor* mon)
+{
+	mon->dirty_complete = true;
+}
+
 #endif
 
 static void open_screen(struct AmigaMonitor* mon)
@@ -3571,6 +3647,7 @@ static bool doInit(AmigaMonitor* mon)
 		amiga_surface = nullptr;
 	}
 	amiga_surface = SDL_CreateRGBSurfaceWithFormat(0, display_width, display_height, 32, pixel_format);
+	mon->full_render_needed = true;
 
 	updatewinrect(mon, true);
 	mon->screen_is_initialized = 1;
@@ -3657,6 +3734,7 @@ bool target_graphics_buffer_update(const int monid, const bool force)
 			write_log("!!! Failed to create amiga_surface.\n");
 			return false;
 		}
+		AMonitors[monid].full_render_needed = true;
 	}
 
 	if (!SDL2_alloctexture(mon->monitor_id, w, h)) {
@@ -103,6 +103,12 @@ struct AmigaMonitor {
 
 	std::vector<SDL_Rect> dirty_rects;
 	bool full_render_needed;
+	// chipset rows written since the last upload (end exclusive), compared against row_shadow
+	int dirty_row_first, dirty_row_end;
+	// all changes since the last upload were reported, nothing reported means nothing to upload
+	bool dirty_complete;
+	// chipset: copy of the texture contents, empty when the texture holds something else
+	std::vector<uae_u8> row_shadow;
 	SDL_Surface* statusline_surface;
 	SDL_Texture* statusline_texture;
 	struct winuae_currentmode currentmode;
@@ -134,6 +140,7 @@ extern void reenumeratemonitors();
 extern bool MonitorFromPoint(SDL_Point pt);
 void gfx_DisplayChangeRequested(int);
 void DX_Invalidate(AmigaMonitor*, int x, int y, int width, int height);
+void DX_InvalidateComplete(AmigaMonitor*);
 int gfx_adjust_screenmode(const MultiDisplay* md, int* pwidth, int* pheight);
 
 extern int default_freq;
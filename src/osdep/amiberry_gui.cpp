@@ -8,6 +8,10 @@
 #include <algorithm>
 #include <vector>
 #include <string>
+#include <atomic>
+#include <thread>
+#include <unordered_map>
+#include <zlib.h>
 
 #include <guisan.hpp>
 #include <guisan/sdl.hpp>
@@ -292,11 +296,229 @@ static int addrom(UAEREG* fkey, struct romdata* rd, const TCHAR* name)
 	return 1;
 }
 
+/* ROM scan cache
+ *
+ * What a scan found in each file is kept in romscan.cache next to
+ * amiberry.ini, keyed by path, size and mtime, together with the CRC32 of
+ * the file. Unchanged files are replayed from it without being opened.
+ * Files that are new or changed get their CRC32 calculated by a pool of
+ * threads, which also pulls them into the page cache. A file whose name,
+ * CRC32 and size match a known entry (a copy or a touched file) reuses that
+ * result, anything else goes through the normal identification, which
+ * stays on the scanning thread as zfile and the archivers are not thread
+ * safe. The cache is dropped when the ROM table or the keyring changes.
+ */
+
+#define ROMSCAN_CACHE_MAGIC "AMIBERRY_ROMSCAN 1"
+#define ROMSCAN_MAX_THREADS 8
+
+struct romscan_hit {
+	std::string name; // appended to the path of the file, non-empty inside archives
+	int id; // 0 if only a key file
+	uae_u32 group;
+	bool key;
+};
+
+struct romscan_entry {
+	uae_s64 size;
+	uae_s64 mtime;
+	uae_u32 crc32;
+	bool used;
+	std::vector<romscan_hit> hits;
+};
+
+struct romscan_file {
+	std::string path;
+	uae_s64 size;
+	uae_s64 mtime;
+	uae_u32 crc32;
+	bool ok;
+	bool deepscan;
+};
+
+static std::unordered_map<std::string, romscan_entry> romscan_cache;
+static std::string romscan_stamp;
+static bool romscan_dirty;
+
+static std::string romscan_cache_path()
+{
+	std::string ini = get_ini_file_path();
+	const auto pos = ini.find_last_of('/');
+	if (pos == std::string::npos)
+		return {};
+	return ini.substr(0, pos + 1) + "romscan.cache";
+}
+
+static std::string romscan_make_stamp()
+{
+	int id = 1;
+	while (getromdatabyid(id))
+		id++;
+	return std::to_string(id) + " " + std::to_string(get_keyring());
+}
+
+static void romscan_cache_load()
+{
+	romscan_cache.clear();
+	romscan_dirty = false;
+	romscan_stamp = romscan_make_stamp();
+	const std::string path = romscan_cache_path();
+	if (path.empty())
+		return;
+	std::ifstream in(path);
+	std::string line;
+	if (!std::getline(in, line) || line != std::string(ROMSCAN_CACHE_MAGIC " ") + romscan_stamp)
+		return;
+	romscan_entry* e = nullptr;
+	while (std::getline(in, line)) {
+		// F size mtime crc path / R id group key name, tab separated
+		std::vector<std::string> f;
+		size_t start = 0;
+		for (int i = 0; i < 4; i++) {
+			const auto tab = line.find('\t', start);
+			if (tab == std::string::npos)
+				break;
+			f.push_back(line.substr(start, tab - start));
+			start = tab + 1;
+		}
+		if (f.size() != 4)
+			continue;
+		const std::string last = line.substr(start);
+		if (f[0] == "F") {
+			romscan_entry& ne = romscan_cache[last];
+			ne.size = strtoll(f[1].c_str(), nullptr, 10);
+			ne.mtime = strtoll(f[2].c_str(), nullptr, 10);
+			ne.crc32 = strtoul(f[3].c_str(), nullptr, 16);
+			ne.used = false;
+			ne.hits.clear();
+			e = &ne;
+		} else if (f[0] == "R" && e) {
+			romscan_hit h;
+			h.name = last;
+			h.id = atoi(f[1].c_str());
+			h.group = strtoul(f[2].c_str(), nullptr, 10);
+			h.key = atoi(f[3].c_str()) != 0;
+			e->hits.push_back(h);
+		}
+	}
+	write_log(_T("ROM scan cache: %d files in '%s'\n"), (int)romscan_cache.size(), path.c_str());
+}
+
+static void romscan_cache_save()
+{
+	size_t unused = 0;
+	for (const auto& it : romscan_cache) {
+		if (!it.second.used)
+			unused++;
+	}
+	if (!romscan_dirty && !unused)
+		return;
+	const std::string path = romscan_cache_path();
+	if (path.empty())
+		return;
+	std::ofstream out(path, std::ios::trunc);
+	if (!out) {
+		write_log(_T("ROM scan cache: can't write '%s'\n"), path.c_str());
+		return;
+	}
+	out << ROMSCAN_CACHE_MAGIC " " << romscan_stamp << "\n";
+	char crc[9];
+	// files not seen by this scan are gone or outside the ROM paths now
+	for (const auto& it : romscan_cache) {
+		const romscan_entry& e = it.second;
+		if (!e.used)
+			continue;
+		_sntprintf(crc, sizeof crc, "%08x", e.crc32);
+		out << "F\t" << e.size << "\t" << e.mtime << "\t" << crc << "\t" << it.first << "\n";
+		for (const auto& h : e.hits)
+			out << "R\t" << h.id << "\t" << h.group << "\t" << (h.key ? 1 : 0) << "\t" << h.name << "\n";
+	}
+}
+
+static void romscan_crc_thread(std::vector<romscan_file>* files, std::atomic<size_t>* next)
+{
+	std::vector<uae_u8> buf(65536);
+	for (;;) {
+		const size_t i = (*next)++;
+		if (i >= files->size())
+			break;
+		romscan_file& rf = (*files)[i];
+		FILE* f = fopen(rf.path.c_str(), "rb");
+		if (!f)
+			continue;
+		uLong crc = crc32(0L, Z_NULL, 0);
+		size_t len;
+		while ((len = fread(buf.data(), 1, buf.size(), f)) > 0)
+			crc = crc32(crc, buf.data(), (uInt)len);
+		rf.ok = !ferror(f);
+		fclose(f);
+		rf.crc32 = (uae_u32)crc;
+	}
+}
+
+static void romscan_crc_files(std::vector<romscan_file>& files)
+{
+	std::atomic<size_t> next(0);
+	std::vector<std::thread> pool;
+	unsigned int threads = std::thread::hardware_concurrency();
+	if (threads < 1)
+		threads = 1;
+	if (threads > ROMSCAN_MAX_THREADS)
+		threads = ROMSCAN_MAX_THREADS;
+	if (threads > files.size())
+		threads = (unsigned int)files.size();
+	for (unsigned int i = 1; i < threads; i++)
+		pool.emplace_back(romscan_crc_thread, &files, &next);
+	romscan_crc_thread(&files, &next);
+	for (auto& t : pool)
+		t.join();
+}
+
+static uae_u64 romscan_crc_key(uae_u32 crc, uae_s64 size)
+{
+	return ((uae_u64)size << 32) ^ crc;
+}
+
+/* Same contents under the same file name, identification also looks at
+ * the name. crc_index may be stale, entries can be replaced by rescans. */
+static const romscan_entry* romscan_find_crc(const std::unordered_map<uae_u64, std::string>& crc_index, const romscan_file& rf)
+{
+	const auto it = crc_index.find(romscan_crc_key(rf.crc32, rf.size));
+	if (it == crc_index.end())
+		return nullptr;
+	const auto e = romscan_cache.find(it->second);
+	if (e == romscan_cache.end() || e->second.crc32 != rf.crc32 || e->second.size != rf.size)
+		return nullptr;
+	if (_tcscmp(my_getfilepart(it->second.c_str()), my_getfilepart(rf.path.c_str())))
+		return nullptr;
+	return &e->second;
+}
+
+static struct romdata* romscan_getromdata(int id, uae_u32 group)
+{
+	return getromdatabyidgroup(id, group >> 16, group & 65535);
+}
+
 struct romscandata {
 	UAEREG* fkey;
 	int got;
+	std::vector<romscan_hit>* hits;
+	size_t pathlen;
 };
 
+static void romscan_record(struct romscandata* rsd, const TCHAR* name, struct romdata* rd, bool key)
+{
+	if (!rsd->hits)
+		return;
+	romscan_hit h;
+	const size_t len = _tcslen(name);
+	h.name = len > rsd->pathlen ? std::string(name + rsd->pathlen) : std::string();
+	h.id = rd ? rd->id : 0;
+	h.group = rd ? rd->group : 0;
+	h.key = key;
+	rsd->hits->push_back(h);
+}
+
 static int isromext(const std::string& path, bool deepscan)
 {
 	if (path.empty())
@@ -368,16 +590,18 @@ static int scan_rom_2(struct zfile* f, void* vrsd)
 		addrom(rsd->fkey, rd, path);
 		if (rd->type & ROMTYPE_KEY)
 			addkeyfile(path);
+		romscan_record(rsd, path, rd, (rd->type & ROMTYPE_KEY) != 0);
 		rsd->got = 1;
 	} else if (_tcslen(path) > _tcslen(romkey) && !_tcsicmp(path + _tcslen(path) - _tcslen(romkey), romkey)) {
 		addkeyfile(path);
+		romscan_record(rsd, path, nullptr, true);
 	}
 	return 0;
 }
 
-static int scan_rom(const std::string& path, UAEREG* fkey, bool deepscan)
+static int scan_rom(const std::string& path, UAEREG* fkey, bool deepscan, std::vector<romscan_hit>* hits)
 {
-	struct romscandata rsd = { fkey, 0 };
+	struct romscandata rsd = { fkey, 0, hits, path.length() };
 	struct romdata* rd;
 	int cnt = 0;
 
@@ -393,6 +617,7 @@ static int scan_rom(const std::string& path, UAEREG* fkey, bool deepscan)
 		if (rd) {
 			if (!addrom(fkey, rd, tmp))
 				return 1;
+			romscan_record(&rsd, tmp, rd, false);
 			continue;
 		}
 		break;
@@ -497,7 +722,23 @@ static void show_rom_list()
 	//free(p);
 }
 
-static int scan_roms_2(UAEREG* fkey, const TCHAR* path, bool deepscan, int level)
+static int romscan_replay(UAEREG* fkey, const std::string& path, const romscan_entry& e)
+{
+	int got = 0;
+	for (const auto& h : e.hits) {
+		const std::string name = path + h.name;
+		struct romdata* rd = h.id ? romscan_getromdata(h.id, h.group) : nullptr;
+		if (rd) {
+			addrom(fkey, rd, name.c_str());
+			got = 1;
+		}
+		if (h.key)
+			addkeyfile(name.c_str());
+	}
+	return got;
+}
+
+static int scan_roms_2(UAEREG* fkey, const TCHAR* path, bool deepscan, int level, std::vector<romscan_file>& misses)
 {
 	struct dirent* entry;
 	struct stat statbuf{};
@@ -519,14 +760,25 @@ static int scan_roms_2(UAEREG* fkey, const TCHAR* path, bool deepscan, int level
 		TCHAR tmppath[MAX_DPATH];
 		_sntprintf(tmppath, sizeof tmppath, _T("%s/%s"), path, entry->d_name);
 
+		// no need to stat files that would be skipped anyway
+		if (entry->d_type == DT_REG && !isromext(tmppath, deepscan))
+			continue;
 		if (stat(tmppath, &statbuf) == -1)
 			continue;
 
 		if (S_ISREG(statbuf.st_mode) && statbuf.st_size < 10000000) {
-			if (scan_rom(tmppath, fkey, deepscan))
-				ret = 1;
+			if (isromext(tmppath, deepscan)) {
+				auto it = romscan_cache.find(tmppath);
+				if (it != romscan_cache.end() && it->second.size == statbuf.st_size && it->second.mtime == statbuf.st_mtime) {
+					it->second.used = true;
+					if (romscan_replay(fkey, tmppath, it->second))
+						ret = 1;
+				} else {
+					misses.push_back({ tmppath, statbuf.st_size, statbuf.st_mtime, 0, false, deepscan });
+				}
+			}
 		} else if (deepscan && S_ISDIR(statbuf.st_mode) && entry->d_name[0] != '.' && (recursiveromscan < 0 || recursiveromscan > level)) {
-			scan_roms_2(fkey, tmppath, deepscan, level + 1);
+			scan_roms_2(fkey, tmppath, deepscan, level + 1, misses);
 		}
 
 		if (!scan_rom_hook(nullptr, 0))
@@ -537,6 +789,44 @@ static int scan_roms_2(UAEREG* fkey, const TCHAR* path, bool deepscan, int level
 	return ret;
 }
 
+/* Files that were not in the cache, or changed */
+static int scan_roms_misses(UAEREG* fkey, std::vector<romscan_file>& misses)
+{
+	int ret = 0;
+
+	if (misses.empty())
+		return 0;
+	write_log(_T("ROM scan: %d new or changed files\n"), (int)misses.size());
+	romscan_crc_files(misses);
+	std::unordered_map<uae_u64, std::string> crc_index;
+	for (const auto& it : romscan_cache)
+		crc_index.emplace(romscan_crc_key(it.second.crc32, it.second.size), it.first);
+	for (auto& rf : misses) {
+		romscan_entry e;
+		e.size = rf.size;
+		e.mtime = rf.mtime;
+		e.crc32 = rf.crc32;
+		e.used = true;
+		const romscan_entry* same = rf.ok ? romscan_find_crc(crc_index, rf) : nullptr;
+		if (same) {
+			e.hits = same->hits;
+			if (romscan_replay(fkey, rf.path, e))
+				ret = 1;
+		} else {
+			if (scan_rom(rf.path, fkey, rf.deepscan, &e.hits))
+				ret = 1;
+		}
+		if (rf.ok) {
+			romscan_cache[rf.path] = std::move(e);
+			crc_index.emplace(romscan_crc_key(rf.crc32, rf.size), rf.path);
+			romscan_dirty = true;
+		}
+		if (!scan_rom_hook(nullptr, 0))
+			break;
+	}
+	return ret;
+}
+
 #define MAX_ROM_PATHS 10
 
 static int scan_roms_3(UAEREG* fkey, TCHAR** paths, const TCHAR* path)
@@ -557,7 +847,10 @@ static int scan_roms_3(UAEREG* fkey, TCHAR** paths, const TCHAR* path)
 		if (paths[i] && !_tcsicmp(paths[i], pathp))
 			return ret;
 	}
-	ret = scan_roms_2(fkey, pathp, deepscan, 0);
+	std::vector<romscan_file> misses;
+	ret = scan_roms_2(fkey, pathp, deepscan, 0, misses);
+	if (scan_roms_misses(fkey, misses))
+		ret = 1;
 	for (i = 0; i < MAX_ROM_PATHS; i++) {
 		if (!paths[i]) {
 			paths[i] = my_strdup(pathp);
@@ -589,6 +882,7 @@ int scan_roms(int show)
 	cnt = 0;
 	for (i = 0; i < MAX_ROM_PATHS; i++)
 		paths[i] = nullptr;
+	romscan_cache_load();
 	scan_rom_hook(nullptr, 0);
 	while (scan_rom_hook(nullptr, 0)) {
 		keys = get_keyring();
@@ -619,6 +913,8 @@ int scan_roms(int show)
 
 	for (i = 0; i < MAX_ROM_PATHS; i++)
 		xfree(paths[i]);
+	romscan_cache_save();
+	romscan_cache.clear();
 
 	fkey2 = regcreatetree(nullptr, _T("DetectedROMS"));
 	if (fkey2) {
@@ -11,11 +11,33 @@
 #include <sys/disk.h>
 #endif
 
+/*
+ * Read cache, CACHE_SIZE sized segments aligned to CACHE_SIZE. Segments
+ * are found through a hash of their offset and recycled from the tail of
+ * an LRU list, empty ones sit at the tail. Links are segment indexes.
+ */
+struct hdf_segment
+{
+	uae_u64 offset;
+	uae_u8 *data;
+	int len;
+	int hnext; // hash chain
+	int prev, next; // LRU list, head is the most recently used
+};
+
 struct hardfilehandle
 {
 	int zfile;
 	struct zfile *zf;
 	FILE *h;
+	struct hdf_segment *segs;
+	uae_u8 *segdata;
+	int numsegs;
+	int *hash;
+	int hashmask;
+	int lru_head, lru_tail;
+	uae_u64 seq_next;
+	int seq_count;
 };
 
 struct uae_driveinfo {
@@ -49,6 +71,9 @@ struct uae_driveinfo {
 
 #define CACHE_SIZE 16384
 #define CACHE_FLUSH_TIME 5
+#define CACHE_MAX_SEGMENTS 4096
+/* segments read in one go once accesses look sequential */
+#define CACHE_READAHEAD 8
 
 /* safety check: only accept drives that:
 * - contain RDSK in block 0
@@ -165,6 +190,165 @@ static int isharddrive(const TCHAR* name)
 
 static const TCHAR *hdz[] = { _T("hdz"), _T("zip"), _T("7z"), nullptr };
 
+static int hdf_cache_hash(struct hardfilehandle *h, uae_u64 offset)
+{
+	return static_cast<int>(offset / CACHE_SIZE) & h->hashmask;
+}
+
+static void hdf_cache_unlink(struct hardfilehandle *h, int idx)
+{
+	struct hdf_segment *seg = &h->segs[idx];
+	if (seg->prev >= 0)
+		h->segs[seg->prev].next = seg->next;
+	else
+		h->lru_head = seg->next;
+	if (seg->next >= 0)
+		h->segs[seg->next].prev = seg->prev;
+	else
+		h->lru_tail = seg->prev;
+}
+
+static void hdf_cache_touch(struct hardfilehandle *h, struct hdf_segment *seg)
+{
+	const int idx = static_cast<int>(seg - h->segs);
+	if (h->lru_head == idx)
+		return;
+	hdf_cache_unlink(h, idx);
+	seg->prev = -1;
+	seg->next = h->lru_head;
+	h->segs[h->lru_head].prev = idx;
+	h->lru_head = idx;
+}
+
+static void hdf_cache_unhash(struct hardfilehandle *h, struct hdf_segment *seg)
+{
+	const int idx = static_cast<int>(seg - h->segs);
+	int *link = &h->hash[hdf_cache_hash(h, seg->offset)];
+	while (*link >= 0) {
+		if (*link == idx) {
+			*link = seg->hnext;
+			break;
+		}
+		link = &h->segs[*link].hnext;
+	}
+}
+
+// forget a segment, it will be the next one recycled
+static void hdf_cache_drop(struct hardfilehandle *h, struct hdf_segment *seg)
+{
+	const int idx = static_cast<int>(seg - h->segs);
+	if (seg->len)
+		hdf_cache_unhash(h, seg);
+	seg->len = 0;
+	if (h->lru_tail == idx)
+		return;
+	hdf_cache_unlink(h, idx);
+	seg->next = -1;
+	seg->prev = h->lru_tail;
+	h->segs[h->lru_tail].next = idx;
+	h->lru_tail = idx;
+}
+
+static void hdf_cache_invalidate(struct hardfilehandle *h)
+{
+	for (int i = 0; i <= h->hashmask; i++)
+		h->hash[i] = -1;
+	for (int i = 0; i < h->numsegs; i++) {
+		struct hdf_segment *seg = &h->segs[i];
+		seg->len = 0;
+		seg->hnext = -1;
+		seg->prev = i - 1;
+		seg->next = i + 1 < h->numsegs ? i + 1 : -1;
+	}
+	h->lru_head = 0;
+	h->lru_tail = h->numsegs - 1;
+}
+
+static bool hdf_cache_alloc(struct hardfilehandle *h)
+{
+	int segs = currprefs.hdf_cache_size * 1024 / CACHE_SIZE;
+	if (segs < 1)
+		segs = 1;
+	if (segs > CACHE_MAX_SEGMENTS)
+		segs = CACHE_MAX_SEGMENTS;
+	int buckets = 1;
+	while (buckets < segs * 2)
+		buckets <<= 1;
+	h->segdata = xmalloc(uae_u8, segs * CACHE_SIZE);
+	h->segs = xcalloc(struct hdf_segment, segs);
+	h->hash = xmalloc(int, buckets);
+	if (!h->segdata || !h->segs || !h->hash)
+		return false;
+	for (int i = 0; i < segs; i++)
+		h->segs[i].data = h->segdata + i * CACHE_SIZE;
+	h->numsegs = segs;
+	h->hashmask = buckets - 1;
+	h->seq_next = 0;
+	h->seq_count = 0;
+	hdf_cache_invalidate(h);
+	return true;
+}
+
+static void hdf_cache_free(struct hardfilehandle *h)
+{
+	xfree(h->hash);
+	xfree(h->segs);
+	xfree(h->segdata);
+	h->hash = nullptr;
+	h->segs = nullptr;
+	h->segdata = nullptr;
+	h->numsegs = 0;
+}
+
+static struct hdf_segment *hdf_cache_find(struct hardfilehandle *h, uae_u64 offset)
+{
+	for (int i = h->hash[hdf_cache_hash(h, offset)]; i >= 0; i = h->segs[i].hnext) {
+		struct hdf_segment *seg = &h->segs[i];
+		if (seg->offset == offset)
+			return seg;
+	}
+	return nullptr;
+}
+
+// least recently used or empty segment, unhashed and ready to be filled
+static struct hdf_segment *hdf_cache_victim(struct hardfilehandle *h)
+{
+	struct hdf_segment *victim = &h->segs[h->lru_tail];
+	if (victim->len)
+		hdf_cache_unhash(h, victim);
+	victim->len = 0;
+	return victim;
+}
+
+// a filled victim goes into the hash and to the head of the LRU list
+static void hdf_cache_insert(struct hardfilehandle *h, struct hdf_segment *seg)
+{
+	const int idx = static_cast<int>(seg - h->segs);
+	const int bucket = hdf_cache_hash(h, seg->offset);
+	seg->hnext = h->hash[bucket];
+	h->hash[bucket] = idx;
+	hdf_cache_touch(h, seg);
+}
+
+/* Written data goes through to cached segments, failed writes drop them */
+static void hdf_cache_update(struct hardfilehandle *h, const void *buffer, uae_u64 offset, int len, bool ok)
+{
+	const uae_u64 end = offset + len;
+	for (uae_u64 segoffset = offset & ~static_cast<uae_u64>(CACHE_SIZE - 1); segoffset < end; segoffset += CACHE_SIZE) {
+		struct hdf_segment *seg = hdf_cache_find(h, segoffset);
+		if (!seg)
+			continue;
+		uae_u64 start = offset > seg->offset ? offset : seg->offset;
+		uae_u64 stop = end < seg->offset + seg->len ? end : seg->offset + seg->len;
+		if (start >= stop)
+			continue;
+		if (ok)
+			memcpy(seg->data + (start - seg->offset), static_cast<const uae_u8*>(buffer) + (start - offset), static_cast<size_t>(stop - start));
+		else
+			hdf_cache_drop(h, seg);
+	}
+}
+
 int hdf_open_target(struct hardfiledata *hfd, const TCHAR *pname)
 {
 	FILE *h = nullptr;
@@ -186,6 +370,11 @@ int hdf_open_target(struct hardfiledata *hfd, const TCHAR *pname)
 	}
 	hfd->handle = xcalloc(struct hardfilehandle, 1);
 	hfd->handle->h = nullptr;
+	if (!hdf_cache_alloc(hfd->handle))
+	{
+		write_log("hdf read cache alloc (%d KB) failed in hdf_open_target\n", currprefs.hdf_cache_size);
+		goto end;
+	}
 	write_log(_T("hfd attempting to open: '%s'\n"), name);
 
 	char* ext;
@@ -272,6 +461,9 @@ int hdf_open_target(struct hardfiledata *hfd, const TCHAR *pname)
 			hfd->physsize = hfd->virtsize = zfile_ftell(hfd->handle->zf);
 			zfile_fseek(hfd->handle->zf, 0, SEEK_SET);
 			hfd->handle_valid = HDF_HANDLE_ZFILE;
+			// streamed from the archive, writes would be lost
+			if (zfile_isondemand(hfd->handle->zf))
+				hfd->ci.readonly = true;
 		}
 	}
 	else {
@@ -300,6 +492,7 @@ static void freehandle(struct hardfilehandle* h)
 	h->zf = nullptr;
 	h->h = nullptr;
 	h->zfile = 0;
+	hdf_cache_free(h);
 }
 
 void hdf_close_target(struct hardfiledata* hfd) {
@@ -416,50 +609,80 @@ static void poscheck(const struct hardfiledata *hfd, int len)
 	}
 }
 
-static int isincache(const struct hardfiledata *hfd, uae_u64 offset, int len)
+static struct hdf_segment *hdf_cache_load(struct hardfiledata *hfd, uae_u64 offset)
 {
-	if (!hfd->cache_valid)
-		return -1;
-	if (offset >= hfd->cache_offset && offset + len <= hfd->cache_offset + CACHE_SIZE)
-		return static_cast<int>(offset - hfd->cache_offset);
-	return -1;
+	struct hardfilehandle *h = hfd->handle;
+	const uae_u64 end = hfd->physsize - hfd->virtual_size;
+	struct hdf_segment *first = nullptr;
+	int readahead = 1;
+
+	if (h->seq_count >= 2) {
+		readahead = h->numsegs / 4;
+		if (readahead > CACHE_READAHEAD)
+			readahead = CACHE_READAHEAD;
+		if (readahead < 1)
+			readahead = 1;
+	}
+	if (hdf_seek(hfd, offset))
+		return nullptr;
+	for (int i = 0; i < readahead && offset < end; i++, offset += CACHE_SIZE) {
+		if (i > 0 && hdf_cache_find(h, offset))
+			break;
+		struct hdf_segment *seg = hdf_cache_victim(h);
+		const int len = end - offset < CACHE_SIZE ? static_cast<int>(end - offset) : CACHE_SIZE;
+		size_t outlen = 0;
+		poscheck(hfd, len);
+		if (hfd->handle_valid == HDF_HANDLE_LINUX)
+			outlen = fread(seg->data, 1, len, h->h);
+		else if (hfd->handle_valid == HDF_HANDLE_ZFILE)
+			outlen = zfile_fread(seg->data, 1, len, h->zf);
+		if (outlen != len)
+			break;
+		seg->offset = offset;
+		seg->len = len;
+		hdf_cache_insert(h, seg);
+		if (!first)
+			first = seg;
+	}
+	return first;
 }
 
 static int hdf_read_2(struct hardfiledata *hfd, void *buffer, uae_u64 offset, int len)
 {
-	size_t outlen = 0;
+	struct hardfilehandle *h = hfd->handle;
+	auto p = static_cast<uae_u8*>(buffer);
+	int got = 0;
 
-	if (offset == 0)
-		hfd->cache_valid = 0;
-	auto coffset = isincache(hfd, offset, len);
-	if (coffset >= 0)
-	{
-		memcpy(buffer, hfd->cache + coffset, len);
-		return len;
+	if (offset == h->seq_next) {
+		if (h->seq_count < 2)
+			h->seq_count++;
+	} else {
+		h->seq_count = 0;
 	}
-	hfd->cache_offset = offset;
-	if (offset + CACHE_SIZE > hfd->offset + (hfd->physsize - hfd->virtual_size))
-		hfd->cache_offset = hfd->offset + (hfd->physsize - hfd->virtual_size) - CACHE_SIZE;
-	if (hdf_seek(hfd, hfd->cache_offset))
-		return 0;
-	poscheck(hfd, CACHE_SIZE);
-	if (hfd->handle_valid == HDF_HANDLE_LINUX)
-		outlen = fread(hfd->cache, 1, CACHE_SIZE, hfd->handle->h);
-	else if (hfd->handle_valid == HDF_HANDLE_ZFILE)
-		outlen = zfile_fread(hfd->cache, 1, CACHE_SIZE, hfd->handle->zf);
-	hfd->cache_valid = 0;
-	if (outlen != CACHE_SIZE)
-		return 0;
-	hfd->cache_valid = 1;
-	coffset = isincache(hfd, offset, len);
-	if (coffset >= 0)
+	h->seq_next = offset + len;
+
+	while (len > 0)
 	{
-		memcpy(buffer, hfd->cache + coffset, len);
-		return len;
+		const uae_u64 segoffset = offset & ~static_cast<uae_u64>(CACHE_SIZE - 1);
+		struct hdf_segment *seg = hdf_cache_find(h, segoffset);
+		if (!seg)
+			seg = hdf_cache_load(hfd, segoffset);
+		if (!seg)
+			return got;
+		hdf_cache_touch(h, seg);
+		const int coffset = static_cast<int>(offset - segoffset);
+		int clen = seg->len - coffset;
+		if (clen > len)
+			clen = len;
+		if (clen <= 0)
+			return got;
+		memcpy(p, seg->data + coffset, clen);
+		p += clen;
+		offset += clen;
+		len -= clen;
+		got += clen;
 	}
-	write_log(_T("hdf_read: cache bug! offset=%I64d len=%d\n"), offset, len);
-	hfd->cache_valid = 0;
-	return 0;
+	return got;
 }
 
 int hdf_read_target(struct hardfiledata *hfd, void *buffer, uae_u64 offset, int len)
@@ -518,7 +741,6 @@ static int hdf_write_2(struct hardfiledata *hfd, const void *buffer, uae_u64 off
 	if (len == 0)
 		return 0;
 
-	hfd->cache_valid = 0;
 	if (hdf_seek(hfd, offset))
 		return 0;
 	poscheck(hfd, len);
@@ -545,6 +767,7 @@ static int hdf_write_2(struct hardfiledata *hfd, const void *buffer, uae_u64 off
 	}
 	else if (hfd->handle_valid == HDF_HANDLE_ZFILE)
 		outlen = zfile_fwrite(hfd->cache, 1, len, hfd->handle->zf);
+	hdf_cache_update(hfd->handle, buffer, offset, len, outlen == len);
 	return static_cast<int>(outlen);
 }
 
@@ -594,6 +817,7 @@ int hdf_resize_target(struct hardfiledata* hfd, uae_u64 newsize)
 	}
 	write_log("hdf_resize_target: %lld -> %lld\n", hfd->physsize, newsize);
 	hfd->physsize = newsize;
+	hdf_cache_invalidate(hfd->handle);
 	return 1;
 }
 
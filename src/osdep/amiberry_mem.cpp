@@ -1,6 +1,9 @@
 #include <algorithm>
+#include <atomic>
+#include <csignal>
 #include <cstdlib>
 #include <cstring>
+#include <mutex>
 
 #include "sysconfig.h"
 #include "sysdeps.h"
@@ -643,8 +646,12 @@ void mapped_free (addrbank *ab)
 	bool rtgmem = (ab->flags & ABFLAG_RTG) != 0;
 
 	ab->flags &= ~ABFLAG_MAPPED;
+	ab->baseaddr_direct_r = nullptr;
+	ab->baseaddr_direct_w = nullptr;
+	memory_direct_update(ab);
 	if (ab->baseaddr == nullptr)
 		return;
+	writewatch_forget(ab->baseaddr, ab->allocated_size);
 
 	if (ab->flags & ABFLAG_INDIRECT) {
 		while(x) {
@@ -1148,6 +1155,326 @@ void mman_set_barriers(bool disable)
 #endif
 }
 
+#ifdef __linux__
+/*
+ * Write watching with page protection, used by the RTG VRAM dirty tracking
+ * and by the rewind buffer. Armed pages are read only, the first write to
+ * one faults, the handler reports the page to the owner while it is still
+ * read only and then makes it writable again. Writes done by the kernel
+ * (read() or recv() directly into Amiga memory) fail with EFAULT instead of
+ * faulting, so host I/O into Amiga memory is bracketed by
+ * writewatch_host_write_begin()/_end(): the target pages are reported and
+ * made writable and are not armed again until the I/O is done.
+ */
+#define MAX_WRITEWATCH 16
+#define MAX_WRITEWATCH_IO 16
+
+struct writewatch
+{
+	// taken until the owner removes it, used until the memory goes away
+	bool taken;
+	std::atomic<bool> used;
+	uae_u8 *base;
+	size_t size;
+	int pages;
+	std::atomic<bool> *armed;
+	WRITEWATCH_FUNC func;
+	void *user;
+};
+
+static struct writewatch writewatches[MAX_WRITEWATCH];
+static std::mutex writewatch_mutex;
+static struct sigaction writewatch_oldaction;
+static int writewatch_page_size;
+// host writes in progress, their pages must stay writable
+static const uae_u8 *writewatch_io_addr[MAX_WRITEWATCH_IO];
+static size_t writewatch_io_size[MAX_WRITEWATCH_IO];
+static int writewatch_io_overflow;
+
+static void writewatch_handler(int signum, siginfo_t *info, void *ptr)
+{
+	uae_u8 *a = static_cast<uae_u8*>(info->si_addr);
+
+	if (info->si_code == SEGV_ACCERR) {
+		for (auto & w : writewatches) {
+			struct writewatch *ww = &w;
+			if (!ww->used.load() || a < ww->base || a >= ww->base + ww->size)
+				continue;
+			const int page = (int)((a - ww->base) / writewatch_page_size);
+			// if another thread won the page it is about to become writable, retry
+			if (ww->armed[page].exchange(false)) {
+				ww->func(ww->user, page);
+				mprotect(ww->base + (size_t)page * writewatch_page_size, writewatch_page_size, PROT_READ | PROT_WRITE);
+			}
+			return;
+		}
+	}
+	if (writewatch_oldaction.sa_flags & SA_SIGINFO) {
+		if (writewatch_oldaction.sa_sigaction) {
+			writewatch_oldaction.sa_sigaction(signum, info, ptr);
+			return;
+		}
+	} else if (writewatch_oldaction.sa_handler != SIG_DFL && writewatch_oldaction.sa_handler != SIG_IGN) {
+		writewatch_oldaction.sa_handler(signum);
+		return;
+	}
+	// no previous handler, fault again with the default action
+	signal(signum, SIG_DFL);
+}
+
+// the JIT installs its own handler when it is (re)initialized, go in front of it again
+static bool writewatch_install()
+{
+	struct sigaction cur{};
+	if (sigaction(SIGSEGV, nullptr, &cur) < 0)
+		return false;
+	if ((cur.sa_flags & SA_SIGINFO) && cur.sa_sigaction == writewatch_handler)
+		return true;
+	struct sigaction action{};
+	action.sa_sigaction = writewatch_handler;
+	action.sa_flags = SA_SIGINFO;
+	sigemptyset(&action.sa_mask);
+	return sigaction(SIGSEGV, &action, &writewatch_oldaction) == 0;
+}
+
+int writewatch_pagesize()
+{
+	if (!writewatch_page_size)
+		writewatch_page_size = (int)sysconf(_SC_PAGESIZE);
+	return writewatch_page_size;
+}
+
+struct writewatch *writewatch_add(uae_u8 *base, size_t size, WRITEWATCH_FUNC func, void *user)
+{
+	const int page_size = writewatch_pagesize();
+
+	if (!base || !size || (reinterpret_cast<uintptr_t>(base) & (page_size - 1)) || (size & (page_size - 1)))
+		return nullptr;
+	std::lock_guard<std::mutex> lock(writewatch_mutex);
+	if (!writewatch_install()) {
+		write_log(_T("WRITEWATCH: failed to install SIGSEGV handler\n"));
+		return nullptr;
+	}
+	for (auto & w : writewatches) {
+		struct writewatch *ww = &w;
+		if (ww->taken)
+			continue;
+		ww->taken = true;
+		ww->pages = (int)(size / page_size);
+		ww->armed = new std::atomic<bool>[ww->pages];
+		for (int i = 0; i < ww->pages; i++)
+			ww->armed[i] = false;
+		ww->base = base;
+		ww->size = size;
+		ww->func = func;
+		ww->user = user;
+		ww->used = true;
+		return ww;
+	}
+	write_log(_T("WRITEWATCH: no free slots\n"));
+	return nullptr;
+}
+
+static void writewatch_release(struct writewatch *ww)
+{
+	ww->used = false;
+	mprotect(ww->base, ww->size, PROT_READ | PROT_WRITE);
+	delete[] ww->armed;
+	ww->armed = nullptr;
+	ww->base = nullptr;
+	ww->size = 0;
+}
+
+void writewatch_remove(struct writewatch *ww)
+{
+	if (!ww)
+		return;
+	std::lock_guard<std::mutex> lock(writewatch_mutex);
+	if (ww->used.load())
+		writewatch_release(ww);
+	ww->taken = false;
+}
+
+// memory is going away, stop watching it, the owners still remove their handles
+void writewatch_forget(uae_u8 *base, size_t size)
+{
+	std::lock_guard<std::mutex> lock(writewatch_mutex);
+	for (auto & w : writewatches) {
+		struct writewatch *ww = &w;
+		if (ww->used.load() && ww->base < base + size && base < ww->base + ww->size)
+			writewatch_release(ww);
+	}
+}
+
+// false if the watched memory was freed since writewatch_add()
+bool writewatch_valid(struct writewatch *ww)
+{
+	return ww && ww->used.load();
+}
+
+void writewatch_lock()
+{
+	writewatch_mutex.lock();
+}
+
+void writewatch_unlock()
+{
+	writewatch_mutex.unlock();
+}
+
+bool writewatch_armed(struct writewatch *ww, int page)
+{
+	return ww->armed[page].load();
+}
+
+static bool writewatch_io_busy(const uae_u8 *p)
+{
+	for (int i = 0; i < MAX_WRITEWATCH_IO; i++) {
+		if (writewatch_io_addr[i] && p < writewatch_io_addr[i] + writewatch_io_size[i] && p + writewatch_page_size > writewatch_io_addr[i])
+			return true;
+	}
+	return false;
+}
+
+// Protects pages [page, page + count), called with writewatch_lock() held.
+// Pages under host I/O are skipped, returns the number of pages armed.
+int writewatch_arm(struct writewatch *ww, int page, int count)
+{
+	const int page_size = writewatch_page_size;
+	int armed = 0;
+
+	if (writewatch_io_overflow || !writewatch_install())
+		return 0;
+	for (int i = page; i < page + count;) {
+		if (ww->armed[i].load() || writewatch_io_busy(ww->base + (size_t)i * page_size)) {
+			i++;
+			continue;
+		}
+		int j = i;
+		while (j < page + count && !ww->armed[j].load() && !writewatch_io_busy(ww->base + (size_t)j * page_size))
+			j++;
+		// flagged first: a write racing with mprotect() must find the page armed
+		for (int k = i; k < j; k++)
+			ww->armed[k] = true;
+		mprotect(ww->base + (size_t)i * page_size, (size_t)(j - i) * page_size, PROT_READ);
+		armed += j - i;
+		i = j;
+	}
+	return armed;
+}
+
+// Makes every page writable without reporting it, called with writewatch_lock() held.
+void writewatch_disarm(struct writewatch *ww)
+{
+	mprotect(ww->base, ww->size, PROT_READ | PROT_WRITE);
+	for (int i = 0; i < ww->pages; i++)
+		ww->armed[i] = false;
+}
+
+// report the watched pages in [p, p + size), optionally make them writable
+static void writewatch_range(const uae_u8 *p, size_t size, bool unprotect)
+{
+	const int page_size = writewatch_page_size;
+
+	for (auto & w : writewatches) {
+		struct writewatch *ww = &w;
+		if (!ww->used.load() || p >= ww->base + ww->size || p + size <= ww->base)
+			continue;
+		const int first = p > ww->base ? (int)((p - ww->base) / page_size) : 0;
+		const int last = std::min((int)((p + size - 1 - ww->base) / page_size), ww->pages - 1);
+		for (int i = first; i <= last; i++) {
+			if (unprotect && ww->armed[i].exchange(false)) {
+				ww->func(ww->user, i);
+				mprotect(ww->base + (size_t)i * page_size, page_size, PROT_READ | PROT_WRITE);
+			} else {
+				ww->func(ww->user, i);
+			}
+		}
+	}
+}
+
+void writewatch_host_write_begin(const void *p, size_t size)
+{
+	const uae_u8 *a = static_cast<const uae_u8*>(p);
+
+	if (!size)
+		return;
+	std::lock_guard<std::mutex> lock(writewatch_mutex);
+	int i;
+	for (i = 0; i < MAX_WRITEWATCH_IO; i++) {
+		if (!writewatch_io_addr[i]) {
+			writewatch_io_addr[i] = a;
+			writewatch_io_size[i] = size;
+			break;
+		}
+	}
+	if (i == MAX_WRITEWATCH_IO)
+		writewatch_io_overflow++;
+	writewatch_range(a, size, true);
+}
+
+void writewatch_host_write_end(const void *p, size_t size)
+{
+	const uae_u8 *a = static_cast<const uae_u8*>(p);
+
+	if (!size)
+		return;
+	std::lock_guard<std::mutex> lock(writewatch_mutex);
+	// the pages may have been collected during the I/O already
+	writewatch_range(a, size, false);
+	for (int i = 0; i < MAX_WRITEWATCH_IO; i++) {
+		if (writewatch_io_addr[i] == a && writewatch_io_size[i] == size) {
+			writewatch_io_addr[i] = nullptr;
+			writewatch_io_size[i] = 0;
+			return;
+		}
+	}
+	writewatch_io_overflow--;
+}
+#else
+int writewatch_pagesize()
+{
+	return 4096;
+}
+struct writewatch *writewatch_add(uae_u8 *base, size_t size, WRITEWATCH_FUNC func, void *user)
+{
+	return nullptr;
+}
+void writewatch_remove(struct writewatch *ww)
+{
+}
+void writewatch_forget(uae_u8 *base, size_t size)
+{
+}
+bool writewatch_valid(struct writewatch *ww)
+{
+	return false;
+}
+void writewatch_lock()
+{
+}
+void writewatch_unlock()
+{
+}
+bool writewatch_armed(struct writewatch *ww, int page)
+{
+	return false;
+}
+int writewatch_arm(struct writewatch *ww, int page, int count)
+{
+	return 0;
+}
+void writewatch_disarm(struct writewatch *ww)
+{
+}
+void writewatch_host_write_begin(const void *p, size_t size)
+{
+}
+void writewatch_host_write_end(const void *p, size_t size)
+{
+}
+#endif
+
 int uae_shmdt (const void *shmaddr)
 {
 	return 0;
@@ -36,8 +36,13 @@
 
 #include <sys/types.h>
 #include <sys/socket.h>
-#include <sys/select.h>
 #include <sys/ioctl.h>
+#include <poll.h>
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#define BSDSOCK_EPOLL
+#endif
 #ifdef HAVE_SYS_FILIO_H
 # include <sys/filio.h>
 #endif
@@ -50,6 +55,10 @@
 #include <csignal>
 #include <arpa/inet.h>
 #include <cstring>
+#include <climits>
+#include <atomic>
+#include <map>
+#include <unordered_map>
 #include <vector>
 #include <unistd.h>
 #include <SDL_mutex.h>
@@ -102,10 +111,27 @@ static uae_sem_t sem_queue;
 /**
  ** Socket Event Monitoring System
  ** Monitors sockets with SO_EVENTMASK set and posts Amiga signals when events occur
+ **
+ ** Every monitored socket has a one-shot registration with the backend (epoll on
+ ** Linux, a poll() loop elsewhere). When it fires, the REP_* events are posted and
+ ** remembered in fired_mask, and the socket is re-armed only for the events that
+ ** are still outstanding. The I/O functions clear fired_mask bits again (recv()
+ ** re-enables REP_READ and so on), which re-arms the registration. The
+ ** registration is level triggered, so re-enabling an event whose condition
+ ** still holds delivers it again right away, as on AmigaOS.
  **/
 
+// Readiness conditions, translated to epoll or poll bits by the backend
+#define MON_IN     0x01
+#define MON_OUT    0x02
+#define MON_PRI    0x04
+#define MON_RDHUP  0x08
+#define MON_ERR    0x10
+#define MON_HUP    0x20
+
 // Entry for a socket being monitored for events
 struct socket_event_entry {
+	uae_u64 id;                // Registration id, passed through the backend
 	struct socketbase* sb;
 	int sd;                    // Amiga socket descriptor (0-based)
 	SOCKET_TYPE s;             // Host socket
@@ -113,15 +139,23 @@ struct socket_event_entry {
 	bool connecting;           // True if connect() is in progress
 	bool connected;            // True if socket is connected (or connectionless/listener)
 	int fired_mask;            // Events that have fired and need re-enabling
+	int armed;                 // MON_* conditions the backend waits for, 0 if disarmed
 };
 
 // Event monitor thread state
 struct event_monitor {
 	uae_thread_id thread;      // Monitor thread
-	SDL_mutex* mutex;          // Protects socket_list
-	int wake_pipe[2];          // Pipe to wake thread on changes
-	bool running;              // Thread running flag
-	std::vector<socket_event_entry> socket_list;  // Sockets to monitor
+	SDL_mutex* mutex;          // Protects the socket tables
+#ifdef BSDSOCK_EPOLL
+	int epoll_fd;              // One-shot registrations of all monitored sockets
+	int wake_fd;               // eventfd to wake the thread on shutdown
+#else
+	int wake_pipe[2];          // Pipe to wake the thread when the armed sockets change
+#endif
+	std::atomic<bool> running; // Thread running flag
+	uae_u64 next_id;           // Registration ids start at 1, 0 is the wakeup
+	std::unordered_map<uae_u64, socket_event_entry> sockets;    // Monitored sockets by id
+	std::map<std::pair<struct socketbase*, int>, uae_u64> ids;  // (sb, sd) to id
 };
 
 static struct event_monitor* g_event_monitor = nullptr;
@@ -531,222 +565,318 @@ static int peek_socket(int s)
 	return 0; // Error/Spurious/WouldBlock
 }
 
+#ifdef BSDSOCK_EPOLL
+static uae_u32 mon_to_epoll(int mon)
+{
+	uae_u32 ev = 0;
+	if (mon & MON_IN) ev |= EPOLLIN;
+	if (mon & MON_OUT) ev |= EPOLLOUT;
+	if (mon & MON_PRI) ev |= EPOLLPRI;
+	if (mon & MON_RDHUP) ev |= EPOLLRDHUP;
+	return ev;
+}
+
+static int epoll_to_mon(uae_u32 ev)
+{
+	int mon = 0;
+	if (ev & EPOLLIN) mon |= MON_IN;
+	if (ev & EPOLLOUT) mon |= MON_OUT;
+	if (ev & EPOLLPRI) mon |= MON_PRI;
+	if (ev & EPOLLRDHUP) mon |= MON_RDHUP;
+	if (ev & EPOLLERR) mon |= MON_ERR;
+	if (ev & EPOLLHUP) mon |= MON_HUP;
+	return mon;
+}
+#endif
+
+static short mon_to_poll(int mon)
+{
+	short ev = 0;
+	if (mon & MON_IN) ev |= POLLIN;
+	if (mon & MON_OUT) ev |= POLLOUT;
+	if (mon & MON_PRI) ev |= POLLPRI;
+#ifdef POLLRDHUP
+	if (mon & MON_RDHUP) ev |= POLLRDHUP;
+#endif
+	return ev;
+}
+
+static int poll_to_mon(short ev)
+{
+	int mon = 0;
+	if (ev & POLLIN) mon |= MON_IN;
+	if (ev & POLLOUT) mon |= MON_OUT;
+	if (ev & POLLPRI) mon |= MON_PRI;
+#ifdef POLLRDHUP
+	if (ev & POLLRDHUP) mon |= MON_RDHUP;
+#endif
+	if (ev & POLLERR) mon |= MON_ERR;
+	if (ev & POLLHUP) mon |= MON_HUP;
+	return mon;
+}
+
+static void monitor_wake(struct event_monitor* monitor)
+{
+#ifdef BSDSOCK_EPOLL
+	uint64_t one = 1;
+	if (write(monitor->wake_fd, &one, sizeof(one)) < 0) {
+		// Counter already pending, the thread wakes up anyway
+	}
+#else
+	char b = 1;
+	if (write(monitor->wake_pipe[1], &b, 1) < 0) {
+		// Pipe full, the thread wakes up anyway
+	}
+#endif
+}
+
+// Conditions to wait for, given the REP_* events that are requested and not delivered yet
+static int monitor_wanted(const socket_event_entry& entry)
+{
+	int active = entry.eventmask & ~entry.fired_mask;
+	int want = 0;
+
+	if (entry.connecting) {
+		// Only the connect completion is of interest until connect() finishes
+		if (active & (REP_CONNECT | REP_WRITE))
+			want |= MON_OUT;
+		return want;
+	}
+	if (active & REP_ACCEPT)
+		want |= MON_IN;
+	// Prevent premature monitoring of READ/WRITE on disconnected sockets
+	if (entry.connected) {
+		if (active & REP_READ)
+			want |= MON_IN;
+		// REP_CONNECT was requested: writability is the implicit expectation
+		if (active & (REP_WRITE | REP_CONNECT))
+			want |= MON_OUT;
+		if (active & REP_CLOSE)
+			want |= MON_RDHUP;
+	}
+	if (active & REP_OOB)
+		want |= MON_PRI;
+	if (want && (active & REP_ERROR))
+		want |= MON_ERR;
+	return want;
+}
+
+// (Re-)arm the one-shot registration of a socket. Called with the mutex held.
+static void monitor_arm(struct event_monitor* monitor, socket_event_entry& entry)
+{
+	int want = monitor_wanted(entry);
+
+	if (want == entry.armed)
+		return;
+#ifdef BSDSOCK_EPOLL
+	struct epoll_event ev {};
+	ev.events = EPOLLONESHOT | mon_to_epoll(want);
+	ev.data.u64 = entry.id;
+	if (epoll_ctl(monitor->epoll_fd, EPOLL_CTL_MOD, entry.s, &ev) < 0 && errno == ENOENT) {
+		if (epoll_ctl(monitor->epoll_fd, EPOLL_CTL_ADD, entry.s, &ev) < 0)
+			write_log("BSDSOCK: Cannot monitor socket %d (native %d): %d\n", entry.sd, entry.s, errno);
+	}
+	entry.armed = want;
+#else
+	entry.armed = want;
+	monitor_wake(monitor);
+#endif
+}
+
+static socket_event_entry* monitor_find(struct event_monitor* monitor, struct socketbase* sb, int sd)
+{
+	auto id = monitor->ids.find(std::make_pair(sb, sd));
+	if (id == monitor->ids.end())
+		return nullptr;
+	auto it = monitor->sockets.find(id->second);
+	return it != monitor->sockets.end() ? &it->second : nullptr;
+}
+
+static void monitor_remove(struct event_monitor* monitor, std::map<std::pair<struct socketbase*, int>, uae_u64>::iterator id)
+{
+	auto it = monitor->sockets.find(id->second);
+	if (it != monitor->sockets.end()) {
+#ifdef BSDSOCK_EPOLL
+		struct epoll_event ev {};
+		// Fails harmlessly if the socket was closed already
+		epoll_ctl(monitor->epoll_fd, EPOLL_CTL_DEL, it->second.s, &ev);
+#endif
+		monitor->sockets.erase(it);
+	}
+	monitor->ids.erase(id);
+}
+
+// Turn the readiness reported for one socket into REP_* events. Called with the mutex held.
+static void monitor_dispatch(struct event_monitor* monitor, uae_u64 id, int revents)
+{
+	auto it = monitor->sockets.find(id);
+	if (it == monitor->sockets.end())
+		return; // Unregistered while the event was in flight
+	socket_event_entry& entry = it->second;
+#ifndef BSDSOCK_EPOLL
+	if (!entry.armed)
+		return;
+#endif
+	// One-shot: the registration stays disabled until it is re-armed
+	entry.armed = 0;
+
+	int events = 0;
+	if (entry.connecting) {
+		if (revents & (MON_OUT | MON_ERR | MON_HUP)) {
+			int error = 0;
+			socklen_t len = sizeof(error);
+			struct sockaddr_storage peer;
+			socklen_t peerlen = sizeof(peer);
+			if (getsockopt(entry.s, SOL_SOCKET, SO_ERROR, &error, &len) < 0 || error != 0) {
+				write_log("BSDSOCK: Socket %d connect failed (error %d)\n", entry.sd, error ? error : errno);
+				entry.connecting = false;
+				events |= REP_ERROR;
+			} else if (getpeername(entry.s, (struct sockaddr*)&peer, &peerlen) == 0) {
+				entry.connecting = false;
+				entry.connected = true;
+				events |= REP_CONNECT | REP_WRITE;
+			} else {
+				// connect() not issued yet, host_connect() re-arms once it returns
+				return;
+			}
+		}
+	} else {
+		if ((revents & MON_IN) && (entry.eventmask & REP_ACCEPT))
+			events |= REP_ACCEPT;
+		// Filter "phantom" read events (where epoll says ready but peek returns error/block)
+		if (entry.connected && (revents & (MON_IN | MON_RDHUP | MON_HUP)) && (entry.eventmask & (REP_READ | REP_CLOSE))) {
+			int peek = peek_socket(entry.s);
+			if (peek == 2) {
+				events |= REP_READ;
+			} else if (peek == 1) {
+				// EOF is also readable (read returns 0)
+				events |= REP_READ | REP_CLOSE;
+			}
+		}
+		if ((revents & MON_OUT) && entry.connected) {
+			events |= REP_WRITE;
+			// Fallback: the app asked for REP_CONNECT but not REP_WRITE, wake it up anyway
+			if (!(entry.eventmask & REP_WRITE))
+				events |= REP_CONNECT;
+		}
+		if (revents & MON_PRI)
+			events |= REP_OOB;
+		if (revents & MON_ERR) {
+			// recv() reports the pending error
+			events |= REP_ERROR;
+			if (entry.connected)
+				events |= REP_READ;
+		}
+	}
+
+	// Deliver only what was requested and not delivered yet
+	events &= entry.eventmask & ~entry.fired_mask;
+	if (events) {
+		post_socket_event(entry.sb, entry.sd, events);
+		// Do NOT clear them from eventmask, as that loses the user's request.
+		entry.fired_mask |= events;
+	} else if (revents & (MON_RDHUP | MON_HUP | MON_ERR)) {
+		// Nothing new to report on a condition that stays set (hangup with
+		// unread data, for instance). Wait for the I/O functions to re-arm.
+		return;
+	}
+	monitor_arm(monitor, entry);
+}
+
 // Event monitor thread - monitors sockets and posts signals
 static int event_monitor_thread(void* data)
 {
 	struct event_monitor* monitor = (struct event_monitor*)data;
+#ifdef BSDSOCK_EPOLL
+	struct epoll_event events[64];
+#else
+	std::vector<struct pollfd> fds;
+	std::vector<uae_u64> fd_ids;
+#endif
 	
 	write_log("BSDSOCK: Event monitor thread started\n");
 	
 	while (monitor->running) {
-		fd_set readfds, writefds, exceptfds;
-		int maxfd = monitor->wake_pipe[0];
-		struct timeval timeout;
-		
-		FD_ZERO(&readfds);
-		FD_ZERO(&writefds);
-		FD_ZERO(&exceptfds);
-		
-		// Always monitor wake pipe
-		FD_SET(monitor->wake_pipe[0], &readfds);
-		
-		// Lock mutex to build fd_sets from socket list
-		SDL_LockMutex(monitor->mutex);
-		
-		if (!monitor->socket_list.empty()) {
-			write_log("BSDSOCK: Event monitor checking %d sockets\n", (int)monitor->socket_list.size());
+#ifdef BSDSOCK_EPOLL
+		int result = epoll_wait(monitor->epoll_fd, events, 64, -1);
+		if (result < 0) {
+			if (errno == EINTR) continue;
+			write_log("BSDSOCK: Event monitor epoll_wait() error: %d\n", errno);
+			break;
 		}
 		
-		for (const auto& entry : monitor->socket_list) {
-			if (entry.s == INVALID_SOCKET) continue;
-			
-			// Skip sockets with no events to monitor
-			if (entry.eventmask == 0) continue;
-			
-			if (entry.s > maxfd) {
-				maxfd = entry.s;
-			}
-			
-			// Add socket to appropriate fd_sets based on event mask
-			// Filter out events that have already fired (one-shot) for default handling
-			int active_mask = entry.eventmask & ~entry.fired_mask;
-
-			// Use active_mask to respect One-Shot behavior (Wait for re-enablement via recv/accept)
-			if (active_mask & (REP_READ | REP_ACCEPT)) {
-				if (active_mask & REP_READ) {
-					// Prevent premature monitoring of READ on connecting/disconnected sockets
-					if (!entry.connecting && entry.connected) {
-						FD_SET(entry.s, &readfds);
-						// write_log("BSDSOCK: Adding socket %d to readfds (mask has REP_READ)\n", entry.sd);
-					}
-				} else {
-					// REP_ACCEPT always monitored (if in active_mask)
-					FD_SET(entry.s, &readfds);
-					write_log("BSDSOCK: Adding socket %d to readfds (mask has REP_ACCEPT)\n", entry.sd);
+		SDL_LockMutex(monitor->mutex);
+		for (int i = 0; i < result; i++) {
+			if (events[i].data.u64 == 0) {
+				uint64_t count;
+				if (read(monitor->wake_fd, &count, sizeof(count)) < 0) {
+					// Already drained
 				}
+				continue;
 			}
-			
-			// REP_WRITE is treated as Level Triggered in select() but Edge Triggered/One-Shot for Amiga signals.
-			// If connected and not connecting, we monitor for write if the event is active (not fired).
-			// FIX: Also monitor if REP_CONNECT was requested, as implicit Writability expectation.
-			if ((active_mask & (REP_WRITE | REP_CONNECT)) && entry.connected && !entry.connecting) {
-				FD_SET(entry.s, &writefds);
-				// logging noise reduced
-			}
-
-			// REP_CONNECT is One-Shot (handled via active_mask).
-			// Only monitor if explicitly connecting.
-			if ((active_mask & REP_CONNECT) && entry.connecting) {
-				FD_SET(entry.s, &writefds);
-				write_log("BSDSOCK: Monitoring socket %d for connect completion (connecting=true)\n", entry.sd);
-			}
-
-			if (active_mask & REP_OOB) {
-				FD_SET(entry.s, &exceptfds);
-			}
+			monitor_dispatch(monitor, events[i].data.u64, epoll_to_mon(events[i].events));
 		}
-		
 		SDL_UnlockMutex(monitor->mutex);
+#else
+		fds.clear();
+		fd_ids.clear();
+		fds.push_back({ monitor->wake_pipe[0], POLLIN, 0 });
+		fd_ids.push_back(0);
 		
-		// Wait for events with 1 second timeout
-		timeout.tv_sec = 1;
-		timeout.tv_usec = 0;
-		
-		int result = select(maxfd + 1, &readfds, &writefds, &exceptfds, &timeout);
-		
-		write_log("BSDSOCK: select() returned %d\n", result);
+		SDL_LockMutex(monitor->mutex);
+		for (const auto& it : monitor->sockets) {
+			if (it.second.armed) {
+				fds.push_back({ it.second.s, mon_to_poll(it.second.armed), 0 });
+				fd_ids.push_back(it.first);
+			}
+		}
+		SDL_UnlockMutex(monitor->mutex);
 		
+		int result = poll(fds.data(), fds.size(), -1);
 		if (result < 0) {
 			if (errno == EINTR) continue;
-			write_log("BSDSOCK: Event monitor select() error: %d\n", errno);
+			write_log("BSDSOCK: Event monitor poll() error: %d\n", errno);
 			break;
 		}
 		
-		if (result == 0) {
-			// Timeout, just loop again
-			continue;
-		}
-		
-		// Check wake pipe
-		if (FD_ISSET(monitor->wake_pipe[0], &readfds)) {
+		if (fds[0].revents) {
 			char buf[256];
-			read(monitor->wake_pipe[0], buf, sizeof(buf));
-			// Socket list changed, loop again to rebuild fd_sets
-			continue;
+			if (read(monitor->wake_pipe[0], buf, sizeof(buf)) < 0) {
+				// Already drained
+			}
 		}
 		
-		// Check sockets for events
 		SDL_LockMutex(monitor->mutex);
-		
-		for (auto& entry : monitor->socket_list) {
-			if (entry.s == INVALID_SOCKET) continue;
-			
-			int events = 0;
-            // Add slight delay if we are spinning on Level Triggered events to prevent CPU hog
-            // Only if we found something? No, loop level.
-            // We rely on select() usage. If select returns immediately, we spin.
-            // We cannot easily throttle here without affecting response time. 
-            // Hoping App clears the signal buffers or handles it.
-			
-			if (FD_ISSET(entry.s, &readfds)) {
-				// Filter "phantom" read events (where select says ready but peek returns error/block)
-				if ((entry.eventmask & REP_READ) || (entry.eventmask & REP_CLOSE)) {
-					int peek = peek_socket(entry.s);
-					if (peek == 2) { // Data
-						if ((entry.eventmask & REP_READ) && !(entry.fired_mask & REP_READ)) {
-							events |= REP_READ;
-						}
-					} else if (peek == 1) { // EOF
-						if ((entry.eventmask & REP_CLOSE) && !(entry.fired_mask & REP_CLOSE)) {
-							events |= REP_CLOSE;
-						}
-						// EOF is also readable (read returns 0)
-						if ((entry.eventmask & REP_READ) && !(entry.fired_mask & REP_READ)) {
-							events |= REP_READ;
-						}
-					}
-				}
-				if ((entry.eventmask & REP_ACCEPT) && !(entry.fired_mask & REP_ACCEPT)) {
-					events |= REP_ACCEPT;
-				}
-			}
-			
-			if (FD_ISSET(entry.s, &writefds)) {
-				bool wrote = false;
-				
-				if (entry.connecting) {
-					int error = 0;
-					socklen_t len = sizeof(error);
-					if (getsockopt(entry.s, SOL_SOCKET, SO_ERROR, &error, &len) < 0 || error != 0) {
-						// Connection failed
-						write_log("BSDSOCK: Socket %d connect check failed (errno=%d), checking SO_ERROR\n", entry.sd, errno);
-						// We don't set REP_ERROR here, maybe we should? But WinUAE usually handles it via generic error?
-						// Actually, we should probably set REP_ERROR if the app asked for it.
-						if (entry.eventmask & REP_ERROR) events |= REP_ERROR;
-						entry.connecting = false;
-					} else {
-						entry.connecting = false;
-						entry.connected = true;
-						
-						if ((entry.eventmask & REP_CONNECT) && !(entry.fired_mask & REP_CONNECT)) {
-							events |= REP_CONNECT;
-						}
-						// Writable now
-						if ((entry.eventmask & REP_WRITE) && !(entry.fired_mask & REP_WRITE)) {
-							events |= REP_WRITE;
-						}
-                        // Do NOT set REP_READ here blindly. Let readfds handle it.
-						write_log("BSDSOCK: Socket %d CONNECT completed successfully\n", entry.sd);
-					}
-					wrote = true;
-				}
-				
-				// Standard Write Signaling
-				if (entry.eventmask & REP_WRITE) {
-					events |= REP_WRITE;
-					wrote = true;
-				}
-				
-				// Fallback: If App asked for REP_CONNECT but NOT REP_WRITE, and we are connected (writable).
-				// We must signal REP_CONNECT (or WRITE) to wake it up.
-				if (!wrote && (entry.eventmask & REP_CONNECT) && entry.connected) {
-					events |= REP_WRITE | REP_CONNECT;
-				}
-			}
-			
-			if (FD_ISSET(entry.s, &exceptfds)) {
-				if (entry.eventmask & REP_OOB) {
-					events |= REP_OOB;
-				}
-			}
-			
-			// Post events to Amiga and clear them from the mask (one-shot delivery)
-			if (events) {
-				post_socket_event(entry.sb, entry.sd, events);
-				
-				// Mark these events as fired so we don't post them again until re-enabled
-				// This implements the one-shot behavior required by Amiga apps
-				entry.fired_mask |= events;
-				
-				// Do NOT clear them from eventmask, as that loses the user's request.
-				// Do NOT update ftable here, post_socket_event handles the SET_ flags.
-				
-				write_log("BSDSOCK: Fired events 0x%x for socket %d, fired_mask now 0x%x\n", 
-				          events, entry.sd, entry.fired_mask);
-			}
+		for (size_t i = 1; i < fds.size(); i++) {
+			if (fds[i].revents)
+				monitor_dispatch(monitor, fd_ids[i], poll_to_mon(fds[i].revents));
 		}
-		
 		SDL_UnlockMutex(monitor->mutex);
-		
-		// Throttle the loop to prevent lock starvation of the Amiga Task
-		// If we spin freely, addtosigqueue() locks can starve GetSocketEvents().
-		SDL_Delay(10);
+#endif
 	}
 	
 	write_log("BSDSOCK: Event monitor thread exiting\n");
 	return 0;
 }
 
+static void free_event_monitor(struct event_monitor* monitor)
+{
+	if (monitor->mutex)
+		SDL_DestroyMutex(monitor->mutex);
+#ifdef BSDSOCK_EPOLL
+	if (monitor->epoll_fd >= 0)
+		close(monitor->epoll_fd);
+	if (monitor->wake_fd >= 0)
+		close(monitor->wake_fd);
+#else
+	if (monitor->wake_pipe[0] >= 0) {
+		close(monitor->wake_pipe[0]);
+		close(monitor->wake_pipe[1]);
+	}
+#endif
+	delete monitor;
+}
+
 // Start the event monitor thread
 static bool start_event_monitor()
 {
@@ -754,46 +884,53 @@ static bool start_event_monitor()
 		return true; // Already running
 	}
 	
-	g_event_monitor = (struct event_monitor*)malloc(sizeof(struct event_monitor));
-	if (!g_event_monitor) {
-		write_log("BSDSOCK: Failed to allocate event monitor\n");
+	auto* monitor = new event_monitor();
+	monitor->next_id = 1;
+	monitor->running = true;
+	
+#ifdef BSDSOCK_EPOLL
+	monitor->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	monitor->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (monitor->epoll_fd < 0 || monitor->wake_fd < 0) {
+		write_log("BSDSOCK: Failed to create epoll set: %d\n", errno);
+		free_event_monitor(monitor);
 		return false;
 	}
-	
-	// Create wake pipe
-	if (pipe(g_event_monitor->wake_pipe) < 0) {
+	struct epoll_event ev {};
+	ev.events = EPOLLIN;
+	ev.data.u64 = 0;
+	if (epoll_ctl(monitor->epoll_fd, EPOLL_CTL_ADD, monitor->wake_fd, &ev) < 0) {
+		write_log("BSDSOCK: Failed to add wake eventfd: %d\n", errno);
+		free_event_monitor(monitor);
+		return false;
+	}
+#else
+	if (pipe(monitor->wake_pipe) < 0) {
 		write_log("BSDSOCK: Failed to create wake pipe: %d\n", errno);
-		free(g_event_monitor);
-		g_event_monitor = nullptr;
+		monitor->wake_pipe[0] = monitor->wake_pipe[1] = -1;
+		free_event_monitor(monitor);
 		return false;
 	}
+	fcntl(monitor->wake_pipe[0], F_SETFL, O_NONBLOCK);
+	fcntl(monitor->wake_pipe[1], F_SETFL, O_NONBLOCK);
+#endif
 	
 	// Create mutex
-	g_event_monitor->mutex = SDL_CreateMutex();
-	if (!g_event_monitor->mutex) {
+	monitor->mutex = SDL_CreateMutex();
+	if (!monitor->mutex) {
 		write_log("BSDSOCK: Failed to create mutex\n");
-		close(g_event_monitor->wake_pipe[0]);
-		close(g_event_monitor->wake_pipe[1]);
-		free(g_event_monitor);
-		g_event_monitor = nullptr;
+		free_event_monitor(monitor);
 		return false;
 	}
 	
-	// Initialize state
-	g_event_monitor->running = true;
-	g_event_monitor->socket_list.clear();
-	
 	// Start thread
-	if (!uae_start_thread("bsdsock_event_monitor", event_monitor_thread, g_event_monitor, &g_event_monitor->thread)) {
+	if (!uae_start_thread("bsdsock_event_monitor", event_monitor_thread, monitor, &monitor->thread)) {
 		write_log("BSDSOCK: Failed to start event monitor thread\n");
-		SDL_DestroyMutex(g_event_monitor->mutex);
-		close(g_event_monitor->wake_pipe[0]);
-		close(g_event_monitor->wake_pipe[1]);
-		free(g_event_monitor);
-		g_event_monitor = nullptr;
+		free_event_monitor(monitor);
 		return false;
 	}
 	
+	g_event_monitor = monitor;
 	write_log("BSDSOCK: Event monitor started\n");
 	return true;
 }
@@ -807,21 +944,14 @@ static void stop_event_monitor()
 	
 	write_log("BSDSOCK: Stopping event monitor\n");
 	
-	// Signal thread to stop
+	// Signal thread to stop and wake it up
 	g_event_monitor->running = false;
-	
-	// Wake up the thread
-	char wake = 1;
-	write(g_event_monitor->wake_pipe[1], &wake, 1);
+	monitor_wake(g_event_monitor);
 	
 	// Wait for thread to exit
 	uae_wait_thread(&g_event_monitor->thread);
 	
-	// Cleanup
-	SDL_DestroyMutex(g_event_monitor->mutex);
-	close(g_event_monitor->wake_pipe[0]);
-	close(g_event_monitor->wake_pipe[1]);
-	free(g_event_monitor);
+	free_event_monitor(g_event_monitor);
 	g_event_monitor = nullptr;
 	
 	write_log("BSDSOCK: Event monitor stopped\n");
@@ -839,38 +969,41 @@ static void register_socket_events(struct socketbase* sb, int sd, SOCKET_TYPE s,
 	
 	SDL_LockMutex(g_event_monitor->mutex);
 	
-	// Check if socket already registered
-	bool found = false;
-	for (auto& entry : g_event_monitor->socket_list) {
-		if (entry.sb == sb && entry.sd == sd) {
-			// Update existing entry
-			entry.eventmask = eventmask;
-			found = true;
-			write_log("BSDSOCK: Updated event mask 0x%x for socket %d\n", eventmask, sd);
-			break;
-		}
-	}
-	
-	if (!found) {
+	socket_event_entry* entry = monitor_find(g_event_monitor, sb, sd);
+	if (entry && entry->s != s) {
+		// Descriptor reused for another host socket
+		monitor_remove(g_event_monitor, g_event_monitor->ids.find(std::make_pair(sb, sd)));
+		entry = nullptr;
+	}
+	if (entry) {
+		// Update existing entry
+		entry->eventmask = eventmask;
+		write_log("BSDSOCK: Updated event mask 0x%x for socket %d\n", eventmask, sd);
+	} else {
 		// Add new entry
-		socket_event_entry entry;
-		entry.sb = sb;
-		entry.sd = sd;
-		entry.s = s;
-		entry.sd = sd;
-		entry.s = s;
-		entry.eventmask = eventmask;
-		entry.connecting = false;
-		entry.connected = true; // Default to true (optimistic), disable if ENOTCONN seen
-		entry.fired_mask = 0;
-		g_event_monitor->socket_list.push_back(entry);
+		socket_event_entry e {};
+		e.id = g_event_monitor->next_id++;
+		e.sb = sb;
+		e.sd = sd;
+		e.s = s;
+		e.eventmask = eventmask;
+		e.connecting = false;
+		e.connected = true; // Default to true (optimistic), disable if ENOTCONN seen
+		e.fired_mask = 0;
+		e.armed = 0;
+		entry = &g_event_monitor->sockets.emplace(e.id, e).first->second;
+		g_event_monitor->ids[std::make_pair(sb, sd)] = e.id;
 		
+#ifdef BSDSOCK_EPOLL
+		struct epoll_event ev {};
+		ev.events = EPOLLONESHOT;
+		ev.data.u64 = e.id;
+		if (epoll_ctl(g_event_monitor->epoll_fd, EPOLL_CTL_ADD, s, &ev) < 0 && errno != EEXIST)
+			write_log("BSDSOCK: Cannot monitor socket %d (native %d): %d\n", sd, s, errno);
+#endif
 		write_log("BSDSOCK: Registered socket %d (native %d) for event monitoring (mask 0x%x)\n", sd, s, eventmask);
 	}
-	
-	// Wake up monitor thread to rebuild fd_sets
-	char wake = 1;
-	write(g_event_monitor->wake_pipe[1], &wake, 1);
+	monitor_arm(g_event_monitor, *entry);
 	
 	SDL_UnlockMutex(g_event_monitor->mutex);
 }
@@ -883,22 +1016,28 @@ static void unregister_socket_events(struct socketbase* sb, int sd)
 	}
 	
 	SDL_LockMutex(g_event_monitor->mutex);
-	
-	// Remove socket from list
-	auto it = g_event_monitor->socket_list.begin();
-	while (it != g_event_monitor->socket_list.end()) {
-		if (it->sb == sb && it->sd == sd) {
-			it = g_event_monitor->socket_list.erase(it);
-			write_log("BSDSOCK: Unregistered socket %d from event monitoring\n", sd);
-		} else {
-			++it;
-		}
+	auto id = g_event_monitor->ids.find(std::make_pair(sb, sd));
+	if (id != g_event_monitor->ids.end()) {
+		monitor_remove(g_event_monitor, id);
+		write_log("BSDSOCK: Unregistered socket %d from event monitoring\n", sd);
+	}
+	SDL_UnlockMutex(g_event_monitor->mutex);
+}
+
+// Unregister all sockets of a task that closes the library
+static void unregister_socketbase_events(struct socketbase* sb)
+{
+	if (!g_event_monitor) {
+		return;
 	}
 	
-	// Wake up monitor thread
-	char wake = 1;
-	write(g_event_monitor->wake_pipe[1], &wake, 1);
-	
+	SDL_LockMutex(g_event_monitor->mutex);
+	auto id = g_event_monitor->ids.lower_bound(std::make_pair(sb, INT_MIN));
+	while (id != g_event_monitor->ids.end() && id->first.first == sb) {
+		auto next = std::next(id);
+		monitor_remove(g_event_monitor, id);
+		id = next;
+	}
 	SDL_UnlockMutex(g_event_monitor->mutex);
 }
 
@@ -908,17 +1047,10 @@ static void set_socket_connecting(struct socketbase* sb, int sd, bool connecting
 	if (!g_event_monitor) return;
 	
 	SDL_LockMutex(g_event_monitor->mutex);
-	for (auto& entry : g_event_monitor->socket_list) {
-		if (entry.sb == sb && entry.sd == sd) {
-			entry.connecting = connecting;
-			write_log("BSDSOCK: Socket %d connecting state set to %d\n", sd, connecting);
-			break;
-		}
-	}
-	// Wake up monitor to update handling
-	if (g_event_monitor->wake_pipe[1] != -1) {
-		char b = 1;
-		write(g_event_monitor->wake_pipe[1], &b, 1);
+	socket_event_entry* entry = monitor_find(g_event_monitor, sb, sd);
+	if (entry) {
+		entry->connecting = connecting;
+		monitor_arm(g_event_monitor, *entry);
 	}
 	SDL_UnlockMutex(g_event_monitor->mutex);
 }
@@ -929,21 +1061,170 @@ static void socket_reenable_events(struct socketbase* sb, int sd, int events)
 	if (!g_event_monitor) return;
 	
 	SDL_LockMutex(g_event_monitor->mutex);
-	for (auto& entry : g_event_monitor->socket_list) {
-		if (entry.sb == sb && entry.sd == sd) {
-			if (entry.fired_mask & events) {
-				entry.fired_mask &= ~events;
-				write_log("BSDSOCK: Re-enabled events 0x%x for socket %d\n", events, sd);
-				// Wake up monitor to check this socket again
-				if (g_event_monitor->wake_pipe[1] != -1) {
-					char b = 1;
-					write(g_event_monitor->wake_pipe[1], &b, 1);
-				}
+	socket_event_entry* entry = monitor_find(g_event_monitor, sb, sd);
+	if (entry) {
+		entry->fired_mask &= ~events;
+		// Also re-arms a registration left disabled after a hangup
+		monitor_arm(g_event_monitor, *entry);
+	}
+	SDL_UnlockMutex(g_event_monitor->mutex);
+}
+
+/*
+ * WaitSelect() state of a task. On Linux the descriptors stay registered in
+ * an epoll set between calls, so a loop that waits on the same sockets again
+ * and again only pays for the ones whose interest changed. Elsewhere the set
+ * is handed to poll() on every call.
+ */
+struct waitselect_fd {
+	int s;          // host socket
+	int want;       // MON_IN, MON_OUT, MON_PRI
+	int ready;      // MON_* reported by the kernel
+};
+
+struct waitselect_set {
+#ifdef BSDSOCK_EPOLL
+	int epoll_fd;
+	std::unordered_map<int, int> registered;    // host socket -> interest in the epoll set
+	unsigned int closes;                        // waitselect_closes when registered was last checked
+	std::vector<struct epoll_event> events;
+#else
+	std::vector<struct pollfd> pfds;
+#endif
+	std::vector<waitselect_fd> fds;             // one slot per host socket in this call
+	std::unordered_map<int, int> slot;          // host socket -> slot
+	struct request { int a_s, set, slot; };
+	std::vector<request> requests;              // Amiga descriptors in this call
+};
+
+#ifdef BSDSOCK_EPOLL
+/*
+ * Counts host socket closes. Closing a socket also drops it from the epoll
+ * sets of other tasks that waited on it before it was released to another
+ * task, and its number can come back as a new socket. Their registered
+ * entries can't be trusted after that.
+ */
+static std::atomic<unsigned int> waitselect_closes;
+#endif
+
+static void waitselect_closed(void)
+{
+#ifdef BSDSOCK_EPOLL
+	waitselect_closes++;
+#endif
+}
+
+static struct waitselect_set* waitselect_get(SB)
+{
+	if (sb->wsset)
+		return sb->wsset;
+	auto* ws = new waitselect_set();
+#ifdef BSDSOCK_EPOLL
+	ws->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (ws->epoll_fd < 0) {
+		write_log("BSDSOCK: WaitSelect() cannot create epoll set: %d\n", errno);
+		delete ws;
+		return nullptr;
+	}
+	struct epoll_event ev {};
+	ev.events = EPOLLIN;
+	ev.data.fd = sb->sockabort[0];
+	epoll_ctl(ws->epoll_fd, EPOLL_CTL_ADD, sb->sockabort[0], &ev);
+#endif
+	sb->wsset = ws;
+	return ws;
+}
+
+static void waitselect_free(SB)
+{
+	if (!sb->wsset)
+		return;
+#ifdef BSDSOCK_EPOLL
+	close(sb->wsset->epoll_fd);
+#endif
+	delete sb->wsset;
+	sb->wsset = nullptr;
+}
+
+// Drop a socket from the WaitSelect() set before it is closed
+static void waitselect_forget(SB, int s)
+{
+#ifdef BSDSOCK_EPOLL
+	if (!sb->wsset)
+		return;
+	if (sb->wsset->registered.erase(s)) {
+		struct epoll_event ev {};
+		epoll_ctl(sb->wsset->epoll_fd, EPOLL_CTL_DEL, s, &ev);
+	}
+#endif
+}
+
+// Wait until one of the slots is ready, returns -1/0/>0 like select(). Sets *aborted on sockabort().
+static int waitselect_wait(SB, struct waitselect_set* ws, int timeout_ms, bool* aborted)
+{
+	int r;
+
+	*aborted = false;
+#ifdef BSDSOCK_EPOLL
+	// after a close re-issue every registration, MOD fails with ENOENT on a stale one
+	unsigned int closes = waitselect_closes.load();
+	bool recheck = closes != ws->closes;
+	ws->closes = closes;
+	for (auto& fd : ws->fds) {
+		auto reg = ws->registered.find(fd.s);
+		if (reg != ws->registered.end() && reg->second == fd.want && !recheck)
+			continue;
+		struct epoll_event ev {};
+		ev.events = mon_to_epoll(fd.want);
+		ev.data.fd = fd.s;
+		int op = reg != ws->registered.end() ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+		if (epoll_ctl(ws->epoll_fd, op, fd.s, &ev) < 0) {
+			// The socket number was closed and reused behind our back
+			op = op == EPOLL_CTL_MOD ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+			if (epoll_ctl(ws->epoll_fd, op, fd.s, &ev) < 0) {
+				write_log("BSDSOCK: WaitSelect() cannot watch native socket %d: %d\n", fd.s, errno);
+				continue;
 			}
-			break;
 		}
+		ws->registered[fd.s] = fd.want;
 	}
-	SDL_UnlockMutex(g_event_monitor->mutex);
+	// Sockets from earlier calls that are not waited for now
+	for (auto reg = ws->registered.begin(); reg != ws->registered.end();) {
+		if (ws->slot.count(reg->first)) {
+			++reg;
+			continue;
+		}
+		struct epoll_event ev {};
+		epoll_ctl(ws->epoll_fd, EPOLL_CTL_DEL, reg->first, &ev);
+		reg = ws->registered.erase(reg);
+	}
+
+	ws->events.resize(ws->fds.size() + 1);
+	r = epoll_wait(ws->epoll_fd, ws->events.data(), (int)ws->events.size(), timeout_ms);
+	for (int i = 0; i < r; i++) {
+		int s = ws->events[i].data.fd;
+		if (s == sb->sockabort[0]) {
+			*aborted = true;
+			continue;
+		}
+		auto slot = ws->slot.find(s);
+		if (slot != ws->slot.end())
+			ws->fds[slot->second].ready = epoll_to_mon(ws->events[i].events);
+	}
+#else
+	ws->pfds.clear();
+	for (const auto& fd : ws->fds)
+		ws->pfds.push_back({ fd.s, mon_to_poll(fd.want), 0 });
+	ws->pfds.push_back({ sb->sockabort[0], POLLIN, 0 });
+
+	r = poll(ws->pfds.data(), ws->pfds.size(), timeout_ms);
+	if (r > 0) {
+		for (size_t i = 0; i < ws->fds.size(); i++)
+			ws->fds[i].ready = poll_to_mon(ws->pfds[i].revents);
+		*aborted = ws->pfds.back().revents != 0;
+	}
+#endif
+	return r;
 }
 
 static int copysockaddr_a2n(struct sockaddr_in* addr, uae_u32 a_addr, unsigned int len)
@@ -1248,31 +1529,29 @@ uae_u32 bsdthr_blockingstuff(uae_u32(*tryfunc)(SB), SB)
         } while (foo < 0 && errno == EINTR); // retry on EINTR
         if (foo < 0 && !nonblock) {
             if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINPROGRESS)) {
-                fd_set readset, writeset, exceptset;
-                int maxfd = (sb->s > sb->sockabort[0]) ? sb->s : sb->sockabort[0];
+                struct pollfd fds[2];
                 int num;
 
-                FD_ZERO(&readset);
-                FD_ZERO(&writeset);
-                FD_ZERO(&exceptset);
-
+                fds[0].fd = sb->s;
+                fds[0].events = 0;
                 if (sb->action == 3 || sb->action == 6)
-                    FD_SET(sb->s, &readset);
+                    fds[0].events |= POLLIN;
                 if (sb->action == 2 || sb->action == 1 || sb->action == 4)
-                    FD_SET(sb->s, &writeset);
-                FD_SET(sb->sockabort[0], &readset);
+                    fds[0].events |= POLLOUT;
+                fds[1].fd = sb->sockabort[0];
+                fds[1].events = POLLIN;
 
                 do {
-                    num = select(maxfd + 1, &readset, &writeset, &exceptset, NULL);
+                    num = poll(fds, 2, -1);
                 } while (num == -1 && errno == EINTR); // retry on EINTR
                 if (num == -1) {
-                    write_log("Blocking select(%d) returns -1,errno is %d\n", sb->sockabort[0], errno);
+                    write_log("Blocking poll(%d) returns -1,errno is %d\n", sb->sockabort[0], errno);
                     if (!is_raw) fcntl(sb->s, F_SETFL, flags);
                     if (is_raw && timeout_set) setsockopt(sb->s, SOL_SOCKET, SO_RCVTIMEO, &orig_timeout, sizeof(orig_timeout));
                     return -1;
                 }
 
-                if (FD_ISSET(sb->sockabort[0], &readset) || FD_ISSET(sb->sockabort[0], &writeset)) {
+                if (fds[1].revents) {
                     /* reset sock abort pipe */
                     /* read from the pipe to reset it */
                     write_log("select aborted from signal\n");
@@ -1483,6 +1762,7 @@ void host_closesocketquick (int s)
 	if(s != -1) {
 		setsockopt (s, SOL_SOCKET, SO_LINGER, &l, sizeof(l));
 		close (s);
+		waitselect_closed();
 	}
 }
 
@@ -1495,6 +1775,7 @@ void host_sbcleanup (SB)
 	}
 
 	uae_thread_id thread = sb->thread;
+	unregister_socketbase_events(sb);
 	close (sb->sockabort[0]);
 	close (sb->sockabort[1]);
 	for (i = 0; i < sb->dtablesize; i++) {
@@ -1502,6 +1783,7 @@ void host_sbcleanup (SB)
 			close(sb->dtable[i]);
 		}
 	}
+	waitselect_closed();
 	sb->action = 0;
 
 	uae_sem_post (&sb->sem); /* destroy happens on socket thread */
@@ -1512,6 +1794,7 @@ void host_sbcleanup (SB)
 	 * pthreads, it always creates joinable threads - and we can't do anything
 	 * about that. */
 	uae_wait_thread (&thread);
+	waitselect_free(sb);
 }
 
 void host_sbreset (void)
@@ -1543,7 +1826,11 @@ int host_dup2socket(TrapContext *ctx, SB, int fd1, int fd2)
 			fd2++;
 			s2 = getsock(ctx, sb, fd2);
 			if (s2 != -1) {
+				// dup() is likely to return the same host fd, stale registrations would hide it
+				unregister_socket_events(sb, fd2 - 1);
+				waitselect_forget(sb, s2);
 				close (s2);
+				waitselect_closed();
 			}
 			setsd (ctx, sb, fd2, dup (s1));
 			return 0;
@@ -1792,9 +2079,12 @@ void host_recvfrom(TrapContext *ctx, SB, uae_u32 sd, uae_u32 msg, uae_u8 *hmsg,
     
     write_log("BSDSOCK: host_recvfrom %d called\n", sd);
 
+	// the socket thread receives straight into Amiga memory
+	writewatch_host_write_begin(realpt, len);
 	uae_sem_post (&sb->sem);
 
 	WAITSIGNAL;
+	writewatch_host_write_end(realpt, len);
 
 	// Implicitly re-enable REP_READ and REP_OOB
 	socket_reenable_events(sb, sd, REP_READ | REP_OOB);
@@ -2182,9 +2472,11 @@ int host_CloseSocket(TrapContext *ctx, SB, int sd)
 	
 	// Unregister from event monitoring if registered
 	unregister_socket_events(sb, sd);
+	waitselect_forget(sb, s);
 	
 	retval = close (s);
 	SETERRNO;
+	waitselect_closed();
 	releasesock (ctx, sb, sd + 1);
 	return retval;
 }
@@ -2198,90 +2490,72 @@ static void fd_zero(TrapContext *ctx, uae_u32 fdset, uae_u32 nfds)
 
 uae_u32 bsdthr_WaitSelect(SB)
 {
-	fd_set sets[3];
-	int i, s, set, a_s, max;
-	uae_u32 a_set;
-	struct timeval tv {};
-	int r;
+	int i, s, set, r;
+	int timeout_ms = -1;
+	bool aborted;
 	TrapContext* ctx = NULL;  // FIXME: Correct?
+	static const int set_want[3] = { MON_IN, MON_OUT, MON_PRI };
+	// Same readiness mapping as the kernel's select()
+	static const int set_ready[3] = { MON_IN | MON_RDHUP | MON_HUP | MON_ERR, MON_OUT | MON_ERR, MON_PRI };
 
-	write_log("WaitSelect: %d 0x%x 0x%x 0x%x 0x%x 0x%x\n", sb->nfds, sb->sets[0], sb->sets[1], sb->sets[2], sb->timeout, sb->sigmp);
-
-	if (sb->timeout)
-		write_log("WaitSelect: timeout %d %d\n", get_long(sb->timeout), get_long(sb->timeout + 4));
-
-	FD_ZERO(&sets[0]);
-	FD_ZERO(&sets[1]);
-	FD_ZERO(&sets[2]);
-
-	/* Set up the abort socket */
-	FD_SET(sb->sockabort[0], &sets[0]);
-	FD_SET(sb->sockabort[0], &sets[2]);
-	max = sb->sockabort[0];
+	struct waitselect_set* ws = waitselect_get(sb);
+	if (!ws) {
+		errno = ENOMEM;
+		return -1;
+	}
+	ws->fds.clear();
+	ws->slot.clear();
+	ws->requests.clear();
 
 	for (set = 0; set < 3; set++) {
-		if (sb->sets[set] != 0) {
-			a_set = sb->sets[set];
-			for (i = 0; i < sb->nfds; i++) {
-				if (bsd_amigaside_FD_ISSET(i, a_set)) {
-					s = getsock(ctx, sb, i + 1);
-					write_log("WaitSelect: AmigaSide %d set. NativeSide %d.\n", i, s);
-					if (s == -1) {
-						write_log("BSDSOCK: WaitSelect() called with invalid descriptor %d in set %d.\n", i, set);
-					} else {
-						FD_SET(s, &sets[set]);
-						if (max < s) max = s;
-					}
-				}
+		if (sb->sets[set] == 0)
+			continue;
+		for (i = 0; i < sb->nfds; i++) {
+			if (!bsd_amigaside_FD_ISSET(i, sb->sets[set]))
+				continue;
+			s = getsock(ctx, sb, i + 1);
+			if (s == -1) {
+				write_log("BSDSOCK: WaitSelect() called with invalid descriptor %d in set %d.\n", i, set);
+				continue;
 			}
+			auto slot = ws->slot.emplace(s, (int)ws->fds.size());
+			if (slot.second)
+				ws->fds.push_back({ s, 0, 0 });
+			ws->fds[slot.first->second].want |= set_want[set];
+			ws->requests.push_back({ i, set, slot.first->second });
 		}
 	}
 
-	max++;
-
 	if (sb->timeout) {
-		tv.tv_sec = get_long(sb->timeout);
-		tv.tv_usec = get_long(sb->timeout + 4);
+		uae_s64 ms = (uae_s64)get_long(sb->timeout) * 1000 + (get_long(sb->timeout + 4) + 999) / 1000;
+		timeout_ms = ms > INT_MAX ? INT_MAX : (int)ms;
 	}
 
-	write_log("Select going to select\n");
-	r = select(max, &sets[0], &sets[1], &sets[2], (sb->timeout == 0) ? NULL : &tv);
-	write_log("Select returns %d, errno is %d\n", r, errno);
-	if (r > 0) {
-		/* Socket told us to abort */
-		if (FD_ISSET(sb->sockabort[0], &sets[0])) {
-			/* read from the pipe to reset it */
-			write_log("WaitSelect aborted from signal\n");
-			r = 0;
-			for (set = 0; set < 3; set++)
-				if (sb->sets[set] != 0)
-					bsd_amigaside_FD_ZERO(sb->sets[set]);
-			clearsockabort(sb);
+	r = waitselect_wait(sb, ws, timeout_ms, &aborted);
+	if (r < 0) {
+		write_log("WaitSelect: r=%d errno=%d\n", r, errno);
+		return r;
+	}
+
+	for (set = 0; set < 3; set++)
+		if (sb->sets[set] != 0)
+			bsd_amigaside_FD_ZERO(sb->sets[set]);
+
+	if (aborted) {
+		/* Socket told us to abort, read from the pipe to reset it */
+		write_log("WaitSelect aborted from signal\n");
+		clearsockabort(sb);
+		return 0;
+	}
+
+	/* Timeout clears the sets, otherwise report the ready descriptors */
+	r = 0;
+	for (const auto& req : ws->requests) {
+		if (ws->fds[req.slot].ready & set_ready[req.set]) {
+			bsd_amigaside_FD_SET(req.a_s, sb->sets[req.set]);
+			r++;
 		}
-		else
-			/* This is perhaps slightly inefficient, but I don't care.. */
-			for (set = 0; set < 3; set++) {
-				a_set = sb->sets[set];
-				if (a_set != 0) {
-					bsd_amigaside_FD_ZERO(a_set);
-					for (i = 0; i < sb->nfds; i++) {
-						a_s = getsock(ctx, sb, i + 1);
-						if (!(a_s < 0)) {
-							if (FD_ISSET(a_s, &sets[set])) {
-								write_log("WaitSelect: NativeSide %d set. AmigaSide %d.\n", a_s, i);
-
-								bsd_amigaside_FD_SET(i, a_set);
-							}
-						}
-					}
-				}
-			}
-	} else if (r == 0) {         /* Timeout. I think we're supposed to clear the sets.. */
-		for (set = 0; set < 3; set++)
-			if (sb->sets[set] != 0)
-				bsd_amigaside_FD_ZERO(sb->sets[set]);
 	}
-	write_log("WaitSelect: r=%d errno=%d\n", r, errno);
 	return r;
 }
 
@@ -0,0 +1,400 @@
+/*
+ * UAE - The Un*x Amiga Emulator
+ *
+ * Host directory listing cache
+ *
+ * Directory filesystems resolve names case-insensitively, enumerate
+ * directories for ExNext/ExAll, stat every entry and read _UAEFSDB.___,
+ * each time by going to the host. This keeps the listing of recently used
+ * directories with an index of exact and folded names, stat results that
+ * are filled in on first use and the contents of the db file.
+ *
+ * On Linux every cached directory has an inotify watch. Pending events are
+ * read before each use and drop what they affect: the listing on create,
+ * delete and rename, a single stat result on write and attribute changes,
+ * the db contents when _UAEFSDB.___ changes. Without inotify the directory
+ * mtime is compared on every use, and stat results are not cached as file
+ * contents don't show in it. At most DC_MAX_DIRS directories and
+ * DC_MAX_NAMES names are kept, the least recently used go first.
+ */
+
+#include "sysconfig.h"
+#include "sysdeps.h"
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#if defined(__linux__)
+#include <sys/inotify.h>
+#define DC_INOTIFY
+#endif
+
+#include "fsdb.h"
+#include "fsdb_host.h"
+
+#define DC_MAX_DIRS 256
+#define DC_MAX_NAMES 262144
+/* mtime checks trust a listing only if the directory was this many seconds old */
+#define DC_RACY_SECS 2
+
+enum
+{
+	DC_META_UNKNOWN,
+	DC_META_NONE,
+	DC_META_LOADED
+};
+
+struct dc_stat
+{
+	bool valid;
+	struct stat st;
+};
+
+struct dc_dir
+{
+	std::string path;
+	std::shared_ptr<std::vector<std::string>> names;
+	std::unordered_map<std::string, int> exact;
+	std::unordered_map<std::string, int> folded;
+	std::vector<dc_stat> stats;
+	int wd;
+	time_t mtime, ctime;
+	bool racy;
+	int meta_state;
+	std::vector<uae_u8> meta;
+};
+
+struct fsdb_dircache_handle
+{
+	std::shared_ptr<std::vector<std::string>> names;
+	size_t pos;
+};
+
+typedef std::list<dc_dir>::iterator dc_iter;
+
+static std::mutex dc_lock;
+static std::list<dc_dir> dc_lru;
+static std::unordered_map<std::string, dc_iter> dc_dirs;
+static size_t dc_names;
+#ifdef DC_INOTIFY
+static std::unordered_map<int, std::string> dc_watches;
+static int dc_inotify_fd = -2;
+#endif
+
+static std::string dc_fold(const std::string &s)
+{
+	std::string f(s);
+	for (auto &c : f) {
+		if (c >= 'A' && c <= 'Z')
+			c += 32;
+	}
+	return f;
+}
+
+static std::string dc_key(const TCHAR *dirname)
+{
+	std::string k(dirname);
+	while (k.length() > 1 && k.back() == FSDB_DIR_SEPARATOR)
+		k.pop_back();
+	return k;
+}
+
+static void dc_drop(dc_iter d)
+{
+#ifdef DC_INOTIFY
+	if (d->wd >= 0) {
+		inotify_rm_watch(dc_inotify_fd, d->wd);
+		dc_watches.erase(d->wd);
+	}
+#endif
+	dc_names -= d->names->size();
+	dc_dirs.erase(d->path);
+	dc_lru.erase(d);
+}
+
+#ifdef DC_INOTIFY
+
+#define DC_WATCH_MASK (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_MODIFY | IN_ATTRIB \
+	| IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+
+static void dc_event(dc_iter d, const struct inotify_event *ev)
+{
+	std::string name;
+
+	if (ev->len && !utf8_to_latin1_string(ev->name, name))
+		name.clear();
+	if (!name.empty() && name == FSDB_FILE) {
+		d->meta_state = DC_META_UNKNOWN;
+		d->meta.clear();
+		return;
+	}
+	if (ev->mask & (IN_MODIFY | IN_ATTRIB)) {
+		if (name.empty())
+			return;
+		auto e = d->exact.find(name);
+		if (e != d->exact.end())
+			d->stats[e->second].valid = false;
+		return;
+	}
+	dc_drop(d);
+}
+
+static void dc_poll(void)
+{
+	alignas(struct inotify_event) char buf[4096];
+
+	if (dc_inotify_fd == -2) {
+		dc_inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (dc_inotify_fd < 0)
+			write_log(_T("FSDB: inotify not available, directory cache uses mtime checks\n"));
+	}
+	if (dc_inotify_fd < 0)
+		return;
+	for (;;) {
+		ssize_t len = read(dc_inotify_fd, buf, sizeof buf);
+		if (len <= 0)
+			break;
+		for (char *p = buf; p < buf + len; ) {
+			const struct inotify_event *ev = (const struct inotify_event*)p;
+			p += sizeof(struct inotify_event) + ev->len;
+			if (ev->mask & IN_Q_OVERFLOW) {
+				while (!dc_lru.empty())
+					dc_drop(dc_lru.begin());
+				continue;
+			}
+			auto w = dc_watches.find(ev->wd);
+			if (w == dc_watches.end())
+				continue;
+			auto d = dc_dirs.find(w->second);
+			if (d != dc_dirs.end())
+				dc_event(d->second, ev);
+		}
+	}
+}
+
+#else
+
+static void dc_poll(void)
+{
+}
+
+#endif
+
+static dc_iter dc_find(const std::string &key)
+{
+	auto it = dc_dirs.find(key);
+	return it == dc_dirs.end() ? dc_lru.end() : it->second;
+}
+
+/* stat the directory itself, used when it has no watch */
+static bool dc_dirstat(const std::string &key, time_t *mtime, time_t *ctime)
+{
+	struct stat st;
+	const auto path = iso_8859_1_to_utf8(key);
+	if (stat(path.c_str(), &st) == -1)
+		return false;
+	*mtime = st.st_mtime;
+	*ctime = st.st_ctime;
+	return true;
+}
+
+static dc_iter dc_load(const std::string &key)
+{
+	dc_dir d;
+	TCHAR fn[MAX_DPATH];
+
+	d.path = key;
+	d.wd = -1;
+	d.mtime = d.ctime = 0;
+	d.racy = false;
+	d.meta_state = DC_META_UNKNOWN;
+	// watch before listing so that nothing between the two gets lost
+#ifdef DC_INOTIFY
+	if (dc_inotify_fd >= 0) {
+		const auto path = iso_8859_1_to_utf8(key);
+		int wd = inotify_add_watch(dc_inotify_fd, path.c_str(), DC_WATCH_MASK);
+		// the same directory through another path shares the watch, leave it alone
+		if (wd >= 0 && dc_watches.find(wd) == dc_watches.end())
+			d.wd = wd;
+	}
+#endif
+	if (d.wd < 0) {
+		if (!dc_dirstat(key, &d.mtime, &d.ctime))
+			return dc_lru.end();
+		d.racy = time(NULL) - d.mtime < DC_RACY_SECS;
+	}
+	struct my_opendir_s *od = my_opendir(key.c_str());
+	if (!od) {
+#ifdef DC_INOTIFY
+		if (d.wd >= 0)
+			inotify_rm_watch(dc_inotify_fd, d.wd);
+#endif
+		return dc_lru.end();
+	}
+	d.names = std::make_shared<std::vector<std::string>>();
+	while (my_readdir(od, fn)) {
+		int idx = (int)d.names->size();
+		d.names->emplace_back(fn);
+		d.exact.emplace(d.names->back(), idx);
+		d.folded.emplace(dc_fold(d.names->back()), idx);
+	}
+	my_closedir(od);
+	d.stats.resize(d.names->size());
+
+	dc_names += d.names->size();
+	dc_lru.push_front(std::move(d));
+	dc_iter it = dc_lru.begin();
+	dc_dirs[key] = it;
+#ifdef DC_INOTIFY
+	if (it->wd >= 0)
+		dc_watches[it->wd] = key;
+#endif
+	while (dc_lru.size() > 1 && (dc_lru.size() > DC_MAX_DIRS || dc_names > DC_MAX_NAMES))
+		dc_drop(std::prev(dc_lru.end()));
+	return it;
+}
+
+/* Cached listing of dirname, loaded if needed. Lock must be held. */
+static dc_iter dc_get(const TCHAR *dirname)
+{
+	const std::string key = dc_key(dirname);
+
+	dc_poll();
+	dc_iter d = dc_find(key);
+	if (d != dc_lru.end() && d->wd < 0) {
+		time_t mtime, ctime;
+		if (d->racy || !dc_dirstat(key, &mtime, &ctime) || mtime != d->mtime || ctime != d->ctime) {
+			dc_drop(d);
+			d = dc_lru.end();
+		}
+	}
+	if (d == dc_lru.end())
+		return dc_load(key);
+	dc_lru.splice(dc_lru.begin(), dc_lru, d);
+	return d;
+}
+
+bool fsdb_dircache_search(const TCHAR *dirname, TCHAR *rel, TCHAR **found)
+{
+	std::lock_guard<std::mutex> lock(dc_lock);
+
+	dc_iter d = dc_get(dirname);
+	if (d == dc_lru.end())
+		return false;
+	*found = NULL;
+	if (d->exact.find(rel) != d->exact.end()) {
+		*found = rel;
+	} else {
+		auto f = d->folded.find(dc_fold(rel));
+		if (f != d->folded.end())
+			*found = my_strdup((*d->names)[f->second].c_str());
+	}
+	return true;
+}
+
+struct fsdb_dircache_handle *fsdb_dircache_opendir(const TCHAR *dirname)
+{
+	std::lock_guard<std::mutex> lock(dc_lock);
+
+	dc_iter d = dc_get(dirname);
+	if (d == dc_lru.end())
+		return NULL;
+	// the handle keeps its own reference, later changes start a new listing
+	auto h = new fsdb_dircache_handle;
+	h->names = d->names;
+	h->pos = 0;
+	return h;
+}
+
+int fsdb_dircache_readdir(struct fsdb_dircache_handle *h, TCHAR *fn)
+{
+	if (!h || h->pos >= h->names->size())
+		return 0;
+	_tcscpy(fn, (*h->names)[h->pos++].c_str());
+	return 1;
+}
+
+void fsdb_dircache_closedir(struct fsdb_dircache_handle *h)
+{
+	delete h;
+}
+
+bool fsdb_dircache_stat(const TCHAR *nname, struct stat *st)
+{
+#ifdef DC_INOTIFY
+	const TCHAR *p = _tcsrchr(nname, FSDB_DIR_SEPARATOR);
+	if (!p || !p[1])
+		return false;
+	std::lock_guard<std::mutex> lock(dc_lock);
+
+	dc_poll();
+	// only directories that were listed anyway, and only with a watch
+	dc_iter d = dc_find(dc_key(std::string(nname, p - nname).c_str()));
+	if (d == dc_lru.end() || d->wd < 0)
+		return false;
+	auto e = d->exact.find(p + 1);
+	if (e == d->exact.end())
+		return false;
+	dc_stat &s = d->stats[e->second];
+	if (!s.valid) {
+		const auto path = iso_8859_1_to_utf8(std::string_view(nname));
+		if (stat(path.c_str(), &s.st) == -1)
+			return false;
+		s.valid = true;
+	}
+	*st = s.st;
+	return true;
+#else
+	return false;
+#endif
+}
+
+uae_u8 *fsdb_dircache_metadata(const TCHAR *dirname, int *size)
+{
+	std::lock_guard<std::mutex> lock(dc_lock);
+
+	*size = -1;
+	dc_iter d = dc_get(dirname);
+	if (d == dc_lru.end())
+		return NULL;
+	if (d->meta_state == DC_META_UNKNOWN) {
+		TCHAR *n = build_nname(d->path.c_str(), FSDB_FILE);
+		FILE *f = uae_tfopen(n, _T("rb"));
+		xfree(n);
+		d->meta.clear();
+		d->meta_state = DC_META_NONE;
+		if (f) {
+			uae_u8 buf[4096];
+			size_t len;
+			while ((len = fread(buf, 1, sizeof buf, f)) > 0)
+				d->meta.insert(d->meta.end(), buf, buf + len);
+			fclose(f);
+			d->meta_state = DC_META_LOADED;
+		}
+	}
+	*size = 0;
+	if (d->meta_state != DC_META_LOADED || d->meta.empty())
+		return NULL;
+	uae_u8 *data = xmalloc(uae_u8, d->meta.size());
+	memcpy(data, d->meta.data(), d->meta.size());
+	*size = (int)d->meta.size();
+	return data;
+}
+
+void fsdb_dircache_metadata_changed(const TCHAR *dirname)
+{
+	std::lock_guard<std::mutex> lock(dc_lock);
+
+	dc_iter d = dc_find(dc_key(dirname));
+	if (d != dc_lru.end()) {
+		d->meta_state = DC_META_UNKNOWN;
+		d->meta.clear();
+	}
+}
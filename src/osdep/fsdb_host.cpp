@@ -331,16 +331,16 @@ int fsdb_fill_file_attrs(a_inode* base, a_inode* aino)
 	}
 
 	try {
-		// Convert filename to UTF-8 for filesystem operations
-		const auto path_utf8 = iso_8859_1_to_utf8(std::string_view(aino->nname));
-
-		// Get file information
+		// Get file information, from the directory cache if it has it
 		struct stat statbuf {};
-		if (stat(path_utf8.c_str(), &statbuf) == -1) {
-			const int error = errno;
-			write_log(_T("fsdb_fill_file_attrs: stat failed for '%s': %s\n"),
-					  aino->nname, strerror(error));
-			return 0;
+		if (!fsdb_dircache_stat(aino->nname, &statbuf)) {
+			const auto path_utf8 = iso_8859_1_to_utf8(std::string_view(aino->nname));
+			if (stat(path_utf8.c_str(), &statbuf) == -1) {
+				const int error = errno;
+				write_log(_T("fsdb_fill_file_attrs: stat failed for '%s': %s\n"),
+						  aino->nname, strerror(error));
+				return 0;
+			}
 		}
 
 		// Set file type (directory or file)
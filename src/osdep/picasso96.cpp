@@ -35,6 +35,9 @@
 
 #include <algorithm>
 #include <cstdlib>
+#ifdef __linux__
+#include <unistd.h>
+#endif
 
 #include "uae.h"
 
@@ -79,6 +82,7 @@
 #include "gfxboard.h"
 #include "devices.h"
 #include "statusline.h"
+#include "bitplane.h"
 
 int debug_rtg_blitter = 3;
 
@@ -100,6 +104,8 @@ void mman_ResetWatch (PVOID lpBaseAddress, SIZE_T dwRegionSize);
 #else
 static bool* dirty_page_map[MAX_RTG_BOARDS];
 static int dirty_page_map_size[MAX_RTG_BOARDS];
+// pages reported by the last picasso_getwritewatch()
+static bool* dirty_page_last[MAX_RTG_BOARDS];
 #endif
 
 static void picasso_flushpixels(int index, uae_u8 *src, int offset, bool render);
@@ -235,7 +241,6 @@ typedef enum {
 } BLIT_OPCODE;
 
 static void init_picasso_screen(int);
-static uae_u32 p2ctab[256][2];
 static int set_gc_called = 0, init_picasso_screen_called = 0;
 //fastscreen
 static uaecptr oldscr = 0;
@@ -447,8 +452,89 @@ static void mark_dirty(int index, uae_u8* addr, int size)
 		dirty_page_map[index][i] = true;
 	}
 }
+
+#ifdef __linux__
+/*
+ * VRAM write tracking with page protection (writewatch_add()). Pages
+ * reported clean by picasso_getwritewatch() are armed, the first write to
+ * one marks it dirty again.
+ */
+static struct writewatch *vram_wwatch[MAX_RTG_BOARDS];
+
+static void vram_wwatch_write(void *user, int page)
+{
+	dirty_page_map[reinterpret_cast<uintptr_t>(user)][page] = true;
+}
+
+static void vram_wprot_free(int index)
+{
+	writewatch_remove(vram_wwatch[index]);
+	vram_wwatch[index] = nullptr;
+	xfree(dirty_page_map[index]);
+	dirty_page_map[index] = nullptr;
+	xfree(dirty_page_last[index]);
+	dirty_page_last[index] = nullptr;
+	dirty_page_map_size[index] = 0;
+}
+
+static void vram_wprot_alloc(int index)
+{
+	uae_u8 *base = gfxmem_banks[index]->baseaddr;
+	const int page_size = gwwpagesize[index];
+	// whole pages only, a partial last page would share protection with other data
+	const size_t size = gfxmem_banks[index]->allocated_size & ~static_cast<size_t>(page_size - 1);
+
+	dirty_page_map_size[index] = static_cast<int>(size / page_size);
+	dirty_page_map[index] = xcalloc(bool, dirty_page_map_size[index]);
+	dirty_page_last[index] = xcalloc(bool, dirty_page_map_size[index]);
+	vram_wwatch[index] = writewatch_add(base, size, vram_wwatch_write, reinterpret_cast<void*>(static_cast<uintptr_t>(index)));
+	if (!vram_wwatch[index]) {
+		write_log(_T("P96: VRAM %d at %p not page aligned, write protection not used\n"), index, base);
+		vram_wprot_free(index);
+		return;
+	}
+	// everything starts dirty and writable, the first flush protects it
+	memset(dirty_page_map[index], 1, dirty_page_map_size[index]);
+	write_log(_T("P96: VRAM %d write protection tracking, %d pages\n"), index, dirty_page_map_size[index]);
+}
+
+// protect all clean pages that are still writable, in runs
+static void vram_wprot_rearm(int index)
+{
+	struct writewatch *ww = vram_wwatch[index];
+
+	if (!writewatch_valid(ww))
+		return;
+	writewatch_lock();
+	for (int i = 0; i < dirty_page_map_size[index];) {
+		if (dirty_page_map[index][i] || writewatch_armed(ww, i)) {
+			i++;
+			continue;
+		}
+		int j = i;
+		while (j < dirty_page_map_size[index] && !dirty_page_map[index][j] && !writewatch_armed(ww, j))
+			j++;
+		writewatch_arm(ww, i, j - i);
+		i = j;
+	}
+	writewatch_unlock();
+}
+#endif
 #endif
 
+void picasso_resetwritewatch(int index)
+{
+#if !defined(_WIN32) && defined(__linux__)
+	struct writewatch *ww = vram_wwatch[index];
+	if (!writewatch_valid(ww))
+		return;
+	writewatch_lock();
+	writewatch_disarm(ww);
+	memset(dirty_page_map[index], 1, dirty_page_map_size[index]);
+	writewatch_unlock();
+#endif
+}
+
 static uae_u8 GetBytesPerPixel(uae_u32 RGBfmt)
 {
 	switch (RGBfmt)
@@ -2656,13 +2742,22 @@ void picasso_allocatewritewatch (int index, int gfxmemsize)
 	gwwpagemask[index] = gwwpagesize[index] - 1;
 	gwwbuf[index] = xmalloc (void*, gwwbufsize[index]);
 #else
-	constexpr int page_size = 4096;
+	int page_size = 4096;
 	xfree (gwwbuf[index]);
+#ifdef __linux__
+	vram_wprot_free(index);
+	if (amiberry_options.rtg_vram_write_protect)
+		page_size = (int)sysconf(_SC_PAGESIZE);
+#endif
 
 	gwwpagesize[index] = page_size;
 	gwwbufsize[index] = gfxmemsize / gwwpagesize[index] + 1;
 	gwwpagemask[index] = gwwpagesize[index] - 1;
 	gwwbuf[index] = xmalloc (void*, gwwbufsize[index]);
+#ifdef __linux__
+	if (amiberry_options.rtg_vram_write_protect)
+		vram_wprot_alloc(index);
+#endif
 #endif
 }
 
@@ -2700,13 +2795,19 @@ int picasso_getwritewatch (int index, int offset, uae_u8 ***gwwbufp, uae_u8 **st
 	int count = 0;
 
 	for (int i = 0; i < dirty_page_map_size[index]; ++i) {
-		if (dirty_page_map[index][i]) {
+		bool dirty = dirty_page_map[index][i];
+		dirty_page_last[index][i] = dirty;
+		if (dirty) {
 			if (count < gwwbufsize[index]) {
 				gwwbuf[index][count++] = const_cast<uae_u8*>(base) + i * page_size;
 			}
 			dirty_page_map[index][i] = false; // Reset after reading
 		}
 	}
+#ifdef __linux__
+	// cleared before protecting: a write in between is still seen by the caller's copy
+	vram_wprot_rearm(index);
+#endif
 
 	if (gwwbufp)
 		*gwwbufp = (uae_u8**)gwwbuf[index];
@@ -2759,7 +2860,7 @@ bool picasso_is_vram_dirty (int index, uaecptr addr, int size)
 	if (end_page >= dirty_page_map_size[index]) end_page = dirty_page_map_size[index] - 1;
 
 	for (int i = start_page; i <= end_page; ++i) {
-		if (dirty_page_map[index][i]) { return true; }
+		if (dirty_page_last[index][i]) { return true; }
 	}
 	return false;
 #endif
@@ -4375,27 +4476,58 @@ void init_hz_p96(int monid)
 }
 
 /* NOTE: Watch for those planeptrs of 0x00000000 and 0xFFFFFFFF for all zero / all one bitmaps !!!! */
+// one row of a plane realigned to start at bit 7 of dst[0]
+static void p2c_fetch_row(TrapContext *ctx, uae_u8 *dst, const uae_u8 *p, uaecptr ap, bool indirect, int bitoffset, int width)
+{
+	const int nbytes = (width + 7) >> 3;
+	const int srcbytes = (width + bitoffset + 7) >> 3;
+
+	if (indirect) {
+		// dst has room for srcbytes
+		trap_get_bytes(ctx, dst, ap, srcbytes);
+		p = dst;
+	} else if (!bitoffset) {
+		memcpy(dst, p, nbytes);
+		return;
+	}
+	if (!bitoffset)
+		return;
+	for (int i = 0; i < nbytes; i++) {
+		uae_u8 next = i + 1 < srcbytes ? p[i + 1] : 0;
+		dst[i] = (p[i] << bitoffset) | (next >> (8 - bitoffset));
+	}
+}
+
 static void PlanarToChunky(TrapContext *ctx, struct RenderInfo *ri, struct BitMap *bm,
 	uae_u32 srcx, uae_u32 srcy, uae_u32 dstx, uae_u32 dsty,
 	uae_u32 width, uae_u32 height, uae_u8 minterm, uae_u8 mask)
 {
 	uae_u8 *PLANAR[8];
 	uaecptr APLANAR[8];
+	const uae_u8 *rowplanes[8];
 	bool specialplane[8];
 	uae_u8 *image = ri->Memory + dstx * GetBytesPerPixel(ri->RGBFormat) + dsty * ri->BytesPerRow;
 	int Depth = bm->Depth;
 	int bitoffset = srcx & 7;
 	bool indirect = trap_is_indirect();
+	const int nbytes = (width + 7) >> 3;
+	const int rowsize = nbytes + 1;
+	uae_u8 *rowbuf = xmalloc(uae_u8, rowsize * (Depth + 1) + nbytes * 8);
+	uae_u8 *ones = rowbuf + rowsize * Depth;
+	uae_u8 *chunky = ones + rowsize;
 
+	memset(ones, 0xff, rowsize);
 	/* Set up our bm->Planes[] pointers to the right horizontal offset */
 	for (int j = 0; j < Depth; j++) {
 		specialplane[j] = false;
+		rowplanes[j] = rowbuf + rowsize * j;
 		if (indirect) {
 			uaecptr ap = bm->APlanes[j];
 			if (ap != 0 && ap != 0xffffffff) {
 				ap += srcx / 8 + srcy * bm->BytesPerRow;
 			} else {
 				specialplane[j] = true;
+				rowplanes[j] = ap ? ones : nullptr;
 			}
 			APLANAR[j] = ap;
 		} else {
@@ -4404,25 +4536,31 @@ static void PlanarToChunky(TrapContext *ctx, struct RenderInfo *ri, struct BitMa
 				p += srcx / 8 + srcy * bm->BytesPerRow;
 			} else {
 				specialplane[j] = true;
+				rowplanes[j] = p == &all_ones_bitmap ? ones : nullptr;
 			}
 			PLANAR[j] = p;
 		}
 	}
 	uae_u32 mask32 = (mask << 24) | (mask << 16) | (mask << 8) | mask;
-	int eol_offset = bm->BytesPerRow - ((width + 7) >> 3);
 	bool needin = false;
 	if ((minterm != BLIT_FALSE && minterm != BLIT_TRUE && minterm != BLIT_NOTSRC && minterm != BLIT_SRC) || mask != 0xff) {
 		needin = true;
 	}
 	for (int rows = 0; rows < height; rows++, image += ri->BytesPerRow) {
 
+		for (int k = 0; k < Depth; k++) {
+			if (!specialplane[k]) {
+				p2c_fetch_row(ctx, rowbuf + rowsize * k, PLANAR[k], APLANAR[k], indirect, bitoffset, width);
+				APLANAR[k] += bm->BytesPerRow;
+				PLANAR[k] += bm->BytesPerRow;
+			}
+		}
+		bitplane_p2c(chunky, rowplanes, Depth, nbytes);
+
 		for (int cols = 0; cols < width; cols += 8) {
-			uae_u32 a = 0, b = 0;
 			uae_u32 amask = 0, bmask = 0;
-			uae_u32 msk = 0xFF;
 			int tmp = cols + 8 - width;
 			if (tmp > 0) {
-				msk <<= tmp;
 				if (tmp < 4) {
 					bmask = 0xffffffff >> (32 - tmp * 8);
 					needin = true;
@@ -4435,31 +4573,8 @@ static void PlanarToChunky(TrapContext *ctx, struct RenderInfo *ri, struct BitMa
 					needin = true;
 				}
 			}
-			for (int k = 0; k < Depth; k++) {
-				uae_u32 data;
-				if (indirect) {
-					if (APLANAR[k] == 0) {
-						data = 0x00;
-					} else if (APLANAR[k] == 0xffffffff) {
-						data = 0xFF;
-					} else {
-						data = static_cast<uae_u8>(trap_get_word(ctx, APLANAR[k]) >> (8 - bitoffset));
-						APLANAR[k]++;
-					}
-				} else {
-					if (PLANAR[k] == &all_zeros_bitmap) {
-						data = 0x00;
-					} else if (PLANAR[k] == &all_ones_bitmap) {
-						data = 0xFF;
-					} else {
-						data = static_cast<uae_u8>(do_get_mem_word(reinterpret_cast<uae_u16*>(PLANAR[k])) >> (8 - bitoffset));
-						PLANAR[k]++;
-					}
-				}
-				data &= msk;
-				a |= p2ctab[data][0] << k;
-				b |= p2ctab[data][1] << k;
-			}
+			uae_u32 a = do_get_mem_long(reinterpret_cast<uae_u32*>(chunky + cols));
+			uae_u32 b = do_get_mem_long(reinterpret_cast<uae_u32*>(chunky + cols + 4));
 
 			uae_u32 inval0 = 0, inval1 = 0;
 			if (needin) {
@@ -4557,13 +4672,8 @@ static void PlanarToChunky(TrapContext *ctx, struct RenderInfo *ri, struct BitMa
 				do_put_mem_long(reinterpret_cast<uae_u32*>(image + cols + 4), out1);
 			}
 		}
-		for (int j = 0; j < Depth; j++) {
-			if (!specialplane[j]) {
-				APLANAR[j] += eol_offset;
-				PLANAR[j] += eol_offset;
-			}
-		}
 	}
+	xfree(rowbuf);
 }
 
 static uae_u32 getcim(uae_u8 v, int bpp, int *maxcp, uaecptr acim, uae_u32 *cim, TrapContext *ctx)
@@ -4652,10 +4762,12 @@ static void PlanarToDirect(TrapContext *ctx, const struct RenderInfo *ri, const
 	const int bpp = GetBytesPerPixel(ri->RGBFormat);
 	uae_u8 *PLANAR[8];
 	uaecptr APLANAR[8];
+	const uae_u8 *rowplanes[8];
 	bool specialplane[8];
 	uae_u8 *image = ri->Memory + dstx * bpp + dsty * ri->BytesPerRow;
 	const int Depth = bm->Depth;
 	const bool indirect = trap_is_indirect();
+	const int bitoffset = srcx & 7;
 	int maxc = -1;
 	uae_u32 cim[256];
 	const uae_u8 depthmask = (1 << Depth) - 1;
@@ -4663,19 +4775,24 @@ static void PlanarToDirect(TrapContext *ctx, const struct RenderInfo *ri, const
 	if(!bpp)
 		return;
 
+	const int nbytes = (width + 7) >> 3;
+	const int rowsize = nbytes + 1;
+	uae_u8 *rowbuf = xmalloc(uae_u8, rowsize * (Depth + 1) + nbytes * 8);
+	uae_u8 *ones = rowbuf + rowsize * Depth;
+	uae_u8 *chunky = ones + rowsize;
+
+	memset(ones, 0xff, rowsize);
 	/* Set up our bm->Planes[] pointers to the right horizontal offset */
 	for (int j = 0; j < Depth; j++) {
 		specialplane[j] = false;
+		rowplanes[j] = rowbuf + rowsize * j;
 		if (indirect) {
 			uaecptr ap = bm->APlanes[j];
 			if (ap != 0 && ap != 0xffffffff) {
 				ap += srcx / 8 + srcy * bm->BytesPerRow;
-			} else if (ap == 0) {
-				specialplane[j] = true;
-				PLANAR[j] = &all_zeros_bitmap;
 			} else {
 				specialplane[j] = true;
-				PLANAR[j] = &all_ones_bitmap;
+				rowplanes[j] = ap ? ones : nullptr;
 			}
 			APLANAR[j] = ap;
 		} else {
@@ -4684,41 +4801,26 @@ static void PlanarToDirect(TrapContext *ctx, const struct RenderInfo *ri, const
 				p += srcx / 8 + srcy * bm->BytesPerRow;
 			} else {
 				specialplane[j] = true;
+				rowplanes[j] = p == &all_ones_bitmap ? ones : nullptr;
 			}
 			PLANAR[j] = p;
 		}
 	}
 
-	uae_u8 *planebuf = nullptr;
-	const int planebuf_width = (width + 1) & ~1;
-	if (indirect) {
-		planebuf = xmalloc(uae_u8, planebuf_width * Depth);
-	}
-
-	const int eol_offset = bm->BytesPerRow - ((width + (srcx & 7)) >> 3);
 	for (int rows = 0; rows < height; rows++, image += ri->BytesPerRow) {
 		uae_u8 *image2 = image;
-		uae_u32 bitoffs = 7 - (srcx & 7);
 
-		if (indirect) {
-			for (int k = 0; k < Depth; k++) {
-				if (!specialplane[k]) {
-					PLANAR[k] = planebuf + planebuf_width * k;
-					trap_get_bytes(ctx, PLANAR[k], APLANAR[k], planebuf_width);
-				}
+		for (int k = 0; k < Depth; k++) {
+			if (!specialplane[k]) {
+				p2c_fetch_row(ctx, rowbuf + rowsize * k, PLANAR[k], APLANAR[k], indirect, bitoffset, width);
+				APLANAR[k] += bm->BytesPerRow;
+				PLANAR[k] += bm->BytesPerRow;
 			}
 		}
+		bitplane_p2c(chunky, rowplanes, Depth, nbytes);
 
 		for (int cols = 0; cols < width; cols ++) {
-			uae_u8 v = 0;
-			for (int k = 0; k < Depth; k++) {
-				if (PLANAR[k] == &all_ones_bitmap)
-					v |= 1 << k;
-				else if (PLANAR[k] != &all_zeros_bitmap) {
-					v |= ((*PLANAR[k] >> bitoffs) & 1) << k;
-				}
-			}
-			v &= depthmask;
+			const uae_u8 v = chunky[cols] & depthmask;
 			const uae_u8 vi = (v ^ mask) & depthmask;
 
 			uae_u32 inval = 0;
@@ -4820,29 +4922,9 @@ static void PlanarToDirect(TrapContext *ctx, const struct RenderInfo *ri, const
 			default: // never
 				break;
 			}
-
-			bitoffs--;
-			bitoffs &= 7;
-			if (bitoffs == 7) {
-				for (int k = 0; k < Depth; k++) {
-					if (!specialplane[k]) {
-						PLANAR[k]++;
-						APLANAR[k]++;
-					}
-				}
-			}
-		}
-
-		for (int i = 0; i < Depth; i++) {
-			if (!specialplane[i]) {
-				PLANAR[i] += eol_offset;
-				APLANAR[i] += eol_offset;
-			}
 		}
 	}
-	if (planebuf) {
-		xfree(planebuf);
-	}
+	xfree(rowbuf);
 }
 
 /*
@@ -5524,6 +5606,28 @@ void picasso_invalidate(int monid, int x, int y, int w, int h)
 	DX_Invalidate(&AMonitors[monid], x, y, w, h);
 }
 
+#define P96_DIRTY_RUNS 16
+
+// merge the rows first..end-1 into the list of changed row ranges, runcnt -1 = too many, use bounding box
+static void p96_add_dirty_run(int runs[P96_DIRTY_RUNS][2], int *runcnt, int first, int end)
+{
+	int n = *runcnt;
+	if (n < 0 || first >= end)
+		return;
+	if (n > 0 && first <= runs[n - 1][1] && end >= runs[n - 1][0]) {
+		runs[n - 1][0] = std::min(runs[n - 1][0], first);
+		runs[n - 1][1] = std::max(runs[n - 1][1], end);
+		return;
+	}
+	if (n >= P96_DIRTY_RUNS) {
+		*runcnt = -1;
+		return;
+	}
+	runs[n][0] = first;
+	runs[n][1] = end;
+	*runcnt = n + 1;
+}
+
 static void picasso_flushpixels(int index, uae_u8 *src, int off, bool render)
 {
 	int monid = currprefs.rtgboards[index].monitor_id;
@@ -5542,6 +5646,9 @@ static void picasso_flushpixels(int index, uae_u8 *src, int off, bool render)
 	int flushlines = 0, matchcount = 0;
 	struct picasso_vidbuf_description *vidinfo = &picasso_vidinfo[monid];
 	bool overlay_updated = false;
+	// changed row ranges, invalidated separately so that only they get uploaded
+	int runs[P96_DIRTY_RUNS][2];
+	int runcnt = 0;
 
 	src_start[0] = src + (off & ~gwwpagemask[index]);
 	src_end[0] = src + ((off + state->BytesPerRow * pheight + gwwpagesize[index] - 1) & ~gwwpagemask[index]);
@@ -5637,6 +5744,7 @@ static void picasso_flushpixels(int index, uae_u8 *src, int off, bool render)
 					p2 += vidinfo->rowbytes;
 				}
 				vidinfo->rtg_clear_flag--;
+				picasso_invalidate(monid, -1, -1, -1, -1);
 			}
 
 			dst += vidinfo->offset;
@@ -5684,6 +5792,7 @@ static void picasso_flushpixels(int index, uae_u8 *src, int off, bool render)
 						y += vidinfo->splitypos;
 					}
 					if (y < pheight) {
+						const int firsty = y;
 						int w = (gwwpagesize[index] + state->BytesPerPixel - 1) / state->BytesPerPixel;
 						x = (realoffset % state->BytesPerRow) / state->BytesPerPixel;
 						if (x < pwidth) {
@@ -5711,6 +5820,7 @@ static void picasso_flushpixels(int index, uae_u8 *src, int off, bool render)
 						if (y > maxy) {
 							maxy = y;
 						}
+						p96_add_dirty_run(runs, &runcnt, firsty, y);
 					}
 				}
 			}
@@ -5724,6 +5834,7 @@ static void picasso_flushpixels(int index, uae_u8 *src, int off, bool render)
 		}
 		if (dstp) {
 			picasso_flushoverlay(index, src, off, dstp);
+			picasso_invalidate(monid, -1, -1, -1, -1);
 		}
 	}
 
@@ -5743,16 +5854,23 @@ static void picasso_flushpixels(int index, uae_u8 *src, int off, bool render)
 			maxy = vidinfo->height;
 			if (miny > vidinfo->height - TD_TOTAL_HEIGHT)
 				miny = vidinfo->height - TD_TOTAL_HEIGHT;
+			p96_add_dirty_run(runs, &runcnt, vidinfo->height - TD_TOTAL_HEIGHT, vidinfo->height);
 			// picasso_statusline(monid, dstp); // Offloaded to GPU in amiberry_gfx.cpp
 		}
 	}
 	if (maxy >= 0) {
 		if (doskip () && p96skipmode == 4) {
 			;
-		} else {
+		} else if (flushlines < 0 || runcnt < 0) {
 			picasso_invalidate(monid, 0, miny, pwidth, maxy - miny);
+		} else {
+			for (int i = 0; i < runcnt; i++) {
+				picasso_invalidate(monid, 0, runs[i][0], pwidth, runs[i][1] - runs[i][0]);
+			}
 		}
 	}
+	// everything that changed has been invalidated, unchanged frames need no upload
+	DX_InvalidateComplete(&AMonitors[monid]);
 
 	if (dstp || render) {
 		gfx_unlock_picasso(monid, render);
@@ -5840,17 +5958,6 @@ void InitPicasso96(int monid)
 	oldscr = 0;
 	//fastscreen
 	memset (state, 0, sizeof (struct picasso96_state_struct));
-
-	for (int i = 0; i < 256; i++) {
-		p2ctab[i][0] = (((i & 128) ? 0x01000000 : 0)
-			| ((i & 64) ? 0x010000 : 0)
-			| ((i & 32) ? 0x0100 : 0)
-			| ((i & 16) ? 0x01 : 0));
-		p2ctab[i][1] = (((i & 8) ? 0x01000000 : 0)
-			| ((i & 4) ? 0x010000 : 0)
-			| ((i & 2) ? 0x0100 : 0)
-			| ((i & 1) ? 0x01 : 0));
-	}
 }
 
 #endif
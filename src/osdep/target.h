@@ -243,6 +243,7 @@ typedef wchar_t* LPCWSTR;
 #define SOUND_DEVICE_WASAPI_EXCLUSIVE 5
 #define SOUND_DEVICE_XAUDIO2 6
 #define SOUND_DEVICE_SDL2 7
+#define SOUND_DEVICE_NULL 8
 
 struct sound_device
 {
@@ -65,6 +65,22 @@
 #include "devices.h"
 #include "fsdb.h"
 #include "gfxboard.h"
+#include "threaddep/thread.h"
+#include "keybuf.h"
+#include "xwin.h"
+#include "sounddep/sound.h"
+#include "rommgr.h"
+#include "chunkcompress.h"
+#ifdef AHI
+#include "ahi_v1.h"
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <sched.h>
+#ifdef USE_ZSTD
+#include <zstd.h>
+#endif
 
 int savestate_state = 0;
 static int savestate_first_capture;
@@ -99,6 +115,9 @@ struct staterecord
 	uae_u8 *data;
 	uae_u8 *end;
 	int inprecoffset;
+	uae_u8 *delta;
+	int deltalen;
+	size_t arenapos;
 };
 
 static struct staterecord **staterecords;
@@ -386,12 +405,51 @@ TCHAR *restore_path_full_func(uae_u8 **dstp)
 }
 
 
+#define SAVESTATE_CHUNK_ZSTD 2
+
+static void save_chunk_write(void *user, const void *data, size_t len)
+{
+	zfile_fwrite(data, 1, len, (struct zfile*)user);
+}
+
+static bool save_chunk_zstd(void)
+{
+#ifdef USE_ZSTD
+	return amiberry_options.savestate_zstd;
+#else
+	return false;
+#endif
+}
+
+static void restore_chunk_uncompress(uae_u8 *dst, int dstsize, struct zfile *f, int srcsize, uae_u32 flags)
+{
+	if (!(flags & SAVESTATE_CHUNK_ZSTD)) {
+		zfile_zuncompress(dst, dstsize, f, srcsize);
+		return;
+	}
+#ifdef USE_ZSTD
+	uae_u8 *src = xmalloc(uae_u8, srcsize);
+	if (src) {
+		if (zfile_fread(src, 1, srcsize, f) == srcsize) {
+			size_t v = ZSTD_decompress(dst, dstsize, src, srcsize);
+			if (ZSTD_isError(v))
+				write_log(_T("Savestate: zstd chunk error: %s\n"), ZSTD_getErrorName(v));
+		}
+		xfree(src);
+		return;
+	}
+#else
+	write_log(_T("Savestate: zstd compressed chunk, zstd support not included\n"));
+#endif
+	zfile_fseek(f, srcsize, SEEK_CUR);
+}
+
 /* read and write IFF-style hunks */
 
 static void save_chunk (struct zfile *f, uae_u8 *chunk, size_t len, const TCHAR *name, int compress)
 {
 	uae_u8 tmp[8], *dst;
-	uae_u32 flags;
+	uae_u32 flags, codec = 0;
 	size_t pos;
 	size_t chunklen, len2;
 	char *s;
@@ -416,8 +474,10 @@ static void save_chunk (struct zfile *f, uae_u8 *chunk, size_t len, const TCHAR
 	zfile_fwrite (&tmp[0], 1, 4, f);
 	/* chunk flags */
 	flags = 0;
+	if (compress && save_chunk_zstd())
+		codec = SAVESTATE_CHUNK_ZSTD;
 	dst = &tmp[0];
-	save_u32(flags | compress);
+	save_u32(flags | compress | codec);
 	zfile_fwrite (&tmp[0], 1, 4, f);
 	/* chunk data */
 	if (compress) {
@@ -427,7 +487,7 @@ static void save_chunk (struct zfile *f, uae_u8 *chunk, size_t len, const TCHAR
 		save_u32t(len);
 		opos = zfile_ftell32(f);
 		zfile_fwrite(&tmp[0], 1, 4, f);
-		len = zfile_zcompress(f, chunk, len);
+		len = chunk_compress(chunk, len, codec != 0, save_chunk_write, f);
 		if (len > 0) {
 			zfile_fseek (f, pos, SEEK_SET);
 			dst = &tmp[0];
@@ -525,7 +585,7 @@ static uae_u8 *restore_chunk (struct zfile *f, TCHAR *name, unsigned int *len, u
 		if (!mem)
 			return NULL;
 		if (flags & 1) {
-			zfile_zuncompress (mem, *totallen, f, len2);
+			restore_chunk_uncompress (mem, *totallen, f, len2, flags);
 		} else {
 			zfile_fread (mem, 1, len2, f);
 		}
@@ -560,7 +620,7 @@ void restore_ram (size_t filepos, uae_u8 *memory)
 		src = tmp;
 		fullsize = restore_u32 ();
 		size -= 4;
-		zfile_zuncompress (memory, fullsize, savestate_file, size);
+		restore_chunk_uncompress (memory, fullsize, savestate_file, size, flags);
 	} else {
 		zfile_fread (memory, 1, size, savestate_file);
 	}
@@ -1367,12 +1427,26 @@ void savestate_quick(int slot, int save)
 	}
 }
 
+static void runahead_start (void);
+static bool runahead_next (void);
+static void runahead_rollback (void);
+
 bool savestate_check(void)
 {
-	if (vpos == 0 && !savestate_state) {
-		if (hsync_counter == 0 && input_play == INPREC_PLAY_NORMAL)
-			savestate_memorysave ();
-		savestate_capture (0);
+	if (vpos == 0 && savestate_runahead > 0) {
+		if (!savestate_state)
+			return runahead_next ();
+		// loading, saving or rewinding continues from the speculative state
+		savestate_runahead_stop ();
+	}
+	if (vpos == 0) {
+		if (!savestate_state) {
+			if (hsync_counter == 0 && input_play == INPREC_PLAY_NORMAL)
+				savestate_memorysave ();
+			savestate_capture (0);
+			runahead_start ();
+		}
+		savestate_runahead_hidden = savestate_runahead > 1;
 	}
 	if (savestate_state == STATE_DORESTORE) {
 		savestate_state = STATE_RESTORE;
@@ -1388,6 +1462,625 @@ bool savestate_check(void)
 	return false;
 }
 
+/*
+ * Delta rewind buffer
+ *
+ * Copying all of RAM into every capture makes rewind expensive in both time
+ * and memory. In delta mode a shadow copy of RAM as it was at the latest
+ * capture is kept instead, and each capture only stores the pages that changed
+ * since the previous one: their previous contents, or with compression enabled
+ * the XOR of old and new contents coded as zero runs and literals. That is
+ * exactly what is needed to step the shadow one capture back. Records live
+ * back to back in one ring arena that is allocated once, the oldest records
+ * are dropped when it runs full.
+ *
+ * Where RAM can be write protected (writewatch_add()) there is no shadow:
+ * all RAM pages are armed after a capture, the first write to a page copies
+ * its old contents into a small pre-image pool and only those pages are
+ * compared at the next capture. The pre-images also bring RAM back to the
+ * latest capture when rewinding. If the pool runs full the history is
+ * dropped and tracking starts over at the next capture.
+ */
+
+#define REWIND_PAGE_SIZE 4096
+#define REWIND_BANKS 4
+#define REWIND_ALIGN(x) (((x) + 15) & ~(size_t)15)
+
+struct rewind_bank
+{
+	uae_u8 *shadow;
+	size_t size;
+	// write tracked RAM, pre-image pool slot of each host page or -1
+	uae_u8 *mem;
+	struct writewatch *ww;
+	int *slot;
+};
+static struct rewind_bank rewind_banks[REWIND_BANKS];
+static bool rewind_delta_mode;
+static bool rewind_tracked;
+static int rewind_host_page;
+static uae_u8 *rewind_pre;
+static uae_u32 *rewind_pre_owner;
+static int rewind_pre_max;
+static std::atomic<int> rewind_pre_used;
+static std::atomic<bool> rewind_pre_overflow;
+// faults from other threads wait while the pool is being collected
+static std::atomic<int> rewind_busy, rewind_faulting;
+static uae_u8 *rewind_arena;
+static size_t rewind_arena_size, rewind_arena_head, rewind_arena_tail;
+static int rewind_records, rewind_oldest;
+static struct staterecord *rewind_scratch;
+static uae_u8 *rewind_delta;
+static size_t rewind_delta_size;
+
+static uae_u8 *rewind_bank_mem (int bank, size_t *len)
+{
+	switch (bank)
+	{
+	case 0:
+		return save_cram (len);
+	case 1:
+		return save_bram (len);
+#ifdef AUTOCONFIG
+	case 2:
+		return save_fram (len, 0);
+	case 3:
+		return save_zram (len, 0);
+#endif
+	}
+	*len = 0;
+	return NULL;
+}
+
+static void rewind_evict_oldest (void)
+{
+	staterecords[rewind_oldest] = NULL;
+	rewind_oldest = (rewind_oldest + 1) % staterecords_max;
+	rewind_records--;
+	if (rewind_records <= 0) {
+		rewind_records = 0;
+		rewind_arena_head = rewind_arena_tail = 0;
+	} else {
+		rewind_arena_tail = staterecords[rewind_oldest]->arenapos;
+	}
+}
+
+static void rewind_clear (void)
+{
+	while (rewind_records > 0)
+		rewind_evict_oldest ();
+}
+
+static void rewind_drop_latest (int pos)
+{
+	struct staterecord *st = staterecords[pos];
+
+	staterecords[pos] = NULL;
+	rewind_records--;
+	if (rewind_records <= 0) {
+		rewind_records = 0;
+		rewind_arena_head = rewind_arena_tail = 0;
+	} else {
+		rewind_arena_head = st->arenapos;
+	}
+}
+
+static uae_u8 *rewind_arena_alloc (size_t size, size_t *pos)
+{
+	if (size > rewind_arena_size)
+		return NULL;
+	for (;;) {
+		if (!rewind_records || rewind_arena_head > rewind_arena_tail) {
+			if (rewind_arena_size - rewind_arena_head >= size) {
+				*pos = rewind_arena_head;
+				break;
+			}
+			// wrap around, the unused end of the arena is skipped
+			if (rewind_records && rewind_arena_tail >= size) {
+				*pos = 0;
+				break;
+			}
+		} else if (rewind_arena_tail - rewind_arena_head >= size) {
+			*pos = rewind_arena_head;
+			break;
+		}
+		rewind_evict_oldest ();
+	}
+	rewind_arena_head = *pos + size;
+	return rewind_arena + *pos;
+}
+
+// Returns the coded length. Pages that don't compress are stored as is,
+// so a coded length equal to the page length means raw old contents.
+static int rewind_encode_page (uae_u8 *dst, const uae_u8 *oldp, const uae_u8 *newp, int len)
+{
+	const uae_u32 *o = (const uae_u32*)oldp;
+	const uae_u32 *n = (const uae_u32*)newp;
+	int units = len / 4;
+	uae_u8 *d = dst;
+	int i = 0;
+
+	if (currprefs.statecapturecompress) {
+		while (i < units) {
+			int start = i;
+			while (i < units && o[i] == n[i])
+				i++;
+			int zeros = i - start;
+			start = i;
+			// keep single unchanged longwords inside the literal run
+			while (i < units && (o[i] != n[i] || (i + 1 < units && o[i + 1] != n[i + 1])))
+				i++;
+			int lits = i - start;
+			if (d - dst + 4 + lits * 4 >= len)
+				goto raw;
+			((uae_u16*)d)[0] = zeros;
+			((uae_u16*)d)[1] = lits;
+			d += 4;
+			for (int j = start; j < i; j++) {
+				*(uae_u32*)d = o[j] ^ n[j];
+				d += 4;
+			}
+		}
+		return addrdiff(d, dst);
+	}
+raw:
+	memcpy (dst, oldp, len);
+	return len;
+}
+
+static void rewind_undo_page (uae_u8 *shadow, const uae_u8 *src, int codedlen, int len)
+{
+	if (codedlen == len) {
+		memcpy (shadow, src, len);
+		return;
+	}
+	uae_u32 *s = (uae_u32*)shadow;
+	const uae_u8 *end = src + codedlen;
+	int i = 0;
+	while (src < end) {
+		const uae_u16 *t = (const uae_u16*)src;
+		const uae_u32 *l = (const uae_u32*)(src + 4);
+		int lits = t[1];
+		i += t[0];
+		for (int j = 0; j < lits; j++)
+			s[i + j] ^= l[j];
+		i += lits;
+		src += 4 + lits * 4;
+	}
+}
+
+// Saves the old contents of a tracked page before its first write.
+static void rewind_capture (struct rewind_bank *rb, int page)
+{
+	if (rb->slot[page] >= 0)
+		return;
+	int n = rewind_pre_used++;
+	if (n >= rewind_pre_max) {
+		rewind_pre_overflow = true;
+		return;
+	}
+	memcpy (rewind_pre + (size_t)n * rewind_host_page, rb->mem + (size_t)page * rewind_host_page, rewind_host_page);
+	rewind_pre_owner[n] = (uae_u32)((rb - rewind_banks) << 24) | page;
+	rb->slot[page] = n;
+}
+
+// write watch callback, runs in the fault handler of the writing thread
+static void rewind_write (void *user, int page)
+{
+	for (;;) {
+		rewind_faulting++;
+		if (!rewind_busy)
+			break;
+		rewind_faulting--;
+		sched_yield ();
+	}
+	rewind_capture ((struct rewind_bank*)user, page);
+	rewind_faulting--;
+}
+
+static void rewind_lock (void)
+{
+	writewatch_lock ();
+	rewind_busy = 1;
+	while (rewind_faulting)
+		sched_yield ();
+}
+
+static void rewind_unlock (void)
+{
+	rewind_busy = 0;
+	writewatch_unlock ();
+}
+
+// Protects tracked pages, those under host I/O can't be and are captured now.
+static void rewind_arm (struct rewind_bank *rb, int page, int count)
+{
+	if (writewatch_arm (rb->ww, page, count) == count)
+		return;
+	for (int i = page; i < page + count; i++) {
+		if (!writewatch_armed (rb->ww, i))
+			rewind_capture (rb, i);
+	}
+}
+
+// Forgets all pre-images and arms every page, called with rewind_lock() held.
+static void rewind_track_reset (void)
+{
+	rewind_pre_used = 0;
+	rewind_pre_overflow = false;
+	for (int b = 0; b < REWIND_BANKS; b++) {
+		struct rewind_bank *rb = &rewind_banks[b];
+		if (!rb->ww)
+			continue;
+		const int pages = (int)(rb->size / rewind_host_page);
+		for (int i = 0; i < pages; i++)
+			rb->slot[i] = -1;
+		rewind_arm (rb, 0, pages);
+	}
+}
+
+static void rewind_untrack (void)
+{
+	for (int b = 0; b < REWIND_BANKS; b++) {
+		struct rewind_bank *rb = &rewind_banks[b];
+		writewatch_remove (rb->ww);
+		rb->ww = NULL;
+		xfree (rb->slot);
+		rb->slot = NULL;
+		rb->mem = NULL;
+	}
+	rewind_tracked = false;
+}
+
+static bool rewind_track (void)
+{
+	size_t total = 0;
+
+	rewind_host_page = writewatch_pagesize ();
+	if (rewind_host_page % REWIND_PAGE_SIZE)
+		return false;
+	for (int b = 0; b < REWIND_BANKS; b++) {
+		struct rewind_bank *rb = &rewind_banks[b];
+		size_t size;
+		uae_u8 *mem = rewind_bank_mem (b, &size);
+		rb->size = size;
+		if (!size)
+			continue;
+		rb->ww = writewatch_add (mem, size, rewind_write, rb);
+		if (!rb->ww) {
+			rewind_untrack ();
+			return false;
+		}
+		rb->mem = mem;
+		rb->slot = xmalloc (int, size / rewind_host_page);
+		total += size;
+	}
+	// a quarter of RAM written between two captures is plenty
+	size_t pool = std::min (total, std::max (total / 4, (size_t)2 * 1024 * 1024));
+	int max = (int)(pool / rewind_host_page);
+	if (max != rewind_pre_max) {
+		xfree (rewind_pre);
+		xfree (rewind_pre_owner);
+		rewind_pre = xmalloc (uae_u8, (size_t)max * rewind_host_page);
+		rewind_pre_owner = xmalloc (uae_u32, max);
+		rewind_pre_max = rewind_pre && rewind_pre_owner ? max : 0;
+	}
+	if (!rewind_pre_max) {
+		rewind_untrack ();
+		return false;
+	}
+	for (int b = 0; b < REWIND_BANKS; b++) {
+		xfree (rewind_banks[b].shadow);
+		rewind_banks[b].shadow = NULL;
+	}
+	rewind_tracked = true;
+	rewind_lock ();
+	rewind_track_reset ();
+	rewind_unlock ();
+	return true;
+}
+
+// Brings the shadow back in sync with RAM, or starts tracking writes to RAM
+// from here on. Any existing history is lost.
+static bool rewind_resync (void)
+{
+	rewind_clear ();
+	rewind_untrack ();
+	if (rewind_track ())
+		return true;
+	for (int b = 0; b < REWIND_BANKS; b++) {
+		struct rewind_bank *rb = &rewind_banks[b];
+		size_t size;
+		uae_u8 *mem = rewind_bank_mem (b, &size);
+		if (size != rb->size || !rb->shadow) {
+			xfree (rb->shadow);
+			rb->shadow = NULL;
+			rb->size = 0;
+			if (size) {
+				rb->shadow = xmalloc (uae_u8, size);
+				if (!rb->shadow)
+					return false;
+				rb->size = size;
+			}
+		}
+		if (size)
+			memcpy (rb->shadow, mem, size);
+	}
+	return true;
+}
+
+static bool rewind_delta_grow (size_t dlen, int plen)
+{
+	if (dlen + 8 + plen <= rewind_delta_size)
+		return true;
+	size_t newsize = rewind_delta_size ? rewind_delta_size * 2 : 256 * 1024;
+	uae_u8 *p = xrealloc (uae_u8, rewind_delta, newsize);
+	if (!p) {
+		write_log (_T("rewind delta buffer realloc %d failed\n"), (int)newsize);
+		return false;
+	}
+	rewind_delta = p;
+	rewind_delta_size = newsize;
+	return true;
+}
+
+// Codes the written pages of tracked RAM against their pre-images and arms
+// them again.
+static int rewind_collect_tracked (void)
+{
+	size_t dlen = 0;
+
+	rewind_lock ();
+	int used = std::min ((int)rewind_pre_used, rewind_pre_max);
+	if (rewind_pre_overflow) {
+		rewind_unlock ();
+		write_log (_T("rewind: more than %d pages written between captures\n"), rewind_pre_max);
+		return rewind_resync () ? -1 : -2;
+	}
+	for (int n = 0; n < used; n++) {
+		const int b = rewind_pre_owner[n] >> 24;
+		const int page = rewind_pre_owner[n] & 0xffffff;
+		struct rewind_bank *rb = &rewind_banks[b];
+		// captured twice by racing threads, the other copy is used
+		if (rb->slot[page] != n)
+			continue;
+		const uae_u8 *pre = rewind_pre + (size_t)n * rewind_host_page;
+		const uae_u8 *mem = rb->mem + (size_t)page * rewind_host_page;
+		for (int off = 0; off < rewind_host_page; off += REWIND_PAGE_SIZE) {
+			if (!memcmp (pre + off, mem + off, REWIND_PAGE_SIZE))
+				continue;
+			if (!rewind_delta_grow (dlen, REWIND_PAGE_SIZE)) {
+				rewind_unlock ();
+				return rewind_resync () ? -1 : -2;
+			}
+			uae_u32 *h = (uae_u32*)(rewind_delta + dlen);
+			h[0] = (b << 24) | (uae_u32)(((size_t)page * rewind_host_page + off) / REWIND_PAGE_SIZE);
+			h[1] = rewind_encode_page (rewind_delta + dlen + 8, pre + off, mem + off, REWIND_PAGE_SIZE);
+			dlen += 8 + h[1];
+		}
+		rb->slot[page] = -1;
+	}
+	rewind_pre_used = 0;
+	// pages that can't be armed are captured again right away, into slots
+	// below n that were already visited
+	for (int n = 0; n < used; n++) {
+		struct rewind_bank *rb = &rewind_banks[rewind_pre_owner[n] >> 24];
+		const int page = rewind_pre_owner[n] & 0xffffff;
+		if (rb->slot[page] < 0 && !writewatch_armed (rb->ww, page))
+			rewind_arm (rb, page, 1);
+	}
+	rewind_unlock ();
+	return (int)dlen;
+}
+
+// Collects the pages changed since the previous capture into rewind_delta
+// and updates the shadow, returns -1 if the shadow had to be resynced.
+static int rewind_collect (void)
+{
+	size_t dlen = 0;
+
+	if (rewind_tracked)
+		return rewind_collect_tracked ();
+	for (int b = 0; b < REWIND_BANKS; b++) {
+		struct rewind_bank *rb = &rewind_banks[b];
+		size_t size;
+		uae_u8 *mem = rewind_bank_mem (b, &size);
+		for (size_t off = 0; off < size; off += REWIND_PAGE_SIZE) {
+			int plen = size - off < REWIND_PAGE_SIZE ? (int)(size - off) : REWIND_PAGE_SIZE;
+			if (!memcmp (rb->shadow + off, mem + off, plen))
+				continue;
+			if (!rewind_delta_grow (dlen, plen))
+				return rewind_resync () ? -1 : -2;
+			uae_u32 *h = (uae_u32*)(rewind_delta + dlen);
+			h[0] = (b << 24) | (uae_u32)(off / REWIND_PAGE_SIZE);
+			h[1] = rewind_encode_page (rewind_delta + dlen + 8, rb->shadow + off, mem + off, plen);
+			dlen += 8 + h[1];
+			memcpy (rb->shadow + off, mem + off, plen);
+		}
+	}
+	return (int)dlen;
+}
+
+// Moves the state captured in the scratch record into the arena together
+// with the RAM delta. On failure all history is dropped.
+static struct staterecord *rewind_commit (struct staterecord *sst)
+{
+	size_t statelen = sst->end - sst->data;
+	size_t hdrlen = REWIND_ALIGN(sizeof (struct staterecord));
+	size_t pos, total;
+	int dlen;
+	bool resync = false;
+	struct staterecord *st;
+
+	if (!rewind_arena) {
+		rewind_arena_size = (size_t)currprefs.statecapturedeltasize * 1024 * 1024;
+		rewind_arena = xmalloc (uae_u8, rewind_arena_size);
+		if (!rewind_arena) {
+			write_log (_T("rewind buffer alloc %d MB failed\n"), currprefs.statecapturedeltasize);
+			return NULL;
+		}
+		rewind_records = 0;
+		rewind_arena_head = rewind_arena_tail = 0;
+	}
+	// ring of records wrapped around, release the slot we are about to reuse
+	while (staterecords[replaycounter] && rewind_records > 0)
+		rewind_evict_oldest ();
+
+	for (int b = 0; b < REWIND_BANKS; b++) {
+		struct rewind_bank *rb = &rewind_banks[b];
+		size_t size;
+		uae_u8 *mem = rewind_bank_mem (b, &size);
+		if (size != rb->size)
+			resync = true;
+		else if (rewind_tracked && size && (mem != rb->mem || !writewatch_valid (rb->ww)))
+			resync = true;
+		else if (!rewind_tracked && size && !rb->shadow)
+			resync = true;
+	}
+	if (resync || !rewind_records) {
+		if (!rewind_resync ())
+			goto fail;
+		dlen = 0;
+	} else {
+		dlen = rewind_collect ();
+		if (dlen == -2)
+			goto fail;
+		if (dlen < 0)
+			dlen = 0;
+	}
+
+	total = hdrlen + REWIND_ALIGN(statelen) + REWIND_ALIGN(dlen);
+	if (total > rewind_arena_size) {
+		// history can't be kept, start over from this capture
+		if (!rewind_resync ())
+			goto fail;
+		dlen = 0;
+		total = hdrlen + REWIND_ALIGN(statelen);
+	}
+	st = (struct staterecord*)rewind_arena_alloc (total, &pos);
+	if (!st)
+		goto fail;
+	if (!rewind_records)
+		rewind_oldest = replaycounter;
+	rewind_records++;
+
+	st->len = (int)total;
+	st->inuse = 0;
+	st->data = (uae_u8*)st + hdrlen;
+	memcpy (st->data, sst->data, statelen);
+	st->cpu = st->data + (sst->cpu - sst->data);
+	st->end = st->data + statelen;
+	st->delta = st->data + REWIND_ALIGN(statelen);
+	st->deltalen = dlen;
+	if (dlen)
+		memcpy (st->delta, rewind_delta, dlen);
+	st->arenapos = pos;
+	staterecords[replaycounter] = st;
+	return st;
+fail:
+	rewind_clear ();
+	rewind_untrack ();
+	for (int b = 0; b < REWIND_BANKS; b++) {
+		xfree (rewind_banks[b].shadow);
+		rewind_banks[b].shadow = NULL;
+		rewind_banks[b].size = 0;
+	}
+	return NULL;
+}
+
+// Steps the shadow, or tracked RAM, back over the changes recorded by this capture.
+static void rewind_undo (struct staterecord *st)
+{
+	uae_u8 *p = st->delta;
+	uae_u8 *end = st->delta + st->deltalen;
+
+	while (p < end) {
+		uae_u32 *h = (uae_u32*)p;
+		struct rewind_bank *rb = &rewind_banks[h[0] >> 24];
+		uae_u8 *target = rewind_tracked ? rb->mem : rb->shadow;
+		size_t off = (size_t)(h[0] & 0xffffff) * REWIND_PAGE_SIZE;
+		int plen = rb->size - off < REWIND_PAGE_SIZE ? (int)(rb->size - off) : REWIND_PAGE_SIZE;
+		rewind_undo_page (target + off, p + 8, h[1], plen);
+		p += 8 + h[1];
+	}
+}
+
+// RAM written since the latest capture can't be brought back
+static bool rewind_ram_lost (void)
+{
+	return rewind_tracked && rewind_pre_overflow;
+}
+
+// Puts RAM back to the latest capture, or to the one before it if undo is set.
+static void rewind_restore_ram (struct staterecord *undo)
+{
+	if (rewind_tracked) {
+		for (int b = 0; b < REWIND_BANKS; b++) {
+			struct rewind_bank *rb = &rewind_banks[b];
+			size_t size;
+			uae_u8 *mem = rewind_bank_mem (b, &size);
+			if (size && (mem != rb->mem || size != rb->size || !writewatch_valid (rb->ww))) {
+				write_log (_T("rewind: RAM bank %d reallocated\n"), b);
+				return;
+			}
+		}
+		rewind_lock ();
+		for (int b = 0; b < REWIND_BANKS; b++) {
+			if (rewind_banks[b].ww)
+				writewatch_disarm (rewind_banks[b].ww);
+		}
+		const int used = std::min ((int)rewind_pre_used, rewind_pre_max);
+		for (int n = 0; n < used; n++) {
+			struct rewind_bank *rb = &rewind_banks[rewind_pre_owner[n] >> 24];
+			const int page = rewind_pre_owner[n] & 0xffffff;
+			if (rb->slot[page] == n)
+				memcpy (rb->mem + (size_t)page * rewind_host_page, rewind_pre + (size_t)n * rewind_host_page, rewind_host_page);
+		}
+		if (undo)
+			rewind_undo (undo);
+		rewind_track_reset ();
+		rewind_unlock ();
+		return;
+	}
+	if (undo)
+		rewind_undo (undo);
+	for (int b = 0; b < REWIND_BANKS; b++) {
+		struct rewind_bank *rb = &rewind_banks[b];
+		size_t size;
+		uae_u8 *mem = rewind_bank_mem (b, &size);
+		if (size != rb->size) {
+			write_log (_T("rewind: RAM bank %d size changed %d -> %d\n"), b, (int)rb->size, (int)size);
+			continue;
+		}
+		if (size)
+			memcpy (mem, rb->shadow, size);
+	}
+}
+
+static void rewind_free (void)
+{
+	rewind_untrack ();
+	xfree (rewind_pre);
+	rewind_pre = NULL;
+	xfree (rewind_pre_owner);
+	rewind_pre_owner = NULL;
+	rewind_pre_max = 0;
+	xfree (rewind_arena);
+	rewind_arena = NULL;
+	rewind_arena_size = rewind_arena_head = rewind_arena_tail = 0;
+	rewind_records = 0;
+	xfree (rewind_scratch);
+	rewind_scratch = NULL;
+	xfree (rewind_delta);
+	rewind_delta = NULL;
+	rewind_delta_size = 0;
+	for (int b = 0; b < REWIND_BANKS; b++) {
+		xfree (rewind_banks[b].shadow);
+		rewind_banks[b].shadow = NULL;
+		rewind_banks[b].size = 0;
+	}
+}
+
 static int rewindmode;
 
 
@@ -1443,32 +2136,13 @@ void savestate_listrewind (void)
 }
 #endif
 
-void savestate_rewind (void)
+// Counterpart of rewind_save_state(), returns the end of the consumed data.
+static uae_u8 *rewind_restore_state (struct staterecord *st)
 {
+	uae_u8 *p = st->data;
 	int len, i;
-	uae_u8 *p, *p2;
-	struct staterecord *st;
-	int pos;
-	bool rewind = false;
 	size_t dummy;
 
-	if (hsync_counter % currprefs.statecapturerate <= 25 && rewindmode <= -2) {
-		pos = replaycounter - 2;
-		rewind = true;
-	} else {
-		pos = replaycounter - 1;
-	}
-	st = canrewind (pos);
-	if (!st) {
-		rewind = false;
-		pos = replaycounter - 1;
-		st = canrewind (pos);
-		if (!st)
-			return;
-	}
-	p = st->data;
-	p2 = st->end;
-	write_log (_T("rewinding %d -> %d\n"), replaycounter - 1, pos);
 	hsync_counter = restore_u32_func (&p);
 	vsync_counter = restore_u32_func (&p);
 	p = restore_cpu (p);
@@ -1552,11 +2226,47 @@ void savestate_rewind (void)
 			p = restore_gayle_ide (p);
 	}
 	p += 4;
-	if (p != p2) {
-		gui_message (_T("reload failure, address mismatch %p != %p"), p, p2);
+	return p;
+}
+
+void savestate_rewind (void)
+{
+	uae_u8 *p;
+	struct staterecord *st;
+	int pos;
+	bool rewind = false;
+
+	if (savestate_runahead < 0) {
+		runahead_rollback ();
+		return;
+	}
+	if (hsync_counter % currprefs.statecapturerate <= 25 && rewindmode <= -2) {
+		pos = replaycounter - 2;
+		rewind = true;
+	} else {
+		pos = replaycounter - 1;
+	}
+	st = canrewind (pos);
+	if (!st) {
+		rewind = false;
+		pos = replaycounter - 1;
+		st = canrewind (pos);
+		if (!st)
+			return;
+	}
+	if (rewind_delta_mode && rewind_ram_lost ()) {
+		write_log (_T("rewind: RAM changes since the last capture were not tracked\n"));
+		return;
+	}
+	write_log (_T("rewinding %d -> %d\n"), replaycounter - 1, pos);
+	p = rewind_restore_state (st);
+	if (p != st->end) {
+		gui_message (_T("reload failure, address mismatch %p != %p"), p, st->end);
 		uae_reset (0, 0);
 		return;
 	}
+	if (rewind_delta_mode)
+		rewind_restore_ram (rewind ? canrewind (replaycounter - 1) : NULL);
 	inprec_setposition (st->inprecoffset, pos);
 	write_log (_T("state %d restored.  (%010ld/%03ld)\n"), pos, hsync_counter, vsync_counter);
 	if (rewind) {
@@ -1565,6 +2275,8 @@ void savestate_rewind (void)
 			replaycounter += staterecords_max;
 		st = canrewind (replaycounter);
 		st->inuse = 0;
+		if (rewind_delta_mode)
+			rewind_drop_latest (replaycounter);
 	}
 
 }
@@ -1588,82 +2300,41 @@ void savestate_memorysave (void)
 		save_state_internal (staterecord_statefile, _T("rerecording"), 1, false);
 }
 
-void savestate_capture (int force)
+// Serializes the machine state into st->data, RAM is stored as empty blocks
+// if ram is false. Returns the end of the data or NULL if st is too small.
+static uae_u8 *rewind_save_state (struct staterecord *st, bool ram)
 {
-	uae_u8 *p, *p2, *p3, *dst;
+	uae_u8 *p, *p3, *dst;
 	size_t len, tlen;
-	int i, retrycnt;
-	struct staterecord *st;
-	bool firstcapture = false;
-
-	if (!staterecords)
-		return;
-	if (!input_record)
-		return;
-#ifdef FILESYS
-	if (nr_units())
-		return;
-#endif
-	if (currprefs.statecapturerate && hsync_counter == 0 && input_record == INPREC_RECORD_START && savestate_first_capture > 0) {
-		// first capture
-		force = true;
-		firstcapture = true;
-	} else if (savestate_first_capture < 0) {
-		force = true;
-		firstcapture = false;
-	}
-	if (!force) {
-		if (currprefs.statecapturerate <= 0)
-			return;
-		if (hsync_counter % currprefs.statecapturerate)
-			return;
-	}
-	savestate_first_capture = false;
+	int i;
 
-	retrycnt = 0;
-retry2:
-	st = staterecords[replaycounter];
-	if (st == NULL) {
-		st = (struct staterecord*)xmalloc (uae_u8, statefile_alloc);
-		st->len = statefile_alloc;
-	} else if (retrycnt > 0) {
-		write_log (_T("realloc %d -> %d\n"), st->len, st->len + STATEFILE_ALLOC_SIZE);
-		st->len += STATEFILE_ALLOC_SIZE;
-		st = (struct staterecord*)xrealloc (uae_u8, st, st->len);
-	}
-	if (st->len > statefile_alloc)
-		statefile_alloc = st->len;
-	st->inuse = 0;
-	st->data = (uae_u8*)(st + 1);
-	staterecords[replaycounter] = st;
-	retrycnt++;
-	p = p2 = st->data;
+	p = st->data;
 	tlen = 0;
 	save_u32_func (&p, hsync_counter);
 	save_u32_func (&p, vsync_counter);
 	tlen += 8;
 
 	if (bufcheck (st, p, 0))
-		goto retry;
+		return NULL;
 	st->cpu = p;
 	save_cpu (&len, p);
 	tlen += len;
 	p += len;
 
 	if (bufcheck (st, p, 0))
-		goto retry;
+		return NULL;
 	save_cycles (&len, p);
 	tlen += len;
 	p += len;
 
 	if (bufcheck (st, p, 0))
-		goto retry;
+		return NULL;
 	save_cpu_extra (&len, p);
 	tlen += len;
 	p += len;
 
 	if (bufcheck (st, p, 0))
-		goto retry;
+		return NULL;
 	p3 = p;
 	save_u32_func (&p, 0);
 	tlen += 4;
@@ -1675,7 +2346,7 @@ retry2:
 
 #ifdef FPUEMU
 	if (bufcheck (st, p, 0))
-		goto retry;
+		return NULL;
 	p3 = p;
 	save_u32_func (&p, 0);
 	tlen += 4;
@@ -1687,7 +2358,7 @@ retry2:
 #endif
 	for (i = 0; i < 4; i++) {
 		if (bufcheck (st, p, 0))
-			goto retry;
+			return NULL;
 		save_disk (i, &len, p, true);
 		tlen += len;
 		p += len;
@@ -1702,25 +2373,25 @@ retry2:
 	}
 
 	if (bufcheck (st, p, 0))
-		goto retry;
+		return NULL;
 	save_floppy (&len, p);
 	tlen += len;
 	p += len;
 
 	if (bufcheck (st, p, 0))
-		goto retry;
+		return NULL;
 	save_custom (&len, p, 0);
 	tlen += len;
 	p += len;
 
 	if (bufcheck (st, p, 0))
-		goto retry;
+		return NULL;
 	save_custom_extra (&len, p);
 	tlen += len;
 	p += len;
 
 	if (bufcheck (st, p, 0))
-		goto retry;
+		return NULL;
 	p3 = p;
 	save_u32_func (&p, 0);
 	tlen += 4;
@@ -1731,19 +2402,19 @@ retry2:
 	}
 
 	if (bufcheck (st, p, 0))
-		goto retry;
+		return NULL;
 	save_blitter_new (&len, p);
 	tlen += len;
 	p += len;
 
 	if (bufcheck (st, p, 0))
-		goto retry;
+		return NULL;
 	save_custom_agacolors (&len, p);
 	tlen += len;
 	p += len;
 	for (i = 0; i < 8; i++) {
 		if (bufcheck (st, p, 0))
-			goto retry;
+			return NULL;
 		save_custom_sprite(i, &len, p);
 		tlen += len;
 		p += len;
@@ -1751,39 +2422,39 @@ retry2:
 
 	for (i = 0; i < 4; i++) {
 		if (bufcheck (st, p, 0))
-			goto retry;
+			return NULL;
 		save_audio (i, &len, p);
 		tlen += len;
 		p += len;
 	}
 
 	if (bufcheck(st, p, len))
-		goto retry;
+		return NULL;
 	save_cia (0, &len, p);
 	tlen += len;
 	p += len;
 
 	if (bufcheck(st, p, len))
-		goto retry;
+		return NULL;
 	save_cia (1, &len, p);
 	tlen += len;
 	p += len;
 
 	if (bufcheck(st, p, len))
-		goto retry;
+		return NULL;
 	save_keyboard (&len, p);
 	tlen += len;
 	p += len;
 
 	if (bufcheck(st, p, len))
-		goto retry;
+		return NULL;
 	save_inputstate (&len, p);
 	tlen += len;
 	p += len;
 
 #ifdef AUTOCONFIG
 	if (bufcheck (st, p, len))
-		goto retry;
+		return NULL;
 	save_expansion (&len, p);
 	tlen += len;
 	p += len;
@@ -1791,7 +2462,7 @@ retry2:
 
 #ifdef PICASSO96
 	if (bufcheck (st, p, 0))
-		goto retry;
+		return NULL;
 	p3 = p;
 	save_u32_func (&p, 0);
 	tlen += 4;
@@ -1803,30 +2474,38 @@ retry2:
 #endif
 
 	dst = save_cram(&len);
+	if (!ram)
+		len = 0;
 	if (bufcheck(st, p, len))
-		goto retry;
+		return NULL;
 	save_u32t_func(&p, len);
 	memcpy(p, dst, len);
 	tlen += len + 4;
 	p += len;
 	dst = save_bram(&len);
+	if (!ram)
+		len = 0;
 	if (bufcheck(st, p, len))
-		goto retry;
+		return NULL;
 	save_u32t_func(&p, len);
 	memcpy(p, dst, len);
 	tlen += len + 4;
 	p += len;
 #ifdef AUTOCONFIG
 	dst = save_fram(&len, 0);
+	if (!ram)
+		len = 0;
 	if (bufcheck(st, p, len))
-		goto retry;
+		return NULL;
 	save_u32t_func(&p, len);
 	memcpy(p, dst, len);
 	tlen += len + 4;
 	p += len;
 	dst = save_zram(&len, 0);
+	if (!ram)
+		len = 0;
 	if (bufcheck(st, p, len))
-		goto retry;
+		return NULL;
 	save_u32t_func(&p, len);
 	memcpy(p, dst, len);
 	tlen += len + 4;
@@ -1834,7 +2513,7 @@ retry2:
 #endif
 #ifdef ACTION_REPLAY
 	if (bufcheck (st, p, 0))
-		goto retry;
+		return NULL;
 	p3 = p;
 	save_u32_func (&p, 0);
 	tlen += 4;
@@ -1844,7 +2523,7 @@ retry2:
 		p += len;
 	}
 	if (bufcheck (st, p, 0))
-		goto retry;
+		return NULL;
 	p3 = p;
 	save_u32_func (&p, 0);
 	tlen += 4;
@@ -1856,7 +2535,7 @@ retry2:
 #endif
 #ifdef CD32
 	if (bufcheck (st, p, 0))
-		goto retry;
+		return NULL;
 	p3 = p;
 	save_u32_func (&p, 0);
 	tlen += 4;
@@ -1868,7 +2547,7 @@ retry2:
 #endif
 #ifdef CDTV
 	if (bufcheck (st, p, 0))
-		goto retry;
+		return NULL;
 	p3 = p;
 	save_u32_func (&p, 0);
 	tlen += 4;
@@ -1878,7 +2557,7 @@ retry2:
 		p += len;
 	}
 	if (bufcheck (st, p, 0))
-		goto retry;
+		return NULL;
 	p3 = p;
 	save_u32_func (&p, 0);
 	tlen += 4;
@@ -1890,7 +2569,7 @@ retry2:
 #endif
 #if 0
 	if (bufcheck (st, p, 0))
-		goto retry;
+		return NULL;
 	p3 = p;
 	save_u32_func (&p, 0);
 	tlen += 4;
@@ -1900,7 +2579,7 @@ retry2:
 		p += len;
 	}
 	if (bufcheck (st, p, 0))
-		goto retry;
+		return NULL;
 	p3 = p;
 	save_u32_func (&p, 0);
 	tlen += 4;
@@ -1911,7 +2590,7 @@ retry2:
 	}
 #endif
 	if (bufcheck (st, p, 0))
-		goto retry;
+		return NULL;
 	p3 = p;
 	save_u32_func (&p, 0);
 	tlen += 4;
@@ -1922,7 +2601,7 @@ retry2:
 	}
 	for (i = 0; i < 4; i++) {
 		if (bufcheck (st, p, 0))
-			goto retry;
+			return NULL;
 		p3 = p;
 		save_u32_func (&p, 0);
 		tlen += 4;
@@ -1933,7 +2612,86 @@ retry2:
 		}
 	}
 	save_u32t_func(&p, tlen);
+	return p;
+}
+
+void savestate_capture (int force)
+{
+	uae_u8 *p;
+	int i, retrycnt;
+	struct staterecord *st;
+	bool firstcapture = false;
+
+	if (!staterecords)
+		return;
+	if (!input_record)
+		return;
+#ifdef FILESYS
+	if (nr_units())
+		return;
+#endif
+	if (currprefs.statecapturerate && hsync_counter == 0 && input_record == INPREC_RECORD_START && savestate_first_capture > 0) {
+		// first capture
+		force = true;
+		firstcapture = true;
+	} else if (savestate_first_capture < 0) {
+		force = true;
+		firstcapture = false;
+	}
+	if (!force) {
+		if (currprefs.statecapturerate <= 0)
+			return;
+		if (hsync_counter % currprefs.statecapturerate)
+			return;
+	}
+	savestate_first_capture = false;
+
+	retrycnt = 0;
+retry2:
+	if (rewind_delta_mode) {
+		// state without RAM is built in a scratch buffer and then
+		// moved to the rewind arena by rewind_commit()
+		st = rewind_scratch;
+		if (st == NULL || retrycnt > 0) {
+			int newlen = st ? st->len + STATEFILE_ALLOC_SIZE : STATEFILE_ALLOC_SIZE;
+			st = (struct staterecord*)xrealloc (uae_u8, st, newlen);
+			if (!st) {
+				write_log (_T("can't save, out of memory\n"));
+				return;
+			}
+			st->len = newlen;
+			rewind_scratch = st;
+		}
+	} else {
+		st = staterecords[replaycounter];
+		if (st == NULL) {
+			st = (struct staterecord*)xmalloc (uae_u8, statefile_alloc);
+			st->len = statefile_alloc;
+		} else if (retrycnt > 0) {
+			write_log (_T("realloc %d -> %d\n"), st->len, st->len + STATEFILE_ALLOC_SIZE);
+			st->len += STATEFILE_ALLOC_SIZE;
+			st = (struct staterecord*)xrealloc (uae_u8, st, st->len);
+		}
+		staterecords[replaycounter] = st;
+	}
+	if (st->len > statefile_alloc)
+		statefile_alloc = st->len;
+	st->inuse = 0;
+	st->data = (uae_u8*)(st + 1);
+	st->delta = NULL;
+	st->deltalen = 0;
+	retrycnt++;
+	p = rewind_save_state (st, !rewind_delta_mode);
+	if (!p)
+		goto retry;
 	st->end = p;
+	if (rewind_delta_mode) {
+		st = rewind_commit (st);
+		if (!st) {
+			write_log (_T("can't save, rewind buffer too small or out of memory\n"));
+			return;
+		}
+	}
 	st->inuse = 1;
 	st->inprecoffset = inprec_getposition ();
 
@@ -1946,10 +2704,10 @@ retry2:
 			staterecords_first -= staterecords_max;
 	}
 
-	write_log (_T("state capture %d (%010ld/%03ld,%ld/%d) (%ld bytes, alloc %d)\n"),
+	write_log (_T("state capture %d (%010ld/%03ld,%ld/%d) (%ld bytes, delta %d, alloc %d)\n"),
 		replaycounter, hsync_counter, vsync_counter,
 		hsync_counter % current_maxvpos (), current_maxvpos (),
-		st->end - st->data, statefile_alloc);
+		st->end - st->data, st->deltalen, statefile_alloc);
 
 	if (firstcapture) {
 		savestate_memorysave ();
@@ -1971,10 +2729,208 @@ retry:
 	return;
 }
 
+/*
+ * Run-ahead
+ *
+ * Games usually act on input a frame or more after reading it. With run-ahead
+ * each frame the input is fed to (the real frame) is followed by a number of
+ * speculative frames that are emulated with the same input. Only the last one
+ * is drawn and shown, none of them is heard, and at the next frame boundary
+ * the machine is rolled back to the end of the real frame. The display then
+ * is that many frames ahead of the emulated machine.
+ *
+ * The snapshot is a state record without RAM plus a copy of RAM that is
+ * only written where pages changed. Both are allocated when run-ahead starts
+ * and reused from then on. The rollback goes through the rewind restore path.
+ */
+
+#define RUNAHEAD_MAX_FRAMES 4
+
+int savestate_runahead;
+bool savestate_runahead_hidden;
+
+static struct staterecord *runahead_record;
+static struct rewind_bank runahead_banks[REWIND_BANKS];
+static int runahead_frames;
+
+static void runahead_copy_changed (uae_u8 *dst, const uae_u8 *src, size_t size)
+{
+	for (size_t off = 0; off < size; off += REWIND_PAGE_SIZE) {
+		size_t plen = size - off < REWIND_PAGE_SIZE ? size - off : REWIND_PAGE_SIZE;
+		if (memcmp (dst + off, src + off, plen))
+			memcpy (dst + off, src + off, plen);
+	}
+}
+
+static void runahead_free (void)
+{
+	xfree (runahead_record);
+	runahead_record = NULL;
+	for (int b = 0; b < REWIND_BANKS; b++) {
+		xfree (runahead_banks[b].shadow);
+		runahead_banks[b].shadow = NULL;
+		runahead_banks[b].size = 0;
+	}
+}
+
+static const int runahead_netboards[] = {
+	ROMTYPE_A2065, ROMTYPE_ARIADNE, ROMTYPE_ARIADNE2, ROMTYPE_HYDRA, ROMTYPE_LANROVER,
+	ROMTYPE_XSURF, ROMTYPE_XSURF100Z2, ROMTYPE_XSURF100Z3,
+	ROMTYPE_NE2KPCI, ROMTYPE_NE2KPCMCIA, ROMTYPE_NE2KISA, 0
+};
+
+static bool runahead_allowed (void)
+{
+	if (currprefs.runahead <= 0 || input_record || input_play)
+		return false;
+	if (currprefs.turbo_emulation || currprefs.cachesize)
+		return false;
+	// disk writes and RTG VRAM can't be rolled back
+	if (currprefs.mountitems || currprefs.rtgboards[0].rtgmem_size)
+		return false;
+	// a speculative frame would write its tracks to the image file
+	if (disk_writable ())
+		return false;
+	// lagless vsync shows parts of the frame while it is emulated
+	if (isvsync_chipset () < 0)
+		return false;
+	// packets, AHI and sampler audio come from the host and would be
+	// consumed again or lost when the speculative frames are rolled back
+	if (currprefs.sana2 || currprefs.samplersoundcard >= 0)
+		return false;
+	for (int i = 0; runahead_netboards[i]; i++) {
+		if (is_device_rom (&currprefs, runahead_netboards[i], 0) >= 0)
+			return false;
+	}
+#ifdef AHI
+	if (ahi_on)
+		return false;
+#endif
+	return !is_savestate_incompatible ();
+}
+
+static bool runahead_snapshot (void)
+{
+	struct staterecord *st = runahead_record;
+
+	for (int retrycnt = 0; ; retrycnt++) {
+		if (st == NULL || retrycnt > 0) {
+			if (retrycnt >= 10)
+				return false;
+			int newlen = st ? st->len + STATEFILE_ALLOC_SIZE : STATEFILE_ALLOC_SIZE;
+			st = (struct staterecord*)xrealloc (uae_u8, st, newlen);
+			runahead_record = st;
+			if (!st)
+				return false;
+			st->len = newlen;
+		}
+		st->data = (uae_u8*)(st + 1);
+		st->end = rewind_save_state (st, false);
+		if (st->end)
+			break;
+	}
+	for (int b = 0; b < REWIND_BANKS; b++) {
+		struct rewind_bank *rb = &runahead_banks[b];
+		size_t size;
+		uae_u8 *mem = rewind_bank_mem (b, &size);
+		if (size != rb->size) {
+			xfree (rb->shadow);
+			rb->shadow = size ? xmalloc (uae_u8, size) : NULL;
+			rb->size = 0;
+			if (size && !rb->shadow)
+				return false;
+			rb->size = size;
+			memcpy (rb->shadow, mem, size);
+		} else if (size) {
+			runahead_copy_changed (rb->shadow, mem, size);
+		}
+	}
+	keybuf_runahead_mark ();
+	sound_runahead_mark ();
+	return true;
+}
+
+void savestate_runahead_stop (void)
+{
+	savestate_runahead = 0;
+	savestate_runahead_hidden = false;
+}
+
+// Called at the end of a frame that was not speculative.
+static void runahead_start (void)
+{
+	int frames = runahead_allowed () ? std::min (currprefs.runahead, RUNAHEAD_MAX_FRAMES) : 0;
+
+	if (frames != runahead_frames) {
+		if (frames)
+			write_log (_T("run-ahead: %d frame(s)\n"), frames);
+		else
+			write_log (_T("run-ahead: off\n"));
+		runahead_frames = frames;
+	}
+	if (!frames) {
+		if (runahead_record)
+			runahead_free ();
+		return;
+	}
+	if (!runahead_snapshot ()) {
+		write_log (_T("run-ahead: snapshot failed, out of memory\n"));
+		runahead_free ();
+		runahead_frames = 0;
+		return;
+	}
+	savestate_runahead = frames;
+}
+
+// Called at the end of a speculative frame, returns true when it is time to roll back.
+static bool runahead_next (void)
+{
+	if (--savestate_runahead > 0) {
+		savestate_runahead_hidden = savestate_runahead > 1;
+		return false;
+	}
+	// the real frame that follows the rollback is never shown
+	savestate_runahead = -1;
+	savestate_runahead_hidden = true;
+	savestate_state = STATE_REWIND;
+	return true;
+}
+
+static void runahead_rollback (void)
+{
+	struct staterecord *st = runahead_record;
+
+	if (!st || rewind_restore_state (st) != st->end) {
+		gui_message (_T("run-ahead rollback failed"));
+		savestate_runahead_stop ();
+		uae_reset (0, 0);
+		return;
+	}
+	for (int b = 0; b < REWIND_BANKS; b++) {
+		struct rewind_bank *rb = &runahead_banks[b];
+		size_t size;
+		uae_u8 *mem = rewind_bank_mem (b, &size);
+		if (size == rb->size && size)
+			runahead_copy_changed (mem, rb->shadow, size);
+	}
+	keybuf_runahead_rollback ();
+	sound_runahead_rollback ();
+}
+
+/* true once, on the line run-ahead rolled back to */
+bool savestate_runahead_resume (void)
+{
+	if (savestate_runahead >= 0)
+		return false;
+	savestate_runahead = 0;
+	return true;
+}
+
 void savestate_free (void)
 {
 	xfree (staterecords);
 	staterecords = NULL;
+	rewind_free ();
 }
 
 void savestate_capture_request (void)
@@ -1989,6 +2945,7 @@ void savestate_init (void)
 	staterecords_max = currprefs.statecapturebuffersize;
 	staterecords = xcalloc (struct staterecord*, staterecords_max);
 	statefile_alloc = STATEFILE_ALLOC_SIZE;
+	rewind_delta_mode = currprefs.statecapturedelta && currprefs.statecapturedeltasize > 0;
 	if (input_record && savestate_state != STATE_DORESTORE) {
 		zfile_fclose (staterecord_statefile);
 		staterecord_statefile = NULL;
@@ -10,6 +10,7 @@
 
 #include <cmath>
 #include <algorithm>
+#include <atomic>
 
 #include "options.h"
 #include "audio.h"
@@ -23,6 +24,8 @@
 #include "gensound.h"
 #include "xwin.h"
 #include "sounddep/sound.h"
+#include "sounddep/sound_ring.h"
+#include "benchmark.h"
 
 struct sound_dp
 {
@@ -31,12 +34,8 @@ struct sound_dp
 	int framesperbuffer;
 	int sndbuf;
 	int pullmode;
-	uae_u8* pullbuffer;
-	unsigned int pullbufferlen;
-	int pullbuffermaxlen;
+	struct sound_ring ring;
 	bool gotpullevent;
-	float avg_correct;
-	float cnt_correct;
 	int stream_initialised;
 	int silence_written;
 };
@@ -63,6 +62,10 @@ uae_u16 paula_sndbuffer[SND_MAX_BUFFER];
 #endif
 uae_u16* paula_sndbufpt;
 int paula_sndbufsize;
+
+// samples of the real frame that were not sent yet when run-ahead started
+static uae_u16 runahead_sndbuffer[sizeof paula_sndbuffer / sizeof paula_sndbuffer[0]];
+static int runahead_sndbufsize;
 int active_sound_stereo;
 
 #ifdef AMIBERRY
@@ -106,7 +109,6 @@ static int avioutput_audio;
 #endif
 
 #define ADJUST_LIMIT 6
-#define ADJUST_LIMIT2 1
 
 void sound_setadjust(float v)
 {
@@ -136,36 +138,6 @@ void sound_setadjust(float v)
 	}
 }
 
-static void docorrection(struct sound_dp* s, int sndbuf, float sync, int granulaty)
-{
-	static int tfprev;
-
-	s->avg_correct += sync;
-	s->cnt_correct++;
-
-	granulaty = std::max(granulaty, 10);
-
-	if (tfprev != timeframes) {
-		const auto avg = s->avg_correct / s->cnt_correct;
-
-		auto skipmode = sync / 100.0f;
-		const auto avgskipmode = avg / (10000.0f / granulaty);
-
-		if (sound_debug && (tfprev % 10) == 0) {
-			write_log(_T("%+05d S=%7.1f AVG=%7.1f (IMM=%7.1f + AVG=%7.1f = %7.1f)\n"), sndbuf, sync, avg, skipmode, avgskipmode, skipmode + avgskipmode);
-		}
-		gui_data.sndbuf = sndbuf;
-
-		if (skipmode > ADJUST_LIMIT2)
-			skipmode = ADJUST_LIMIT2;
-		if (skipmode < -ADJUST_LIMIT2)
-			skipmode = -ADJUST_LIMIT2;
-
-		sound_setadjust(skipmode + avgskipmode);
-		tfprev = static_cast<int>(timeframes);
-	}
-}
-
 static float sync_sound(float m)
 {
 	float skipmode;
@@ -205,15 +177,14 @@ static void clearbuffer_sdl2(struct sound_data *sd)
 
 static void clearbuffer(struct sound_data* sd)
 {
-	const auto* s = sd->data;
+	auto* s = sd->data;
 	if (sd->devicetype == SOUND_DEVICE_SDL2)
 		clearbuffer_sdl2(sd);
-	if (s->pullbuffer) {
-		if (sd->devicetype == SOUND_DEVICE_SDL2)
-			SDL_LockAudioDevice(s->dev);
-		memset(s->pullbuffer, 0, s->pullbuffermaxlen);
-		if (sd->devicetype == SOUND_DEVICE_SDL2)
-			SDL_UnlockAudioDevice(s->dev);
+	if (s->ring.buf) {
+		// control path only, the lock keeps the callback out while both indexes move
+		SDL_LockAudioDevice(s->dev);
+		sound_ring_reset(&s->ring);
+		SDL_UnlockAudioDevice(s->dev);
 	}
 }
 
@@ -238,8 +209,6 @@ static void resume_audio_sdl2(struct sound_data* sd)
 	
 	clearbuffer(sd);
 	sd->waiting_for_buffer = 1;
-	s->avg_correct = 0;
-	s->cnt_correct = 0;
 	SDL_PauseAudioDevice(s->dev, 0);
 	sd->paused = 0;
 }
@@ -250,12 +219,7 @@ static void close_audio_sdl2(struct sound_data* sd)
 	SDL_PauseAudioDevice(s->dev, 1);
 	
 	SDL_LockAudioDevice(s->dev);
-	if (s->pullbuffer != nullptr)
-	{
-		xfree(s->pullbuffer);
-		s->pullbuffer = nullptr;
-	}
-	s->pullbufferlen = 0;
+	sound_ring_free(&s->ring);
 	SDL_UnlockAudioDevice(s->dev);
 	
 	SDL_CloseAudioDevice(s->dev);
@@ -289,56 +253,30 @@ void set_volume(int volume, int mute)
 	config_changed = 1;
 }
 
-static void finish_sound_buffer_sdl2_push(struct sound_data* sd, uae_u16* sndbuffer)
-{
-	sound_dp* s = sd->data;
-	if (sd->mute) {
-		memset(sndbuffer, 0, sd->sndbufsize);
-		s->silence_written++; // In push mode no sound gen means no audio push so this might not be incremented frequently
-	}
-	SDL_QueueAudio(s->dev, sndbuffer, sd->sndbufsize);
-
-	// Sync
-	const auto queued = SDL_GetQueuedAudioSize(s->dev);
-	const auto target = sd->sndbufsize; // Target 1 buffer latency?
-	const auto diff = static_cast<int>(queued) - target;
-	const auto val = static_cast<float>(diff) / static_cast<float>(sd->samplesize);
-	
-	int vis = 0;
-	if (target > 0)
-		vis = queued * 500 / target; // 500 = 50% (nominal)
-	
-	docorrection(s, vis, val, 100);
-}
-
-static void finish_sound_buffer_pull(struct sound_data* sd, uae_u16* sndbuffer)
+static void finish_sound_buffer_ring(struct sound_data* sd, uae_u16* sndbuffer)
 {
 	auto* s = sd->data;
+	const unsigned int frames = sd->sndbufsize / sd->samplesize;
+	unsigned int fill;
 
-	SDL_LockAudioDevice(s->dev);
-	if (s->pullbufferlen + sd->sndbufsize > s->pullbuffermaxlen) {
-		write_log(_T("pull overflow! %d %d %d\n"), s->pullbufferlen, sd->sndbufsize, s->pullbuffermaxlen);
-		s->pullbufferlen = 0;
+	if (!s->ring.buf)
+		return;
+	if (!sound_ring_write(&s->ring, reinterpret_cast<uae_s16*>(sndbuffer), frames, &fill)) {
+		// callback has stalled, the buffer was dropped
+		if (gui_data.sndbuf_status != 1)
+			write_log(_T("sound ring overflow! %u %u %u\n"), fill, frames, s->ring.frames);
 		gui_data.sndbuf_status = 1;
+		statuscnt = SND_STATUSCNT;
+		return;
 	}
-	else 
-		gui_data.sndbuf_status = 0;
-	memcpy(s->pullbuffer + s->pullbufferlen, sndbuffer, sd->sndbufsize);
-	s->pullbufferlen += sd->sndbufsize;
-	
-	// Calc sync inside lock to get consistent len
-	const auto len = s->pullbufferlen;
-	const auto maxlen = s->pullbuffermaxlen;
-	SDL_UnlockAudioDevice(s->dev);
+	// underrun reported by the callback, cleared by the vsync countdown like an overflow
+	if (gui_data.sndbuf_status == -1 && statuscnt == 0)
+		statuscnt = SND_STATUSCNT;
 
-	if (maxlen > 0)
-	{
-		const auto target = maxlen / 2;
-		const auto diff = len - target;
-		const auto val = static_cast<float>(diff) / static_cast<float>(sd->samplesize);
-		const auto vis = len * 1000 / maxlen;
-		docorrection(s, vis, val, 100);
-	}
+	// 500 = at target (50%)
+	gui_data.sndbuf = std::min(static_cast<int>(fill * 500 / s->ring.target), 1000);
+	if (sound_debug && (timeframes % 50) == 0)
+		write_log(_T("sound ring %u/%d frames, ratio %.5f\n"), fill, s->ring.target, s->ring.rs_ratio.load(std::memory_order_relaxed));
 }
 
 static int open_audio_sdl2(struct sound_data* sd, int index)
@@ -364,11 +302,9 @@ static int open_audio_sdl2(struct sound_data* sd, int index)
 	want.channels = ch;
 	want.samples = s->framesperbuffer;
 
-	if (s->pullmode)
-	{
-		want.callback = sdl2_audio_callback;
-		want.userdata = sd;
-	}
+	// push and pull mode both feed the callback through the ring
+	want.callback = sdl2_audio_callback;
+	want.userdata = sd;
 
 	if (s->dev == 0)
 		s->dev = SDL_OpenAudioDevice(currprefs.soundcard_default ? nullptr : devname, 0, &want, &have, 0);
@@ -383,19 +319,31 @@ static int open_audio_sdl2(struct sound_data* sd, int index)
 		}
 	}
 
-	if (s->pullmode)
-	{
-		s->pullbuffermaxlen = sd->sndbufsize * 2;
-		s->pullbuffer = xcalloc(uae_u8, s->pullbuffermaxlen);
-		s->pullbufferlen = 0;
-	}
-	write_log("SDL2: CH=%d, FREQ=%d '%s' buffer %d/%d (%s)\n", ch, freq, sound_devices[index]->name,
-		s->sndbufsize, s->framesperbuffer, !s->pullmode ? _T("push") : _T("pull"));
+	const int chunk = sd->sndbufsize / sd->samplesize;
+	sound_ring_alloc(&s->ring, ch, std::max(chunk, static_cast<int>(have.samples)) + have.freq * RS_LATENCY_MS / 1000, chunk);
+	write_log("SDL2: CH=%d, FREQ=%d '%s' buffer %d/%d (%s), ring %d/%u frames\n", ch, freq, sound_devices[index]->name,
+		s->sndbufsize, s->framesperbuffer, !s->pullmode ? _T("push") : _T("pull"), s->ring.target, s->ring.frames);
 	clearbuffer(sd);
 
 	return 1;
 }
 
+// Benchmark sink: Paula still renders every buffer, the result is dropped.
+static int open_audio_null(struct sound_data* sd)
+{
+	auto* const s = sd->data;
+
+	sd->devicetype = SOUND_DEVICE_NULL;
+	sd->sndbufsize = std::max(sd->sndbufsize, 0x80);
+	s->framesperbuffer = sd->sndbufsize;
+	s->sndbufsize = s->framesperbuffer;
+	sd->sndbufsize = s->sndbufsize * sd->channels * 2;
+	if (sd->sndbufsize > SND_MAX_BUFFER)
+		sd->sndbufsize = SND_MAX_BUFFER;
+	write_log("NULL: CH=%d, FREQ=%d buffer %d\n", sd->channels, sd->freq, s->sndbufsize);
+	return 1;
+}
+
 int open_sound_device(struct sound_data* sd, int index, int bufsize, int freq, int channels)
 {
 	auto* dp = xcalloc(struct sound_dp, 1);
@@ -406,7 +354,7 @@ int open_sound_device(struct sound_data* sd, int index, int bufsize, int freq, i
 	sd->channels = channels;
 	sd->paused = 1;
 	sd->index = index;
-	const auto ret = open_audio_sdl2(sd, index);
+	const auto ret = benchmark_active() ? open_audio_null(sd) : open_audio_sdl2(sd, index);
 	sd->samplesize = sd->channels * 2;
 	sd->sndbufframes = sd->sndbufsize / sd->samplesize;
 	return ret;
@@ -415,7 +363,8 @@ int open_sound_device(struct sound_data* sd, int index, int bufsize, int freq, i
 void close_sound_device(struct sound_data* sd)
 {
 	pause_sound_device(sd);
-	close_audio_sdl2(sd);
+	if (sd->devicetype == SOUND_DEVICE_SDL2)
+		close_audio_sdl2(sd);
 	xfree(sd->data);
 	sd->data = NULL;
 	sd->index = -1;
@@ -426,11 +375,13 @@ void pause_sound_device(struct sound_data* sd)
 	sd->paused = 1;
 	gui_data.sndbuf_status = 0;
 	gui_data.sndbuf = 0;
-	pause_audio_sdl2(sd);
+	if (sd->devicetype == SOUND_DEVICE_SDL2)
+		pause_audio_sdl2(sd);
 }
 void resume_sound_device(struct sound_data* sd)
 {
-	resume_audio_sdl2(sd);
+	if (sd->devicetype == SOUND_DEVICE_SDL2)
+		resume_audio_sdl2(sd);
 	sd->paused = 0;
 }
 
@@ -453,7 +404,7 @@ static int open_sound()
 	int num = enumerate_sound_devices();
 	if (currprefs.soundcard >= num)
 		currprefs.soundcard = changed_prefs.soundcard = 0;
-	if (num == 0)
+	if (num == 0 && !benchmark_active())
 		return 0;
 	const auto ch = get_audio_nativechannels(active_sound_stereo);
 	const auto ret = open_sound_device(sdp, currprefs.soundcard, size, currprefs.sound_freq, ch);
@@ -594,14 +545,10 @@ void restart_sound_buffer()
 
 static void finish_sound_buffer_sdl2(struct sound_data *sd, uae_u16 *sndbuffer)
 {
-	const auto* s = sd->data;
 	if (!sd->waiting_for_buffer)
 		return;
 	
-	if (s->pullmode)
-		finish_sound_buffer_pull(sd, sndbuffer);
-	else
-		finish_sound_buffer_sdl2_push(sd, sndbuffer);
+	finish_sound_buffer_ring(sd, sndbuffer);
 }
 
 static void channelswap(uae_s16* sndbuffer, int len)
@@ -627,7 +574,7 @@ static void channelswap6(uae_s16* sndbuffer, int len)
 static bool send_sound_do(struct sound_data* sd)
 {
 	if (const int type = sd->devicetype; type == SOUND_DEVICE_SDL2) {
-		finish_sound_buffer_pull(sd, paula_sndbuffer);
+		finish_sound_buffer_ring(sd, paula_sndbuffer);
 		return true;
 	}
 	return false;
@@ -640,6 +587,8 @@ static void send_sound(struct sound_data* sd, uae_u16* sndbuffer)
 		return;
 	if (sd->paused)
 		return;
+	if (type == SOUND_DEVICE_NULL)
+		return;
 	if (sd->softvolume >= 0) {
 		auto* p = reinterpret_cast<uae_s16*>(sndbuffer);
 		for (auto i = 0; i < sd->sndbufsize / 2; i++) {
@@ -697,7 +646,7 @@ int audio_pull_buffer()
 	if (sdp->paused || sdp->deactive || sdp->reset || !sdp->data)
 		return 0;
 	const auto* s = sdp->data;
-	if (s->pullbufferlen > 0) {
+	if (s->ring.buf && !sound_ring_empty(&s->ring)) {
 		cnt++;
 		int size = static_cast<int>(reinterpret_cast<uae_u8*>(paula_sndbufpt) - reinterpret_cast<uae_u8*>(paula_sndbuffer));
 		if (size > sdp->sndbufsize * 2 / 3)
@@ -760,8 +709,23 @@ static void handle_reset()
 	}
 }
 
+void sound_runahead_mark()
+{
+	runahead_sndbufsize = paula_sndbufpt ? addrdiff((uae_u8*)paula_sndbufpt, (uae_u8*)paula_sndbuffer) : 0;
+	memcpy(runahead_sndbuffer, paula_sndbuffer, runahead_sndbufsize);
+}
+
+void sound_runahead_rollback()
+{
+	if (!paula_sndbufpt)
+		return;
+	memcpy(paula_sndbuffer, runahead_sndbuffer, runahead_sndbufsize);
+	paula_sndbufpt = (uae_u16*)((uae_u8*)paula_sndbuffer + runahead_sndbufsize);
+}
+
 void finish_sound_buffer()
 {
+	benchmark_scope bench(BENCH_AUDIO);
 	static unsigned long tframe;
 	int bufsize = addrdiff((uae_u8*)paula_sndbufpt, (uae_u8*)paula_sndbuffer);
 
@@ -771,7 +735,8 @@ void finish_sound_buffer()
 		return;
 	}
 	
-	if (currprefs.turbo_emulation) {
+	// speculative run-ahead frames are not heard
+	if (currprefs.turbo_emulation || isrunahead()) {
 		paula_sndbufpt = paula_sndbuffer;
 		return;
 	}
@@ -934,30 +899,27 @@ void sdl2_audio_callback(void* userdata, Uint8* stream, int len)
 	auto* sd = static_cast<sound_data*>(userdata);
 	auto* s = sd->data;
 
-	if (!s->stream_initialised || sd->mute) {
+	if (!s->stream_initialised || sd->mute || !s->ring.buf) {
 		std::fill_n(stream, len, 0);
 		if (sd->mute) s->silence_written++;
 		s->stream_initialised = 1;
+		// keep draining while muted so that the writer doesn't overflow
+		if (s->ring.buf)
+			sound_ring_drain(&s->ring);
 		return;
 	}
 
-	if (!s->framesperbuffer || sdp->deactive)
-		return;
-
-	if (s->pullbufferlen <= 0) {
-		gui_data.sndbuf_status = -1;
+	if (!s->framesperbuffer || sdp->deactive) {
+		std::fill_n(stream, len, 0);
 		return;
 	}
 
-	const auto bytes_to_copy = std::min(static_cast<unsigned int>(s->framesperbuffer * sd->samplesize), s->pullbufferlen);
-	if (sd->mute == 0 && bytes_to_copy > 0) {
-		std::copy(s->pullbuffer, s->pullbuffer + bytes_to_copy, stream);
-	}
-
-	if (bytes_to_copy < s->pullbufferlen) {
-		std::memmove(s->pullbuffer, s->pullbuffer + bytes_to_copy, s->pullbufferlen - bytes_to_copy);
+	const int frames = len / sd->samplesize;
+	const int got = sound_ring_read(&s->ring, reinterpret_cast<uae_s16*>(stream), frames);
+	if (got < frames) {
+		std::fill_n(stream + got * sd->samplesize, len - got * sd->samplesize, 0);
+		gui_data.sndbuf_status = -1;
 	}
-	s->pullbufferlen -= bytes_to_copy;
 }
 
 int sound_get_silence()
@@ -17,6 +17,8 @@ extern uae_u16* paula_sndbufpt;
 extern int paula_sndbufsize;
 
 extern void finish_sound_buffer(void);
+extern void sound_runahead_mark(void);
+extern void sound_runahead_rollback(void);
 extern void restart_sound_buffer(void);
 extern void pause_sound_buffer(void);
 extern int init_sound(void);
@@ -0,0 +1,123 @@
+/*
+  * UAE - The Un*x Amiga Emulator
+  *
+  * Sound ring buffer with a drift correcting resampler
+  */
+#include <cstring>
+
+#include "sysconfig.h"
+#include "sysdeps.h"
+
+#include <algorithm>
+
+#include "sounddep/sound_ring.h"
+
+/* target is the fill level the reader steers to, chunk the largest write */
+bool sound_ring_alloc(struct sound_ring* sr, int channels, int target, int chunk)
+{
+	sr->channels = channels;
+	sr->target = target;
+	sr->frames = 1024;
+	while (sr->frames < static_cast<unsigned int>(4 * (target + chunk)))
+		sr->frames <<= 1;
+	sr->buf = xcalloc(uae_s16, sr->frames * channels);
+	sound_ring_reset(sr);
+	return sr->buf != nullptr;
+}
+
+void sound_ring_free(struct sound_ring* sr)
+{
+	xfree(sr->buf);
+	sr->buf = nullptr;
+	sr->frames = 0;
+}
+
+// both sides must be stopped, it moves both indexes
+void sound_ring_reset(struct sound_ring* sr)
+{
+	sr->w.store(0, std::memory_order_relaxed);
+	sr->r.store(0, std::memory_order_relaxed);
+	sr->primed = false;
+	sr->rs_pos = 0;
+	sr->rs_fill = sr->target;
+	sr->rs_ratio.store(1.0f, std::memory_order_relaxed);
+}
+
+/* Writer side. Returns false and drops the data if it doesn't fit, the
+ * reader has stalled and r is only ever moved by the reader. fill is the
+ * number of frames buffered after the write. */
+bool sound_ring_write(struct sound_ring* sr, const uae_s16* data, unsigned int frames, unsigned int* fill)
+{
+	const auto w = sr->w.load(std::memory_order_relaxed);
+	const auto used = w - sr->r.load(std::memory_order_acquire);
+	const size_t framesize = sr->channels * sizeof(uae_s16);
+
+	*fill = used;
+	if (used + frames > sr->frames)
+		return false;
+	const auto pos = w & (sr->frames - 1);
+	const auto n1 = std::min(frames, sr->frames - pos);
+	memcpy(sr->buf + pos * sr->channels, data, n1 * framesize);
+	if (n1 < frames)
+		memcpy(sr->buf, data + n1 * sr->channels, (frames - n1) * framesize);
+	sr->w.store(w + frames, std::memory_order_release);
+	*fill = used + frames;
+	return true;
+}
+
+/* Reads frames from the ring at a rate of rs_ratio input frames per output
+ * frame, with linear interpolation. The ratio follows the smoothed fill
+ * level, so host and emulated clock drift is taken out a little at a time
+ * instead of in steps. Returns the number of frames written. */
+int sound_ring_read(struct sound_ring* sr, uae_s16* out, int frames)
+{
+	const int ch = sr->channels;
+	const unsigned int mask = sr->frames - 1;
+	const auto r = sr->r.load(std::memory_order_relaxed);
+	const int avail = static_cast<int>(sr->w.load(std::memory_order_acquire) - r);
+
+	if (!sr->primed) {
+		if (avail < sr->target)
+			return 0;
+		sr->primed = true;
+		sr->rs_fill = avail;
+	}
+	sr->rs_fill += (avail - sr->rs_fill) * RS_SMOOTH;
+	const double err = (sr->rs_fill - sr->target) / sr->target;
+	const double ratio = 1.0 + std::clamp(err * RS_GAIN, -RS_MAX_ADJUST, RS_MAX_ADJUST);
+	sr->rs_ratio.store(static_cast<float>(ratio), std::memory_order_relaxed);
+
+	double pos = sr->rs_pos;
+	int i;
+	for (i = 0; i < frames; i++) {
+		const int ip = static_cast<int>(pos);
+		if (ip + 1 >= avail)
+			break;
+		const auto f = static_cast<float>(pos - ip);
+		const uae_s16* a = sr->buf + ((r + ip) & mask) * ch;
+		const uae_s16* b = sr->buf + ((r + ip + 1) & mask) * ch;
+		for (int c = 0; c < ch; c++)
+			out[i * ch + c] = static_cast<uae_s16>(a[c] + (b[c] - a[c]) * f);
+		pos += ratio;
+	}
+	const int used = static_cast<int>(pos);
+	sr->rs_pos = pos - used;
+	sr->r.store(r + used, std::memory_order_release);
+	if (i < frames) {
+		// ran dry, build up the full cushion again before restarting
+		sr->primed = false;
+		sr->rs_pos = 0;
+	}
+	return i;
+}
+
+// reader side, throws away everything written so far
+void sound_ring_drain(struct sound_ring* sr)
+{
+	sr->r.store(sr->w.load(std::memory_order_acquire), std::memory_order_release);
+}
+
+bool sound_ring_empty(const struct sound_ring* sr)
+{
+	return sr->w.load(std::memory_order_relaxed) == sr->r.load(std::memory_order_acquire);
+}
@@ -0,0 +1,40 @@
+/*
+  * UAE - The Un*x Amiga Emulator
+  *
+  * Sound ring buffer with a drift correcting resampler
+  */
+
+#pragma once
+#include <atomic>
+
+/* Single producer, single consumer ring between finish_sound_buffer()
+ * and the SDL callback. Positions are free running frame counts, only
+ * the emulation thread writes w and only the callback r. */
+struct sound_ring
+{
+	uae_s16* buf;
+	unsigned int frames; // power of two
+	int channels;
+	std::atomic<unsigned int> w, r;
+	int target;
+	bool primed;
+	/* resampler state, callback side only */
+	double rs_pos;
+	double rs_fill;
+	std::atomic<float> rs_ratio;
+};
+
+/* The reader resamples by up to RS_MAX_ADJUST to keep the ring at
+ * target frames, one emulator buffer plus RS_LATENCY_MS. */
+#define RS_LATENCY_MS 10
+#define RS_MAX_ADJUST 0.005
+#define RS_GAIN 0.02
+#define RS_SMOOTH 0.05
+
+extern bool sound_ring_alloc(struct sound_ring* sr, int channels, int target, int chunk);
+extern void sound_ring_free(struct sound_ring* sr);
+extern void sound_ring_reset(struct sound_ring* sr);
+extern bool sound_ring_write(struct sound_ring* sr, const uae_s16* data, unsigned int frames, unsigned int* fill);
+extern int sound_ring_read(struct sound_ring* sr, uae_s16* out, int frames);
+extern void sound_ring_drain(struct sound_ring* sr);
+extern bool sound_ring_empty(const struct sound_ring* sr);
@@ -20,6 +20,7 @@
 #include "fsdb.h"
 #include "fsusage.h"
 #include "zarchive.h"
+#include "zinflate.h"
 #include "diskutil.h"
 #include "fdi2raw.h"
 #include "uae.h"
@@ -210,6 +211,8 @@ static void zfile_free (struct zfile *f)
 	xfree (f->originalname);
 	xfree (f->data);
 	xfree (f->mode);
+	if (f->zfileclose)
+		f->zfileclose (f);
 	xfree (f->userdata);
 	xfree (f);
 }
@@ -563,6 +566,66 @@ end:
 	return z;
 }
 
+/* the compressed stream is read from the parent, zinflate.cpp does the rest */
+static uae_s64 zinflate_readparent (void *user, uae_s64 offset, void *buf, uae_s64 len)
+{
+	struct zfile *zf = (struct zfile*)user;
+	zfile_fseek (zf->parent, zf->offset + offset, SEEK_SET);
+	return zfile_fread (buf, 1, (size_t)len, zf->parent);
+}
+
+static void zinflate_fclose (struct zfile *zf)
+{
+	zinflate_close ((struct zinflate*)zf->userdata);
+	zf->userdata = NULL;
+}
+
+static uae_s64 zinflate_fread (void *data, uae_u64 l1, uae_u64 l2, struct zfile *zf)
+{
+	uae_s64 size = l1 * l2;
+	uae_s64 done;
+
+	if (!l1 || !l2)
+		return 0;
+	if (zf->seek + size > zf->size)
+		size = zf->size > zf->seek ? zf->size - zf->seek : 0;
+	done = zinflate_read ((struct zinflate*)zf->userdata, zf->seek, data, size);
+	zf->seek += done;
+	return done / l1;
+}
+
+// inflated on demand, there is nothing to write to
+static uae_s64 zinflate_fwrite (const void *data, uae_u64 l1, uae_u64 l2, struct zfile *zf)
+{
+	return 0;
+}
+
+/* Deflate stream of csize bytes at offset in z, size bytes uncompressed */
+struct zfile *zfile_fopen_deflate (struct zfile *z, const TCHAR *name, uae_u64 offset, uae_u64 csize, uae_u64 size)
+{
+	struct zfile *zf;
+
+	zf = zfile_fopen_parent (z, name, offset, size);
+	if (!zf)
+		return NULL;
+	zf->userdata = zinflate_open (csize, zinflate_readparent, zf, name);
+	if (!zf->userdata) {
+		zfile_fclose (zf);
+		return NULL;
+	}
+	zf->useparent = 0;
+	zf->dataseek = 1;
+	zf->zfileread = zinflate_fread;
+	zf->zfilewrite = zinflate_fwrite;
+	zf->zfileclose = zinflate_fclose;
+	return zf;
+}
+
+bool zfile_isdeflate (struct zfile *z)
+{
+	return z->zfileread == zinflate_fread;
+}
+
 static struct zfile *zfile_gunzip (struct zfile *z, int *retcode)
 {
 	uae_u8 header[2 + 1 + 1 + 4 + 1 + 1];
@@ -574,6 +637,8 @@ static struct zfile *zfile_gunzip (struct zfile *z, int *retcode)
 	uae_u8 buffer[8192];
 	struct zfile *z2;
 	uae_u8 b;
+	uae_s64 fsize, csize;
+	bool wrap;
 
 	if (checkwrite (z, retcode))
 		return NULL;
@@ -622,6 +687,26 @@ static struct zfile *zfile_gunzip (struct zfile *z, int *retcode)
 	size |= b << 16;
 	zfile_fread (&b, 1, 1, z);
 	size |= b << 24;
+	fsize = zfile_ftell (z);
+	csize = fsize - 8 - offset;
+	// ISIZE is the size modulo 4G, it can't be trusted if the stream may inflate to more
+	wrap = csize > 0xffffffffLL / ZINFLATE_MAXRATIO;
+	if (((uae_u32)size >= ZFILE_STREAM_MIN_SIZE || wrap) && csize > 0) {
+		z2 = zfile_fopen_deflate (z, name, offset, csize, (uae_u32)size);
+		if (!z2)
+			return NULL;
+		if (wrap) {
+			uae_s64 realsize = zinflate_scan ((struct zinflate*)z2->userdata);
+			if (realsize < 0 || (uae_u32)realsize != (uae_u32)size) {
+				write_log (_T("zfile: '%s' size does not match gzip trailer\n"), name);
+				zfile_fclose (z2);
+				return NULL;
+			}
+			z2->size = z2->datasize = realsize;
+		}
+		zfile_fclose (z);
+		return z2;
+	}
 	if (size < 8 || size > 256 * 1024 * 1024) /* safety check */
 		return NULL;
 	zfile_fseek (z, offset, SEEK_SET);
@@ -2066,6 +2151,12 @@ struct zfile *zfile_dup (struct zfile *zf)
 		return NULL;
 	if (zf->archiveparent)
 		checkarchiveparent (zf);
+	if (zfile_isdeflate (zf)) {
+		nzf = zfile_fopen_deflate (zf->parent, zf->name, zf->offset, zinflate_csize ((struct zinflate*)zf->userdata), zf->size);
+		if (nzf)
+			zfile_fseek (nzf, zf->seek, SEEK_SET);
+		return nzf;
+	}
 	if (zf->userdata)
 		return NULL;
 	if (!zf->data && zf->dataseek) {
@@ -2126,7 +2217,15 @@ int zfile_exists (const TCHAR *name)
 
 int zfile_iscompressed (struct zfile *z)
 {
-	return z->data ? 1 : 0;
+	return z->data || zfile_isdeflate (z) ? 1 : 0;
+}
+
+/* read from the archive file when needed, writes can't go anywhere */
+int zfile_isondemand (struct zfile *z)
+{
+	if (zfile_isdeflate (z))
+		return 1;
+	return z->parent && z->useparent && !z->zfilewrite ? 1 : 0;
 }
 
 struct zfile *zfile_fopen_empty (struct zfile *prev, const TCHAR *name, uae_u64 size)
@@ -475,6 +475,21 @@ static struct zfile *archive_do_zip (struct znode *zn, struct zfile *z, int flag
 	s = NULL;
 	if (unzOpenCurrentFile (uz) != UNZ_OK)
 		goto error;
+	if (!z && zn->size >= ZFILE_STREAM_MIN_SIZE) {
+		uLong pos, method, csize;
+		// large member, read it from the archive when needed
+		if (unzGetCurrentFileDataPos (uz, &pos, &method, &csize) == UNZ_OK) {
+			if (method == 0)
+				z = zfile_fopen_parent (zn->volume->archive, zn->fullname, pos, zn->size);
+			else if (method == Z_DEFLATED)
+				z = zfile_fopen_deflate (zn->volume->archive, zn->fullname, pos, csize, zn->size);
+		}
+		if (z) {
+			unzCloseCurrentFile (uz);
+			unzClose (uz);
+			return z;
+		}
+	}
 	if (!z)
 		z = zfile_fopen_empty (NULL, zn->fullname, zn->size);
 	if (z) {
@@ -0,0 +1,260 @@
+/*
+* UAE - The Un*x Amiga Emulator
+*
+* Random access to large deflate streams (gzip files, deflated zip members).
+*
+* Instead of inflating the whole image into memory, the stream is inflated
+* on demand in spans of about ZINFLATE_SPAN bytes. Span boundaries are
+* placed on deflate block boundaries the first time the stream is read
+* past them, each keeps the compressed position and the last 32K of output
+* so that inflating can restart there. Only ZINFLATE_CACHE inflated spans
+* are kept in memory.
+*/
+
+#include "sysconfig.h"
+#include "sysdeps.h"
+
+#include "zinflate.h"
+
+#include <zlib.h>
+
+#define ZINFLATE_SPAN (2 * 1024 * 1024)
+#define ZINFLATE_WINDOW 32768
+#define ZINFLATE_CACHE 8
+
+struct zinflate_point
+{
+	uae_s64 in; // compressed offset of the first full byte
+	uae_s64 out;
+	int bits; // bits of the previous byte not yet consumed
+	uae_u8 *window;
+};
+
+struct zinflate_span
+{
+	int point;
+	uae_u8 *data;
+	uae_s64 len;
+	uae_u32 age;
+};
+
+struct zinflate
+{
+	uae_s64 csize;
+	ZINFLATE_READ read;
+	void *user;
+	TCHAR *name;
+	struct zinflate_point *points;
+	int numpoints, maxpoints;
+	bool complete;
+	bool failed;
+	uae_s64 size; // known once complete
+	struct zinflate_span spans[ZINFLATE_CACHE];
+	uae_u32 age;
+};
+
+static void zinflate_addpoint (struct zinflate *zi, uae_s64 in, uae_s64 out, int bits, const uae_u8 *window)
+{
+	if (zi->numpoints >= zi->maxpoints) {
+		zi->maxpoints = zi->maxpoints ? zi->maxpoints * 2 : 64;
+		zi->points = xrealloc (struct zinflate_point, zi->points, zi->maxpoints);
+	}
+	struct zinflate_point *p = &zi->points[zi->numpoints++];
+	p->in = in;
+	p->out = out;
+	p->bits = bits;
+	p->window = NULL;
+	if (window) {
+		p->window = xmalloc (uae_u8, ZINFLATE_WINDOW);
+		memcpy (p->window, window, ZINFLATE_WINDOW);
+	}
+}
+
+// inflate span starting at point idx, the last known span also adds the next point
+static struct zinflate_span *zinflate_decode (struct zinflate *zi, int idx)
+{
+	struct zinflate_point *p = &zi->points[idx];
+	struct zinflate_span *sp = &zi->spans[0];
+	// end of this span is not known yet
+	bool last = idx == zi->numpoints - 1 && !zi->complete;
+	uae_s64 cap, in;
+	uae_u8 *data;
+	uae_u8 buffer[16384];
+	z_stream zs;
+	int ret;
+
+	for (int i = 1; i < ZINFLATE_CACHE; i++) {
+		if (zi->spans[i].age < sp->age)
+			sp = &zi->spans[i];
+	}
+	sp->point = -1;
+	if (last) {
+		cap = ZINFLATE_SPAN + ZINFLATE_SPAN / 2;
+	} else if (idx < zi->numpoints - 1) {
+		cap = zi->points[idx + 1].out - p->out;
+	} else {
+		cap = zi->size - p->out;
+	}
+	if (cap <= 0)
+		return NULL;
+	data = xrealloc (uae_u8, sp->data, cap);
+	if (!data)
+		return NULL;
+	sp->data = data;
+
+	memset (&zs, 0, sizeof zs);
+	if (inflateInit2 (&zs, -MAX_WBITS) != Z_OK)
+		return NULL;
+	in = p->in;
+	if (p->bits) {
+		uae_u8 b = 0;
+		zi->read (zi->user, in - 1, &b, 1);
+		inflatePrime (&zs, p->bits, b >> (8 - p->bits));
+	}
+	if (p->window)
+		inflateSetDictionary (&zs, p->window, ZINFLATE_WINDOW);
+	ret = Z_OK;
+	while (ret == Z_OK) {
+		uae_s64 left = zi->csize - in;
+		if (zs.avail_in == 0 && left > 0) {
+			zs.next_in = buffer;
+			zs.avail_in = (uInt)zi->read (zi->user, in, buffer, left < (uae_s64)sizeof buffer ? left : (uae_s64)sizeof buffer);
+			if (zs.avail_in == 0)
+				break;
+			in += zs.avail_in;
+		}
+		if (zs.total_out >= (uLong)cap) {
+			if (!last)
+				break;
+			cap *= 2;
+			data = xrealloc (uae_u8, sp->data, cap);
+			if (!data)
+				break;
+			sp->data = data;
+		}
+		zs.next_out = sp->data + zs.total_out;
+		zs.avail_out = (uInt)(cap - zs.total_out);
+		ret = inflate (&zs, last ? Z_BLOCK : Z_NO_FLUSH);
+		// no progress possible: only an error when all input has been used
+		if (ret == Z_BUF_ERROR && (zs.avail_in || in < zi->csize))
+			ret = Z_OK;
+		// block boundary and not the end of the stream
+		if (last && ret == Z_OK && (zs.data_type & 128) && !(zs.data_type & 64) && zs.total_out >= ZINFLATE_SPAN) {
+			zinflate_addpoint (zi, p->in + zs.total_in, p->out + zs.total_out, zs.data_type & 7, sp->data + zs.total_out - ZINFLATE_WINDOW);
+			p = &zi->points[idx];
+			break;
+		}
+		if (!last && zs.total_out >= (uLong)cap)
+			break;
+	}
+	sp->len = zs.total_out;
+	inflateEnd (&zs);
+	if (ret == Z_STREAM_END && last) {
+		zi->complete = true;
+		zi->size = p->out + sp->len;
+	}
+	if (ret != Z_STREAM_END && (last ? idx == zi->numpoints - 1 : sp->len < cap)) {
+		if (!zi->failed)
+			write_log (_T("zfile: inflate error %d at %lld in '%s'\n"), ret, p->out + sp->len, zi->name);
+		zi->failed = true;
+		zi->complete = true;
+		if (sp->len == 0)
+			return NULL;
+	}
+	sp->point = idx;
+	sp->age = ++zi->age;
+	return sp;
+}
+
+/* copies size bytes of inflated data at pos, returns the number of bytes copied */
+uae_s64 zinflate_read (struct zinflate *zi, uae_s64 pos, void *data, uae_s64 size)
+{
+	uae_u8 *dst = (uae_u8*)data;
+	uae_s64 done = 0;
+
+	while (done < size) {
+		uae_s64 at = pos + done;
+		int lo = 0, hi = zi->numpoints - 1;
+		while (lo < hi) {
+			int mid = (lo + hi + 1) / 2;
+			if (zi->points[mid].out <= at)
+				lo = mid;
+			else
+				hi = mid - 1;
+		}
+		struct zinflate_span *sp = NULL;
+		for (int i = 0; i < ZINFLATE_CACHE; i++) {
+			if (zi->spans[i].point == lo) {
+				sp = &zi->spans[i];
+				sp->age = ++zi->age;
+				break;
+			}
+		}
+		if (!sp) {
+			if (lo == zi->numpoints - 1 && (zi->failed || (zi->complete && at >= zi->size)))
+				break;
+			sp = zinflate_decode (zi, lo);
+			if (!sp)
+				break;
+		}
+		uae_s64 off = at - zi->points[lo].out;
+		if (off >= sp->len) {
+			// span ended before pos, continue from the point it added
+			if (lo == zi->numpoints - 1)
+				break;
+			continue;
+		}
+		uae_s64 len = sp->len - off;
+		if (len > size - done)
+			len = size - done;
+		memcpy (dst + done, sp->data + off, (size_t)len);
+		done += len;
+	}
+	return done;
+}
+
+/* inflate the whole stream once, indexes all of it and returns the real size */
+uae_s64 zinflate_scan (struct zinflate *zi)
+{
+	while (!zi->complete) {
+		if (!zinflate_decode (zi, zi->numpoints - 1))
+			return -1;
+	}
+	if (zi->failed)
+		return -1;
+	return zi->size;
+}
+
+uae_s64 zinflate_csize (struct zinflate *zi)
+{
+	return zi->csize;
+}
+
+/* deflate stream of csize bytes, read() is called with offsets relative to its start */
+struct zinflate *zinflate_open (uae_s64 csize, ZINFLATE_READ read, void *user, const TCHAR *name)
+{
+	struct zinflate *zi = xcalloc (struct zinflate, 1);
+	if (!zi)
+		return NULL;
+	zi->csize = csize;
+	zi->read = read;
+	zi->user = user;
+	zi->name = my_strdup (name ? name : _T(""));
+	for (int i = 0; i < ZINFLATE_CACHE; i++)
+		zi->spans[i].point = -1;
+	zinflate_addpoint (zi, 0, 0, 0, NULL);
+	return zi;
+}
+
+void zinflate_close (struct zinflate *zi)
+{
+	if (!zi)
+		return;
+	for (int i = 0; i < zi->numpoints; i++)
+		xfree (zi->points[i].window);
+	xfree (zi->points);
+	for (int i = 0; i < ZINFLATE_CACHE; i++)
+		xfree (zi->spans[i].data);
+	xfree (zi->name);
+	xfree (zi);
+}
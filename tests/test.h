@@ -0,0 +1,20 @@
+/*
+ * Minimal checks for the unit tests, a failed check is reported and
+ * makes the test exit with a non-zero status.
+ */
+
+#pragma once
+
+#include <cstdio>
+
+extern int test_failures;
+
+#define CHECK(cond) \
+	do { \
+		if (!(cond)) { \
+			fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+			test_failures++; \
+		} \
+	} while (0)
+
+#define TEST_RESULT() (test_failures ? 1 : 0)
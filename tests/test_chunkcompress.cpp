@@ -0,0 +1,94 @@
+/*
+ * Savestate chunk compression: the segments compressed in parallel must
+ * join into one zlib stream that plain uncompress() restores.
+ */
+
+#include "sysconfig.h"
+#include "sysdeps.h"
+
+#include <vector>
+#include <zlib.h>
+#ifdef USE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "chunkcompress.h"
+#include "test.h"
+
+static void vec_write(void *user, const void *data, size_t len)
+{
+	std::vector<uae_u8> *v = (std::vector<uae_u8>*)user;
+	v->insert(v->end(), (const uae_u8*)data, (const uae_u8*)data + len);
+}
+
+// chip ram like: zero areas, repeated patterns and noise
+static std::vector<uae_u8> make_chunk(size_t len, uae_u32 seed)
+{
+	std::vector<uae_u8> d(len);
+	for (size_t i = 0; i < len; i++) {
+		seed = seed * 1664525 + 1013904223;
+		switch ((i >> 15) % 3)
+		{
+		case 0:
+			d[i] = 0;
+			break;
+		case 1:
+			d[i] = (uae_u8)(i * 7);
+			break;
+		default:
+			d[i] = (uae_u8)(seed >> 24);
+			break;
+		}
+	}
+	return d;
+}
+
+static void test_zlib(size_t len, uae_u32 seed)
+{
+	std::vector<uae_u8> src = make_chunk(len, seed);
+	std::vector<uae_u8> out;
+	size_t clen = chunk_compress(src.data(), len, false, vec_write, &out);
+	CHECK(clen == out.size());
+	CHECK(clen > 6);
+
+	std::vector<uae_u8> dst(len + 1);
+	uLongf dlen = (uLongf)dst.size();
+	CHECK(uncompress(dst.data(), &dlen, out.data(), (uLong)out.size()) == Z_OK);
+	CHECK(dlen == len);
+	CHECK(!memcmp(dst.data(), src.data(), len));
+}
+
+#ifdef USE_ZSTD
+static void test_zstd(size_t len, uae_u32 seed)
+{
+	std::vector<uae_u8> src = make_chunk(len, seed);
+	std::vector<uae_u8> out;
+	size_t clen = chunk_compress(src.data(), len, true, vec_write, &out);
+	CHECK(clen == out.size());
+
+	std::vector<uae_u8> dst(len + 1);
+	size_t v = ZSTD_decompress(dst.data(), dst.size(), out.data(), out.size());
+	CHECK(!ZSTD_isError(v) && v == len);
+	CHECK(!memcmp(dst.data(), src.data(), len));
+}
+#endif
+
+int main(void)
+{
+	std::vector<uae_u8> out;
+	CHECK(chunk_compress(NULL, 0, false, vec_write, &out) == 0);
+	CHECK(out.empty());
+
+	// single segment, segment boundaries and many segments with a short tail
+	const size_t sizes[] = { 1, 1000, 1024 * 1024, 1024 * 1024 + 1, 2 * 1024 * 1024, 9 * 1024 * 1024 + 12345 };
+	for (size_t i = 0; i < sizeof sizes / sizeof sizes[0]; i++) {
+		test_zlib(sizes[i], (uae_u32)i);
+#ifdef USE_ZSTD
+		test_zstd(sizes[i], (uae_u32)i);
+#endif
+	}
+	// the workers are reused between chunks
+	for (int i = 0; i < 10; i++)
+		test_zlib(3 * 1024 * 1024 + i * 4099, 100 + i);
+	return TEST_RESULT();
+}
@@ -0,0 +1,220 @@
+/*
+ * eventtab2 heap: events must come out in (evtime, insertion) order
+ * whatever order they were added or removed in.
+ */
+
+#include "sysconfig.h"
+#include "sysdeps.h"
+
+#include <cstdlib>
+#include <vector>
+
+#include "options.h"
+#include "events.h"
+#include "test.h"
+
+// the parts of the emulator events.cpp calls into, none of them are reached here
+struct uae_prefs currprefs;
+struct ev eventtab[ev_max];
+struct ev2 eventtab2[ev2_max];
+uae_u8 agnus_hpos;
+uae_u16 dmacon;
+bool ecs_agnus, ecs_denise;
+int64_t g_uae_epoch;
+int pissoff, pissoff_value, pissoff_nojit_value;
+volatile int ppc_state;
+
+void gui_message(const char *, ...) { }
+void vsync_clear(void) { }
+int vsync_isdone(frame_time_t *) { return 1; }
+int do_cycles_cck(int) { return 0; }
+bool isvsync_chipset(void) { return false; }
+void vsync_event_done(void) { }
+void audio_finish_pull(void) { }
+void uae_ppc_execute_check(void) { }
+void uae_ppc_execute_quick(void) { }
+int target_get_display_scanline(int) { return 0; }
+
+static std::vector<uae_u32> fired;
+static std::vector<evt_t> firedtime;
+
+static void ev_record(uae_u32 v)
+{
+	fired.push_back(v);
+	firedtime.push_back(get_cycles());
+}
+
+static void ev_other(uae_u32 v)
+{
+	fired.push_back(v | 0x10000);
+	firedtime.push_back(get_cycles());
+}
+
+// schedules a follow up for the same cycle, it has to run in this MISC_handler call
+static void ev_chain(uae_u32 v)
+{
+	ev_record(v);
+	if (v < 3)
+		event2_newevent_xx(-1, 0, v + 1, ev_chain);
+}
+
+// what the CPU loop does: jump to the next ev_misc and run it
+static void run_until(evt_t end)
+{
+	while (eventtab[ev_misc].active && eventtab[ev_misc].evtime <= end) {
+		set_cycles(eventtab[ev_misc].evtime);
+		MISC_handler();
+	}
+	set_cycles(end);
+}
+
+static void reset(void)
+{
+	clear_events();
+	set_cycles(0);
+	fired.clear();
+	firedtime.clear();
+}
+
+static void test_order(void)
+{
+	reset();
+	// many more than one pool chunk, lots of equal times
+	const int n = 300;
+	std::vector<evt_t> when(n);
+	srand(1);
+	for (int i = 0; i < n; i++) {
+		when[i] = (1 + rand() % 40) * CYCLE_UNIT;
+		event2_newevent_xx(-1, when[i], i, ev_record);
+	}
+	int cnt;
+	struct ev2 **pending = event2_get_pending(&cnt);
+	CHECK(cnt == n);
+	for (int i = 1; i < cnt; i++) {
+		CHECK(pending[i - 1]->evtime < pending[i]->evtime ||
+			(pending[i - 1]->evtime == pending[i]->evtime && pending[i - 1]->data < pending[i]->data));
+	}
+	xfree(pending);
+
+	run_until(100 * CYCLE_UNIT);
+	CHECK(fired.size() == n);
+	for (size_t i = 0; i < fired.size(); i++) {
+		CHECK(firedtime[i] == when[fired[i]]);
+		if (i > 0) {
+			CHECK(firedtime[i - 1] <= firedtime[i]);
+			if (firedtime[i - 1] == firedtime[i])
+				CHECK(fired[i - 1] < fired[i]);
+		}
+	}
+	CHECK(!eventtab[ev_misc].active);
+}
+
+static void test_remove(void)
+{
+	reset();
+	for (int i = 0; i < 100; i++)
+		event2_newevent_xx(-1, (1 + i % 7) * CYCLE_UNIT, i, (i & 1) ? ev_other : ev_record);
+	CHECK(event2_newevent_x_exists(ev_other));
+	event2_newevent_x_remove(ev_other);
+	CHECK(!event2_newevent_x_exists(ev_other));
+	CHECK(event2_newevent_x_exists(ev_record));
+
+	run_until(10 * CYCLE_UNIT);
+	CHECK(fired.size() == 50);
+	for (size_t i = 0; i < fired.size(); i++) {
+		CHECK(!(fired[i] & 1));
+		if (i > 0)
+			CHECK(firedtime[i - 1] <= firedtime[i]);
+	}
+
+	// removing from the middle of the heap keeps the rest in order
+	reset();
+	std::vector<struct ev2*> nodes;
+	for (int i = 0; i < 64; i++)
+		event2_newevent_xx(-1, (64 - i) * CYCLE_UNIT, i, ev_record);
+	int cnt;
+	struct ev2 **pending = event2_get_pending(&cnt);
+	for (int i = 0; i < cnt; i += 3)
+		nodes.push_back(pending[i]);
+	xfree(pending);
+	for (auto e : nodes)
+		event2_remevent_x(e);
+	run_until(100 * CYCLE_UNIT);
+	CHECK(fired.size() == 64 - nodes.size());
+	for (size_t i = 1; i < fired.size(); i++)
+		CHECK(firedtime[i - 1] < firedtime[i]);
+}
+
+static void test_fixed_slot(void)
+{
+	reset();
+	eventtab2[ev2_blitter].handler = ev_other;
+	event2_newevent_xx(-1, 5 * CYCLE_UNIT, 1, ev_record);
+	event2_newevent(ev2_blitter, 10, 2);
+	// re-adding the fixed slot moves it, it is never queued twice
+	event2_newevent(ev2_blitter, 3, 3);
+	CHECK(eventtab2[ev2_blitter].active);
+	int cnt;
+	struct ev2 **pending = event2_get_pending(&cnt);
+	CHECK(cnt == 2);
+	CHECK(pending[0] == &eventtab2[ev2_blitter]);
+	xfree(pending);
+
+	run_until(20 * CYCLE_UNIT);
+	CHECK(fired.size() == 2);
+	CHECK(fired[0] == (3 | 0x10000) && firedtime[0] == 3 * CYCLE_UNIT);
+	CHECK(fired[1] == 1 && firedtime[1] == 5 * CYCLE_UNIT);
+	CHECK(!eventtab2[ev2_blitter].active);
+
+	event2_newevent(ev2_blitter, 4, 4);
+	event2_remevent(ev2_blitter);
+	run_until(30 * CYCLE_UNIT);
+	CHECK(fired.size() == 2);
+}
+
+static void test_dedupe(void)
+{
+	reset();
+	event2_newevent_xx(-1, 8 * CYCLE_UNIT, 7, ev_record);
+	event2_newevent_xx(-1, 8 * CYCLE_UNIT, 7, ev_record);
+	event2_newevent_xx(-1, 8 * CYCLE_UNIT, 8, ev_record);
+	event2_newevent_xx(-1, 9 * CYCLE_UNIT, 7, ev_record);
+	int cnt;
+	struct ev2 **pending = event2_get_pending(&cnt);
+	CHECK(cnt == 3);
+	xfree(pending);
+	run_until(20 * CYCLE_UNIT);
+	CHECK(fired.size() == 3);
+
+	// replace keeps a single instance at the new time
+	reset();
+	event2_newevent_x_add_not_exists(4, 1, ev_record);
+	event2_newevent_x_add_not_exists(2, 2, ev_record);
+	event2_newevent_x_replace(6, 3, ev_record);
+	run_until(20 * CYCLE_UNIT);
+	CHECK(fired.size() == 1);
+	CHECK(fired[0] == 3 && firedtime[0] == 6 * CYCLE_UNIT);
+}
+
+static void test_chain(void)
+{
+	reset();
+	event2_newevent_xx(-1, 2 * CYCLE_UNIT, 0, ev_chain);
+	event2_newevent_xx(-1, 3 * CYCLE_UNIT, 100, ev_record);
+	run_until(10 * CYCLE_UNIT);
+	CHECK(fired.size() == 5);
+	for (int i = 0; i < 4; i++)
+		CHECK(fired[i] == (uae_u32)i && firedtime[i] == 2 * CYCLE_UNIT);
+	CHECK(fired[4] == 100 && firedtime[4] == 3 * CYCLE_UNIT);
+	CHECK(!eventtab[ev_misc].active);
+}
+
+int main(void)
+{
+	test_order();
+	test_remove();
+	test_fixed_slot();
+	test_dedupe();
+	test_chain();
+	return TEST_RESULT();
+}
@@ -0,0 +1,21 @@
+/*
+ * write_log() for the unit tests, the emulator version lives in the
+ * platform code that the tests don't link.
+ */
+
+#include "sysconfig.h"
+#include "sysdeps.h"
+
+#include <cstdarg>
+
+#include "test.h"
+
+int test_failures;
+
+void write_log(const TCHAR *format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	vfprintf(stderr, format, args);
+	va_end(args);
+}
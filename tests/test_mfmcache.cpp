@@ -0,0 +1,184 @@
+/*
+ * MFM track cache: cached tracks must be identical to a fresh encoding,
+ * writes must drop the old encoding and the worker must fill the
+ * cylinders around the head.
+ */
+
+#include "sysconfig.h"
+#include "sysdeps.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "mfmcache.h"
+#include "test.h"
+
+#define TRACKS 40
+#define WORDS 1024
+#define UNCACHED 7
+
+static int trackversion[TRACKS];
+static std::atomic<int> encodes[TRACKS];
+static std::atomic<bool> stopped;
+
+static int encode_track(int tr, uae_u16 *mfm, int *skipoffset)
+{
+	int tracklen = 8000 + tr * 16 + trackversion[tr];
+	for (int i = 0; i < (tracklen + 15) / 16; i++)
+		mfm[i] = (uae_u16)((trackversion[tr] << 12) ^ (tr << 6) ^ i);
+	*skipoffset = tr;
+	return tracklen;
+}
+
+static int test_encode(void *user, int cyl, int side, uae_u16 *mfm, int *skipoffset)
+{
+	int tr = cyl * 2 + side;
+	CHECK(user == &trackversion);
+	CHECK(!stopped);
+	if (tr == UNCACHED)
+		return -1;
+	encodes[tr]++;
+	return encode_track(tr, mfm, skipoffset);
+}
+
+static bool same_as_fresh(int tr, const uae_u16 *mfm, int tracklen, int skipoffset)
+{
+	uae_u16 fresh[WORDS];
+	int freshskip;
+	int freshlen = encode_track(tr, fresh, &freshskip);
+	return tracklen == freshlen && skipoffset == freshskip && !memcmp(mfm, fresh, ((tracklen + 15) / 16) * sizeof(uae_u16));
+}
+
+// the worker runs on its own, give it a moment
+static bool wait_cached(struct mfmcache *mc, int tr)
+{
+	uae_u16 mfm[WORDS];
+	int tracklen, skipoffset;
+	for (int i = 0; i < 2000; i++) {
+		if (mfmcache_get(mc, tr, mfm, &tracklen, &skipoffset))
+			return same_as_fresh(tr, mfm, tracklen, skipoffset);
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	return false;
+}
+
+static bool cached(struct mfmcache *mc, int tr)
+{
+	uae_u16 mfm[WORDS];
+	int tracklen, skipoffset;
+	return mfmcache_get(mc, tr, mfm, &tracklen, &skipoffset);
+}
+
+static void settle(void)
+{
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+}
+
+static void test_fill(struct mfmcache *mc)
+{
+	mfmcache_start(mc, test_encode, &trackversion, TRACKS, 5);
+	CHECK(mfmcache_active(mc));
+	for (int tr = 3 * 2; tr <= 7 * 2 + 1; tr++) {
+		if (tr != UNCACHED)
+			CHECK(wait_cached(mc, tr));
+	}
+	settle();
+	// only two cylinders each way
+	CHECK(!cached(mc, 2 * 2 + 1));
+	CHECK(!cached(mc, 8 * 2));
+
+	// each track is encoded once, lookups don't encode again
+	for (int tr = 6; tr < 16; tr++)
+		CHECK(encodes[tr] == (tr == UNCACHED ? 0 : 1));
+
+	// head moved, the new neighbourhood is filled
+	mfmcache_prefetch(mc, 12);
+	for (int cyl = 10; cyl <= 14; cyl++)
+		CHECK(wait_cached(mc, cyl * 2 + 1));
+	CHECK(encodes[14] == 1);
+
+	// the last cylinders don't go past the end of the disk
+	mfmcache_prefetch(mc, TRACKS / 2 - 1);
+	CHECK(wait_cached(mc, TRACKS - 1));
+}
+
+static void test_uncached(struct mfmcache *mc)
+{
+	// the worker skips the track, the owner can still put its own encoding
+	mfmcache_prefetch(mc, UNCACHED / 2);
+	CHECK(wait_cached(mc, UNCACHED - 1));
+	settle();
+	CHECK(!cached(mc, UNCACHED));
+	uae_u16 mfm[WORDS];
+	int skipoffset;
+	int tracklen = encode_track(UNCACHED, mfm, &skipoffset);
+	mfmcache_put(mc, UNCACHED, mfm, tracklen, skipoffset);
+	CHECK(wait_cached(mc, UNCACHED));
+}
+
+static void test_write(struct mfmcache *mc)
+{
+	int tr = 9;
+	uae_u16 mfm[WORDS];
+	int tracklen, skipoffset;
+
+	mfmcache_prefetch(mc, tr / 2);
+	CHECK(wait_cached(mc, tr));
+
+	// nothing is returned or stored while the owner changes the image
+	mfmcache_write_begin(mc);
+	CHECK(!cached(mc, tr));
+	CHECK(!cached(mc, tr - 1));
+	trackversion[tr]++;
+	tracklen = encode_track(tr, mfm, &skipoffset);
+	mfmcache_put(mc, tr, mfm, tracklen, skipoffset);
+	mfmcache_write_end(mc, tr);
+
+	// the old encoding is gone, the neighbours are still there
+	CHECK(!cached(mc, tr));
+	CHECK(wait_cached(mc, tr - 1));
+
+	// the worker encodes the new trackversion
+	mfmcache_prefetch(mc, tr / 2);
+	CHECK(wait_cached(mc, tr));
+	CHECK(encodes[tr] == 2);
+}
+
+static void test_stop(struct mfmcache *mc)
+{
+	mfmcache_stop(mc);
+	stopped = true;
+	CHECK(!mfmcache_active(mc));
+	CHECK(!cached(mc, 10));
+	mfmcache_prefetch(mc, 3);
+	settle();
+	CHECK(!cached(mc, 6));
+
+	// restarting starts from nothing
+	stopped = false;
+	for (int i = 0; i < TRACKS; i++)
+		encodes[i] = 0;
+	mfmcache_start(mc, test_encode, &trackversion, 8, 0);
+	CHECK(wait_cached(mc, 1));
+	CHECK(!cached(mc, 10));
+	settle();
+	CHECK(!cached(mc, 8));
+	CHECK(encodes[8] == 0);
+	CHECK(!cached(mc, -1));
+	CHECK(!cached(mc, 1000));
+}
+
+int main(void)
+{
+	struct mfmcache *mc = mfmcache_alloc(TRACKS, WORDS);
+	CHECK(mc != NULL);
+	CHECK(!mfmcache_active(mc));
+
+	test_fill(mc);
+	test_uncached(mc);
+	test_write(mc);
+	test_stop(mc);
+	mfmcache_stop(mc);
+	return TEST_RESULT();
+}
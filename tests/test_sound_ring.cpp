@@ -0,0 +1,179 @@
+/*
+ * Sound ring: what goes in must come out in order, unchanged at ratio 1,
+ * and the resampler may only drift by RS_MAX_ADJUST.
+ */
+
+#include "sysconfig.h"
+#include "sysdeps.h"
+
+#include <cmath>
+#include <vector>
+
+#include "sounddep/sound_ring.h"
+#include "test.h"
+
+#define CH 2
+#define TARGET 1000
+#define CHUNK 256
+
+// left channel counts frames, right is its negative
+static void make_frames(std::vector<uae_s16> &v, int first, int frames)
+{
+	v.resize(frames * CH);
+	for (int i = 0; i < frames; i++) {
+		v[i * CH + 0] = (uae_s16)(first + i);
+		v[i * CH + 1] = (uae_s16)-(first + i);
+	}
+}
+
+static bool write_frames(struct sound_ring *sr, int first, int frames)
+{
+	std::vector<uae_s16> v;
+	unsigned int fill;
+	make_frames(v, first, frames);
+	return sound_ring_write(sr, v.data(), frames, &fill);
+}
+
+static void init(struct sound_ring *sr)
+{
+	CHECK(sound_ring_alloc(sr, CH, TARGET, CHUNK));
+	CHECK((sr->frames & (sr->frames - 1)) == 0);
+	CHECK(sr->frames >= 4 * (TARGET + CHUNK));
+}
+
+static void test_identity(void)
+{
+	struct sound_ring sr = {};
+	std::vector<uae_s16> out(CHUNK * CH);
+	int written = 0, expected = 0;
+
+	init(&sr);
+	// kept exactly at the target the ratio stays 1, samples pass through as they are
+	CHECK(write_frames(&sr, written, TARGET));
+	written += TARGET;
+	// many times round the ring
+	for (int n = 0; n < 100; n++) {
+		CHECK(sound_ring_read(&sr, out.data(), CHUNK) == CHUNK);
+		CHECK(sr.rs_ratio.load() == 1.0f);
+		for (int i = 0; i < CHUNK; i++) {
+			CHECK(out[i * CH + 0] == (uae_s16)expected);
+			CHECK(out[i * CH + 1] == (uae_s16)-expected);
+			expected++;
+		}
+		CHECK(write_frames(&sr, written, CHUNK));
+		written += CHUNK;
+	}
+	sound_ring_free(&sr);
+	CHECK(!sr.buf);
+}
+
+static void test_overflow(void)
+{
+	struct sound_ring sr = {};
+	std::vector<uae_s16> v;
+	unsigned int fill;
+	int written = 0;
+
+	init(&sr);
+	while (written + CHUNK <= (int)sr.frames) {
+		CHECK(write_frames(&sr, written, CHUNK));
+		written += CHUNK;
+	}
+	// the reader has stalled, the write is dropped and nothing moves
+	make_frames(v, 30000, CHUNK);
+	CHECK(!sound_ring_write(&sr, v.data(), CHUNK, &fill));
+	CHECK(fill == (unsigned int)written);
+	CHECK(sr.w.load() == (unsigned int)written);
+	CHECK(sr.r.load() == 0);
+	CHECK(!sound_ring_empty(&sr));
+
+	// the frames that fit come out in order, the dropped ones never do
+	std::vector<uae_s16> out(CHUNK * CH);
+	int last = -1;
+	while (sound_ring_read(&sr, out.data(), CHUNK) > 0) {
+		CHECK(out[0] > last && out[0] < written);
+		last = out[0];
+	}
+	sound_ring_drain(&sr);
+	CHECK(sound_ring_empty(&sr));
+	sound_ring_free(&sr);
+}
+
+static void test_underrun(void)
+{
+	struct sound_ring sr = {};
+	std::vector<uae_s16> out(TARGET * 2 * CH);
+
+	init(&sr);
+	// nothing is read until the cushion is built up
+	CHECK(write_frames(&sr, 0, TARGET - 1));
+	CHECK(sound_ring_read(&sr, out.data(), CHUNK) == 0);
+	CHECK(sr.r.load() == 0);
+	CHECK(write_frames(&sr, TARGET - 1, 1));
+	CHECK(sound_ring_read(&sr, out.data(), CHUNK) == CHUNK);
+	CHECK(out[0] == 0);
+
+	// asking for more than there is returns what there was and primes again
+	int got = sound_ring_read(&sr, out.data(), TARGET * 2);
+	CHECK(got > 0 && got < TARGET * 2);
+	CHECK(!sr.primed);
+	CHECK(write_frames(&sr, TARGET, CHUNK));
+	CHECK(sound_ring_read(&sr, out.data(), CHUNK) == 0);
+
+	sound_ring_reset(&sr);
+	CHECK(sound_ring_empty(&sr));
+	CHECK(sr.rs_ratio.load() == 1.0f);
+	sound_ring_free(&sr);
+}
+
+// every output frame must lie between the two input frames it came from
+static void check_interpolated(const std::vector<uae_s16> &out, int frames)
+{
+	for (int i = 1; i < frames; i++) {
+		CHECK(out[i * CH] >= out[(i - 1) * CH]);
+		CHECK(out[i * CH] - out[(i - 1) * CH] <= 2);
+		CHECK(out[i * CH + 1] == -out[i * CH] || std::abs(out[i * CH + 1] + out[i * CH]) <= 1);
+	}
+}
+
+static void test_clamp(void)
+{
+	struct sound_ring sr = {};
+	std::vector<uae_s16> out(CHUNK * CH);
+
+	// far too full: consume faster, but no more than RS_MAX_ADJUST faster
+	init(&sr);
+	int written = (int)sr.frames - CHUNK;
+	CHECK(write_frames(&sr, 0, written));
+	unsigned int r0 = sr.r.load();
+	for (int n = 0; n < 10; n++) {
+		CHECK(sound_ring_read(&sr, out.data(), CHUNK) == CHUNK);
+		check_interpolated(out, CHUNK);
+	}
+	CHECK(sr.rs_ratio.load() == (float)(1.0 + RS_MAX_ADJUST));
+	unsigned int consumed = sr.r.load() - r0;
+	CHECK(consumed == (unsigned int)(10 * CHUNK * (1.0 + RS_MAX_ADJUST)));
+	sound_ring_free(&sr);
+
+	// running low: slow down, again by no more than RS_MAX_ADJUST
+	init(&sr);
+	CHECK(write_frames(&sr, 0, TARGET));
+	CHECK(sound_ring_read(&sr, out.data(), CHUNK) == CHUNK);
+	CHECK(sound_ring_read(&sr, out.data(), CHUNK) == CHUNK);
+	CHECK(sound_ring_read(&sr, out.data(), CHUNK) == CHUNK);
+	for (int n = 0; n < 100; n++)
+		CHECK(sound_ring_read(&sr, out.data(), 1) == 1);
+	CHECK(sr.rs_ratio.load() == (float)(1.0 - RS_MAX_ADJUST));
+	CHECK(sound_ring_read(&sr, out.data(), 64) == 64);
+	check_interpolated(out, 64);
+	sound_ring_free(&sr);
+}
+
+int main(void)
+{
+	test_identity();
+	test_overflow();
+	test_underrun();
+	test_clamp();
+	return TEST_RESULT();
+}
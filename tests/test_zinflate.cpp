@@ -0,0 +1,150 @@
+/*
+ * zinflate index: random reads from a raw deflate stream must return
+ * the same bytes as the original data, whatever order the spans were
+ * indexed and evicted in.
+ */
+
+#include "sysconfig.h"
+#include "sysdeps.h"
+
+#include <cstdlib>
+#include <vector>
+#include <zlib.h>
+
+#include "zinflate.h"
+#include "test.h"
+
+struct memstream
+{
+	std::vector<uae_u8> data;
+};
+
+static uae_s64 memread(void *user, uae_s64 offset, void *buf, uae_s64 len)
+{
+	struct memstream *ms = (struct memstream*)user;
+	if (offset < 0 || offset >= (uae_s64)ms->data.size())
+		return 0;
+	if (offset + len > (uae_s64)ms->data.size())
+		len = ms->data.size() - offset;
+	memcpy(buf, ms->data.data() + offset, (size_t)len);
+	return len;
+}
+
+// text like runs mixed with noise so that deflate uses all kinds of blocks
+static std::vector<uae_u8> make_data(size_t size)
+{
+	std::vector<uae_u8> d(size);
+	uae_u32 seed = 12345;
+	size_t i = 0;
+	while (i < size) {
+		seed = seed * 1103515245 + 12345;
+		int run = 1 + ((seed >> 16) & 4095);
+		int kind = (seed >> 28) & 3;
+		for (int j = 0; j < run && i < size; j++, i++) {
+			seed = seed * 1103515245 + 12345;
+			if (kind == 0)
+				d[i] = (uae_u8)(seed >> 24);
+			else if (kind == 1)
+				d[i] = 'a' + (seed >> 24) % 8;
+			else
+				d[i] = (uae_u8)(i / 64);
+		}
+	}
+	return d;
+}
+
+static std::vector<uae_u8> deflate_raw(const std::vector<uae_u8> &src)
+{
+	std::vector<uae_u8> out(compressBound((uLong)src.size()) + 1024);
+	z_stream zs;
+	memset(&zs, 0, sizeof zs);
+	deflateInit2(&zs, 6, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+	zs.next_in = (Bytef*)src.data();
+	zs.avail_in = (uInt)src.size();
+	zs.next_out = out.data();
+	zs.avail_out = (uInt)out.size();
+	int ret = deflate(&zs, Z_FINISH);
+	CHECK(ret == Z_STREAM_END);
+	out.resize(zs.total_out);
+	deflateEnd(&zs);
+	return out;
+}
+
+static bool read_matches(struct zinflate *zi, const std::vector<uae_u8> &orig, uae_s64 pos, uae_s64 len)
+{
+	std::vector<uae_u8> buf(len);
+	uae_s64 expected = len;
+	if (pos + len > (uae_s64)orig.size())
+		expected = pos < (uae_s64)orig.size() ? orig.size() - pos : 0;
+	uae_s64 got = zinflate_read(zi, pos, buf.data(), len);
+	if (got != expected)
+		return false;
+	return !memcmp(buf.data(), orig.data() + pos, (size_t)got);
+}
+
+static void test_random_reads(const std::vector<uae_u8> &orig, struct memstream *ms)
+{
+	// fresh index, reads far ahead of anything indexed yet
+	struct zinflate *zi = zinflate_open(ms->data.size(), memread, ms, _T("test"));
+	CHECK(zi != NULL);
+	CHECK(zinflate_csize(zi) == (uae_s64)ms->data.size());
+	CHECK(read_matches(zi, orig, orig.size() - 1000, 1000));
+	CHECK(read_matches(zi, orig, 0, 100));
+
+	srand(2);
+	for (int i = 0; i < 200; i++) {
+		uae_s64 pos = ((uae_s64)rand() * 4099) % orig.size();
+		uae_s64 len = 1 + rand() % (3 * 1024 * 1024);
+		CHECK(read_matches(zi, orig, pos, len));
+	}
+	// across the end and past it
+	CHECK(read_matches(zi, orig, orig.size() - 10, 100));
+	CHECK(read_matches(zi, orig, orig.size() + 10, 100));
+	CHECK(zinflate_scan(zi) == (uae_s64)orig.size());
+	zinflate_close(zi);
+
+	// scan first, then read everything in one go
+	zi = zinflate_open(ms->data.size(), memread, ms, _T("test"));
+	CHECK(zinflate_scan(zi) == (uae_s64)orig.size());
+	CHECK(read_matches(zi, orig, 0, orig.size()));
+	CHECK(read_matches(zi, orig, 5, orig.size()));
+	zinflate_close(zi);
+}
+
+static void test_truncated(const std::vector<uae_u8> &orig, const std::vector<uae_u8> &comp)
+{
+	struct memstream ms;
+	ms.data.assign(comp.begin(), comp.begin() + comp.size() / 2);
+	struct zinflate *zi = zinflate_open(ms.data.size(), memread, &ms, _T("truncated"));
+	std::vector<uae_u8> buf(orig.size());
+	uae_s64 got = zinflate_read(zi, 0, buf.data(), orig.size());
+	CHECK(got > 0 && got < (uae_s64)orig.size());
+	CHECK(!memcmp(buf.data(), orig.data(), (size_t)got));
+	CHECK(zinflate_scan(zi) < 0);
+	// what was readable stays readable
+	CHECK(read_matches(zi, orig, 0, got / 2));
+	zinflate_close(zi);
+}
+
+int main(void)
+{
+	// well over the span cache so spans get evicted and decoded again
+	std::vector<uae_u8> orig = make_data(24 * 1024 * 1024 + 333);
+	struct memstream ms;
+	ms.data = deflate_raw(orig);
+
+	test_random_reads(orig, &ms);
+	test_truncated(orig, ms.data);
+
+	// small stream, a single span that ends the stream
+	std::vector<uae_u8> small = make_data(5000);
+	struct memstream ss;
+	ss.data = deflate_raw(small);
+	struct zinflate *zi = zinflate_open(ss.data.size(), memread, &ss, _T("small"));
+	CHECK(read_matches(zi, small, 100, 200));
+	CHECK(zinflate_scan(zi) == (uae_s64)small.size());
+	CHECK(read_matches(zi, small, 4000, 2000));
+	zinflate_close(zi);
+
+	return TEST_RESULT();
+}